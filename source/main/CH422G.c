@@ -19,10 +19,17 @@ limitations under the License.
 #include <string.h>
 #include <stdlib.h>
 
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
 #include "driver/i2c.h"
 #include "esp_bit_defs.h"
 #include "esp_check.h"
 #include "esp_log.h"
+#include "main.h"
+#include "i2c_scheduler.h"
 #include "CH422G.h"
 
 
@@ -31,6 +38,9 @@ limitations under the License.
 // Timeout of each I2C communication 
 #define I2C_TIMEOUT_MS          (10)
 
+// time for the IO pins to switch to input, at least 1 msec
+#define INPUT_SETTLE_TICKS      (pdMS_TO_TICKS(1) + 1)
+
 #define IO_COUNT                (8)
 #define DIR_OUT_VALUE           (0xFFF)
 #define DIR_IN_VALUE            (0xF00)
@@ -82,7 +92,50 @@ typedef struct
  */
 static esp_io_expander_ch422g_t ch422g;
 static const char *TAG = "app_ch422g";
-static SemaphoreHandle_t I2CMutexHandle;
+static SemaphoreHandle_t ModeMutexHandle;          // held across an input read, so the mode can't change under it
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Write one byte to a CH422G function address
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       
+*****************************************************************************/
+static esp_err_t CH422G_write(uint8_t address, uint8_t data)
+{
+    return i2c_scheduler_write(ch422g.i2c_num, I2C_DEVICE_CH422G, address, &data, 1);
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Read the input pins and return to output mode
+* PARAMETERS:  arg: uint8_t for the pin states
+* RETURN:      
+* NOTES:       I2C scheduler job, so nothing else gets on the bus mid sequence
+*****************************************************************************/
+static esp_err_t CH422G_read_job(i2c_port_t port, void* arg)
+{
+    uint8_t* temp = (uint8_t*)arg;
+    uint8_t data;
+    esp_err_t res;
+
+    // read pin state
+    res = i2c_master_read_from_device(port, ch422g.i2c_address, temp, 1, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
+
+    if (res == ESP_OK)
+    {
+        res = i2c_master_read_from_device(port, CH422G_REG_RD_IO, temp, 1, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
+    }
+
+    // return to output mode
+    data = CH422G_Mode_IO_OE;
+    if (i2c_master_write_to_device(port, CH422G_Mode, &data, 1, pdMS_TO_TICKS(I2C_TIMEOUT_MS)) != ESP_OK)
+    {
+        res = ESP_FAIL;
+    }
+
+    return res;
+}
 
 /****************************************************************************
 * NAME:        
@@ -97,9 +150,9 @@ esp_err_t CH422G_enableAllIO_Input(void)
     esp_err_t res = ESP_FAIL;
 
     // WR-SET
-    if (xSemaphoreTake(I2CMutexHandle, (TickType_t)100) == pdTRUE)
+    if (xSemaphoreTake(ModeMutexHandle, (TickType_t)100) == pdTRUE)
     {
-        res = i2c_master_write_to_device(ch422g.i2c_num, CH422G_REG_WR_SET, &data, sizeof(data), pdMS_TO_TICKS(I2C_TIMEOUT_MS));
+        res = CH422G_write(CH422G_REG_WR_SET, data);
         if (res == ESP_OK)
         {
             ch422g.regs.wr_set = data;
@@ -109,7 +162,7 @@ esp_err_t CH422G_enableAllIO_Input(void)
             ESP_LOGE(TAG, "CH422G_enableAllIO_Input() failed");
         }
 
-        xSemaphoreGive(I2CMutexHandle);
+        xSemaphoreGive(ModeMutexHandle);
     }
     
     // Delay 1ms to wait for the IO expander to switch to input mode
@@ -152,38 +205,28 @@ esp_err_t CH422G_read_input(uint8_t pin_bit, uint8_t* value)
 * DESCRIPTION: 
 * PARAMETERS:  
 * RETURN:      
-* NOTES:       
+* NOTES:       The pins take a moment to become inputs. That wait sleeps
+*              without the bus, so touch and others can use it meanwhile
 *****************************************************************************/
 esp_err_t CH422G_read_all_input(uint16_t* values)
 {
     uint8_t temp = 0;
-    uint8_t data;
     esp_err_t res = ESP_FAIL;
     *values = 0;
 
-    if (xSemaphoreTake(I2CMutexHandle, (TickType_t)100) == pdTRUE)
+    if (xSemaphoreTake(ModeMutexHandle, (TickType_t)100) == pdTRUE)
     {
         // first set the pins to input mode (can't do separate input/output per pin)
-        data = 0;
-        res = i2c_master_write_to_device(ch422g.i2c_num, CH422G_Mode, &data, 1, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
-        esp_rom_delay_us(1000);
+        res = CH422G_write(CH422G_Mode, 0);
 
         if (res == ESP_OK)
         {
-            // read pin state
-            res = i2c_master_read_from_device(ch422g.i2c_num, ch422g.i2c_address, &temp, 1, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
-
-            if (res == ESP_OK)
-            {
-                res = i2c_master_read_from_device(ch422g.i2c_num, CH422G_REG_RD_IO, &temp, 1, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
+            vTaskDelay(INPUT_SETTLE_TICKS);
 
-                // return to output mode
-                data = CH422G_Mode_IO_OE;
-                res = i2c_master_write_to_device(ch422g.i2c_num, CH422G_Mode, &data, 1, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
-            }
+            res = i2c_scheduler_run(ch422g.i2c_num, I2C_DEVICE_CH422G, CH422G_read_job, (void*)&temp);
         }
 
-        xSemaphoreGive(I2CMutexHandle);
+        xSemaphoreGive(ModeMutexHandle);
     }
     
     if (res == ESP_OK)
@@ -219,16 +262,11 @@ esp_err_t CH422G_write_output(uint8_t pin_bit, uint8_t value)
     }
     
     // WR-IO
-    if (xSemaphoreTake(I2CMutexHandle, (TickType_t)100) == pdTRUE)
-    {
-        res = i2c_master_write_to_device(ch422g.i2c_num, CH422G_REG_WR_IO, &ch422g.regs.wr_io, sizeof(ch422g.regs.wr_io), pdMS_TO_TICKS(I2C_TIMEOUT_MS));
+    res = CH422G_write(CH422G_REG_WR_IO, ch422g.regs.wr_io);
         
-        if (res != ESP_OK)
-        {
-            ESP_LOGE(TAG, "CH422G_write_output_reg() failed 1");
-        }
-
-        xSemaphoreGive(I2CMutexHandle);
+    if (res != ESP_OK)
+    {
+        ESP_LOGE(TAG, "CH422G_write_output_reg() failed 1");
     }
 	
     return res;
@@ -270,9 +308,9 @@ esp_err_t CH422G_write_direction(uint8_t pin_bit, uint8_t value)
     }
 
     // WR-SET
-    if (xSemaphoreTake(I2CMutexHandle, (TickType_t)100) == pdTRUE)
+    if (xSemaphoreTake(ModeMutexHandle, (TickType_t)100) == pdTRUE)
     {
-        res = i2c_master_write_to_device(ch422g.i2c_num, CH422G_REG_WR_SET, &data, sizeof(data), pdMS_TO_TICKS(I2C_TIMEOUT_MS));
+        res = CH422G_write(CH422G_REG_WR_SET, data);
 
         if (res == ESP_OK)
         {
@@ -283,7 +321,7 @@ esp_err_t CH422G_write_direction(uint8_t pin_bit, uint8_t value)
             ESP_LOGE(TAG, "CH422G_write_direction_reg() failed 1");
         }
 
-        xSemaphoreGive(I2CMutexHandle);
+        xSemaphoreGive(ModeMutexHandle);
     }
 
     return res;
@@ -324,11 +362,11 @@ esp_err_t CH422G_set_io_mode(uint8_t output_mode)
         data = 0;
     }
 
-    if (xSemaphoreTake(I2CMutexHandle, (TickType_t)100) == pdTRUE)
+    if (xSemaphoreTake(ModeMutexHandle, (TickType_t)100) == pdTRUE)
     {
-        res = i2c_master_write_to_device(ch422g.i2c_num, CH422G_Mode, &data, 1, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
+        res = CH422G_write(CH422G_Mode, data);
 
-        xSemaphoreGive(I2CMutexHandle);
+        xSemaphoreGive(ModeMutexHandle);
     }
 
     return res;
@@ -356,9 +394,14 @@ esp_err_t CH422G_reset(void)
 * RETURN:      
 * NOTES:       
 *****************************************************************************/
-esp_err_t CH422G_init(i2c_port_t i2c_num, SemaphoreHandle_t I2CMutex)
+esp_err_t CH422G_init(i2c_port_t i2c_num)
 {
-    I2CMutexHandle = I2CMutex;
+    ModeMutexHandle = xSemaphoreCreateMutex();
+    if (ModeMutexHandle == NULL)
+    {
+        ESP_LOGE(TAG, "CH422G mode mutex create failed");
+        return ESP_FAIL;
+    }
 
     ch422g.i2c_num = i2c_num;
     ch422g.i2c_address = ESP_IO_EXPANDER_I2C_CH422G_ADDRESS_000;
@@ -19,18 +19,22 @@ limitations under the License.
 #include <string.h>
 #include <stdlib.h>
 
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
 #include "driver/i2c.h"
 #include "esp_bit_defs.h"
 #include "esp_check.h"
 #include "esp_log.h"
+#include "esp_rom_sys.h"
+#include "main.h"
+#include "i2c_scheduler.h"
 #include "LP5562.h"
 
 
 #define LP5562_I2C_ADDR         	0x30
 
-// Timeout of each I2C communication 
-#define I2C_TIMEOUT_MS          	(10)
-
 
 #define LP5562_REG_ENABLE			0x00
 #define LP5562_REG_OP_MODE			0x01
@@ -63,6 +67,9 @@ limitations under the License.
 #define LP5562_ENG_HOLD				0x0
 #define LP5562_ENG_STEP				0x1
 #define LP5562_ENG_RUN				0x2
+#define LP5562_OP_MODE_LOAD			0x1
+#define LP5562_OP_MODE_RUN			0x2
+#define LP5562_MODE_DELAY_US		200			// after an engine mode change
 
 
 // this chip used on AtomS3R to run led backlight
@@ -73,7 +80,6 @@ limitations under the License.
  *
  */
 static const char *TAG = "app_LP5562";
-static SemaphoreHandle_t I2CMutexHandle;
 static i2c_port_t i2cnum;
 
 /****************************************************************************
@@ -91,15 +97,10 @@ static esp_err_t LP5562_write(uint8_t reg, uint8_t val)
 	buff[0] = reg;
 	buff[1] = val;
 
-    if (xSemaphoreTake(I2CMutexHandle, pdMS_TO_TICKS(200)) == pdTRUE)
-    {		
-        res = i2c_master_write_to_device(i2cnum, LP5562_I2C_ADDR, buff, sizeof(buff), pdMS_TO_TICKS(I2C_TIMEOUT_MS));
-        if (res != ESP_OK)
-        {
-            ESP_LOGE(TAG, "LP5562_write failed");
-        }
-
-        xSemaphoreGive(I2CMutexHandle);
+    res = i2c_scheduler_write(i2cnum, I2C_DEVICE_LP5562, LP5562_I2C_ADDR, buff, sizeof(buff));
+    if (res != ESP_OK)
+    {
+        ESP_LOGE(TAG, "LP5562_write failed");
     }
 
 	return res;
@@ -116,15 +117,10 @@ static esp_err_t LP5562_read(uint8_t reg, uint8_t* val)
 {
 	esp_err_t res = ESP_FAIL;
 
-	if (xSemaphoreTake(I2CMutexHandle, pdMS_TO_TICKS(200)) == pdTRUE)
-    {		
-        res = i2c_master_write_read_device(i2cnum, LP5562_I2C_ADDR, &reg, sizeof(reg), val, sizeof(val), pdMS_TO_TICKS(I2C_TIMEOUT_MS));
-        if (res != ESP_OK)
-        {
-            ESP_LOGE(TAG, "LP5562_read failed");
-        }
-
-        xSemaphoreGive(I2CMutexHandle);
+    res = i2c_scheduler_read_register(i2cnum, I2C_DEVICE_LP5562, LP5562_I2C_ADDR, reg, val, sizeof(*val), 0);
+    if (res != ESP_OK)
+    {
+        ESP_LOGE(TAG, "LP5562_read failed");
     }
 
 	return res;
@@ -194,25 +190,29 @@ esp_err_t __attribute__((unused)) LP5562_set_color(uint8_t red, uint8_t blue, ui
 * RETURN:      
 * NOTES:       
 *****************************************************************************/
-esp_err_t __attribute__((unused)) LP5562_set_engine(uint8_t r, uint8_t g, uint8_t b)
+esp_err_t LP5562_set_engine(uint8_t r, uint8_t g, uint8_t b, uint8_t w)
 {
-	return LP5562_write(LP5562_REG_LED_MAP, (r << 4) | (g << 2) | b);
+	return LP5562_write(LP5562_REG_LED_MAP, (w << 6) | (r << 4) | (g << 2) | b);
 }
 
 /****************************************************************************
 * NAME:        
-* DESCRIPTION: 
-* PARAMETERS:  
+* DESCRIPTION: Load an engine program
+* PARAMETERS:  engine: 1 - 3
 * RETURN:      
-* NOTES:       
+* NOTES:       The program goes in one auto increment write
 *****************************************************************************/
-esp_err_t __attribute__((unused)) LP5562_engine_load(uint8_t engine, const uint8_t* program, uint8_t size)
+esp_err_t LP5562_engine_load(uint8_t engine, const uint8_t* program, uint8_t size)
 {
-	uint8_t prog_addr = LP5562_REG_ENG_PROG(engine);
-	uint8_t i;
+	uint8_t buff[1 + (LP5562_PROGRAM_MAX_STEPS * 2)];
     esp_err_t ret;
 	uint8_t val;
 	uint8_t shift = 6 - (engine * 2);
+
+	if ((engine < 1) || (engine > 3) || (size > (LP5562_PROGRAM_MAX_STEPS * 2)))
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
     
 	ret = LP5562_read(LP5562_REG_OP_MODE, &val);
     
@@ -222,28 +222,32 @@ esp_err_t __attribute__((unused)) LP5562_engine_load(uint8_t engine, const uint8
     }
 	
     val &= ~(0x3 << shift);
-	val |= 0x1 << shift;
+	val |= LP5562_OP_MODE_LOAD << shift;
     
 	ret = LP5562_write(LP5562_REG_OP_MODE, val);
 	if (ret == ESP_FAIL)
     {
 		return ret;
     }
+
+	esp_rom_delay_us(LP5562_MODE_DELAY_US);
     
-	for (i = 0; i < size; ++i) 
+	buff[0] = LP5562_REG_ENG_PROG(engine);
+	memcpy((void*)&buff[1], (void*)program, size);
+
+    ret = i2c_scheduler_write(i2cnum, I2C_DEVICE_LP5562, LP5562_I2C_ADDR, buff, 1 + size);
+	if (ret != ESP_OK)
     {
-		ret = LP5562_write(prog_addr + i, program[i]);
-        
-		if (ret == ESP_FAIL)
-        {
-			return ret;
-        }
-	}
+        ESP_LOGE(TAG, "LP5562_engine_load failed");
+		return ret;
+    }
 	
     val &= ~(0x3 << shift);
-	val |= 0x2 << shift;
+	val |= LP5562_OP_MODE_RUN << shift;
     
 	ret = LP5562_write(LP5562_REG_OP_MODE, val);
+	esp_rom_delay_us(LP5562_MODE_DELAY_US);
+
 	return ret;
 }
 
@@ -320,6 +324,51 @@ esp_err_t __attribute__((unused)) LP5562_set_pc(uint8_t engine, uint8_t val)
 {
 	return LP5562_write(LP5562_REG_ENG1_PC + engine - 1, val);
 }
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Compile an effect and start an engine running it
+* PARAMETERS:  engine: 1 - 3
+* RETURN:      
+* NOTES:       The engine runs it on its own from here, no more I2C. Map
+*              the outputs to the engine with LP5562_set_engine()
+*****************************************************************************/
+esp_err_t LP5562_run_effect(uint8_t engine, const tLP5562Effect* effect)
+{
+	tLP5562Program program;
+    esp_err_t ret;
+	uint8_t val;
+	uint8_t shift = 6 - (engine * 2);
+
+	if (!LP5562_compile(effect, &program))
+	{
+		ESP_LOGE(TAG, "LP5562 effect %d does not fit in an engine", (int)effect->Type);
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	ret = LP5562_engine_load(engine, program.Code, program.Steps * 2);
+	if (ret != ESP_OK)
+	{
+		return ret;
+	}
+
+	// run this engine, leave the others as they are
+	ret = LP5562_read(LP5562_REG_ENABLE, &val);
+	if (ret != ESP_OK)
+	{
+		return ret;
+	}
+
+	val &= ~(0x3 << shift);
+	val |= LP5562_ENG_RUN << shift;
+
+	ret = LP5562_write(LP5562_REG_ENABLE, val);
+	esp_rom_delay_us(LP5562_MODE_DELAY_US);
+
+	ESP_LOGI(TAG, "LP5562 engine %d running %d steps", (int)engine, (int)program.Steps);
+
+	return ret;
+}
 #endif
 
 /****************************************************************************
@@ -329,11 +378,10 @@ esp_err_t __attribute__((unused)) LP5562_set_pc(uint8_t engine, uint8_t val)
 * RETURN:      
 * NOTES:       
 *****************************************************************************/
-esp_err_t LP5562_init(i2c_port_t i2c_num, SemaphoreHandle_t I2CMutex)
+esp_err_t LP5562_init(i2c_port_t i2c_num)
 {
 #if CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_M5ATOMS3R
 	// save handles
-    I2CMutexHandle = I2CMutex;
 	i2cnum = i2c_num;
     
     LP5562_poweron();    
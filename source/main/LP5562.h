@@ -21,12 +21,14 @@ limitations under the License.
 
 #include "driver/i2c.h"
 #include "esp_err.h"
+#include "LP5562_compiler.h"
 
 esp_err_t LP5562_set_color(uint8_t red, uint8_t blue, uint8_t green, uint8_t white);
-esp_err_t LP5562_set_engine(uint8_t r, uint8_t g, uint8_t b);
+esp_err_t LP5562_set_engine(uint8_t r, uint8_t g, uint8_t b, uint8_t w);
 esp_err_t LP5562_engine_load(uint8_t engine, const uint8_t *program, uint8_t size);
 esp_err_t LP5562_engine_control(uint8_t eng1, uint8_t eng2, uint8_t eng3);
 uint8_t LP5562_get_engine_state(uint8_t engine);
 uint8_t LP5562_get_pc(uint8_t engine);
 esp_err_t LP5562_set_pc(uint8_t engine, uint8_t val);
-esp_err_t LP5562_init(i2c_port_t i2c_num, SemaphoreHandle_t I2CMutex);
+esp_err_t LP5562_run_effect(uint8_t engine, const tLP5562Effect* effect);
+esp_err_t LP5562_init(i2c_port_t i2c_num);
@@ -0,0 +1,253 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include "LP5562_compiler.h"
+
+// instructions
+#define LP5562_OP_GO_TO_START           0x0000
+#define LP5562_OP_SET_PWM               0x4000      // low byte is the PWM value
+#define LP5562_OP_BRANCH                0xA000      // loop count bits 12-7, step bits 3-0
+#define LP5562_OP_END                   0xC000      // PWM holds
+
+// ramp and wait fields
+#define LP5562_PRESCALE                 0x4000
+#define LP5562_STEP_TIME_SHIFT          8
+#define LP5562_RAMP_DOWN                0x0080
+#define LP5562_MAX_STEP_TIME            63
+#define LP5562_MAX_INCREMENT            127
+#define LP5562_MAX_LOOPS                63
+
+// step time units with the internal 32768 Hz clock, usec
+#define LP5562_CYCLE_SHORT              488         // 16 clocks
+#define LP5562_CYCLE_LONG               15625       // 512 clocks
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Add an instruction
+* PARAMETERS:
+* RETURN:      1 if it fitted
+* NOTES:
+*****************************************************************************/
+static uint8_t LP5562_emit(tLP5562Program* program, uint16_t instruction)
+{
+    if (program->Steps >= LP5562_PROGRAM_MAX_STEPS)
+    {
+        return 0;
+    }
+
+    program->Code[program->Steps * 2] = (uint8_t)(instruction >> 8);
+    program->Code[(program->Steps * 2) + 1] = (uint8_t)instruction;
+    program->Steps++;
+
+    return 1;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Pick the step time for a time per step
+* PARAMETERS:  step_us: usec
+* RETURN:      prescale and step time bits
+* NOTES:       Short cycles where they're long enough, for the finer
+*              resolution
+*****************************************************************************/
+static uint16_t LP5562_step_time(uint32_t step_us)
+{
+    uint32_t steps;
+    uint16_t prescale = 0;
+    uint32_t cycle = LP5562_CYCLE_SHORT;
+
+    if (step_us > (LP5562_MAX_STEP_TIME * LP5562_CYCLE_SHORT))
+    {
+        prescale = LP5562_PRESCALE;
+        cycle = LP5562_CYCLE_LONG;
+    }
+
+    steps = (step_us + (cycle / 2)) / cycle;
+
+    // 0 would be a different instruction
+    if (steps < 1)
+    {
+        steps = 1;
+    }
+    else if (steps > LP5562_MAX_STEP_TIME)
+    {
+        steps = LP5562_MAX_STEP_TIME;
+    }
+
+    return prescale | (uint16_t)(steps << LP5562_STEP_TIME_SHIFT);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Add a wait
+* PARAMETERS:  time: msec
+* RETURN:      1 if it fitted
+* NOTES:       A ramp with no increment. Up to about 1 second each
+*****************************************************************************/
+static uint8_t LP5562_emit_wait(tLP5562Program* program, uint32_t time)
+{
+    uint32_t remaining = time * 1000;
+    uint32_t chunk;
+
+    while (remaining >= (LP5562_CYCLE_SHORT / 2))
+    {
+        chunk = remaining;
+        if (chunk > (LP5562_MAX_STEP_TIME * LP5562_CYCLE_LONG))
+        {
+            chunk = LP5562_MAX_STEP_TIME * LP5562_CYCLE_LONG;
+        }
+
+        if (!LP5562_emit(program, LP5562_step_time(chunk)))
+        {
+            return 0;
+        }
+
+        remaining -= chunk;
+    }
+
+    return 1;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Add a ramp
+* PARAMETERS:  time: msec
+* RETURN:      1 if it fitted
+* NOTES:       Starts from wherever the PWM is, so it must already be at
+*              from. Each instruction moves at most 127 levels
+*****************************************************************************/
+static uint8_t LP5562_emit_ramp(tLP5562Program* program, uint8_t from, uint8_t to, uint32_t time)
+{
+    uint16_t delta = (to > from) ? (to - from) : (from - to);
+    uint16_t step_time;
+    uint16_t increment;
+
+    if (delta == 0)
+    {
+        return LP5562_emit_wait(program, time);
+    }
+
+    step_time = LP5562_step_time((time * 1000) / delta);
+
+    if (to < from)
+    {
+        step_time |= LP5562_RAMP_DOWN;
+    }
+
+    while (delta > 0)
+    {
+        increment = (delta > LP5562_MAX_INCREMENT) ? LP5562_MAX_INCREMENT : delta;
+
+        if (!LP5562_emit(program, step_time | increment))
+        {
+            return 0;
+        }
+
+        delta -= increment;
+    }
+
+    return 1;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Finish a repeating effect
+* PARAMETERS:  start: step the repeating part starts at
+* RETURN:      1 if it fitted
+* NOTES:       The branch has 6 bits for the loop count
+*****************************************************************************/
+static uint8_t LP5562_emit_repeat(tLP5562Program* program, uint8_t count, uint8_t start)
+{
+    if (count == 0)
+    {
+        // forever
+        return LP5562_emit(program, LP5562_OP_GO_TO_START);
+    }
+
+    // the first pass isn't a loop
+    if (count > 1)
+    {
+        if ((count - 1) > LP5562_MAX_LOOPS)
+        {
+            return 0;
+        }
+
+        if (!LP5562_emit(program, LP5562_OP_BRANCH | ((uint16_t)(count - 1) << 7) | start))
+        {
+            return 0;
+        }
+    }
+
+    return LP5562_emit(program, LP5562_OP_END);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Compile an effect into an engine program
+* PARAMETERS:
+* RETURN:      1 if it fitted in an engine
+* NOTES:
+*****************************************************************************/
+uint8_t LP5562_compile(const tLP5562Effect* effect, tLP5562Program* program)
+{
+    uint8_t ok = 1;
+    uint8_t start;
+
+    memset((void*)program, 0, sizeof(tLP5562Program));
+
+    if ((effect->Type >= LP5562_EFFECT_LAST) || (effect->Count > LP5562_EFFECT_MAX_COUNT))
+    {
+        return 0;
+    }
+
+    switch (effect->Type)
+    {
+        case LP5562_EFFECT_BREATHE:
+        {
+            ok &= LP5562_emit(program, LP5562_OP_SET_PWM | effect->Low);
+            start = program->Steps;
+
+            ok &= LP5562_emit_ramp(program, effect->Low, effect->High, effect->RiseTime);
+            ok &= LP5562_emit_ramp(program, effect->High, effect->Low, effect->FallTime);
+            ok &= LP5562_emit_wait(program, effect->OffTime);
+            ok &= LP5562_emit_repeat(program, effect->Count, start);
+        } break;
+
+        case LP5562_EFFECT_BLINK:
+        {
+            start = program->Steps;
+
+            ok &= LP5562_emit(program, LP5562_OP_SET_PWM | effect->High);
+            ok &= LP5562_emit_wait(program, effect->OnTime);
+            ok &= LP5562_emit(program, LP5562_OP_SET_PWM | effect->Low);
+            ok &= LP5562_emit_wait(program, effect->OffTime);
+            ok &= LP5562_emit_repeat(program, effect->Count, start);
+        } break;
+
+        case LP5562_EFFECT_RAMP:
+        default:
+        {
+            ok &= LP5562_emit(program, LP5562_OP_SET_PWM | effect->Low);
+            ok &= LP5562_emit_ramp(program, effect->Low, effect->High, effect->RiseTime);
+            ok &= LP5562_emit(program, LP5562_OP_END);
+        } break;
+    }
+
+    return ok;
+}
@@ -0,0 +1,54 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// Compiles LED effects into LP5562 engine programs, so the chip runs them
+// with no I2C traffic. No hardware access
+
+#define LP5562_PROGRAM_MAX_STEPS        16          // instructions per engine
+#define LP5562_EFFECT_MAX_COUNT         64          // most repeats a branch can do
+
+enum LP5562Effects
+{
+    LP5562_EFFECT_BREATHE,              // ramp Low to High and back, then wait OffTime
+    LP5562_EFFECT_BLINK,                // High for OnTime, Low for OffTime
+    LP5562_EFFECT_RAMP,                 // Low to High once, then hold
+    LP5562_EFFECT_LAST
+};
+
+typedef struct
+{
+    uint8_t Type;                       // LP5562_EFFECT_
+    uint8_t Low;                        // PWM levels
+    uint8_t High;
+    uint16_t RiseTime;                  // msec, breathe and ramp
+    uint16_t FallTime;                  // msec, breathe
+    uint16_t OnTime;                    // msec, blink
+    uint16_t OffTime;                   // msec, blink and breathe
+    uint8_t Count;                      // cycles, 0 = forever. Not used for ramp
+} tLP5562Effect;
+
+typedef struct
+{
+    uint8_t Code[LP5562_PROGRAM_MAX_STEPS * 2];     // instructions, high byte first
+    uint8_t Steps;
+} tLP5562Program;
+
+uint8_t LP5562_compile(const tLP5562Effect* effect, tLP5562Program* program);
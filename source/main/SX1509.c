@@ -20,13 +20,13 @@
 #include "esp_log.h"
 #include "driver/i2c.h"
 #include "main.h"
+#include "i2c_scheduler.h"
 #include "SX1509.h"
 
 /* 
 ** Defines
 */
 #define SX1509_IC2_ADDRESS           0x71
-#define I2C_TIMEOUT_MS          	 10
 
 // Class flags
 #define SX1509_FLAG_PRESERVE_STATE   0x0001
@@ -87,7 +87,6 @@ enum
 static uint16_t _flags = 0;
 static uint8_t registers[LAST_USED_REGISTER];
 static const char *TAG = "app_SX1509";
-static SemaphoreHandle_t I2CMutexHandle;
 static i2c_port_t i2cnum;
 
 /****************************************************************************
@@ -199,18 +198,14 @@ static esp_err_t SX1509_write_register(uint8_t reg, uint8_t val)
     outbuffer[1] = val;
 
     // do the transfer
-    if (xSemaphoreTake(I2CMutexHandle, pdMS_TO_TICKS(200)) == pdTRUE)
-    {		
-        if (i2c_master_write_to_device(i2cnum, SX1509_IC2_ADDRESS, outbuffer, 2, pdMS_TO_TICKS(I2C_TIMEOUT_MS)) != ESP_OK)
-        {
-            ESP_LOGE(TAG, "SX1509 write failed");
-        }
-        else
-        {
-            registers[reg] = val;
-            ret = ESP_OK;
-        }
-        xSemaphoreGive(I2CMutexHandle);
+    if (i2c_scheduler_write(i2cnum, I2C_DEVICE_SX1509, SX1509_IC2_ADDRESS, outbuffer, 2) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "SX1509 write failed");
+    }
+    else
+    {
+        registers[reg] = val;
+        ret = ESP_OK;
     }
 
     return ret;
@@ -223,7 +218,7 @@ static esp_err_t SX1509_write_register(uint8_t reg, uint8_t val)
 * RETURN:      none
 * NOTES:       none
 *****************************************************************************/
-static esp_err_t __attribute__((unused)) SX1509_write_registers(uint8_t reg, uint8_t* buf, uint8_t len) 
+static esp_err_t SX1509_write_registers(uint8_t reg, uint8_t* buf, uint8_t len) 
 {
     esp_err_t ret = ESP_FAIL;    
     uint8_t outbuffer[255];
@@ -237,17 +232,13 @@ static esp_err_t __attribute__((unused)) SX1509_write_registers(uint8_t reg, uin
     }
 
     // do the transfer
-    if (xSemaphoreTake(I2CMutexHandle, pdMS_TO_TICKS(200)) == pdTRUE)
-    {		
-        if (i2c_master_write_to_device(i2cnum, SX1509_IC2_ADDRESS, outbuffer, len + 1, pdMS_TO_TICKS(I2C_TIMEOUT_MS)) != ESP_OK)
-        {
-            ESP_LOGE(TAG, "SX1509 writes failed");
-        }
-        else
-        {
-            ret = ESP_OK; 
-        }
-        xSemaphoreGive(I2CMutexHandle);
+    if (i2c_scheduler_write(i2cnum, I2C_DEVICE_SX1509, SX1509_IC2_ADDRESS, outbuffer, len + 1) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "SX1509 writes failed");
+    }
+    else
+    {
+        ret = ESP_OK; 
     }
 
     return ret;
@@ -263,29 +254,21 @@ static esp_err_t __attribute__((unused)) SX1509_write_registers(uint8_t reg, uin
 static esp_err_t SX1509_read_register(uint8_t reg, uint8_t len) 
 {  
     esp_err_t ret = ESP_FAIL;
-    uint8_t outbuffer[5];
     uint8_t inbuffer[255];
 
-    outbuffer[0] = reg;
+    // do the transfer. Registers auto-increment, so reads queued together can share one transfer
+    if (i2c_scheduler_read_register(i2cnum, I2C_DEVICE_SX1509, SX1509_IC2_ADDRESS, reg, inbuffer, len, I2C_FLAG_MERGE_READ) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "SX1509_read_register failed");
+    }
+    else
+    {
+        ret = ESP_OK;
 
-    // do the transfer
-    if (xSemaphoreTake(I2CMutexHandle, pdMS_TO_TICKS(200)) == pdTRUE)
-    {		
-        if (i2c_master_write_read_device(i2cnum, SX1509_IC2_ADDRESS, outbuffer, 1, inbuffer, len, pdMS_TO_TICKS(I2C_TIMEOUT_MS)) != ESP_OK)
-        {
-            ESP_LOGE(TAG, "SX1509_read_register failed");
-        }
-        else
+        for (uint8_t i = 0; i < len; i++) 
         {
-            ret = ESP_OK;
-
-            for (uint8_t i = 0; i < len; i++) 
-            {
-                registers[reg + i] = inbuffer[i];
-            }
+            registers[reg + i] = inbuffer[i];
         }
-
-        xSemaphoreGive(I2CMutexHandle);
     }
 
     return ret;
@@ -298,12 +281,11 @@ static esp_err_t SX1509_read_register(uint8_t reg, uint8_t len)
 * RETURN:      none
 * NOTES:       none
 *****************************************************************************/
-esp_err_t SX1509_Init(i2c_port_t i2c_num, SemaphoreHandle_t I2CMutex)
+esp_err_t SX1509_Init(i2c_port_t i2c_num)
 { 
     esp_err_t ret = ESP_FAIL;
     
     // save handles
-    I2CMutexHandle = I2CMutex;
     i2cnum = i2c_num;
 
     memset((void*)registers, 0, sizeof(registers));
@@ -446,24 +428,19 @@ esp_err_t SX1509_digitalRead(uint8_t pin, uint8_t* value)
 * DESCRIPTION: 
 * PARAMETERS:  none
 * RETURN:      none
-* NOTES:       none
+* NOTES:       One burst read, the register address auto increments
 *****************************************************************************/
 esp_err_t SX1509_getPinValues(uint16_t* values)
 {
-    esp_err_t ret = ESP_FAIL;
+    esp_err_t ret;
     *values = 0;
 
-    // read first bank
-    if (SX1509_read_register(SX1509_REG_DATA_A, 1) == ESP_OK)
-    {
-        *values = (uint16_t)registers[SX1509_REG_DATA_A];
+    // read both banks, B then A
+    ret = SX1509_read_register(SX1509_REG_DATA_B, 2);
 
-        // read second bank
-        if (SX1509_read_register(SX1509_REG_DATA_B, 1) == ESP_OK)
-        {
-            *values |= ((uint16_t)registers[SX1509_REG_DATA_B] << 8);
-            ret = ESP_OK;
-        }
+    if (ret == ESP_OK)
+    {
+        *values = ((uint16_t)registers[SX1509_REG_DATA_B] << 8) | (uint16_t)registers[SX1509_REG_DATA_A];
     }
   
     return ret;
@@ -605,3 +582,97 @@ esp_err_t SX1509_gpioMode(uint8_t pin, uint8_t mode)
 
     return ret;
 }
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Enable change interrupts on pins
+* PARAMETERS:  pins: bit per pin, others are masked
+* RETURN:      ESP_OK if all written
+* NOTES:       Both edges. NINT stays low until cleared
+*****************************************************************************/
+esp_err_t SX1509_enableInterrupts(uint16_t pins)
+{
+    esp_err_t ret = ESP_OK;
+    uint32_t sense = 0;
+
+    // 2 sense bits per pin, 11 = both edges
+    for (uint8_t pin = 0; pin < 16; pin++)
+    {
+        if ((pins & (1 << pin)) != 0)
+        {
+            sense |= (3UL << (pin * 2));
+        }
+    }
+
+    if (SX1509_write_register(SX1509_REG_SENSE_LOW_A, sense & 0xFF) != ESP_OK)
+    {
+        ret = ESP_FAIL;
+    }
+
+    if (SX1509_write_register(SX1509_REG_SENSE_HIGH_A, (sense >> 8) & 0xFF) != ESP_OK)
+    {
+        ret = ESP_FAIL;
+    }
+
+    if (SX1509_write_register(SX1509_REG_SENSE_LOW_B, (sense >> 16) & 0xFF) != ESP_OK)
+    {
+        ret = ESP_FAIL;
+    }
+
+    if (SX1509_write_register(SX1509_REG_SENSE_HIGH_B, (sense >> 24) & 0xFF) != ESP_OK)
+    {
+        ret = ESP_FAIL;
+    }
+
+    // mask bit 0 = interrupt enabled
+    if (SX1509_write_register(SX1509_REG_INTERRUPT_MASK_A, ~pins & 0xFF) != ESP_OK)
+    {
+        ret = ESP_FAIL;
+    }
+
+    if (SX1509_write_register(SX1509_REG_INTERRUPT_MASK_B, (~pins >> 8) & 0xFF) != ESP_OK)
+    {
+        ret = ESP_FAIL;
+    }
+
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG,  "SX1509 enable interrupts failed");
+    }
+
+    return ret;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Read and clear the interrupt sources
+* PARAMETERS:  sources: bit per pin that changed
+* RETURN:      ESP_OK if read
+* NOTES:       Only the bits read are cleared, so a change that lands in
+*              between still raises NINT
+*****************************************************************************/
+esp_err_t SX1509_clearInterrupts(uint16_t* sources)
+{
+    esp_err_t ret;
+    uint8_t clear[2];
+
+    *sources = 0;
+
+    // B then A
+    ret = SX1509_read_register(SX1509_REG_INTERRUPT_SOURCE_B, 2);
+
+    if (ret == ESP_OK)
+    {
+        clear[0] = registers[SX1509_REG_INTERRUPT_SOURCE_B];
+        clear[1] = registers[SX1509_REG_INTERRUPT_SOURCE_A];
+        *sources = ((uint16_t)clear[0] << 8) | clear[1];
+
+        if (*sources != 0)
+        {
+            // write 1 to clear
+            ret = SX1509_write_registers(SX1509_REG_INTERRUPT_SOURCE_B, clear, 2);
+        }
+    }
+
+    return ret;
+}
@@ -15,12 +15,14 @@ enum Expander_PinModes
     EXPANDER_OUTPUT_PULLDOWN
 };
 
-esp_err_t SX1509_Init(i2c_port_t i2c_num, SemaphoreHandle_t I2CMutex);
+esp_err_t SX1509_Init(i2c_port_t i2c_num);
 esp_err_t SX1509_refresh(void);
 esp_err_t SX1509_gpioMode(uint8_t pin, uint8_t mode);
 esp_err_t SX1509_digitalWrite(uint8_t pin, uint8_t value);
 esp_err_t SX1509_digitalRead(uint8_t pin, uint8_t* value); 
 esp_err_t SX1509_getPinValues(uint16_t* values);
+esp_err_t SX1509_enableInterrupts(uint16_t pins);
+esp_err_t SX1509_clearInterrupts(uint16_t* sources);
 
 
 #endif      //_SX1509_H
@@ -0,0 +1,692 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ 
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "control.h"
+#include "tonex_params.h"
+#include "expression_filter.h"
+#include "midi_parser.h"
+#include "midi_router.h"
+#include "preset_record.h"
+#include "config_store.h"
+
+#define CONFIG_STORE_LEGACY_KEY             "userdata"        // legacy single blob config, migrated on load
+#define CONFIG_STORE_VERSION_KEY            "ver"
+#define CONFIG_STORE_ENTRY_SIZE             32                // flash used per NVS entry
+#define PRESET_RECORD_MAX                   PRESET_RECORD_SIZE(MAX_TEXT_LENGTH)
+#define CONFIG_ITEMS_ALL                    ((1ULL << CONFIG_ITEM_LAST) - 1)
+#define PRESETS_ALL                         ((1UL << MAX_PRESETS_DEFAULT) - 1)
+
+#define CONFIG_FIELD_SIZE(field)            sizeof(((tConfigData*)0)->field)
+
+// whole int field, part of a flags field, or string buffer
+#define CONFIG_VALUE(field)                 offsetof(tConfigData, field), CONFIG_FIELD_SIZE(field), 0, (8 * CONFIG_FIELD_SIZE(field))
+#define CONFIG_BITS(field, shift, bits)     offsetof(tConfigData, field), CONFIG_FIELD_SIZE(field), shift, bits
+#define CONFIG_STRING(field)                offsetof(tConfigData, field), CONFIG_FIELD_SIZE(field), 0, 0
+
+#define CONFIG_INT(min, max, def)           min, max, def, NULL
+#define CONFIG_TEXT(def)                    0, 0, 0, def
+
+#define CONFIG_EXT_FOOTSW_EFFECT(index, json, nvs) \
+    [CONFIG_ITEM_EXT_FOOTSW_EFFECT##index##_SW]   = {CONFIG_TYPE_INT, CONFIG_FLAG_SETCONFIG, CONFIG_VALUE(ExternalFootswitchEffectConfig[index - 1].Switch),  CONFIG_INT(0, 255, SWITCH_NOT_USED), json "_SW", nvs "_sw"}, \
+    [CONFIG_ITEM_EXT_FOOTSW_EFFECT##index##_CC]   = {CONFIG_TYPE_INT, CONFIG_FLAG_SETCONFIG, CONFIG_VALUE(ExternalFootswitchEffectConfig[index - 1].CC),      CONFIG_INT(0, 127, 0),               json "_CC", nvs "_cc"}, \
+    [CONFIG_ITEM_EXT_FOOTSW_EFFECT##index##_VAL1] = {CONFIG_TYPE_INT, CONFIG_FLAG_SETCONFIG, CONFIG_VALUE(ExternalFootswitchEffectConfig[index - 1].Value_1), CONFIG_INT(0, 127, 0),               json "_V1", nvs "_v1"}, \
+    [CONFIG_ITEM_EXT_FOOTSW_EFFECT##index##_VAL2] = {CONFIG_TYPE_INT, CONFIG_FLAG_SETCONFIG, CONFIG_VALUE(ExternalFootswitchEffectConfig[index - 1].Value_2), CONFIG_INT(0, 127, 0),               json "_V2", nvs "_v2"}
+
+#define CONFIG_MIDI_ROUTE(index, json, nvs, src, dst) \
+    [CONFIG_ITEM_MIDI_ROUTE##index##_SRC]  = {CONFIG_TYPE_INT, CONFIG_FLAG_SETCONFIG, CONFIG_VALUE(MidiRoutes[index - 1].Sources),      CONFIG_INT(0, MIDI_ROUTER_SOURCE_MASK_ALL, src),   json "_SRC",  nvs "_src"}, \
+    [CONFIG_ITEM_MIDI_ROUTE##index##_DST]  = {CONFIG_TYPE_INT, CONFIG_FLAG_SETCONFIG, CONFIG_VALUE(MidiRoutes[index - 1].Destinations), CONFIG_INT(0, MIDI_ROUTER_DEST_ALL, dst),          json "_DST",  nvs "_dst"}, \
+    [CONFIG_ITEM_MIDI_ROUTE##index##_CH]   = {CONFIG_TYPE_INT, CONFIG_FLAG_SETCONFIG, CONFIG_VALUE(MidiRoutes[index - 1].Channel),      CONFIG_INT(0, 16, 0),                              json "_CH",   nvs "_ch"}, \
+    [CONFIG_ITEM_MIDI_ROUTE##index##_TYPE] = {CONFIG_TYPE_INT, CONFIG_FLAG_SETCONFIG, CONFIG_VALUE(MidiRoutes[index - 1].Types),        CONFIG_INT(0, MIDI_ROUTER_TYPE_ALL, MIDI_ROUTER_TYPE_ALL), json "_TYPE", nvs "_type"}
+
+// Midi thru build option gives the defaults for the first two user routes
+#if CONFIG_TONEX_CONTROLLER_MIDI_THRU
+#define MIDI_ROUTE1_DEFAULT_SRC             MIDI_ROUTER_SOURCE_MASK(MIDI_ROUTER_SOURCE_SERIAL)
+#define MIDI_ROUTE1_DEFAULT_DST             MIDI_ROUTER_DEST_BLE_OUT
+#define MIDI_ROUTE2_DEFAULT_SRC             (MIDI_ROUTER_SOURCE_MASK(MIDI_ROUTER_SOURCE_BLE_CENTRAL) | MIDI_ROUTER_SOURCE_MASK(MIDI_ROUTER_SOURCE_BLE_PERIPHERAL))
+#define MIDI_ROUTE2_DEFAULT_DST             MIDI_ROUTER_DEST_SERIAL_OUT
+#else
+#define MIDI_ROUTE1_DEFAULT_SRC             0
+#define MIDI_ROUTE1_DEFAULT_DST             0
+#define MIDI_ROUTE2_DEFAULT_SRC             0
+#define MIDI_ROUTE2_DEFAULT_DST             0
+#endif
+
+// ConfigDirty and the handler masks have a bit per item
+_Static_assert(CONFIG_ITEM_LAST <= 64, "Too many config items");
+
+// config item registry, indexed by ConfigItems. Get, set, defaults, range
+// checks, web UI and flash all work from this. NVS keys must never change
+static const tConfigItemInfo ConfigItemInfo[CONFIG_ITEM_LAST] = 
+{
+    [CONFIG_ITEM_BT_MODE]                   = {CONFIG_TYPE_INT,    CONFIG_FLAG_SETCONFIG | CONFIG_FLAG_REBOOT, CONFIG_VALUE(BTMode),                 CONFIG_INT(BT_MODE_DISABLED, BT_MODE_PERIPHERAL, BT_MODE_CENTRAL),                       "BT_MODE",         "bt_mode"},
+    [CONFIG_ITEM_MV_CHOC_ENABLE]            = {CONFIG_TYPE_INT,    CONFIG_FLAG_SETCONFIG | CONFIG_FLAG_REBOOT, CONFIG_BITS(BTClientFlags, 0, 1),     CONFIG_INT(0, 1, 1),                                                                     "BT_CHOC_EN",      "bt_mvave"},
+    [CONFIG_ITEM_XV_MD1_ENABLE]             = {CONFIG_TYPE_INT,    CONFIG_FLAG_SETCONFIG | CONFIG_FLAG_REBOOT, CONFIG_BITS(BTClientFlags, 1, 1),     CONFIG_INT(0, 1, 1),                                                                     "BT_MD1_EN",       "bt_md1"},
+    [CONFIG_ITEM_CUSTOM_BT_ENABLE]          = {CONFIG_TYPE_INT,    CONFIG_FLAG_SETCONFIG | CONFIG_FLAG_REBOOT, CONFIG_BITS(BTClientFlags, 2, 1),     CONFIG_INT(0, 1, 0),                                                                     "BT_CUST_EN",      "bt_cust_en"},
+    [CONFIG_ITEM_BT_CUSTOM_NAME]            = {CONFIG_TYPE_STRING, CONFIG_FLAG_SETCONFIG | CONFIG_FLAG_REBOOT, CONFIG_STRING(BTClientCustomName),    CONFIG_TEXT(""),                                                                         "BT_CUST_NAME",    "bt_cust_name"},
+    [CONFIG_ITEM_MIDI_ENABLE]               = {CONFIG_TYPE_INT,    CONFIG_FLAG_SETCONFIG | CONFIG_FLAG_REBOOT, CONFIG_BITS(MidiFlags, 0, 1),         CONFIG_INT(0, 1, 0),                                                                     "S_MIDI_EN",       "midi_en"},
+    [CONFIG_ITEM_MIDI_CHANNEL]              = {CONFIG_TYPE_INT,    CONFIG_FLAG_SETCONFIG, CONFIG_VALUE(MidiChannel),            CONFIG_INT(1, 16, 1),                                                                    "S_MIDI_CH",       "midi_ch"},
+    [CONFIG_ITEM_TOGGLE_BYPASS]             = {CONFIG_TYPE_INT,    CONFIG_FLAG_SETCONFIG, CONFIG_BITS(GeneralFlags, 0, 1),      CONFIG_INT(0, 1, 0),                                                                     "TOGGLE_BYPASS",   "tog_bypass"},
+    [CONFIG_ITEM_FOOTSWITCH_MODE]           = {CONFIG_TYPE_INT,    CONFIG_FLAG_SETCONFIG, CONFIG_VALUE(FootswitchMode),         CONFIG_INT(0, FOOTSWITCH_MODE_LAST - 1, FOOTSWITCH_MODE_DUAL_UP_DOWN),                   "FOOTSW_MODE",     "fsw_mode"},
+    [CONFIG_ITEM_ENABLE_BT_MIDI_CC]         = {CONFIG_TYPE_INT,    CONFIG_FLAG_SETCONFIG, CONFIG_BITS(MidiFlags, 1, 1),         CONFIG_INT(0, 1, 0),                                                                     "BT_MIDI_CC",      "bt_midi_cc"},
+    [CONFIG_ITEM_WIFI_MODE]                 = {CONFIG_TYPE_INT,    CONFIG_FLAG_SETWIFI | CONFIG_FLAG_REBOOT, CONFIG_BITS(WiFiFlags, 0, 4),         CONFIG_INT(0, WIFI_MODE_ACCESS_POINT, WIFI_MODE_ACCESS_POINT_TIMED),                     "WIFI_MODE",       "wifi_mode"},
+    [CONFIG_ITEM_WIFI_SSID]                 = {CONFIG_TYPE_STRING, CONFIG_FLAG_SETWIFI | CONFIG_FLAG_REBOOT, CONFIG_STRING(WifiSSID),              CONFIG_TEXT("TonexConfig"),                                                              "WIFI_SSID",       "wifi_ssid"},
+    [CONFIG_ITEM_WIFI_PASSWORD]             = {CONFIG_TYPE_STRING, CONFIG_FLAG_SETWIFI | CONFIG_FLAG_REBOOT | CONFIG_FLAG_HIDDEN, CONFIG_STRING(WifiPassword), CONFIG_TEXT("12345678"),                                                     "WIFI_PW",         "wifi_pw"},
+    [CONFIG_ITEM_SCREEN_ROTATION]           = {CONFIG_TYPE_INT,    CONFIG_FLAG_SETCONFIG | CONFIG_FLAG_REBOOT, CONFIG_BITS(GeneralFlags, 1, 2),      CONFIG_INT(0, SCREEN_ROTATION_MAX - 1, SCREEN_ROTATION_0),                               "SCREEN_ROT",      "screen_rot"},
+    [CONFIG_ITEM_WIFI_TX_POWER]             = {CONFIG_TYPE_INT,    CONFIG_FLAG_SETWIFI,   CONFIG_BITS(WiFiFlags, 4, 4),         CONFIG_INT(0, WIFI_TX_POWER_100, WIFI_TX_POWER_25),                                      "WIFI_POWER",      "wifi_power"},
+    [CONFIG_ITEM_MDNS_NAME]                 = {CONFIG_TYPE_STRING, CONFIG_FLAG_SETWIFI,   CONFIG_STRING(MDNSName),              CONFIG_TEXT("tonex"),                                                                    "MDNS_NAME",       "mdns_name"},
+    [CONFIG_ITEM_EXT_FOOTSW_PRESET_LAYOUT]  = {CONFIG_TYPE_INT,    CONFIG_FLAG_SETCONFIG, CONFIG_VALUE(ExternalFootswitchPresetLayout), CONFIG_INT(0, FOOTSWITCH_LAYOUT_LAST - 1, FOOTSWITCH_LAYOUT_1X4),                 "EXTFS_PS_LAYOUT", "extfs_layout"},
+    CONFIG_EXT_FOOTSW_EFFECT(1, "EXTFS_ES1", "extfs1"),
+    CONFIG_EXT_FOOTSW_EFFECT(2, "EXTFS_ES2", "extfs2"),
+    CONFIG_EXT_FOOTSW_EFFECT(3, "EXTFS_ES3", "extfs3"),
+    CONFIG_EXT_FOOTSW_EFFECT(4, "EXTFS_ES4", "extfs4"),
+    CONFIG_EXT_FOOTSW_EFFECT(5, "EXTFS_ES5", "extfs5"),
+    [CONFIG_ITEM_FOOTSW_ACTIONS]            = {CONFIG_TYPE_STRING, CONFIG_FLAG_SETCONFIG, CONFIG_STRING(FootswitchActions),     CONFIG_TEXT("1:P1 2:P2 3:P3 4:P4 1+2:BD 3+4:BU"),                                        "FOOTSW_ACTIONS",  "fsw_actions"},
+    [CONFIG_ITEM_EXT_FOOTSW_ACTIONS]        = {CONFIG_TYPE_STRING, CONFIG_FLAG_SETCONFIG, CONFIG_STRING(ExternalFootswitchActions), CONFIG_TEXT("1:P1 2:P2 3:P3 4:P4 1+2:BD 3+4:BU"),                                    "EXTFS_ACTIONS",   "extfs_actions"},
+    [CONFIG_ITEM_EXP_PARAM]                 = {CONFIG_TYPE_INT,    CONFIG_FLAG_SETCONFIG, CONFIG_VALUE(ExpressionParam),        CONFIG_INT(0, TONEX_PARAM_LAST, TONEX_PARAM_LAST),                                       "EXP_PARAM",       "exp_param"},
+    [CONFIG_ITEM_EXP_CURVE]                 = {CONFIG_TYPE_INT,    CONFIG_FLAG_SETCONFIG, CONFIG_BITS(ExpressionFlags, 0, 2),   CONFIG_INT(0, EXPRESSION_CURVE_LAST - 1, EXPRESSION_CURVE_LINEAR),                       "EXP_CURVE",       "exp_curve"},
+    [CONFIG_ITEM_EXP_CALIBRATE]             = {CONFIG_TYPE_INT,    CONFIG_FLAG_SETCONFIG, CONFIG_BITS(ExpressionFlags, 2, 1),   CONFIG_INT(0, 1, 0),                                                                     "EXP_CAL",         "exp_cal"},
+    [CONFIG_ITEM_EXP_HEEL]                  = {CONFIG_TYPE_INT,    CONFIG_FLAG_SETCONFIG, CONFIG_VALUE(ExpressionHeel),         CONFIG_INT(0, EXPRESSION_ADC_MAX, 200),                                                  "EXP_HEEL",        "exp_heel"},
+    [CONFIG_ITEM_EXP_TOE]                   = {CONFIG_TYPE_INT,    CONFIG_FLAG_SETCONFIG, CONFIG_VALUE(ExpressionToe),          CONFIG_INT(0, EXPRESSION_ADC_MAX, 3900),                                                 "EXP_TOE",         "exp_toe"},
+    CONFIG_MIDI_ROUTE(1, "MIDI_RT1", "mroute1", MIDI_ROUTE1_DEFAULT_SRC, MIDI_ROUTE1_DEFAULT_DST),
+    CONFIG_MIDI_ROUTE(2, "MIDI_RT2", "mroute2", MIDI_ROUTE2_DEFAULT_SRC, MIDI_ROUTE2_DEFAULT_DST),
+    CONFIG_MIDI_ROUTE(3, "MIDI_RT3", "mroute3", 0, 0),
+    CONFIG_MIDI_ROUTE(4, "MIDI_RT4", "mroute4", 0, 0),
+};
+
+typedef struct
+{
+    tConfigStore* Store;
+    const tConfigStorage* Storage;
+    uint8_t Version;
+} tConfigLoadContext;
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Read an int config item from the config data
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       Fields are little endian, as is the target
+*****************************************************************************/
+static uint32_t ReadConfigItemInt(const tConfigStore* store, const tConfigItemInfo* info)
+{
+    uint32_t field = 0;
+
+    memcpy((void*)&field, (void*)((uint8_t*)&store->ConfigData + info->Offset), info->Size);
+
+    return (field >> info->Shift) & (0xFFFFFFFFUL >> (32 - info->Bits));
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Write an int config item into the config data
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       Other bits sharing the field are kept
+*****************************************************************************/
+static void WriteConfigItemInt(tConfigStore* store, const tConfigItemInfo* info, uint32_t value)
+{
+    uint32_t field = 0;
+    uint32_t mask = (0xFFFFFFFFUL >> (32 - info->Bits)) << info->Shift;
+    uint8_t* data = (uint8_t*)&store->ConfigData + info->Offset;
+
+    memcpy((void*)&field, (void*)data, info->Size);
+    field = (field & ~mask) | ((value << info->Shift) & mask);
+    memcpy((void*)data, (void*)&field, info->Size);
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Get the registry entry for a config item
+* PARAMETERS:  
+* RETURN:      NULL if not a config item
+* NOTES:       
+*****************************************************************************/
+const tConfigItemInfo* config_store_get_item_info(uint32_t item)
+{
+    if (item >= CONFIG_ITEM_LAST)
+    {
+        return NULL;
+    }
+
+    return &ConfigItemInfo[item];
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Set every config item to its default
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       Presets are not touched. Everything is marked for saving
+*****************************************************************************/
+void config_store_set_defaults(tConfigStore* store)
+{
+    for (uint32_t item = 0; item < CONFIG_ITEM_LAST; item++)
+    {
+        const tConfigItemInfo* info = &ConfigItemInfo[item];
+
+        if (info->Type == CONFIG_TYPE_STRING)
+        {
+            char* data = (char*)&store->ConfigData + info->Offset;
+
+            memset((void*)data, 0, info->Size);
+            strncpy(data, info->DefaultString, info->Size - 1);
+        }
+        else
+        {
+            WriteConfigItemInt(store, info, info->Default);
+        }
+    }
+
+    store->ConfigDirty = CONFIG_ITEMS_ALL;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Get an int config item
+* PARAMETERS:  
+* RETURN:      value, 0 if not an int item
+* NOTES:       
+*****************************************************************************/
+uint32_t config_store_get_int(const tConfigStore* store, uint32_t item)
+{
+    if ((item >= CONFIG_ITEM_LAST) || (ConfigItemInfo[item].Type != CONFIG_TYPE_INT))
+    {
+        return 0;
+    }
+
+    return ReadConfigItemInt(store, &ConfigItemInfo[item]);
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Get a string config item
+* PARAMETERS:  text: at least MAX_TEXT_LENGTH
+* RETURN:      1 if OK, 0 if not a string item
+* NOTES:       
+*****************************************************************************/
+uint8_t config_store_get_string(const tConfigStore* store, uint32_t item, char* text)
+{
+    const tConfigItemInfo* info;
+
+    if ((item >= CONFIG_ITEM_LAST) || (ConfigItemInfo[item].Type != CONFIG_TYPE_STRING))
+    {
+        return 0;
+    }
+
+    info = &ConfigItemInfo[item];
+    strncpy(text, (char*)&store->ConfigData + info->Offset, info->Size - 1);
+    text[info->Size - 1] = 0;
+
+    return 1;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Set an int config item
+* PARAMETERS:  
+* RETURN:      ConfigStoreSetResults
+* NOTES:       Out of range values are ignored. Marks the item for saving
+*              if it changed
+*****************************************************************************/
+uint8_t config_store_set_int(tConfigStore* store, uint32_t item, uint32_t value)
+{
+    const tConfigItemInfo* info;
+
+    if ((item >= CONFIG_ITEM_LAST) || (ConfigItemInfo[item].Type != CONFIG_TYPE_INT))
+    {
+        return CONFIG_STORE_INVALID_ITEM;
+    }
+
+    info = &ConfigItemInfo[item];
+    if ((value < info->Min) || (value > info->Max))
+    {
+        return CONFIG_STORE_OUT_OF_RANGE;
+    }
+
+    if (ReadConfigItemInt(store, info) == value)
+    {
+        return CONFIG_STORE_UNCHANGED;
+    }
+
+    WriteConfigItemInt(store, info, value);
+    store->ConfigDirty |= CONFIG_ITEM_MASK(item);
+
+    return CONFIG_STORE_CHANGED;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Set a string config item
+* PARAMETERS:  
+* RETURN:      ConfigStoreSetResults
+* NOTES:       Too long text is cut. Marks the item for saving if it changed
+*****************************************************************************/
+uint8_t config_store_set_string(tConfigStore* store, uint32_t item, const char* text)
+{
+    const tConfigItemInfo* info;
+    char* data;
+
+    if ((item >= CONFIG_ITEM_LAST) || (ConfigItemInfo[item].Type != CONFIG_TYPE_STRING))
+    {
+        return CONFIG_STORE_INVALID_ITEM;
+    }
+
+    info = &ConfigItemInfo[item];
+    data = (char*)&store->ConfigData + info->Offset;
+
+    if (strncmp(data, text, info->Size - 1) == 0)
+    {
+        return CONFIG_STORE_UNCHANGED;
+    }
+
+    strncpy(data, text, info->Size - 1);
+    data[info->Size - 1] = 0;
+    store->ConfigDirty |= CONFIG_ITEM_MASK(item);
+
+    return CONFIG_STORE_CHANGED;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Flash used by an NVS entry
+* PARAMETERS:  length: data length for strings and blobs, 0 for ints
+* RETURN:      bytes
+* NOTES:       Header entry plus data spans
+*****************************************************************************/
+static uint32_t entry_bytes(size_t length)
+{
+    return CONFIG_STORE_ENTRY_SIZE + (((length + CONFIG_STORE_ENTRY_SIZE - 1) / CONFIG_STORE_ENTRY_SIZE) * CONFIG_STORE_ENTRY_SIZE);
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Build the storage key for a preset
+* PARAMETERS:  key: CONFIG_STORE_KEY_SIZE buffer
+* RETURN:      
+* NOTES:       
+*****************************************************************************/
+static void preset_key(uint32_t preset, char* key)
+{
+    snprintf(key, CONFIG_STORE_KEY_SIZE, "preset%02d", (int)preset);
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Decode a preset record
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       Fields not in the record keep their current value
+*****************************************************************************/
+static void DecodePresetRecord(tConfigStore* store, uint32_t preset, const uint8_t* record, size_t length)
+{
+    tUserData* user_data = &store->ConfigData.UserData[preset];
+    uint16_t skin_index = user_data->SkinIndex;     // packed struct, no pointer to the member
+
+    preset_record_decode(record, length, &skin_index, user_data->PresetDescription, MAX_TEXT_LENGTH);
+    user_data->SkinIndex = skin_index;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Write changed config items and presets
+* PARAMETERS:  
+* RETURN:      1 if OK
+* NOTES:       Only dirty entries are written, each has its own key. Failed
+*              entries stay dirty for the next save
+****************************************************************************/
+uint8_t config_store_save(tConfigStore* store, const tConfigStorage* storage)
+{
+    const tConfigStorageOps* ops = storage->Ops;
+    uint8_t result = 1;
+    uint8_t written;
+    uint32_t items = 0;
+    uint32_t bytes = 0;
+    char str_val[MAX_TEXT_LENGTH];
+    char key[CONFIG_STORE_KEY_SIZE];
+    uint8_t record[PRESET_RECORD_MAX];
+    size_t length;
+
+    if ((store->ConfigDirty == 0) && (store->PresetDirty == 0))
+    {
+        return 1;
+    }
+
+    for (uint32_t item = 0; item < CONFIG_ITEM_LAST; item++)
+    {
+        if ((store->ConfigDirty & CONFIG_ITEM_MASK(item)) == 0)
+        {
+            continue;
+        }
+
+        if (ConfigItemInfo[item].Type == CONFIG_TYPE_STRING)
+        {
+            config_store_get_string(store, item, str_val);
+            written = ops->SetString(storage->Context, ConfigItemInfo[item].NVSKey, str_val);
+            bytes += entry_bytes(strlen(str_val) + 1);
+        }
+        else
+        {
+            written = ops->SetU32(storage->Context, ConfigItemInfo[item].NVSKey, config_store_get_int(store, item));
+            bytes += entry_bytes(0);
+        }
+
+        if (written)
+        {
+            store->ConfigDirty &= ~CONFIG_ITEM_MASK(item);
+            items++;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+
+    for (uint32_t preset = 0; preset < MAX_PRESETS_DEFAULT; preset++)
+    {
+        if ((store->PresetDirty & (1UL << preset)) == 0)
+        {
+            continue;
+        }
+
+        length = preset_record_encode(store->ConfigData.UserData[preset].SkinIndex, store->ConfigData.UserData[preset].PresetDescription, MAX_TEXT_LENGTH, record);
+        preset_key(preset, key);
+        bytes += entry_bytes(length);
+
+        if (ops->SetBlob(storage->Context, key, (void*)record, length))
+        {
+            store->PresetDirty &= ~(1UL << preset);
+            items++;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+
+    if (!ops->Commit(storage->Context))
+    {
+        result = 0;
+    }
+
+    store->SaveStats.Saves++;
+    store->SaveStats.LastItems = items;
+    store->SaveStats.LastBytes = bytes;
+    store->SaveStats.TotalBytes += bytes;
+
+    return result;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Migrate from the single tConfigData blob
+* PARAMETERS:  legacy: namespace holding the blob, NULL if none
+* RETURN:      version reached
+* NOTES:       Used up to V1.0.8. Fields were only ever added to the end of
+*              the struct, so an older, shorter blob is a prefix of the
+*              current one. Everything is written in the current form, then
+*              the old blob is erased
+****************************************************************************/
+static uint8_t MigrateFromLegacyBlob(tConfigStore* store, const tConfigStorage* storage, const tConfigStorage* legacy)
+{
+    size_t length = 0;
+    uint8_t migrated = 0;
+    uint8_t* blob;
+
+    // everything gets written in the new form
+    store->ConfigDirty = CONFIG_ITEMS_ALL;
+    store->PresetDirty = PRESETS_ALL;
+
+    if ((legacy != NULL) && legacy->Ops->GetBlob(legacy->Context, CONFIG_STORE_LEGACY_KEY, NULL, &length))
+    {
+        // a larger blob is from a newer firmware, leave it alone
+        if (length <= sizeof(store->ConfigData))
+        {
+            blob = malloc(length);
+            if ((blob == NULL) || !legacy->Ops->GetBlob(legacy->Context, CONFIG_STORE_LEGACY_KEY, (void*)blob, &length))
+            {
+                // legacy blob is kept, try again next boot
+                free(blob);
+                return 0;
+            }
+
+            memcpy((void*)&store->ConfigData, (void*)blob, length);
+            free(blob);
+            migrated = 1;
+        }
+    }
+
+    if (!config_store_save(store, storage))
+    {
+        return 0;
+    }
+
+    if (migrated)
+    {
+        legacy->Ops->Erase(legacy->Context, CONFIG_STORE_LEGACY_KEY);
+        legacy->Ops->Commit(legacy->Context);
+    }
+
+    return CONFIG_STORE_VERSION;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Migrate presets from packed tUserData blobs to records
+* PARAMETERS:  
+* RETURN:      version reached
+* NOTES:       
+****************************************************************************/
+static uint8_t MigratePresetsToRecords(tConfigStore* store, const tConfigStorage* storage, const tConfigStorage* legacy)
+{
+    tUserData user_data;
+    char key[CONFIG_STORE_KEY_SIZE];
+    size_t length;
+
+    for (uint32_t preset = 0; preset < MAX_PRESETS_DEFAULT; preset++)
+    {
+        memset((void*)&user_data, 0, sizeof(user_data));
+        length = sizeof(user_data);
+        preset_key(preset, key);
+
+        if (storage->Ops->GetBlob(storage->Context, key, (void*)&user_data, &length))
+        {
+            user_data.PresetDescription[MAX_TEXT_LENGTH - 1] = 0;
+            memcpy((void*)&store->ConfigData.UserData[preset], (void*)&user_data, sizeof(user_data));
+        }
+    }
+
+    // rewrite only the presets, config items are unchanged
+    store->ConfigDirty = 0;
+    store->PresetDirty = PRESETS_ALL;
+    return config_store_save(store, storage) ? 2 : 0;
+}
+
+// forward migrations, one per stored version older than CONFIG_STORE_VERSION
+typedef struct
+{
+    uint8_t FromVersion;
+    uint8_t (*Migrate)(tConfigStore* store, const tConfigStorage* storage, const tConfigStorage* legacy);      // returns the version reached, 0 if failed
+} tConfigMigration;
+
+static const tConfigMigration ConfigMigrations[] = 
+{
+    {0, MigrateFromLegacyBlob},     // no version key, single tConfigData blob
+    {1, MigratePresetsToRecords},   // presets were packed tUserData blobs
+};
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Bring stored config up to the current version
+* PARAMETERS:  
+* RETURN:      version stored
+* NOTES:       A failed step leaves the version where it was, to try again
+*              next boot
+****************************************************************************/
+static uint8_t MigrateUserData(tConfigStore* store, const tConfigStorage* storage, const tConfigStorage* legacy)
+{
+    uint8_t version = 0;
+    uint8_t new_version;
+    uint8_t found;
+
+    storage->Ops->GetU8(storage->Context, CONFIG_STORE_VERSION_KEY, &version);
+
+    while (version < CONFIG_STORE_VERSION)
+    {
+        found = 0;
+        new_version = 0;
+
+        for (uint8_t loop = 0; loop < (sizeof(ConfigMigrations) / sizeof(tConfigMigration)); loop++)
+        {
+            if (ConfigMigrations[loop].FromVersion == version)
+            {
+                found = 1;
+                new_version = ConfigMigrations[loop].Migrate(store, storage, legacy);
+                break;
+            }
+        }
+
+        if (!found || (new_version <= version))
+        {
+            return version;
+        }
+
+        version = new_version;
+        storage->Ops->SetU8(storage->Context, CONFIG_STORE_VERSION_KEY, version);
+        storage->Ops->Commit(storage->Context);
+    }
+
+    return version;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Load one stored entry
+* PARAMETERS:  arg: tConfigLoadContext
+* RETURN:      
+* NOTES:       Keys that aren't known, or have the wrong type, are skipped
+****************************************************************************/
+static void LoadUserDataEntry(void* arg, const char* key, uint8_t type)
+{
+    tConfigLoadContext* load = (tConfigLoadContext*)arg;
+    const tConfigStorage* storage = load->Storage;
+    char str_val[MAX_TEXT_LENGTH];
+    uint8_t record[PRESET_RECORD_MAX];
+    uint32_t int_val;
+    unsigned int preset;
+    size_t length;
+
+    if (sscanf(key, "preset%u", &preset) == 1)
+    {
+        length = sizeof(record);
+        // before version 2 these weren't records, skip if migration failed
+        if ((load->Version >= 2) && (preset < MAX_PRESETS_DEFAULT) && (type == CONFIG_STORAGE_BLOB) && 
+            storage->Ops->GetBlob(storage->Context, key, (void*)record, &length))
+        {
+            DecodePresetRecord(load->Store, preset, record, length);
+            load->Store->PresetDirty &= ~(1UL << preset);
+        }
+        return;
+    }
+
+    for (uint32_t item = 0; item < CONFIG_ITEM_LAST; item++)
+    {
+        if (strcmp(key, ConfigItemInfo[item].NVSKey) != 0)
+        {
+            continue;
+        }
+
+        if ((ConfigItemInfo[item].Type == CONFIG_TYPE_STRING) && (type == CONFIG_STORAGE_STRING))
+        {
+            length = sizeof(str_val);
+            if (storage->Ops->GetString(storage->Context, key, str_val, &length))
+            {
+                config_store_set_string(load->Store, item, str_val);
+                load->Store->ConfigDirty &= ~CONFIG_ITEM_MASK(item);
+            }
+        }
+        else if ((ConfigItemInfo[item].Type == CONFIG_TYPE_INT) && (type == CONFIG_STORAGE_U32))
+        {
+            if (storage->Ops->GetU32(storage->Context, key, &int_val))
+            {
+                // out of range is left for the check after loading
+                WriteConfigItemInt(load->Store, &ConfigItemInfo[item], int_val);
+                load->Store->ConfigDirty &= ~CONFIG_ITEM_MASK(item);
+            }
+        }
+        break;
+    }
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Load config items and presets, migrating older forms first
+* PARAMETERS:  storage: config namespace
+*              legacy: namespace of the pre V1.0.8 blob, NULL if none
+* RETURN:      version stored, less than CONFIG_STORE_VERSION if a
+*              migration failed
+* NOTES:       Items missing from storage keep their current value, and are
+*              written along with any invalid ones that were reset
+****************************************************************************/
+uint8_t config_store_load(tConfigStore* store, const tConfigStorage* storage, const tConfigStorage* legacy)
+{
+    tConfigLoadContext load;
+
+    // older layouts are converted in place
+    load.Store = store;
+    load.Storage = storage;
+    load.Version = MigrateUserData(store, storage, legacy);
+
+    // everything needs writing unless found
+    store->ConfigDirty = CONFIG_ITEMS_ALL;
+    store->PresetDirty = PRESETS_ALL;
+    store->LoadReset = 0;
+
+    // one pass over everything stored
+    storage->Ops->ForEach(storage->Context, LoadUserDataEntry, (void*)&load);
+
+    // check values, migrated and loaded data skip the range check
+    for (uint32_t item = 0; item < CONFIG_ITEM_LAST; item++)
+    {
+        const tConfigItemInfo* info = &ConfigItemInfo[item];
+        uint32_t value;
+
+        if (info->Type != CONFIG_TYPE_INT)
+        {
+            continue;
+        }
+
+        value = ReadConfigItemInt(store, info);
+        if ((value < info->Min) || (value > info->Max))
+        {
+            WriteConfigItemInt(store, info, info->Default);
+            store->ConfigDirty |= CONFIG_ITEM_MASK(item);
+            store->LoadReset |= CONFIG_ITEM_MASK(item);
+        }
+    }
+
+    // write anything new or fixed
+    config_store_save(store, storage);
+
+    return load.Version;
+}
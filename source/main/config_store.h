@@ -0,0 +1,145 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ 
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "control.h"
+
+// Config items and presets held in RAM, and their load, save and migration
+// through a caller supplied storage. No hardware access, so the migration
+// chain can be run on the host against flash images
+
+#define MAX_TEXT_LENGTH                     128
+#define MAX_PRESETS_DEFAULT                 20
+#define MAX_BT_CUSTOM_NAME                  25
+#define CONFIG_STORE_VERSION                2                 // bump and add a ConfigMigrations entry when the stored form changes
+#define CONFIG_STORE_KEY_SIZE               16                // NVS key limit, including terminator
+
+typedef struct __attribute__ ((packed)) 
+{
+    uint16_t SkinIndex;
+    char PresetDescription[MAX_TEXT_LENGTH];
+} tUserData;
+
+// Up to V1.0.8 this whole struct was stored as one blob, so fields must
+// only ever be added to the end of it
+typedef struct __attribute__ ((packed)) 
+{
+    tUserData UserData[MAX_PRESETS_DEFAULT];
+
+    uint8_t BTMode;
+
+    // bt client flags. Bit 0 Mvave Chocolate, 1 Xvive MD1, 2 custom
+    uint16_t BTClientFlags;
+
+    // serial Midi flags. Bit 0 serial enable, 1 BT Midi CC
+    uint8_t MidiFlags;
+
+    uint8_t MidiChannel;
+
+    // general flags. Bit 0 double press toggle bypass, 1-2 screen rotation
+    uint16_t GeneralFlags;
+
+    uint8_t FootswitchMode;
+    char BTClientCustomName[MAX_BT_CUSTOM_NAME];
+
+    // wifi. Bits 0-3 mode, 4-7 tx power
+    uint8_t WiFiFlags;
+    char WifiSSID[MAX_WIFI_SSID_PW];
+    char WifiPassword[MAX_WIFI_SSID_PW];
+    char MDNSName[MAX_MDNS_NAME];
+
+    // external footswitches
+    uint8_t ExternalFootswitchPresetLayout;
+    tExternalFootswitchEffectConfig ExternalFootswitchEffectConfig[MAX_EXTERNAL_EFFECT_FOOTSWITCHES];
+
+    // footswitch action tables, text form
+    char FootswitchActions[MAX_FOOTSWITCH_ACTION_TEXT];
+    char ExternalFootswitchActions[MAX_FOOTSWITCH_ACTION_TEXT];
+
+    // expression pedal. Flags bits 0-1 curve, 2 calibrate
+    uint16_t ExpressionParam;
+    uint8_t ExpressionFlags;
+    uint16_t ExpressionHeel;
+    uint16_t ExpressionToe;
+
+    // user Midi routes, on top of the fixed routes to the pedal
+    tMidiRouteConfig MidiRoutes[MAX_MIDI_USER_ROUTES];
+} tConfigData;
+
+typedef struct
+{
+    tConfigData ConfigData;
+    uint64_t ConfigDirty;                        // bit per ConfigItems not yet saved
+    uint32_t PresetDirty;                        // bit per preset UserData not yet saved
+    uint64_t LoadReset;                          // bit per ConfigItems found invalid by the last load
+    tConfigSaveStats SaveStats;
+} tConfigStore;
+
+enum ConfigStorageTypes
+{
+    CONFIG_STORAGE_U8,
+    CONFIG_STORAGE_U32,
+    CONFIG_STORAGE_STRING,
+    CONFIG_STORAGE_BLOB,
+    CONFIG_STORAGE_OTHER
+};
+
+typedef void (*tConfigStorageEntry)(void* arg, const char* key, uint8_t type);
+
+// one storage namespace. All return 1 if OK
+typedef struct
+{
+    uint8_t (*GetU8)(void* context, const char* key, uint8_t* value);
+    uint8_t (*SetU8)(void* context, const char* key, uint8_t value);
+    uint8_t (*GetU32)(void* context, const char* key, uint32_t* value);
+    uint8_t (*SetU32)(void* context, const char* key, uint32_t value);
+    uint8_t (*GetString)(void* context, const char* key, char* text, size_t* length);
+    uint8_t (*SetString)(void* context, const char* key, const char* text);
+    uint8_t (*GetBlob)(void* context, const char* key, void* data, size_t* length);       // data NULL to get the length
+    uint8_t (*SetBlob)(void* context, const char* key, const void* data, size_t length);
+    uint8_t (*Erase)(void* context, const char* key);
+    uint8_t (*Commit)(void* context);
+    void (*ForEach)(void* context, tConfigStorageEntry entry, void* arg);                 // every key stored
+} tConfigStorageOps;
+
+typedef struct
+{
+    const tConfigStorageOps* Ops;
+    void* Context;
+} tConfigStorage;
+
+// config_store_set_int/string results
+enum ConfigStoreSetResults
+{
+    CONFIG_STORE_UNCHANGED,
+    CONFIG_STORE_CHANGED,
+    CONFIG_STORE_INVALID_ITEM,
+    CONFIG_STORE_OUT_OF_RANGE
+};
+
+const tConfigItemInfo* config_store_get_item_info(uint32_t item);
+void config_store_set_defaults(tConfigStore* store);
+uint32_t config_store_get_int(const tConfigStore* store, uint32_t item);
+uint8_t config_store_get_string(const tConfigStore* store, uint32_t item, char* text);
+uint8_t config_store_set_int(tConfigStore* store, uint32_t item, uint32_t value);
+uint8_t config_store_set_string(tConfigStore* store, uint32_t item, const char* text);
+uint8_t config_store_save(tConfigStore* store, const tConfigStorage* storage);
+uint8_t config_store_load(tConfigStore* store, const tConfigStorage* storage, const tConfigStorage* legacy);
@@ -17,6 +17,7 @@ limitations under the License.
 
 
 #include <inttypes.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
 #include "sdkconfig.h"
@@ -25,6 +26,7 @@ limitations under the License.
 #include "freertos/semphr.h"
 #include "esp_check.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "usb/usb_host.h"
 #include "driver/i2c.h"
 #include "nvs_flash.h"
@@ -40,14 +42,20 @@ limitations under the License.
 #include "footswitches.h"
 #include "display.h"
 #include "wifi_config.h"
+#include "midi_out.h"
+#include "leds.h"
 #include "task_priorities.h"
+#include "config_store.h"
 
 #define CTRL_TASK_STACK_SIZE                (3 * 1024)
-#define NVS_USERDATA_NAME                   "userdata"        
+#define NVS_LEGACY_NAMESPACE                "storage"         // legacy single blob config, migrated on load
+#define NVS_CONFIG_NAMESPACE                "config"
+#define CONFIG_SAVE_DELAY                   2000000           // usec, coalesces bursts of save requests
 
-#define MAX_TEXT_LENGTH                     128
-#define MAX_PRESETS_DEFAULT                 20
-#define MAX_BT_CUSTOM_NAME                  25                 
+#define CONTROL_QUEUE_LENGTH                20
+#define CONTROL_TEXT_SLOTS                  6                 // text messages in flight
+#define CONTROL_TEXT_NONE                   0                 // slots are 1 based
+#define CONTROL_STATS_INTERVAL              30000             // msec
 
 enum CommandEvents
 {
@@ -62,62 +70,34 @@ enum CommandEvents
     EVENT_SAVE_USER_DATA,
     EVENT_SET_USER_TEXT,
     EVENT_SET_CONFIG_ITEM_INT,
-    EVENT_SET_CONFIG_ITEM_STRING
+    EVENT_SET_CONFIG_ITEM_STRING,
+    EVENT_FLUSH_USER_DATA,
+    EVENT_CONFIG_COMMIT,
+    EVENT_LAST
 };
 
+// kept small, strings travel in the text pool
 typedef struct
 {
     uint8_t Event;
-    char Text[MAX_TEXT_LENGTH];
-    uint32_t Value;
-    uint32_t Item;
+    uint8_t Text;                       // text pool slot, or CONTROL_TEXT_NONE
+    uint16_t Item;
+    union
+    {
+        uint32_t Value;
+        void* Object;
+    };
+    uint32_t QueuedTime;                // usec, low 32 bits of esp_timer
 } tControlMessage;
 
-typedef struct __attribute__ ((packed)) 
-{
-    uint16_t SkinIndex;
-    char PresetDescription[MAX_TEXT_LENGTH];
-} tUserData;
-
-
-typedef struct __attribute__ ((packed)) 
+typedef struct
 {
-    tUserData UserData[MAX_PRESETS_DEFAULT];
-
-    uint8_t BTMode;
-
-    // bt client flags
-    uint16_t BTClientMvaveChocolateEnable: 1;
-    uint16_t BTClientXviveMD1Enable: 1;
-    uint16_t BTClientCustomEnable: 1;
-    uint16_t BTClientSpares: 13;
-
-    // serial Midi flags
-    uint8_t MidiSerialEnable: 1;
-    uint8_t EnableBTmidiCC: 1;
-    uint8_t MidiSpares: 6;
+    uint32_t Count;
+    uint32_t LatencyMax;
+    uint64_t LatencyTotal;
+} tControlEventCounters;
 
-    uint8_t MidiChannel;
-
-    // general flags
-    uint16_t GeneralDoublePressToggleBypass: 1;
-    uint16_t GeneralScreenRotation: 2;
-    uint16_t GeneralSpare: 13;
-
-    uint8_t FootswitchMode;
-    char BTClientCustomName[MAX_BT_CUSTOM_NAME];
-
-    // wifi
-    uint8_t WiFiMode : 4;
-    uint8_t WifiTxPower : 4;
-    char WifiSSID[MAX_WIFI_SSID_PW];
-    char WifiPassword[MAX_WIFI_SSID_PW];
-    char MDNSName[MAX_MDNS_NAME];
-
-    // external footswitches
-    uint8_t ExternalFootswitchPresetLayout;
-    tExternalFootswitchEffectConfig ExternalFootswitchEffectConfig[MAX_EXTERNAL_EFFECT_FOOTSWITCHES];
-} tConfigData;
+_Static_assert(EVENT_LAST <= MAX_CONTROL_EVENTS, "MAX_CONTROL_EVENTS too small");
 
 typedef struct 
 {
@@ -126,16 +106,300 @@ typedef struct
     uint32_t USBStatus;
     uint32_t BTStatus;
     uint32_t WiFiStatus;
-    tConfigData ConfigData;
+    tConfigStore Store;                          // config items and presets
 } tControlData;
 
+// an NVS namespace for the config store, opened on first use
+typedef struct
+{
+    const char* Namespace;
+    nvs_handle_t Handle;
+    uint8_t Opened;
+} tControlNVS;
+
 static const char *TAG = "app_control";
 static QueueHandle_t control_input_queue;
+static TaskHandle_t control_task_handle;
 static tControlData ControlData;
+static esp_timer_handle_t save_timer;
+static SemaphoreHandle_t config_commit_mutex;
+static SemaphoreHandle_t config_commit_done;
+static SemaphoreHandle_t config_handler_mutex;
+static char ControlTextPool[CONTROL_TEXT_SLOTS][MAX_TEXT_LENGTH];
+static uint32_t ControlTextFree = (1 << CONTROL_TEXT_SLOTS) - 1;
+static portMUX_TYPE control_text_lock = portMUX_INITIALIZER_UNLOCKED;
+static tControlEventCounters ControlEventCounters[EVENT_LAST];
+static tControlQueueStats ControlQueueStats;
+
+typedef struct
+{
+    uint64_t Items;                         // CONFIG_ITEM_MASK() bits
+    tConfigChangedHandler Handler;
+} tConfigHandler;
+
+static tConfigHandler ConfigHandlers[MAX_CONFIG_HANDLERS];
+static uint8_t ConfigHandlerCount;
 
 static uint8_t SaveUserData(void);
 static uint8_t LoadUserData(void);
 
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Set an int config item
+* PARAMETERS:  
+* RETURN:      1 if changed
+* NOTES:       Out of range values are ignored. Marks the item for saving
+*              if it changed
+*****************************************************************************/
+static uint8_t SetConfigItemInt(uint32_t item, uint32_t value)
+{
+    uint8_t result = config_store_set_int(&ControlData.Store, item, value);
+
+    if (result == CONFIG_STORE_INVALID_ITEM)
+    {
+        ESP_LOGE(TAG, "Unknown/Invalid int parameter item %d", (int)item);
+    }
+    else if (result == CONFIG_STORE_OUT_OF_RANGE)
+    {
+        ESP_LOGW(TAG, "Config %s value %d out of range", config_store_get_item_info(item)->JsonKey, (int)value);
+    }
+    else if (result == CONFIG_STORE_CHANGED)
+    {
+        ESP_LOGI(TAG, "Config set %s %d", config_store_get_item_info(item)->JsonKey, (int)value);
+    }
+
+    return result == CONFIG_STORE_CHANGED;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Set a string config item
+* PARAMETERS:  
+* RETURN:      1 if changed
+* NOTES:       Marks the item for saving if it changed
+*****************************************************************************/
+static uint8_t SetConfigItemString(uint32_t item, char* text)
+{
+    uint8_t result = config_store_set_string(&ControlData.Store, item, text);
+    const tConfigItemInfo* info = config_store_get_item_info(item);
+
+    if (result == CONFIG_STORE_INVALID_ITEM)
+    {
+        ESP_LOGE(TAG, "Unknown/Invalid string parameter item %d", (int)item);
+    }
+    else if (result == CONFIG_STORE_CHANGED)
+    {
+        ESP_LOGI(TAG, "Config set %s %s", info->JsonKey, (info->Flags & CONFIG_FLAG_HIDDEN) ? "<hidden>" : text);
+    }
+
+    return result == CONFIG_STORE_CHANGED;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Tell subscribers about changed config items
+* PARAMETERS:  changed: CONFIG_ITEM_MASK() bits
+* RETURN:      1 if a changed item needs a restart to take effect
+* NOTES:       Runs in the control task
+*****************************************************************************/
+static uint8_t NotifyConfigChanged(uint64_t changed)
+{
+    uint8_t reboot = 0;
+
+    if (changed == 0)
+    {
+        return 0;
+    }
+
+    for (uint32_t item = 0; item < CONFIG_ITEM_LAST; item++)
+    {
+        if ((changed & CONFIG_ITEM_MASK(item)) && (config_store_get_item_info(item)->Flags & CONFIG_FLAG_REBOOT))
+        {
+            reboot = 1;
+        }
+    }
+
+    xSemaphoreTake(config_handler_mutex, portMAX_DELAY);
+
+    for (uint8_t loop = 0; loop < ConfigHandlerCount; loop++)
+    {
+        if (ConfigHandlers[loop].Items & changed)
+        {
+            ConfigHandlers[loop].Handler(ConfigHandlers[loop].Items & changed);
+        }
+    }
+
+    xSemaphoreGive(config_handler_mutex);
+
+    return reboot;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Take a text pool slot and fill it
+* PARAMETERS:  prefix: optional, text: copied after prefix
+* RETURN:      slot number, or CONTROL_TEXT_NONE if the pool is empty
+* NOTES:       Any task. The slot goes back when the control task is done
+*****************************************************************************/
+static uint8_t AllocControlText(const char* prefix, const char* text)
+{
+    uint8_t slot = CONTROL_TEXT_NONE;
+    uint8_t used;
+    char* buffer;
+
+    taskENTER_CRITICAL(&control_text_lock);
+    if (ControlTextFree != 0)
+    {
+        slot = __builtin_ctz(ControlTextFree) + 1;
+        ControlTextFree &= ~(1 << (slot - 1));
+
+        used = CONTROL_TEXT_SLOTS - __builtin_popcount(ControlTextFree);
+        if (used > ControlQueueStats.TextHighWater)
+        {
+            ControlQueueStats.TextHighWater = used;
+        }
+    }
+    else
+    {
+        ControlQueueStats.TextFailed++;
+    }
+    taskEXIT_CRITICAL(&control_text_lock);
+
+    if (slot == CONTROL_TEXT_NONE)
+    {
+        return CONTROL_TEXT_NONE;
+    }
+
+    buffer = ControlTextPool[slot - 1];
+    buffer[0] = 0;
+
+    if (prefix != NULL)
+    {
+        strncat(buffer, prefix, MAX_TEXT_LENGTH - 1);
+    }
+    strncat(buffer, text, MAX_TEXT_LENGTH - 1 - strlen(buffer));
+
+    return slot;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Return a text pool slot
+* PARAMETERS:  
+* RETURN:      none
+* NOTES:       
+*****************************************************************************/
+static void FreeControlText(uint8_t slot)
+{
+    if (slot == CONTROL_TEXT_NONE)
+    {
+        return;
+    }
+
+    taskENTER_CRITICAL(&control_text_lock);
+    ControlTextFree |= (1 << (slot - 1));
+    taskEXIT_CRITICAL(&control_text_lock);
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Queue a message for the control task
+* PARAMETERS:  wait: ticks to wait for queue space
+* RETURN:      ESP_OK if queued
+* NOTES:       The text slot is released if the queue is full
+*****************************************************************************/
+static esp_err_t SendControlMessage(tControlMessage* message, TickType_t wait)
+{
+    message->QueuedTime = (uint32_t)esp_timer_get_time();
+
+    if (xQueueSend(control_input_queue, (void*)message, wait) != pdPASS)
+    {
+        ControlQueueStats.SendFailed++;
+        FreeControlText(message->Text);
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Update queue stats for a received message
+* PARAMETERS:  
+* RETURN:      none
+* NOTES:       Control task only
+*****************************************************************************/
+static void UpdateControlQueueStats(tControlMessage* message)
+{
+    uint32_t latency = (uint32_t)esp_timer_get_time() - message->QueuedTime;
+    uint16_t waiting = uxQueueMessagesWaiting(control_input_queue) + 1;
+    tControlEventCounters* counters;
+
+    if (waiting > ControlQueueStats.HighWater)
+    {
+        ControlQueueStats.HighWater = waiting;
+    }
+
+    if (message->Event >= EVENT_LAST)
+    {
+        return;
+    }
+
+    counters = &ControlEventCounters[message->Event];
+    counters->Count++;
+    counters->LatencyTotal += latency;
+    if (latency > counters->LatencyMax)
+    {
+        counters->LatencyMax = latency;
+    }
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Log queue stats
+* PARAMETERS:  
+* RETURN:      none
+* NOTES:       
+*****************************************************************************/
+static void LogControlQueueStats(void)
+{
+    tControlQueueStats stats;
+
+    control_get_queue_stats(&stats);
+
+    ESP_LOGI(TAG, "Queue high water %d/%d send failed %d, text high water %d/%d failed %d", (int)stats.HighWater, CONTROL_QUEUE_LENGTH, 
+             (int)stats.SendFailed, (int)stats.TextHighWater, CONTROL_TEXT_SLOTS, (int)stats.TextFailed);
+
+    for (uint8_t loop = 0; loop < EVENT_LAST; loop++)
+    {
+        if (stats.Events[loop].Count != 0)
+        {
+            ESP_LOGI(TAG, "Event %d: count %d latency avg %d max %d usec", (int)loop, (int)stats.Events[loop].Count, 
+                     (int)stats.Events[loop].LatencyAvg, (int)stats.Events[loop].LatencyMax);
+        }
+    }
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Save timer expired
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       esp_timer callback, the save is done in the control task
+*****************************************************************************/
+static void save_timer_callback(void* arg)
+{
+    tControlMessage message = {0};
+
+    message.Event = EVENT_FLUSH_USER_DATA;
+
+    // send to queue
+    if (SendControlMessage(&message, 0) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "save_timer_callback queue send failed!");            
+    }
+}
+
 /****************************************************************************
 * NAME:        
 * DESCRIPTION: 
@@ -145,8 +409,15 @@ static uint8_t LoadUserData(void);
 *****************************************************************************/
 static uint8_t process_control_command(tControlMessage* message)
 {
+    char* text = NULL;
+
     ESP_LOGI(TAG, "Control command %d", message->Event);
 
+    if (message->Text != CONTROL_TEXT_NONE)
+    {
+        text = ControlTextPool[message->Text - 1];
+    }
+
     // check what we got
     switch (message->Event)
     {
@@ -181,18 +452,24 @@ static uint8_t process_control_command(tControlMessage* message)
         {
             ControlData.PresetIndex = message->Value;
 
-            memcpy((void*)ControlData.PresetName, (void*)message->Text, MAX_TEXT_LENGTH);
+            strncpy(ControlData.PresetName, text, MAX_TEXT_LENGTH - 1);
             ControlData.PresetName[MAX_TEXT_LENGTH - 1] = 0;
 
 #if CONFIG_TONEX_CONTROLLER_HAS_DISPLAY
             // update UI
             UI_SetPresetLabel(ControlData.PresetName);
-            UI_SetAmpSkin(ControlData.ConfigData.UserData[ControlData.PresetIndex].SkinIndex);
-            UI_SetPresetDescription(ControlData.ConfigData.UserData[ControlData.PresetIndex].PresetDescription);
+            UI_SetAmpSkin(ControlData.Store.ConfigData.UserData[ControlData.PresetIndex].SkinIndex);
+            UI_SetPresetDescription(ControlData.Store.ConfigData.UserData[ControlData.PresetIndex].PresetDescription);
 #endif
 
             // update web UI
             wifi_request_sync(WIFI_SYNC_TYPE_PRESET, (void*)ControlData.PresetName, (void*)&ControlData.PresetIndex);
+
+            // update Midi controllers
+            midi_out_sync_preset(ControlData.PresetIndex);
+
+            // status led colour
+            leds_set_preset(ControlData.PresetIndex);
         } break;
 
         case EVENT_SET_USB_STATUS:
@@ -227,272 +504,106 @@ static uint8_t process_control_command(tControlMessage* message)
 
         case EVENT_SET_AMP_SKIN:
         {
-            ControlData.ConfigData.UserData[ControlData.PresetIndex].SkinIndex = message->Value;
+            ControlData.Store.ConfigData.UserData[ControlData.PresetIndex].SkinIndex = message->Value;
+            ControlData.Store.PresetDirty |= (1UL << ControlData.PresetIndex);
 
 #if CONFIG_TONEX_CONTROLLER_HAS_DISPLAY
             // update UI
-            UI_SetAmpSkin(ControlData.ConfigData.UserData[ControlData.PresetIndex].SkinIndex);
+            UI_SetAmpSkin(ControlData.Store.ConfigData.UserData[ControlData.PresetIndex].SkinIndex);
 #endif 
         } break;
 
         case EVENT_SAVE_USER_DATA:
         {
-            // save it
-            SaveUserData();
-
             if (message->Value != 0)
             {
+                // save it now
+                esp_timer_stop(save_timer);
+                SaveUserData();
+
                 ESP_LOGI(TAG, "Config save rebooting");
                 vTaskDelay(10);
                 esp_restart();
             }
+            else
+            {
+                // save after a short delay, so a burst of requests is one write
+                esp_timer_stop(save_timer);
+                esp_timer_start_once(save_timer, CONFIG_SAVE_DELAY);
+            }
         } break;
 
-        case EVENT_SET_USER_TEXT:
+        case EVENT_FLUSH_USER_DATA:
         {
-            memcpy((void*)ControlData.ConfigData.UserData[ControlData.PresetIndex].PresetDescription, (void*)message->Text, MAX_TEXT_LENGTH);
-            ControlData.ConfigData.UserData[ControlData.PresetIndex].PresetDescription[MAX_TEXT_LENGTH - 1] = 0;
+            SaveUserData();
         } break;
 
-        case EVENT_SET_CONFIG_ITEM_INT:
+        case EVENT_CONFIG_COMMIT:
         {
-            switch (message->Item)
-            {
-                case CONFIG_ITEM_BT_MODE:
-                {
-                    ESP_LOGI(TAG, "Config set BT mode %d", (int)message->Value);
-                    ControlData.ConfigData.BTMode = (uint8_t)message->Value;
-                } break;
-
-                case CONFIG_ITEM_MV_CHOC_ENABLE:
-                {
-                    ESP_LOGI(TAG, "Config set MV Choc enable %d", (int)message->Value);
-                    ControlData.ConfigData.BTClientMvaveChocolateEnable = (uint8_t)message->Value;
-                } break;
-
-                case CONFIG_ITEM_XV_MD1_ENABLE:
-                {
-                    ESP_LOGI(TAG, "Config set XV MD1 enable %d", (int)message->Value);
-                    ControlData.ConfigData.BTClientXviveMD1Enable = (uint8_t)message->Value;
-                } break;
-
-                case CONFIG_ITEM_CUSTOM_BT_ENABLE:
-                {
-                    ESP_LOGI(TAG, "Config set custom BT enable %d", (int)message->Value);
-                    ControlData.ConfigData.BTClientCustomEnable = (uint8_t)message->Value;
-                } break;
-                
-                case CONFIG_ITEM_MIDI_ENABLE:
-                {
-                    ESP_LOGI(TAG, "Config set Midi enable %d", (int)message->Value);
-                    ControlData.ConfigData.MidiSerialEnable = (uint8_t)message->Value;
-                } break;
-
-                case CONFIG_ITEM_MIDI_CHANNEL:
-                {
-                    ESP_LOGI(TAG, "Config set Midi channel %d", (int)message->Value);
-                    ControlData.ConfigData.MidiChannel = (uint8_t)message->Value;
-                } break;
-
-                case CONFIG_ITEM_TOGGLE_BYPASS:
-                {
-                    ESP_LOGI(TAG, "Config set Toggle Bypass %d", (int)message->Value);
-                    ControlData.ConfigData.GeneralDoublePressToggleBypass = (uint8_t)message->Value;
-                } break;
-
-                case CONFIG_ITEM_FOOTSWITCH_MODE:
-                {
-                    ESP_LOGI(TAG, "Config set Footswitch Mode %d", (int)message->Value);
-                    ControlData.ConfigData.FootswitchMode = (uint8_t)message->Value;
-                } break;
-
-                case CONFIG_ITEM_ENABLE_BT_MIDI_CC:
-                {
-                    ESP_LOGI(TAG, "Config set BT Midi CC enable %d", (int)message->Value);
-                    ControlData.ConfigData.EnableBTmidiCC = (uint8_t)message->Value;
-                } break;
+            tConfigTransaction* transaction = (tConfigTransaction*)message->Object;
+            uint64_t changed = 0;
+            uint8_t item_changed;
 
-                case CONFIG_ITEM_WIFI_MODE:
-                {
-                    ESP_LOGI(TAG, "Config set WiFi modee %d", (int)message->Value);
-                    ControlData.ConfigData.WiFiMode = (uint8_t)message->Value;
-                } break;
-
-                case CONFIG_ITEM_SCREEN_ROTATION:
-                {
-                    ESP_LOGI(TAG, "Config set screen rotation %d", (int)message->Value);
-                    ControlData.ConfigData.GeneralScreenRotation = (uint8_t)message->Value & 0x03;
-                } break;
-
-                case CONFIG_ITEM_WIFI_TX_POWER:
-                {
-                    ESP_LOGI(TAG, "Config set wifi tx power %d", (int)message->Value);
-                    ControlData.ConfigData.WifiTxPower = (uint8_t)message->Value & 0x0F;
-                } break;
-
-                case CONFIG_ITEM_EXT_FOOTSW_PRESET_LAYOUT:
-                {
-                    ESP_LOGI(TAG, "Config set external footsw preset layout %d", (int)message->Value);
-                    ControlData.ConfigData.ExternalFootswitchPresetLayout = (uint8_t)message->Value;
-                } break;
-
-                case CONFIG_ITEM_EXT_FOOTSW_EFFECT1_SW:
-                {
-                    ESP_LOGI(TAG, "Config set external footsw effect1 sw %d", (int)message->Value);
-                    ControlData.ConfigData.ExternalFootswitchEffectConfig[0].Switch = (uint8_t)message->Value;
-                } break;
-
-                case CONFIG_ITEM_EXT_FOOTSW_EFFECT1_CC:
-                {
-                    ESP_LOGI(TAG, "Config set external footsw effect1 CC %d", (int)message->Value);
-                    ControlData.ConfigData.ExternalFootswitchEffectConfig[0].CC = (uint8_t)message->Value;
-                } break;
-
-                case CONFIG_ITEM_EXT_FOOTSW_EFFECT1_VAL1:
-                {
-                    ESP_LOGI(TAG, "Config set external footsw effect1 Value_1 %d", (int)message->Value);
-                    ControlData.ConfigData.ExternalFootswitchEffectConfig[0].Value_1 = (uint8_t)message->Value;
-                } break;
-
-                case CONFIG_ITEM_EXT_FOOTSW_EFFECT1_VAL2:
-                {
-                    ESP_LOGI(TAG, "Config set external footsw effect1 Value_2 %d", (int)message->Value);
-                    ControlData.ConfigData.ExternalFootswitchEffectConfig[0].Value_2 = (uint8_t)message->Value;
-                } break;
-
-                case CONFIG_ITEM_EXT_FOOTSW_EFFECT2_SW:
-                {
-                    ESP_LOGI(TAG, "Config set external footsw effect2 sw %d", (int)message->Value);
-                    ControlData.ConfigData.ExternalFootswitchEffectConfig[1].Switch = (uint8_t)message->Value;
-                } break;
-
-                case CONFIG_ITEM_EXT_FOOTSW_EFFECT2_CC:
-                {
-                    ESP_LOGI(TAG, "Config set external footsw effect2 CC %d", (int)message->Value);
-                    ControlData.ConfigData.ExternalFootswitchEffectConfig[1].CC = (uint8_t)message->Value;
-                } break;
-
-                case CONFIG_ITEM_EXT_FOOTSW_EFFECT2_VAL1:
-                {
-                    ESP_LOGI(TAG, "Config set external footsw effect2 Value_1 %d", (int)message->Value);
-                    ControlData.ConfigData.ExternalFootswitchEffectConfig[1].Value_1 = (uint8_t)message->Value;
-                } break;
-
-                case CONFIG_ITEM_EXT_FOOTSW_EFFECT2_VAL2:
-                {
-                    ESP_LOGI(TAG, "Config set external footsw effect2 Value_2 %d", (int)message->Value);
-                    ControlData.ConfigData.ExternalFootswitchEffectConfig[1].Value_2 = (uint8_t)message->Value;
-                } break;
-
-                case CONFIG_ITEM_EXT_FOOTSW_EFFECT3_SW:
-                {
-                    ESP_LOGI(TAG, "Config set external footsw effect3 sw %d", (int)message->Value);
-                    ControlData.ConfigData.ExternalFootswitchEffectConfig[2].Switch = (uint8_t)message->Value;
-                } break;
-
-                case CONFIG_ITEM_EXT_FOOTSW_EFFECT3_CC:
-                {
-                    ESP_LOGI(TAG, "Config set external footsw effect3 CC %d", (int)message->Value);
-                    ControlData.ConfigData.ExternalFootswitchEffectConfig[2].CC = (uint8_t)message->Value;
-                } break;
-
-                case CONFIG_ITEM_EXT_FOOTSW_EFFECT3_VAL1:
-                {
-                    ESP_LOGI(TAG, "Config set external footsw effect3 Value_1 %d", (int)message->Value);
-                    ControlData.ConfigData.ExternalFootswitchEffectConfig[2].Value_1 = (uint8_t)message->Value;
-                } break;
-
-                case CONFIG_ITEM_EXT_FOOTSW_EFFECT3_VAL2:
+            for (uint32_t item = 0; item < CONFIG_ITEM_LAST; item++)
+            {
+                if ((transaction->Items & CONFIG_ITEM_MASK(item)) == 0)
                 {
-                    ESP_LOGI(TAG, "Config set external footsw effect3 Value_2 %d", (int)message->Value);
-                    ControlData.ConfigData.ExternalFootswitchEffectConfig[2].Value_2 = (uint8_t)message->Value;
-                } break;
+                    continue;
+                }
 
-                case CONFIG_ITEM_EXT_FOOTSW_EFFECT4_SW:
+                if (config_store_get_item_info(item)->Type == CONFIG_TYPE_STRING)
                 {
-                    ESP_LOGI(TAG, "Config set external footsw effect4 sw %d", (int)message->Value);
-                    ControlData.ConfigData.ExternalFootswitchEffectConfig[3].Switch = (uint8_t)message->Value;
-                } break;
-
-                case CONFIG_ITEM_EXT_FOOTSW_EFFECT4_CC:
+                    item_changed = SetConfigItemString(item, &transaction->TextPool[transaction->Values[item]]);
+                }
+                else
                 {
-                    ESP_LOGI(TAG, "Config set external footsw effect4 CC %d", (int)message->Value);
-                    ControlData.ConfigData.ExternalFootswitchEffectConfig[3].CC = (uint8_t)message->Value;
-                } break;
+                    item_changed = SetConfigItemInt(item, transaction->Values[item]);
+                }
 
-                case CONFIG_ITEM_EXT_FOOTSW_EFFECT4_VAL1:
+                if (item_changed)
                 {
-                    ESP_LOGI(TAG, "Config set external footsw effect4 Value_1 %d", (int)message->Value);
-                    ControlData.ConfigData.ExternalFootswitchEffectConfig[3].Value_1 = (uint8_t)message->Value;
-                } break;
+                    changed |= CONFIG_ITEM_MASK(item);
+                }
+            }
 
-                case CONFIG_ITEM_EXT_FOOTSW_EFFECT4_VAL2:
-                {
-                    ESP_LOGI(TAG, "Config set external footsw effect4 Value_2 %d", (int)message->Value);
-                    ControlData.ConfigData.ExternalFootswitchEffectConfig[3].Value_2 = (uint8_t)message->Value;
-                } break;
+            // one write for the lot
+            esp_timer_stop(save_timer);
+            transaction->Result = SaveUserData() ? ESP_OK : ESP_FAIL;
 
-                case CONFIG_ITEM_EXT_FOOTSW_EFFECT5_SW:
-                {
-                    ESP_LOGI(TAG, "Config set external footsw effect5 sw %d", (int)message->Value);
-                    ControlData.ConfigData.ExternalFootswitchEffectConfig[4].Switch = (uint8_t)message->Value;
-                } break;
+            // apply live where possible
+            transaction->RebootNeeded = NotifyConfigChanged(changed);
+            ESP_LOGI(TAG, "Config commit %s, reboot %d", esp_err_to_name(transaction->Result), (int)transaction->RebootNeeded);
 
-                case CONFIG_ITEM_EXT_FOOTSW_EFFECT5_CC:
-                {
-                    ESP_LOGI(TAG, "Config set external footsw effect5 CC %d", (int)message->Value);
-                    ControlData.ConfigData.ExternalFootswitchEffectConfig[4].CC = (uint8_t)message->Value;
-                } break;
+            // caller owns the transaction, don't touch it after this
+            xSemaphoreGive(config_commit_done);
+        } break;
 
-                case CONFIG_ITEM_EXT_FOOTSW_EFFECT5_VAL1:
-                {
-                    ESP_LOGI(TAG, "Config set external footsw effect5 Value_1 %d", (int)message->Value);
-                    ControlData.ConfigData.ExternalFootswitchEffectConfig[4].Value_1 = (uint8_t)message->Value;
-                } break;
+        case EVENT_SET_USER_TEXT:
+        {
+            strncpy(ControlData.Store.ConfigData.UserData[ControlData.PresetIndex].PresetDescription, text, MAX_TEXT_LENGTH - 1);
+            ControlData.Store.ConfigData.UserData[ControlData.PresetIndex].PresetDescription[MAX_TEXT_LENGTH - 1] = 0;
+            ControlData.Store.PresetDirty |= (1UL << ControlData.PresetIndex);
+        } break;
 
-                case CONFIG_ITEM_EXT_FOOTSW_EFFECT5_VAL2:
-                {
-                    ESP_LOGI(TAG, "Config set external footsw effect5 Value_2 %d", (int)message->Value);
-                    ControlData.ConfigData.ExternalFootswitchEffectConfig[4].Value_2 = (uint8_t)message->Value;
-                } break;
+        case EVENT_SET_CONFIG_ITEM_INT:
+        {
+            if (SetConfigItemInt(message->Item, message->Value))
+            {
+                NotifyConfigChanged(CONFIG_ITEM_MASK(message->Item));
             }
         } break;
 
         case EVENT_SET_CONFIG_ITEM_STRING:
         {
-            switch (message->Item)
+            if (SetConfigItemString(message->Item, text))
             {
-                case CONFIG_ITEM_BT_CUSTOM_NAME:
-                {
-                    ESP_LOGI(TAG, "Config set custom BT name %s", message->Text);
-                    strncpy(ControlData.ConfigData.BTClientCustomName, message->Text, MAX_BT_CUSTOM_NAME - 1);
-                    ControlData.ConfigData.BTClientCustomName[MAX_BT_CUSTOM_NAME - 1] = 0;
-                } break;
-
-                case CONFIG_ITEM_WIFI_SSID:
-                {
-                    ESP_LOGI(TAG, "Config set WiFi SSID %s", message->Text);
-                    strncpy(ControlData.ConfigData.WifiSSID, message->Text, MAX_WIFI_SSID_PW - 1);
-                    ControlData.ConfigData.WifiSSID[MAX_WIFI_SSID_PW - 1] = 0;
-                } break;
-
-                case CONFIG_ITEM_WIFI_PASSWORD:
-                {
-                    ESP_LOGI(TAG, "Config set WiFi password <hidden>");
-                    strncpy(ControlData.ConfigData.WifiPassword, message->Text, MAX_WIFI_SSID_PW - 1);
-                    ControlData.ConfigData.WifiPassword[MAX_WIFI_SSID_PW - 1] = 0;
-                } break;
-
-                case CONFIG_ITEM_MDNS_NAME:
-                {
-                    ESP_LOGI(TAG, "Config set MDNS name %s", message->Text);
-                    strncpy(ControlData.ConfigData.MDNSName, message->Text, MAX_MDNS_NAME - 1);
-                    ControlData.ConfigData.MDNSName[MAX_MDNS_NAME - 1] = 0;
-                } break;
+                NotifyConfigChanged(CONFIG_ITEM_MASK(message->Item));
             }
         } break;
     }
 
+    FreeControlText(message->Text);
+
     return 1;
 }
 
@@ -505,14 +616,14 @@ static uint8_t process_control_command(tControlMessage* message)
 *****************************************************************************/
 void control_request_preset_down(void)
 {
-    tControlMessage message;
+    tControlMessage message = {0};
 
     ESP_LOGI(TAG, "control_request_preset_down");            
 
     message.Event = EVENT_PRESET_DOWN;
 
     // send to queue
-    if (xQueueSend(control_input_queue, (void*)&message, 0) != pdPASS)
+    if (SendControlMessage(&message, 0) != ESP_OK)
     {
         ESP_LOGE(TAG, "control_request_preset_down queue send failed!");            
     }
@@ -527,14 +638,14 @@ void control_request_preset_down(void)
 *****************************************************************************/
 void control_request_preset_up(void)
 {
-    tControlMessage message;
+    tControlMessage message = {0};
 
     ESP_LOGI(TAG, "control_request_preset_up");
 
     message.Event = EVENT_PRESET_UP;
 
     // send to queue
-    if (xQueueSend(control_input_queue, (void*)&message, 0) != pdPASS)
+    if (SendControlMessage(&message, 0) != ESP_OK)
     {
         ESP_LOGE(TAG, "control_request_preset_up queue send failed!");            
     }
@@ -549,7 +660,7 @@ void control_request_preset_up(void)
 *****************************************************************************/
 void control_request_preset_index(uint8_t index)
 {
-    tControlMessage message;
+    tControlMessage message = {0};
 
     ESP_LOGI(TAG, "control_request_preset_index %d", index);
 
@@ -557,7 +668,7 @@ void control_request_preset_index(uint8_t index)
     message.Value = index;
 
     // send to queue
-    if (xQueueSend(control_input_queue, (void*)&message, 0) != pdPASS)
+    if (SendControlMessage(&message, 0) != ESP_OK)
     {
         ESP_LOGE(TAG, "control_request_preset_index queue send failed!");            
     }
@@ -572,17 +683,23 @@ void control_request_preset_index(uint8_t index)
 *****************************************************************************/
 void control_sync_preset_details(uint16_t index, char* name)
 {
-    tControlMessage message;
+    tControlMessage message = {0};
+    char prefix[8];
 
     ESP_LOGI(TAG, "control_sync_preset_details");            
 
     message.Event = EVENT_SET_PRESET_DETAILS;
     message.Value = index;
-    sprintf(message.Text, "%d: ", (int)index + 1);
-    strncat(message.Text, name, MAX_TEXT_LENGTH - 1);
+    sprintf(prefix, "%d: ", (int)index + 1);
+    message.Text = AllocControlText(prefix, name);
+    if (message.Text == CONTROL_TEXT_NONE)
+    {
+        ESP_LOGE(TAG, "control_sync_preset_details text pool empty!");
+        return;
+    }
 
     // send to queue
-    if (xQueueSend(control_input_queue, (void*)&message, 0) != pdPASS)
+    if (SendControlMessage(&message, 0) != ESP_OK)
     {
         ESP_LOGE(TAG, "control_sync_preset_details queue send failed!");            
     }
@@ -597,15 +714,20 @@ void control_sync_preset_details(uint16_t index, char* name)
 *****************************************************************************/
 void control_set_user_text(char* text)
 {
-    tControlMessage message;
+    tControlMessage message = {0};
 
     ESP_LOGI(TAG, "control_set_user_text");            
 
     message.Event = EVENT_SET_USER_TEXT;
-    strncat(message.Text, text, MAX_TEXT_LENGTH - 1);
+    message.Text = AllocControlText(NULL, text);
+    if (message.Text == CONTROL_TEXT_NONE)
+    {
+        ESP_LOGE(TAG, "control_set_user_text text pool empty!");
+        return;
+    }
 
     // send to queue
-    if (xQueueSend(control_input_queue, (void*)&message, 0) != pdPASS)
+    if (SendControlMessage(&message, 0) != ESP_OK)
     {
         ESP_LOGE(TAG, "control_set_user_text queue send failed!");            
     }
@@ -620,7 +742,7 @@ void control_set_user_text(char* text)
 *****************************************************************************/
 void control_set_usb_status(uint32_t status)
 {
-    tControlMessage message;
+    tControlMessage message = {0};
 
     ESP_LOGI(TAG, "control_set_usb_status");
 
@@ -628,7 +750,7 @@ void control_set_usb_status(uint32_t status)
     message.Value = status;
 
     // send to queue
-    if (xQueueSend(control_input_queue, (void*)&message, 0) != pdPASS)
+    if (SendControlMessage(&message, 0) != ESP_OK)
     {
         ESP_LOGE(TAG, "control_set_usb_status queue send failed!");            
     }
@@ -643,7 +765,7 @@ void control_set_usb_status(uint32_t status)
 *****************************************************************************/
 void control_set_bt_status(uint32_t status)
 {
-    tControlMessage message;
+    tControlMessage message = {0};
 
     ESP_LOGI(TAG, "control_set_bt_status");
 
@@ -651,7 +773,7 @@ void control_set_bt_status(uint32_t status)
     message.Value = status;
 
     // send to queue
-    if (xQueueSend(control_input_queue, (void*)&message, 0) != pdPASS)
+    if (SendControlMessage(&message, 0) != ESP_OK)
     {
         ESP_LOGE(TAG, "control_set_usb_status queue send failed!");            
     }
@@ -666,7 +788,7 @@ void control_set_bt_status(uint32_t status)
 *****************************************************************************/
 void control_set_wifi_status(uint32_t status)
 {
-    tControlMessage message;
+    tControlMessage message = {0};
 
     ESP_LOGI(TAG, "control_set_wifi_status %d", (int)status);
 
@@ -674,7 +796,7 @@ void control_set_wifi_status(uint32_t status)
     message.Value = status;
 
     // send to queue
-    if (xQueueSend(control_input_queue, (void*)&message, 0) != pdPASS)
+    if (SendControlMessage(&message, 0) != ESP_OK)
     {
         ESP_LOGE(TAG, "control_set_wifi_status queue send failed!");            
     }
@@ -689,7 +811,7 @@ void control_set_wifi_status(uint32_t status)
 *****************************************************************************/
 void control_save_user_data(uint8_t reboot)
 {
-    tControlMessage message;
+    tControlMessage message = {0};
 
     ESP_LOGI(TAG, "control_save_user_data");
 
@@ -697,7 +819,7 @@ void control_save_user_data(uint8_t reboot)
     message.Value = reboot;
 
     // send to queue
-    if (xQueueSend(control_input_queue, (void*)&message, 0) != pdPASS)
+    if (SendControlMessage(&message, 0) != ESP_OK)
     {
         ESP_LOGE(TAG, "control_save_user_data queue send failed!");            
     }
@@ -712,7 +834,7 @@ void control_save_user_data(uint8_t reboot)
 *****************************************************************************/
 void control_set_amp_skin_index(uint32_t status)
 {
-    tControlMessage message;
+    tControlMessage message = {0};
 
     ESP_LOGI(TAG, "control_set_amp_skin_index");
 
@@ -720,7 +842,7 @@ void control_set_amp_skin_index(uint32_t status)
     message.Value = status;
 
     // send to queue
-    if (xQueueSend(control_input_queue, (void*)&message, 0) != pdPASS)
+    if (SendControlMessage(&message, 0) != ESP_OK)
     {
         ESP_LOGE(TAG, "control_set_amp_skin_index queue send failed!");            
     }
@@ -735,7 +857,7 @@ void control_set_amp_skin_index(uint32_t status)
 *****************************************************************************/
 void control_set_config_item_int(uint32_t item, uint32_t status)
 {
-    tControlMessage message;
+    tControlMessage message = {0};
 
     ESP_LOGI(TAG, "control_set_config_item_int: %d %d", (int)item, (int)status);
 
@@ -744,7 +866,7 @@ void control_set_config_item_int(uint32_t item, uint32_t status)
     message.Item = item;
 
     // send to queue
-    if (xQueueSend(control_input_queue, (void*)&message, 0) != pdPASS)
+    if (SendControlMessage(&message, 0) != ESP_OK)
     {
         ESP_LOGE(TAG, "control_set_config_item_int queue send failed!");            
     }
@@ -759,16 +881,21 @@ void control_set_config_item_int(uint32_t item, uint32_t status)
 *****************************************************************************/
 void control_set_config_item_string(uint32_t item, char* name)
 {
-    tControlMessage message;
+    tControlMessage message = {0};
 
     ESP_LOGI(TAG, "control_set_config_item_string: %d", (int)item);
 
     message.Event = EVENT_SET_CONFIG_ITEM_STRING;
-    strncpy(message.Text, name, MAX_TEXT_LENGTH - 1);
     message.Item = item;
+    message.Text = AllocControlText(NULL, name);
+    if (message.Text == CONTROL_TEXT_NONE)
+    {
+        ESP_LOGE(TAG, "control_set_config_item_string text pool empty!");
+        return;
+    }
 
     // send to queue
-    if (xQueueSend(control_input_queue, (void*)&message, 0) != pdPASS)
+    if (SendControlMessage(&message, 0) != ESP_OK)
     {
         ESP_LOGE(TAG, "control_set_config_item_string queue send failed!");            
     }
@@ -783,224 +910,189 @@ void control_set_config_item_string(uint32_t item, char* name)
 *****************************************************************************/
 uint32_t control_get_config_item_int(uint32_t item)
 {
-    uint32_t value = 0;
-
-    switch (item)
+    if ((item >= CONFIG_ITEM_LAST) || (config_store_get_item_info(item)->Type != CONFIG_TYPE_INT))
     {
-        case CONFIG_ITEM_BT_MODE:
-        {
-            value = ControlData.ConfigData.BTMode;
-        } break;
-
-        case CONFIG_ITEM_MV_CHOC_ENABLE:
-        {
-            value = ControlData.ConfigData.BTClientMvaveChocolateEnable;
-        } break;
-
-        case CONFIG_ITEM_XV_MD1_ENABLE:
-        {
-            value = ControlData.ConfigData.BTClientXviveMD1Enable;
-        } break;
-
-        case CONFIG_ITEM_CUSTOM_BT_ENABLE:
-        {
-            value = ControlData.ConfigData.BTClientCustomEnable;
-        } break;
-        
-        case CONFIG_ITEM_MIDI_ENABLE:
-        {
-            value = ControlData.ConfigData.MidiSerialEnable;
-        } break;
-
-        case CONFIG_ITEM_MIDI_CHANNEL:
-        {
-            value = ControlData.ConfigData.MidiChannel;
-        } break;
-
-        case CONFIG_ITEM_TOGGLE_BYPASS:
-        {
-            value = ControlData.ConfigData.GeneralDoublePressToggleBypass;
-        } break;
-
-        case CONFIG_ITEM_FOOTSWITCH_MODE:
-        {
-            value = ControlData.ConfigData.FootswitchMode;
-        } break;
-
-        case CONFIG_ITEM_ENABLE_BT_MIDI_CC:
-        {
-            value = ControlData.ConfigData.EnableBTmidiCC;
-        } break;
-
-        case CONFIG_ITEM_WIFI_MODE:
-        {
-            value = ControlData.ConfigData.WiFiMode;
-        } break;
+        ESP_LOGE(TAG, "Unknown/Invalid int parameter item %d", (int)item);            
+        return 0;
+    }
 
-        case CONFIG_ITEM_SCREEN_ROTATION:
-        {
-            value = ControlData.ConfigData.GeneralScreenRotation;
-        } break;
+    return config_store_get_int(&ControlData.Store, item);
+}
 
-        case CONFIG_ITEM_WIFI_TX_POWER:
-        {
-            value = ControlData.ConfigData.WifiTxPower;
-        } break;
-        
-        case CONFIG_ITEM_EXT_FOOTSW_PRESET_LAYOUT:
-        {
-            value = ControlData.ConfigData.ExternalFootswitchPresetLayout;
-        } break;
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: 
+* PARAMETERS:  name: at least MAX_TEXT_LENGTH
+* RETURN:      
+* NOTES:       
+*****************************************************************************/
+void control_get_config_item_string(uint32_t item, char* name)
+{
+    if (!config_store_get_string(&ControlData.Store, item, name))
+    {
+        ESP_LOGE(TAG, "Unknown/Invalid string parameter item %d", (int)item);            
+    }
+}
 
-        case CONFIG_ITEM_EXT_FOOTSW_EFFECT1_SW:
-        {
-            value = ControlData.ConfigData.ExternalFootswitchEffectConfig[0].Switch;
-        } break;
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Start a config transaction
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       
+*****************************************************************************/
+void control_config_begin(tConfigTransaction* transaction)
+{
+    transaction->Items = 0;
+    transaction->TextUsed = 0;
+    transaction->Result = ESP_OK;
+    transaction->RebootNeeded = 0;
+}
 
-        case CONFIG_ITEM_EXT_FOOTSW_EFFECT1_CC:
-        {
-            value = ControlData.ConfigData.ExternalFootswitchEffectConfig[0].CC;
-        } break;
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Add an int config item to a transaction
+* PARAMETERS:  
+* RETURN:      ESP_ERR_INVALID_ARG if not an int item or out of range
+* NOTES:       
+*****************************************************************************/
+esp_err_t control_config_set_int(tConfigTransaction* transaction, uint32_t item, uint32_t value)
+{
+    if ((item >= CONFIG_ITEM_LAST) || (config_store_get_item_info(item)->Type != CONFIG_TYPE_INT) ||
+        (value < config_store_get_item_info(item)->Min) || (value > config_store_get_item_info(item)->Max))
+    {
+        ESP_LOGW(TAG, "Config transaction item %d value %d invalid", (int)item, (int)value);
+        return ESP_ERR_INVALID_ARG;
+    }
 
-        case CONFIG_ITEM_EXT_FOOTSW_EFFECT1_VAL1:
-        {
-            value = ControlData.ConfigData.ExternalFootswitchEffectConfig[0].Value_1;
-        } break;
+    transaction->Values[item] = value;
+    transaction->Items |= (1ULL << item);
 
-        case CONFIG_ITEM_EXT_FOOTSW_EFFECT1_VAL2:
-        {
-            value = ControlData.ConfigData.ExternalFootswitchEffectConfig[0].Value_2;
-        } break;
+    return ESP_OK;
+}
 
-        case CONFIG_ITEM_EXT_FOOTSW_EFFECT2_SW:
-        {
-            value = ControlData.ConfigData.ExternalFootswitchEffectConfig[1].Switch;
-        } break;
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Add a string config item to a transaction
+* PARAMETERS:  
+* RETURN:      ESP_ERR_INVALID_ARG if not a string item, ESP_ERR_NO_MEM if 
+*              the text pool is full
+* NOTES:       Text is truncated to the item size
+*****************************************************************************/
+esp_err_t control_config_set_string(tConfigTransaction* transaction, uint32_t item, const char* text)
+{
+    size_t length;
 
-        case CONFIG_ITEM_EXT_FOOTSW_EFFECT2_CC:
-        {
-            value = ControlData.ConfigData.ExternalFootswitchEffectConfig[1].CC;
-        } break;
+    if ((item >= CONFIG_ITEM_LAST) || (config_store_get_item_info(item)->Type != CONFIG_TYPE_STRING))
+    {
+        ESP_LOGW(TAG, "Config transaction item %d not a string", (int)item);
+        return ESP_ERR_INVALID_ARG;
+    }
 
-        case CONFIG_ITEM_EXT_FOOTSW_EFFECT2_VAL1:
-        {
-            value = ControlData.ConfigData.ExternalFootswitchEffectConfig[1].Value_1;
-        } break;
+    length = strnlen(text, config_store_get_item_info(item)->Size - 1);
+    if ((transaction->TextUsed + length + 1) > CONFIG_TRANSACTION_TEXT_POOL)
+    {
+        ESP_LOGW(TAG, "Config transaction text pool full");
+        return ESP_ERR_NO_MEM;
+    }
 
-        case CONFIG_ITEM_EXT_FOOTSW_EFFECT2_VAL2:
-        {
-            value = ControlData.ConfigData.ExternalFootswitchEffectConfig[1].Value_2;
-        } break;
+    memcpy((void*)&transaction->TextPool[transaction->TextUsed], (void*)text, length);
+    transaction->TextPool[transaction->TextUsed + length] = 0;
+    transaction->Values[item] = transaction->TextUsed;
+    transaction->TextUsed += length + 1;
+    transaction->Items |= (1ULL << item);
 
-        case CONFIG_ITEM_EXT_FOOTSW_EFFECT3_SW:
-        {
-            value = ControlData.ConfigData.ExternalFootswitchEffectConfig[2].Switch;
-        } break;
+    return ESP_OK;
+}
 
-        case CONFIG_ITEM_EXT_FOOTSW_EFFECT3_CC:
-        {
-            value = ControlData.ConfigData.ExternalFootswitchEffectConfig[2].CC;
-        } break;
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Apply and save a config transaction
+* PARAMETERS:  
+* RETURN:      ESP_OK once everything is saved, ESP_ERR_INVALID_STATE if
+*              called from the control task
+* NOTES:       Blocks until the control task has finished with it. One 
+*              message and one flash write, however many items. Changes
+*              are live, except where RebootNeeded gets set.
+*              Must not be called from the control task, including config
+*              handlers, as it would wait on itself forever
+*****************************************************************************/
+esp_err_t control_config_commit(tConfigTransaction* transaction)
+{
+    tControlMessage message = {0};
+    esp_err_t result;
 
-        case CONFIG_ITEM_EXT_FOOTSW_EFFECT3_VAL1:
-        {
-            value = ControlData.ConfigData.ExternalFootswitchEffectConfig[2].Value_1;
-        } break;
+    ESP_LOGI(TAG, "control_config_commit");
 
-        case CONFIG_ITEM_EXT_FOOTSW_EFFECT3_VAL2:
-        {
-            value = ControlData.ConfigData.ExternalFootswitchEffectConfig[2].Value_2;
-        } break;
+    if (xTaskGetCurrentTaskHandle() == control_task_handle)
+    {
+        ESP_LOGE(TAG, "control_config_commit called from the control task!");
+        return ESP_ERR_INVALID_STATE;
+    }
 
-        case CONFIG_ITEM_EXT_FOOTSW_EFFECT4_SW:
-        {
-            value = ControlData.ConfigData.ExternalFootswitchEffectConfig[3].Switch;
-        } break;
+    xSemaphoreTake(config_commit_mutex, portMAX_DELAY);
 
-        case CONFIG_ITEM_EXT_FOOTSW_EFFECT4_CC:
-        {
-            value = ControlData.ConfigData.ExternalFootswitchEffectConfig[3].CC;
-        } break;
+    message.Event = EVENT_CONFIG_COMMIT;
+    message.Object = (void*)transaction;
 
-        case CONFIG_ITEM_EXT_FOOTSW_EFFECT4_VAL1:
-        {
-            value = ControlData.ConfigData.ExternalFootswitchEffectConfig[3].Value_1;
-        } break;
+    // send to queue
+    if (SendControlMessage(&message, pdMS_TO_TICKS(1000)) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "control_config_commit queue send failed!");
+        xSemaphoreGive(config_commit_mutex);
+        return ESP_ERR_TIMEOUT;
+    }
 
-        case CONFIG_ITEM_EXT_FOOTSW_EFFECT4_VAL2:
-        {
-            value = ControlData.ConfigData.ExternalFootswitchEffectConfig[3].Value_2;
-        } break;
+    xSemaphoreTake(config_commit_done, portMAX_DELAY);
+    result = transaction->Result;
 
-        case CONFIG_ITEM_EXT_FOOTSW_EFFECT5_SW:
-        {
-            value = ControlData.ConfigData.ExternalFootswitchEffectConfig[4].Switch;
-        } break;
+    xSemaphoreGive(config_commit_mutex);
 
-        case CONFIG_ITEM_EXT_FOOTSW_EFFECT5_CC:
-        {
-            value = ControlData.ConfigData.ExternalFootswitchEffectConfig[4].CC;
-        } break;
+    return result;
+}
 
-        case CONFIG_ITEM_EXT_FOOTSW_EFFECT5_VAL1:
-        {
-            value = ControlData.ConfigData.ExternalFootswitchEffectConfig[4].Value_1;
-        } break;
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Subscribe to config item changes
+* PARAMETERS:  items: CONFIG_ITEM_MASK() bits
+* RETURN:      ESP_ERR_NO_MEM if too many handlers
+* NOTES:       The handler is called from the control task once the items 
+*              have changed and been saved. Read the new values with 
+*              control_get_config_item_int() etc
+*****************************************************************************/
+esp_err_t control_register_config_handler(uint64_t items, tConfigChangedHandler handler)
+{
+    esp_err_t result = ESP_OK;
 
-        case CONFIG_ITEM_EXT_FOOTSW_EFFECT5_VAL2:
-        {
-            value = ControlData.ConfigData.ExternalFootswitchEffectConfig[4].Value_2;
-        } break;
+    xSemaphoreTake(config_handler_mutex, portMAX_DELAY);
 
-        default:
-        {
-            ESP_LOGE(TAG, "Unknown/Invalid int parameter item %d", (int)item);            
-        } break;
+    if (ConfigHandlerCount < MAX_CONFIG_HANDLERS)
+    {
+        ConfigHandlers[ConfigHandlerCount].Items = items;
+        ConfigHandlers[ConfigHandlerCount].Handler = handler;
+        ConfigHandlerCount++;
+    }
+    else
+    {
+        ESP_LOGE(TAG, "Too many config handlers");
+        result = ESP_ERR_NO_MEM;
     }
 
-    return value;
+    xSemaphoreGive(config_handler_mutex);
+
+    return result;
 }
 
 /****************************************************************************
 * NAME:        
-* DESCRIPTION: 
+* DESCRIPTION: Get the registry entry for a config item
 * PARAMETERS:  
-* RETURN:      
+* RETURN:      NULL if not a config item
 * NOTES:       
 *****************************************************************************/
-void control_get_config_item_string(uint32_t item, char* name)
+const tConfigItemInfo* control_get_config_item_info(uint32_t item)
 {
-    switch (item)
-    {
-        case CONFIG_ITEM_BT_CUSTOM_NAME:
-        {
-            strncpy(name, ControlData.ConfigData.BTClientCustomName, MAX_BT_CUSTOM_NAME - 1);
-            name[MAX_BT_CUSTOM_NAME - 1] = 0;
-        } break;
-
-        case CONFIG_ITEM_WIFI_SSID:
-        {
-            strncpy(name, ControlData.ConfigData.WifiSSID, MAX_WIFI_SSID_PW - 1);
-            name[MAX_WIFI_SSID_PW - 1] = 0;
-        } break;
-
-        case CONFIG_ITEM_WIFI_PASSWORD:
-        {
-            strncpy(name, ControlData.ConfigData.WifiPassword, MAX_WIFI_SSID_PW - 1);
-            name[MAX_WIFI_SSID_PW - 1] = 0;            
-        } break;
-
-        case CONFIG_ITEM_MDNS_NAME:
-        {
-            strncpy(name, ControlData.ConfigData.MDNSName, MAX_MDNS_NAME - 1);
-            name[MAX_MDNS_NAME - 1] = 0;            
-        } break;
-
-        default:
-        {
-            ESP_LOGE(TAG, "Unknown/Invalid string parameter item %d", (int)item);            
-        } break;
-    }
+    return config_store_get_item_info(item);
 }
 
 /****************************************************************************
@@ -1012,10 +1104,10 @@ void control_get_config_item_string(uint32_t item, char* name)
 *****************************************************************************/
 void control_set_skin_next(void)
 {
-    if (ControlData.ConfigData.UserData[ControlData.PresetIndex].SkinIndex < (SKIN_MAX - 1))
+    if (ControlData.Store.ConfigData.UserData[ControlData.PresetIndex].SkinIndex < (SKIN_MAX - 1))
     {
-        ControlData.ConfigData.UserData[ControlData.PresetIndex].SkinIndex++;
-        control_set_amp_skin_index(ControlData.ConfigData.UserData[ControlData.PresetIndex].SkinIndex);
+        ControlData.Store.ConfigData.UserData[ControlData.PresetIndex].SkinIndex++;
+        control_set_amp_skin_index(ControlData.Store.ConfigData.UserData[ControlData.PresetIndex].SkinIndex);
     }
 }
 
@@ -1028,184 +1120,338 @@ void control_set_skin_next(void)
 *****************************************************************************/
 void control_set_skin_previous(void)
 {
-    if (ControlData.ConfigData.UserData[ControlData.PresetIndex].SkinIndex > 0)
+    if (ControlData.Store.ConfigData.UserData[ControlData.PresetIndex].SkinIndex > 0)
     {
-        ControlData.ConfigData.UserData[ControlData.PresetIndex].SkinIndex--;
+        ControlData.Store.ConfigData.UserData[ControlData.PresetIndex].SkinIndex--;
     
-        control_set_amp_skin_index(ControlData.ConfigData.UserData[ControlData.PresetIndex].SkinIndex);
+        control_set_amp_skin_index(ControlData.Store.ConfigData.UserData[ControlData.PresetIndex].SkinIndex);
     }
 }
 
 /****************************************************************************
 * NAME:        
-* DESCRIPTION: 
+* DESCRIPTION: Open an NVS namespace on first use
 * PARAMETERS:  
-* RETURN:      none
-* NOTES:       none
-****************************************************************************/
-static uint8_t SaveUserData(void)
+* RETURN:      1 if open
+* NOTES:       
+*****************************************************************************/
+static uint8_t nvs_storage_open(tControlNVS* nvs)
 {
-    esp_err_t err;
-    nvs_handle_t my_handle;
-    uint8_t result = 0;
-
-    ESP_LOGI(TAG, "Writing User Data");
+    if (!nvs->Opened && (nvs_open(nvs->Namespace, NVS_READWRITE, &nvs->Handle) == ESP_OK))
+    {
+        nvs->Opened = 1;
+    }
 
-    // open storage
-    err = nvs_open("storage", NVS_READWRITE, &my_handle);
+    return nvs->Opened;
+}
 
-    if (err == ESP_OK) 
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Close an NVS namespace if it was opened
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       
+*****************************************************************************/
+static void nvs_storage_close(tControlNVS* nvs)
+{
+    if (nvs->Opened)
     {
-        // write value
-        size_t required_size = sizeof(ControlData.ConfigData);
-        err = nvs_set_blob(my_handle, NVS_USERDATA_NAME, (void*)&ControlData.ConfigData, required_size);
+        nvs_close(nvs->Handle);
+        nvs->Opened = 0;
+    }
+}
 
-        switch (err) 
-        {
-            case ESP_OK:
-            {
-                result = 1;
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: tConfigStorageOps for NVS
+* PARAMETERS:  context: tControlNVS
+* RETURN:      1 if OK
+* NOTES:       
+*****************************************************************************/
+static uint8_t nvs_storage_get_u8(void* context, const char* key, uint8_t* value)
+{
+    tControlNVS* nvs = (tControlNVS*)context;
 
-                ESP_LOGI(TAG, "Wrote User Data OK");
-            } break;
-            
-            default:
-            {
-                ESP_LOGE(TAG, "Error (%s) writing User Data\n", esp_err_to_name(err));
-            } break;
-        }
+    return nvs_storage_open(nvs) && (nvs_get_u8(nvs->Handle, key, value) == ESP_OK);
+}
 
-        // commit value
-        err = nvs_commit(my_handle);
+static uint8_t nvs_storage_set_u8(void* context, const char* key, uint8_t value)
+{
+    tControlNVS* nvs = (tControlNVS*)context;
+
+    return nvs_storage_open(nvs) && (nvs_set_u8(nvs->Handle, key, value) == ESP_OK);
+}
 
-        // close
-        nvs_close(my_handle);
+static uint8_t nvs_storage_get_u32(void* context, const char* key, uint32_t* value)
+{
+    tControlNVS* nvs = (tControlNVS*)context;
+
+    return nvs_storage_open(nvs) && (nvs_get_u32(nvs->Handle, key, value) == ESP_OK);
+}
+
+static uint8_t nvs_storage_set_u32(void* context, const char* key, uint32_t value)
+{
+    tControlNVS* nvs = (tControlNVS*)context;
+    esp_err_t err;
+
+    if (!nvs_storage_open(nvs))
+    {
+        return 0;
     }
-    else
+
+    err = nvs_set_u32(nvs->Handle, key, value);
+    if (err != ESP_OK)
     {
-        ESP_LOGE(TAG, "Write User Data failed to open");
+        ESP_LOGE(TAG, "Error (%s) writing %s", esp_err_to_name(err), key);
     }
 
-    return result;
+    return err == ESP_OK;
 }
 
-/****************************************************************************
-* NAME:        
-* DESCRIPTION: 
-* PARAMETERS:  
-* RETURN:      none
-* NOTES:       none
-****************************************************************************/
-static uint8_t LoadUserData(void)
+static uint8_t nvs_storage_get_string(void* context, const char* key, char* text, size_t* length)
 {
-    esp_err_t err;
-    nvs_handle_t my_handle;
-    uint8_t result = 0;
-    uint8_t save_needed = 0;
+    tControlNVS* nvs = (tControlNVS*)context;
 
-    ESP_LOGI(TAG, "Load User Data");
+    return nvs_storage_open(nvs) && (nvs_get_str(nvs->Handle, key, text, length) == ESP_OK);
+}
 
-    // open storage
-    err = nvs_open("storage", NVS_READWRITE, &my_handle);
+static uint8_t nvs_storage_set_string(void* context, const char* key, const char* text)
+{
+    tControlNVS* nvs = (tControlNVS*)context;
+    esp_err_t err;
 
-    if (err == ESP_OK) 
+    if (!nvs_storage_open(nvs))
     {
-        // read data
-        size_t required_size = sizeof(ControlData.ConfigData);
-        err = nvs_get_blob(my_handle, NVS_USERDATA_NAME, (void*)&ControlData.ConfigData, &required_size);
+        return 0;
+    }
 
-         switch (err) 
-         {
-            case ESP_OK:
-            {
-                // close
-                nvs_close(my_handle);
+    err = nvs_set_str(nvs->Handle, key, text);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Error (%s) writing %s", esp_err_to_name(err), key);
+    }
 
-                ESP_LOGI(TAG, "Load User Data OK");
+    return err == ESP_OK;
+}
 
-                result = 1;
-            } break;
-            
-            case ESP_ERR_NVS_NOT_FOUND:
-            default:
-            {
-                ESP_LOGE(TAG, "Error (%s) reading User Data \n", esp_err_to_name(err));
+static uint8_t nvs_storage_get_blob(void* context, const char* key, void* data, size_t* length)
+{
+    tControlNVS* nvs = (tControlNVS*)context;
+
+    return nvs_storage_open(nvs) && (nvs_get_blob(nvs->Handle, key, data, length) == ESP_OK);
+}
 
-                // close
-                nvs_close(my_handle);
+static uint8_t nvs_storage_set_blob(void* context, const char* key, const void* data, size_t length)
+{
+    tControlNVS* nvs = (tControlNVS*)context;
+    esp_err_t err;
 
-                // write default values
-                SaveUserData();
-            } break;
-        }
+    if (!nvs_storage_open(nvs))
+    {
+        return 0;
     }
-    else
+
+    err = nvs_set_blob(nvs->Handle, key, data, length);
+    if (err != ESP_OK)
     {
-        ESP_LOGE(TAG, "Read User Data failed to open");
+        ESP_LOGE(TAG, "Error (%s) writing %s", esp_err_to_name(err), key);
     }
 
-    // check values
-    if (ControlData.ConfigData.BTMode > BT_MODE_PERIPHERAL)
+    return err == ESP_OK;
+}
+
+static uint8_t nvs_storage_erase(void* context, const char* key)
+{
+    tControlNVS* nvs = (tControlNVS*)context;
+
+    return nvs_storage_open(nvs) && (nvs_erase_key(nvs->Handle, key) == ESP_OK);
+}
+
+static uint8_t nvs_storage_commit(void* context)
+{
+    tControlNVS* nvs = (tControlNVS*)context;
+    esp_err_t err;
+
+    if (!nvs_storage_open(nvs))
     {
-        ESP_LOGW(TAG, "Config BTMode invalid");
-        ControlData.ConfigData.BTMode = BT_MODE_CENTRAL;
-        save_needed = 1;
+        ESP_LOGE(TAG, "Failed to open %s", nvs->Namespace);
+        return 0;
     }
 
-    if (ControlData.ConfigData.MidiChannel > 16)
+    err = nvs_commit(nvs->Handle);
+    if (err != ESP_OK)
     {
-        ESP_LOGW(TAG, "Config MidiChannel invalid");
-        ControlData.ConfigData.MidiChannel = 1;
-        save_needed = 1;
+        ESP_LOGE(TAG, "Error (%s) committing %s", esp_err_to_name(err), nvs->Namespace);
     }
 
-    if (ControlData.ConfigData.FootswitchMode >= FOOTSWITCH_MODE_LAST)
+    return err == ESP_OK;
+}
+
+static void nvs_storage_for_each(void* context, tConfigStorageEntry entry, void* arg)
+{
+    tControlNVS* nvs = (tControlNVS*)context;
+    nvs_iterator_t it = NULL;
+    nvs_entry_info_t info;
+    uint8_t type;
+    esp_err_t err;
+
+    err = nvs_entry_find(NVS_DEFAULT_PART_NAME, nvs->Namespace, NVS_TYPE_ANY, &it);
+    while (err == ESP_OK)
     {
-        ESP_LOGW(TAG, "Config Footswitch mode invalid");
-        ControlData.ConfigData.FootswitchMode = FOOTSWITCH_MODE_DUAL_UP_DOWN;
-        save_needed = 1;
+        nvs_entry_info(it, &info);
+
+        switch (info.type)
+        {
+            case NVS_TYPE_U8:   type = CONFIG_STORAGE_U8;      break;
+            case NVS_TYPE_U32:  type = CONFIG_STORAGE_U32;     break;
+            case NVS_TYPE_STR:  type = CONFIG_STORAGE_STRING;  break;
+            case NVS_TYPE_BLOB: type = CONFIG_STORAGE_BLOB;    break;
+            default:            type = CONFIG_STORAGE_OTHER;   break;
+        }
+
+        entry(arg, info.key, type);
+        err = nvs_entry_next(&it);
     }
+    nvs_release_iterator(it);
+}
 
-    if (ControlData.ConfigData.ExternalFootswitchPresetLayout >= FOOTSWITCH_LAYOUT_LAST)
+static const tConfigStorageOps NVSStorageOps = 
+{
+    .GetU8 = nvs_storage_get_u8,
+    .SetU8 = nvs_storage_set_u8,
+    .GetU32 = nvs_storage_get_u32,
+    .SetU32 = nvs_storage_set_u32,
+    .GetString = nvs_storage_get_string,
+    .SetString = nvs_storage_set_string,
+    .GetBlob = nvs_storage_get_blob,
+    .SetBlob = nvs_storage_set_blob,
+    .Erase = nvs_storage_erase,
+    .Commit = nvs_storage_commit,
+    .ForEach = nvs_storage_for_each
+};
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Write changed config items and presets to flash
+* PARAMETERS:  
+* RETURN:      1 if OK
+* NOTES:       Only dirty entries are written, each has its own NVS key
+****************************************************************************/
+static uint8_t SaveUserData(void)
+{
+    tControlNVS nvs = {.Namespace = NVS_CONFIG_NAMESPACE};
+    tConfigStorage storage = {.Ops = &NVSStorageOps, .Context = (void*)&nvs};
+    uint8_t result;
+
+    if ((ControlData.Store.ConfigDirty == 0) && (ControlData.Store.PresetDirty == 0))
     {
-        ESP_LOGW(TAG, "Config External Footswitch preset layout invalid");
-        ControlData.ConfigData.ExternalFootswitchPresetLayout = FOOTSWITCH_LAYOUT_1X4;
-        save_needed = 1;
+        ESP_LOGI(TAG, "User Data unchanged");
+        return 1;
     }
 
-    if (save_needed)
+    ESP_LOGI(TAG, "Writing User Data");
+
+    result = config_store_save(&ControlData.Store, &storage);
+    nvs_storage_close(&nvs);
+
+    ESP_LOGI(TAG, "Wrote User Data, %d items %d bytes", (int)ControlData.Store.SaveStats.LastItems, (int)ControlData.Store.SaveStats.LastBytes);
+
+    return result;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: 
+* PARAMETERS:  
+* RETURN:      version stored
+* NOTES:       Items missing from flash keep their default and are written
+*              on the next save
+****************************************************************************/
+static uint8_t LoadUserData(void)
+{
+    tControlNVS nvs = {.Namespace = NVS_CONFIG_NAMESPACE};
+    tControlNVS legacy_nvs = {.Namespace = NVS_LEGACY_NAMESPACE};
+    tConfigStorage storage = {.Ops = &NVSStorageOps, .Context = (void*)&nvs};
+    tConfigStorage legacy = {.Ops = &NVSStorageOps, .Context = (void*)&legacy_nvs};
+    char str_val[MAX_TEXT_LENGTH];
+    uint8_t version;
+
+    ESP_LOGI(TAG, "Load User Data");
+
+    // older layouts are converted in place
+    version = config_store_load(&ControlData.Store, &storage, &legacy);
+    nvs_storage_close(&legacy_nvs);
+    nvs_storage_close(&nvs);
+
+    if (version < CONFIG_STORE_VERSION)
     {
-        SaveUserData();
+        // try again next boot
+        ESP_LOGE(TAG, "User Data migration from version %d failed", (int)version);
     }
 
-    ESP_LOGI(TAG, "Config BT Mode: %d", (int)ControlData.ConfigData.BTMode);
-    ESP_LOGI(TAG, "Config BT Mvave Choc: %d", (int)ControlData.ConfigData.BTClientMvaveChocolateEnable);
-    ESP_LOGI(TAG, "Config BT Xvive MD1: %d", (int)ControlData.ConfigData.BTClientMvaveChocolateEnable);
-    ESP_LOGI(TAG, "Config BT Custom Client Enable: %d", (int)ControlData.ConfigData.BTClientCustomEnable);
-    ESP_LOGI(TAG, "Config BT Custom Client Name: %s", ControlData.ConfigData.BTClientCustomName);
-    ESP_LOGI(TAG, "Config Midi enable: %d", (int)ControlData.ConfigData.MidiSerialEnable);
-    ESP_LOGI(TAG, "Config Midi channel: %d", (int)ControlData.ConfigData.MidiChannel);
-    ESP_LOGI(TAG, "Config Toggle bypass: %d", (int)ControlData.ConfigData.GeneralDoublePressToggleBypass);
-    ESP_LOGI(TAG, "Config Footswitch Mode: %d", (int)ControlData.ConfigData.FootswitchMode);
-    ESP_LOGI(TAG, "Config EnableBTmidiCC Mode: %d", (int)ControlData.ConfigData.EnableBTmidiCC);
-    ESP_LOGI(TAG, "Config WiFi Mode: %d", (int)ControlData.ConfigData.WiFiMode);
-    ESP_LOGI(TAG, "Config WiFi SSID: %s", ControlData.ConfigData.WifiSSID);
-    ESP_LOGI(TAG, "Config WiFi Password: <hidden>");
-    ESP_LOGI(TAG, "Config MDNS name: %s", ControlData.ConfigData.MDNSName);
-    ESP_LOGI(TAG, "Config WiFi TX Power: %d", ControlData.ConfigData.WifiTxPower);
-    ESP_LOGI(TAG, "Config Screen Rotation: %d", (int)ControlData.ConfigData.GeneralScreenRotation);
-    ESP_LOGI(TAG, "Config Ext Footsw Prst Layout: %d", (int)ControlData.ConfigData.ExternalFootswitchPresetLayout);
-    
-    for (uint8_t loop = 0; loop < MAX_EXTERNAL_EFFECT_FOOTSWITCHES; loop++)
+    ESP_LOGI(TAG, "Load User Data OK");
+
+    for (uint32_t item = 0; item < CONFIG_ITEM_LAST; item++)
     {
-        ESP_LOGI(TAG, "Config Ext Footsw Effect %d Switch: %d", (int)loop, (int)ControlData.ConfigData.ExternalFootswitchEffectConfig[loop].Switch);
-        ESP_LOGI(TAG, "Config Ext Footsw Effect %d CC: %d", (int)loop, (int)ControlData.ConfigData.ExternalFootswitchEffectConfig[loop].CC);
-        ESP_LOGI(TAG, "Config Ext Footsw Effect %d Val 1: %d", (int)loop, (int)ControlData.ConfigData.ExternalFootswitchEffectConfig[loop].Value_1);
-        ESP_LOGI(TAG, "Config Ext Footsw Effect %d Val 2: %d", (int)loop, (int)ControlData.ConfigData.ExternalFootswitchEffectConfig[loop].Value_2);
+        const tConfigItemInfo* item_info = config_store_get_item_info(item);
+
+        if (ControlData.Store.LoadReset & CONFIG_ITEM_MASK(item))
+        {
+            ESP_LOGW(TAG, "Config %s invalid", item_info->JsonKey);
+        }
+
+        if (item_info->Flags & CONFIG_FLAG_HIDDEN)
+        {
+            ESP_LOGI(TAG, "Config %s: <hidden>", item_info->JsonKey);
+        }
+        else if (item_info->Type == CONFIG_TYPE_STRING)
+        {
+            control_get_config_item_string(item, str_val);
+            ESP_LOGI(TAG, "Config %s: %s", item_info->JsonKey, str_val);
+        }
+        else
+        {
+            ESP_LOGI(TAG, "Config %s: %d", item_info->JsonKey, (int)control_get_config_item_int(item));
+        }
     }
     
-    // status    
-    return result;
+    return version;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Get config save counters
+* PARAMETERS:  stats: filled in
+* RETURN:      
+* NOTES:       
+*****************************************************************************/
+void control_get_config_save_stats(tConfigSaveStats* stats)
+{
+    memcpy((void*)stats, (void*)&ControlData.Store.SaveStats, sizeof(tConfigSaveStats));
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Get control queue stats
+* PARAMETERS:  
+* RETURN:      none
+* NOTES:       Latencies are usec from send to receive
+*****************************************************************************/
+void control_get_queue_stats(tControlQueueStats* stats)
+{
+    memcpy((void*)stats, (void*)&ControlQueueStats, sizeof(tControlQueueStats));
+
+    for (uint8_t loop = 0; loop < MAX_CONTROL_EVENTS; loop++)
+    {
+        memset((void*)&stats->Events[loop], 0, sizeof(tControlEventStats));
+
+        if ((loop < EVENT_LAST) && (ControlEventCounters[loop].Count != 0))
+        {
+            stats->Events[loop].Count = ControlEventCounters[loop].Count;
+            stats->Events[loop].LatencyAvg = (uint32_t)(ControlEventCounters[loop].LatencyTotal / ControlEventCounters[loop].Count);
+            stats->Events[loop].LatencyMax = ControlEventCounters[loop].LatencyMax;
+        }
+    }
 }
 
 /****************************************************************************
@@ -1217,30 +1463,8 @@ static uint8_t LoadUserData(void)
 *****************************************************************************/
 void control_set_default_config(void)
 {
-    ControlData.ConfigData.BTMode = BT_MODE_CENTRAL;
-    ControlData.ConfigData.BTClientMvaveChocolateEnable = 1;
-    ControlData.ConfigData.BTClientXviveMD1Enable = 1;
-    ControlData.ConfigData.BTClientCustomEnable = 0;
-    ControlData.ConfigData.GeneralDoublePressToggleBypass = 0;
-    ControlData.ConfigData.MidiSerialEnable = 0;
-    ControlData.ConfigData.MidiChannel = 1;
-    ControlData.ConfigData.FootswitchMode = FOOTSWITCH_MODE_DUAL_UP_DOWN;
-    ControlData.ConfigData.EnableBTmidiCC = 0;
-    memset((void*)ControlData.ConfigData.BTClientCustomName, 0, sizeof(ControlData.ConfigData.BTClientCustomName));
-    ControlData.ConfigData.WiFiMode = WIFI_MODE_ACCESS_POINT_TIMED;
-    strcpy(ControlData.ConfigData.WifiSSID, "TonexConfig");
-    strcpy(ControlData.ConfigData.WifiPassword, "12345678");   
-    strcpy(ControlData.ConfigData.MDNSName, "tonex");   
-    ControlData.ConfigData.WifiTxPower = WIFI_TX_POWER_25;
-    ControlData.ConfigData.GeneralScreenRotation = SCREEN_ROTATION_0;
-    ControlData.ConfigData.ExternalFootswitchPresetLayout = FOOTSWITCH_LAYOUT_1X4;
-    memset((void*)ControlData.ConfigData.ExternalFootswitchEffectConfig, 0, sizeof(ControlData.ConfigData.ExternalFootswitchEffectConfig));
-
-    // default to no switches configured
-    for (uint8_t loop = 0; loop < MAX_EXTERNAL_EFFECT_FOOTSWITCHES; loop++)
-    {
-        ControlData.ConfigData.ExternalFootswitchEffectConfig[loop].Switch = SWITCH_NOT_USED;
-    }
+    // all of it needs writing on the next save
+    config_store_set_defaults(&ControlData.Store);
 }
 
 /****************************************************************************
@@ -1253,20 +1477,26 @@ void control_set_default_config(void)
 void control_task(void *arg)
 {
     tControlMessage message;
+    TickType_t stats_tick = xTaskGetTickCount();
 
     ESP_LOGI(TAG, "Control task start");
 
     while (1) 
     {
-        // check for any input messages
-        if (xQueueReceive(control_input_queue, (void*)&message, pdMS_TO_TICKS(20)) == pdPASS)
+        // nothing to do until a message arrives
+        if (xQueueReceive(control_input_queue, (void*)&message, portMAX_DELAY) == pdPASS)
         {
+            UpdateControlQueueStats(&message);
+
             // process it
             process_control_command(&message);
-        }
 
-        // don't hog the CPU
-        vTaskDelay(pdMS_TO_TICKS(3));
+            if ((xTaskGetTickCount() - stats_tick) >= pdMS_TO_TICKS(CONTROL_STATS_INTERVAL))
+            {
+                stats_tick = xTaskGetTickCount();
+                LogControlQueueStats();
+            }
+        }
 	}
 }
 
@@ -1286,7 +1516,7 @@ void control_load_config(void)
     // this will become init from Flash mem
     for (uint32_t loop = 0; loop < MAX_PRESETS_DEFAULT; loop++)
     {
-        sprintf(ControlData.ConfigData.UserData[loop].PresetDescription, "Description");
+        sprintf(ControlData.Store.ConfigData.UserData[loop].PresetDescription, "Description");
     }
 
     // default config, will be overwritten or used as default
@@ -1318,11 +1548,31 @@ void control_load_config(void)
 void control_init(void)
 {
     // create queue for commands from other threads
-    control_input_queue = xQueueCreate(20, sizeof(tControlMessage));
+    control_input_queue = xQueueCreate(CONTROL_QUEUE_LENGTH, sizeof(tControlMessage));
     if (control_input_queue == NULL)
     {
         ESP_LOGE(TAG, "Failed to create control input queue!");
     }
 
-    xTaskCreatePinnedToCore(control_task, "CTRL", CTRL_TASK_STACK_SIZE, NULL, CTRL_TASK_PRIORITY, NULL, 1);
+    config_commit_mutex = xSemaphoreCreateMutex();
+    config_commit_done = xSemaphoreCreateBinary();
+    config_handler_mutex = xSemaphoreCreateMutex();
+    if ((config_commit_mutex == NULL) || (config_commit_done == NULL) || (config_handler_mutex == NULL))
+    {
+        ESP_LOGE(TAG, "Failed to create config semaphores!");
+    }
+
+    // delayed save of user data
+    const esp_timer_create_args_t save_timer_args = 
+    {
+        .callback = &save_timer_callback,
+        .name = "cfg_save"
+    };
+
+    if (esp_timer_create(&save_timer_args, &save_timer) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to create save timer!");
+    }
+
+    xTaskCreatePinnedToCore(control_task, "CTRL", CTRL_TASK_STACK_SIZE, NULL, CTRL_TASK_PRIORITY, &control_task_handle, 1);
 }
@@ -119,7 +119,31 @@ enum ConfigItems
     CONFIG_ITEM_EXT_FOOTSW_EFFECT5_SW,
     CONFIG_ITEM_EXT_FOOTSW_EFFECT5_CC,
     CONFIG_ITEM_EXT_FOOTSW_EFFECT5_VAL1,
-    CONFIG_ITEM_EXT_FOOTSW_EFFECT5_VAL2
+    CONFIG_ITEM_EXT_FOOTSW_EFFECT5_VAL2,
+    CONFIG_ITEM_FOOTSW_ACTIONS,
+    CONFIG_ITEM_EXT_FOOTSW_ACTIONS,
+    CONFIG_ITEM_EXP_PARAM,
+    CONFIG_ITEM_EXP_CURVE,
+    CONFIG_ITEM_EXP_CALIBRATE,
+    CONFIG_ITEM_EXP_HEEL,
+    CONFIG_ITEM_EXP_TOE,
+    CONFIG_ITEM_MIDI_ROUTE1_SRC,
+    CONFIG_ITEM_MIDI_ROUTE1_DST,
+    CONFIG_ITEM_MIDI_ROUTE1_CH,
+    CONFIG_ITEM_MIDI_ROUTE1_TYPE,
+    CONFIG_ITEM_MIDI_ROUTE2_SRC,
+    CONFIG_ITEM_MIDI_ROUTE2_DST,
+    CONFIG_ITEM_MIDI_ROUTE2_CH,
+    CONFIG_ITEM_MIDI_ROUTE2_TYPE,
+    CONFIG_ITEM_MIDI_ROUTE3_SRC,
+    CONFIG_ITEM_MIDI_ROUTE3_DST,
+    CONFIG_ITEM_MIDI_ROUTE3_CH,
+    CONFIG_ITEM_MIDI_ROUTE3_TYPE,
+    CONFIG_ITEM_MIDI_ROUTE4_SRC,
+    CONFIG_ITEM_MIDI_ROUTE4_DST,
+    CONFIG_ITEM_MIDI_ROUTE4_CH,
+    CONFIG_ITEM_MIDI_ROUTE4_TYPE,
+    CONFIG_ITEM_LAST
 };
 
 enum BluetoothModes
@@ -134,6 +158,7 @@ enum FootswitchModes
     FOOTSWITCH_MODE_DUAL_UP_DOWN,       // next/previous
     FOOTSWITCH_MODE_QUAD_BANKED,        // like Mvave Choc with bank select from 1+2 and 3+4
     FOOTSWITCH_MODE_QUAD_BINARY,        // direct binary selection from 4 switches
+    FOOTSWITCH_MODE_CUSTOM,             // per switch actions from the footswitch action table
     FOOTSWITCH_MODE_LAST
 };
 
@@ -173,6 +198,7 @@ enum FootswitchLayouts
     FOOTSWITCH_LAYOUT_2X5B,               // 2 rows of 5 switches, bank via 5 and 10
     FOOTSWITCH_LAYOUT_2X6A,               // 2 rows of 6 switches, bank via 1+2 and 5+6
     FOOTSWITCH_LAYOUT_2X6B,               // 2 rows of 6 switches, bank via 6 and 12
+    FOOTSWITCH_LAYOUT_CUSTOM,             // per switch actions from the external action table
     FOOTSWITCH_LAYOUT_LAST
 };
 
@@ -204,10 +230,96 @@ typedef struct __attribute__ ((packed))
     uint8_t Value_2;
 } tExternalFootswitchEffectConfig;
 
+// user Midi route, see midi_router.h
+typedef struct __attribute__ ((packed)) 
+{
+    uint8_t Sources;            // MIDI_ROUTER_SOURCE_MASK() bits, 0 is off
+    uint8_t Destinations;       // MIDI_ROUTER_DEST_ bits, 0 is off
+    uint8_t Channel;            // 1 to 16, 0 any
+    uint8_t Types;              // MIDI_ROUTER_TYPE_ bits
+} tMidiRouteConfig;
+
 #define MAX_WIFI_SSID_PW                        65   
 #define MAX_MDNS_NAME                           32
 #define MAX_EXTERNAL_EFFECT_FOOTSWITCHES        5
+#define MAX_MIDI_USER_ROUTES                    4
 #define SWITCH_NOT_USED                         0xFF
+#define MAX_FOOTSWITCH_ACTION_TEXT              128     // footswitch action table, see footswitch_actions.h
+
+typedef struct
+{
+    uint32_t Saves;
+    uint32_t LastItems;         // NVS keys written by the last save
+    uint32_t LastBytes;         // flash written by the last save
+    uint32_t TotalBytes;
+} tConfigSaveStats;
+
+#define MAX_CONTROL_EVENTS                      16
+
+typedef struct
+{
+    uint32_t Count;
+    uint32_t LatencyAvg;        // usec, queued to received
+    uint32_t LatencyMax;
+} tControlEventStats;
+
+typedef struct
+{
+    uint16_t HighWater;         // most messages waiting
+    uint16_t TextHighWater;     // most text pool slots in use
+    uint32_t SendFailed;
+    uint32_t TextFailed;
+    tControlEventStats Events[MAX_CONTROL_EVENTS];
+} tControlQueueStats;
+
+enum ConfigItemTypes
+{
+    CONFIG_TYPE_INT,
+    CONFIG_TYPE_STRING
+};
+
+// config item flags
+#define CONFIG_FLAG_SETCONFIG                   (1 << 0)        // set by the web UI SETCONFIG command
+#define CONFIG_FLAG_SETWIFI                     (1 << 1)        // set by the web UI SETWIFI command
+#define CONFIG_FLAG_HIDDEN                      (1 << 2)        // not logged
+#define CONFIG_FLAG_REBOOT                      (1 << 3)        // only takes effect after a restart
+
+#define CONFIG_ITEM_MASK(item)                  (1ULL << (item))
+#define CONFIG_ITEM_RANGE_MASK(first, last)     (CONFIG_ITEM_MASK((last) + 1) - CONFIG_ITEM_MASK(first))
+#define MAX_CONFIG_HANDLERS                     8
+
+// one entry per ConfigItems, everything about an item lives here
+typedef struct
+{
+    uint8_t Type;                   // ConfigItemTypes
+    uint8_t Flags;                  // CONFIG_FLAG_
+    uint16_t Offset;                // byte offset in the config data
+    uint8_t Size;                   // field or string buffer size in bytes
+    uint8_t Shift;                  // int only, bit position in the field
+    uint8_t Bits;                   // int only, bit width
+    uint32_t Min;                   // int only, valid range
+    uint32_t Max;
+    uint32_t Default;
+    const char* DefaultString;      // string only
+    const char* JsonKey;            // web UI
+    const char* NVSKey;             // flash
+} tConfigItemInfo;
+
+#define CONFIG_TRANSACTION_TEXT_POOL            ((4 * MAX_WIFI_SSID_PW) + (2 * MAX_FOOTSWITCH_ACTION_TEXT))
+
+// a batch of config changes, applied and saved together by the control task
+typedef struct
+{
+    uint64_t Items;                                 // bit per ConfigItems set
+    uint32_t Values[CONFIG_ITEM_LAST];              // int value, or string offset in TextPool
+    char TextPool[CONFIG_TRANSACTION_TEXT_POOL];
+    uint16_t TextUsed;
+    esp_err_t Result;
+    uint8_t RebootNeeded;                           // set by commit, a changed item needs a restart
+} tConfigTransaction;
+
+// called from the control task with the subscribed items that changed. Keep it short
+typedef void (*tConfigChangedHandler)(uint64_t changed);
 
 // thread safe public API
 void control_request_preset_up(void);
@@ -231,4 +343,14 @@ void control_set_config_item_object(uint32_t item, void* object);
 
 uint32_t control_get_config_item_int(uint32_t item);
 void control_get_config_item_string(uint32_t item, char* name);
-void control_get_config_item_object(uint32_t item, void* object);
\ No newline at end of file
+void control_get_config_item_object(uint32_t item, void* object);
+void control_get_config_save_stats(tConfigSaveStats* stats);
+void control_get_queue_stats(tControlQueueStats* stats);
+const tConfigItemInfo* control_get_config_item_info(uint32_t item);
+
+// config transactions. Not for use from the control task
+void control_config_begin(tConfigTransaction* transaction);
+esp_err_t control_config_set_int(tConfigTransaction* transaction, uint32_t item, uint32_t value);
+esp_err_t control_config_set_string(tConfigTransaction* transaction, uint32_t item, const char* text);
+esp_err_t control_config_commit(tConfigTransaction* transaction);
+esp_err_t control_register_config_handler(uint64_t items, tConfigChangedHandler handler);
\ No newline at end of file
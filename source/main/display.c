@@ -67,6 +67,7 @@ limitations under the License.
 #include "midi_control.h"
 #include "LP5562.h"
 #include "tonex_params.h"
+#include "i2c_scheduler.h"
 
 static const char *TAG = "app_display";
 
@@ -161,7 +162,7 @@ typedef struct
 } tUIUpdate;
 
 static QueueHandle_t ui_update_queue;
-static SemaphoreHandle_t I2CMutexHandle;
+static i2c_port_t I2CPort;
 static SemaphoreHandle_t lvgl_mux = NULL;
 
 #if CONFIG_TONEX_CONTROLLER_HAS_DISPLAY
@@ -217,6 +218,51 @@ static bool display_on_vsync_event(esp_lcd_panel_handle_t panel, const esp_lcd_r
     return high_task_awoken == pdTRUE;
 }
 
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Read the touch controller
+* PARAMETERS:  arg: touch handle
+* RETURN:      
+* NOTES:       I2C scheduler job, as the touch driver does its own transfers
+*****************************************************************************/
+static esp_err_t display_touch_read_job(i2c_port_t port, void* arg)
+{
+    return esp_lcd_touch_read_data((esp_lcd_touch_handle_t)arg);
+}
+
+typedef struct
+{
+    esp_lcd_panel_io_handle_t IOHandle;
+    const esp_lcd_touch_config_t* Config;
+    esp_lcd_touch_handle_t* Touch;
+} tTouchInit;
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Init the GT911 touch controller
+* PARAMETERS:  arg: tTouchInit
+* RETURN:      
+* NOTES:       I2C scheduler job
+*****************************************************************************/
+static esp_err_t display_touch_init_job(i2c_port_t port, void* arg)
+{
+    tTouchInit* init = (tTouchInit*)arg;
+
+    return esp_lcd_touch_new_i2c_gt911(init->IOHandle, init->Config, init->Touch);
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Reset the I2C bus
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       I2C scheduler job
+*****************************************************************************/
+static esp_err_t display_i2c_reset_job(i2c_port_t port, void* arg)
+{
+    return i2c_master_reset();
+}
+
 /****************************************************************************
 * NAME:        
 * DESCRIPTION: 
@@ -231,20 +277,11 @@ static void display_lvgl_touch_cb(lv_indev_drv_t * drv, lv_indev_data_t * data)
     uint8_t touchpad_cnt = 0;
     bool touchpad_pressed = false;
 
-    if (xSemaphoreTake(I2CMutexHandle, (TickType_t)10) == pdTRUE)
-    {
-        /* Read touch controller data */
-        esp_lcd_touch_read_data(drv->user_data);
+    /* Read touch controller data */
+    i2c_scheduler_run(I2CPort, I2C_DEVICE_TOUCH, display_touch_read_job, drv->user_data);
 
-        /* Get coordinates */
-        touchpad_pressed = esp_lcd_touch_get_coordinates(drv->user_data, touchpad_x, touchpad_y, NULL, &touchpad_cnt, 1);
-
-        xSemaphoreGive(I2CMutexHandle);
-    }
-    else
-    {
-        ESP_LOGE(TAG, "Touch cb mutex timeout");
-    }
+    /* Get coordinates */
+    touchpad_pressed = esp_lcd_touch_get_coordinates(drv->user_data, touchpad_x, touchpad_y, NULL, &touchpad_cnt, 1);
 
     if (touchpad_pressed && touchpad_cnt > 0) 
     {
@@ -2789,9 +2826,9 @@ void display_task(void *arg)
 * RETURN:      
 * NOTES:       
 *****************************************************************************/
-void display_init(i2c_port_t I2CNum, SemaphoreHandle_t I2CMutex)
+void display_init(i2c_port_t I2CNum)
 {    
-    I2CMutexHandle = I2CMutex;
+    I2CPort = I2CNum;
 
     // create queue for UI updates from other threads
     ui_update_queue = xQueueCreate(20, sizeof(tUIUpdate));
@@ -2940,21 +2977,17 @@ void display_init(i2c_port_t I2CNum, SemaphoreHandle_t I2CMutex)
     // Initialize touch
     ESP_LOGI(TAG, "Initialize touch controller GT911");
 
+    tTouchInit touch_init = 
+    {
+        .IOHandle = tp_io_handle,
+        .Config = &tp_cfg,
+        .Touch = &tp,
+    };
+
     // try a few times
     for (int loop = 0; loop < 5; loop++)
     {
-        ret = ESP_FAIL;
-
-        if (xSemaphoreTake(I2CMutexHandle, (TickType_t)10000) == pdTRUE)
-        {
-            ret = (esp_lcd_touch_new_i2c_gt911(tp_io_handle, &tp_cfg, &tp));
-
-            xSemaphoreGive(I2CMutexHandle);
-        }
-        else
-        {
-            ESP_LOGE(TAG, "Initialize touch loop mutex timeout");
-        }
+        ret = i2c_scheduler_run(I2CPort, I2C_DEVICE_TOUCH, display_touch_init_job, (void*)&touch_init);
         
         if (ret == ESP_OK)
         {
@@ -2967,7 +3000,7 @@ void display_init(i2c_port_t I2CNum, SemaphoreHandle_t I2CMutex)
             ESP_LOGI(TAG, "Touch controller init retry %s", esp_err_to_name(ret));
 
             // reset I2C bus
-            i2c_master_reset();
+            i2c_scheduler_run(I2CPort, I2C_DEVICE_TOUCH, display_i2c_reset_job, NULL);
         }
            
         vTaskDelay(pdMS_TO_TICKS(25));    
@@ -3160,8 +3193,18 @@ void display_init(i2c_port_t I2CNum, SemaphoreHandle_t I2CMutex)
     esp_lcd_panel_mirror(lcd_panel, true, true);
     esp_lcd_panel_disp_on_off(lcd_panel, true);
 
-    // LCD backlight on 
-    LP5562_set_color(0, 0, 0, 180);
+    // LCD backlight fades in, the LP5562 runs it by itself
+    tLP5562Effect backlight = {0};
+    backlight.Type = LP5562_EFFECT_RAMP;
+    backlight.High = 180;
+    backlight.RiseTime = 500;
+
+    if ((LP5562_set_engine(0, 0, 0, 1) != ESP_OK) || (LP5562_run_effect(1, &backlight) != ESP_OK))
+    {
+        // just on
+        LP5562_set_engine(0, 0, 0, 0);
+        LP5562_set_color(0, 0, 0, 180);
+    }
 
     esp_lcd_panel_set_gap(lcd_panel, 2, 1);
     esp_lcd_panel_invert_color(lcd_panel, true);
@@ -0,0 +1,331 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_adc/adc_continuous.h"
+#include "usb/usb_host.h"
+#include "usb_comms.h"
+#include "control.h"
+#include "task_priorities.h"
+#include "tonex_params.h"
+#include "expression_filter.h"
+#include "expression.h"
+
+#define EXPRESSION_TASK_STACK_SIZE          (3 * 1024)
+#define EXPRESSION_SAMPLE_RATE              10000       // Hz
+#define EXPRESSION_BLOCK_SAMPLES            128         // averaged into one filter input, about 78 a second
+#define EXPRESSION_FRAME_SIZE               (EXPRESSION_BLOCK_SAMPLES * SOC_ADC_DIGI_RESULT_BYTES)
+#define EXPRESSION_READ_TIMEOUT             50          // msec
+#define EXPRESSION_SMOOTHING                0.25f       // IIR weight of each block
+#define EXPRESSION_HYSTERESIS               6.0f        // ADC counts
+#define EXPRESSION_DEAD_ZONE                0.02f       // at each end of the travel
+#define EXPRESSION_STEPS                    128         // same resolution as a Midi CC
+#define EXPRESSION_MIN_UPDATE_TIME          20000       // usec between parameter updates
+#define EXPRESSION_MIN_CAL_RANGE            400         // ADC counts a calibration sweep must cover
+
+static const char *TAG = "app_expression";
+
+typedef struct
+{
+    adc_continuous_handle_t Handle;
+    adc_channel_t Channel;
+    tExpressionFilter Filter;
+    tExpressionFilterConfig FilterConfig;
+    uint16_t Param;                             // TONEX_PARAM_, TONEX_PARAM_LAST if not used
+    uint8_t Pending;                            // position changed but not sent yet
+    int64_t LastSendTime;
+    uint8_t Calibrating;
+    float CalibrateMin;
+    float CalibrateMax;
+    volatile uint8_t ConfigChanged;
+} tExpression;
+
+static tExpression Expression;
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Save the heel and toe readings from a calibration sweep
+* PARAMETERS:
+* RETURN:
+* NOTES:       Keeps the direction of the current calibration, so a
+*              reversed pedal stays reversed
+*****************************************************************************/
+static void expression_finish_calibration(void)
+{
+    uint16_t heel = (uint16_t)Expression.CalibrateMin;
+    uint16_t toe = (uint16_t)Expression.CalibrateMax;
+
+    if ((Expression.CalibrateMax - Expression.CalibrateMin) < EXPRESSION_MIN_CAL_RANGE)
+    {
+        ESP_LOGW(TAG, "Expression calibration range too small, %d to %d", (int)heel, (int)toe);
+        return;
+    }
+
+    if (Expression.FilterConfig.Heel > Expression.FilterConfig.Toe)
+    {
+        heel = (uint16_t)Expression.CalibrateMax;
+        toe = (uint16_t)Expression.CalibrateMin;
+    }
+
+    ESP_LOGI(TAG, "Expression calibrated, heel %d toe %d", (int)heel, (int)toe);
+
+    control_set_config_item_int(CONFIG_ITEM_EXP_HEEL, heel);
+    control_set_config_item_int(CONFIG_ITEM_EXP_TOE, toe);
+    control_save_user_data(0);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Load expression pedal config
+* PARAMETERS:
+* RETURN:
+* NOTES:       Called from the expression task, on start and after a change
+*****************************************************************************/
+static void expression_load_config(void)
+{
+    uint8_t calibrate = control_get_config_item_int(CONFIG_ITEM_EXP_CALIBRATE);
+
+    Expression.Param = control_get_config_item_int(CONFIG_ITEM_EXP_PARAM);
+
+    Expression.FilterConfig.Heel = (float)control_get_config_item_int(CONFIG_ITEM_EXP_HEEL);
+    Expression.FilterConfig.Toe = (float)control_get_config_item_int(CONFIG_ITEM_EXP_TOE);
+    Expression.FilterConfig.DeadZone = EXPRESSION_DEAD_ZONE;
+    Expression.FilterConfig.Smoothing = EXPRESSION_SMOOTHING;
+    Expression.FilterConfig.Hysteresis = EXPRESSION_HYSTERESIS;
+    Expression.FilterConfig.Curve = control_get_config_item_int(CONFIG_ITEM_EXP_CURVE);
+    Expression.FilterConfig.Steps = EXPRESSION_STEPS;
+
+    if (calibrate && !Expression.Calibrating)
+    {
+        ESP_LOGI(TAG, "Expression calibration, sweep the pedal heel to toe");
+        Expression.CalibrateMin = EXPRESSION_ADC_MAX;
+        Expression.CalibrateMax = 0;
+    }
+    else if (!calibrate && Expression.Calibrating)
+    {
+        expression_finish_calibration();
+    }
+
+    Expression.Calibrating = calibrate;
+
+    // position is sent again once the pedal moves
+    Expression.Filter.Step = -1;
+    Expression.Pending = 0;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Expression config items changed
+* PARAMETERS:
+* RETURN:
+* NOTES:       Called from the control task, the expression task reloads
+*****************************************************************************/
+static void expression_config_changed(uint64_t changed)
+{
+    Expression.ConfigChanged = 1;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Send the pedal position to its parameter
+* PARAMETERS:
+* RETURN:
+* NOTES:       Scaled to the parameter's range
+*****************************************************************************/
+static void expression_send(int64_t now)
+{
+    tTonexParameter* param_ptr;
+    float min;
+    float max;
+
+    if (tonex_params_get_locked_access(&param_ptr) != ESP_OK)
+    {
+        // try again next block
+        return;
+    }
+
+    min = param_ptr[Expression.Param].Min;
+    max = param_ptr[Expression.Param].Max;
+
+    tonex_params_release_locked_access();
+
+    usb_modify_parameter(Expression.Param, min + (Expression.Filter.Position * (max - min)));
+
+    Expression.Pending = 0;
+    Expression.LastSendTime = now;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Average a frame of ADC readings
+* PARAMETERS:
+* RETURN:      1 if there were any for our channel
+* NOTES:
+*****************************************************************************/
+static uint8_t expression_average(const uint8_t* buffer, uint32_t length, float* average)
+{
+    const adc_digi_output_data_t* data;
+    uint32_t sum = 0;
+    uint32_t count = 0;
+
+    for (uint32_t loop = 0; (loop + SOC_ADC_DIGI_RESULT_BYTES) <= length; loop += SOC_ADC_DIGI_RESULT_BYTES)
+    {
+        data = (const adc_digi_output_data_t*)&buffer[loop];
+
+        if (data->type2.channel == Expression.Channel)
+        {
+            sum += data->type2.data;
+            count++;
+        }
+    }
+
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    // oversampled, the average has more resolution than a single reading
+    *average = (float)sum / (float)count;
+    return 1;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Expression pedal task
+* PARAMETERS:
+* RETURN:
+* NOTES:       The ADC samples into DMA buffers by itself, this only wakes
+*              for each full frame
+*****************************************************************************/
+static void expression_task(void *arg)
+{
+    uint8_t buffer[EXPRESSION_FRAME_SIZE];
+    uint32_t length;
+    int32_t last_step;
+    float average;
+    int64_t now;
+
+    ESP_LOGI(TAG, "Expression task start");
+
+    expression_load_config();
+
+    while (1)
+    {
+        // config changed from web?
+        if (Expression.ConfigChanged)
+        {
+            Expression.ConfigChanged = 0;
+            expression_load_config();
+        }
+
+        if ((adc_continuous_read(Expression.Handle, buffer, sizeof(buffer), &length, EXPRESSION_READ_TIMEOUT) == ESP_OK) &&
+            expression_average(buffer, length, &average))
+        {
+            last_step = Expression.Filter.Step;
+
+            // only once the pedal moves, so the preset's own value stands until then
+            if (expression_filter_run(&Expression.Filter, &Expression.FilterConfig, average) && (last_step >= 0) &&
+                (Expression.Param < TONEX_PARAM_LAST))
+            {
+                Expression.Pending = 1;
+            }
+
+            if (Expression.Calibrating)
+            {
+                if (Expression.Filter.Held < Expression.CalibrateMin)
+                {
+                    Expression.CalibrateMin = Expression.Filter.Held;
+                }
+
+                if (Expression.Filter.Held > Expression.CalibrateMax)
+                {
+                    Expression.CalibrateMax = Expression.Filter.Held;
+                }
+            }
+        }
+
+        // rate capped, the latest position goes when the time is up
+        now = esp_timer_get_time();
+        if (Expression.Pending && ((now - Expression.LastSendTime) >= EXPRESSION_MIN_UPDATE_TIME))
+        {
+            expression_send(now);
+        }
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION:
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+void expression_init(void)
+{
+    adc_unit_t unit;
+    adc_continuous_handle_cfg_t handle_config = {0};
+    adc_continuous_config_t adc_config = {0};
+    adc_digi_pattern_config_t pattern = {0};
+
+    memset((void*)&Expression, 0, sizeof(Expression));
+    expression_filter_reset(&Expression.Filter);
+
+    if ((adc_continuous_io_to_channel(CONFIG_TONEX_CONTROLLER_EXPRESSION_GPIO, &unit, &Expression.Channel) != ESP_OK) || (unit != ADC_UNIT_1))
+    {
+        ESP_LOGE(TAG, "GPIO %d is not an ADC1 input", CONFIG_TONEX_CONTROLLER_EXPRESSION_GPIO);
+        return;
+    }
+
+    handle_config.max_store_buf_size = 4 * EXPRESSION_FRAME_SIZE;
+    handle_config.conv_frame_size = EXPRESSION_FRAME_SIZE;
+    if (adc_continuous_new_handle(&handle_config, &Expression.Handle) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Expression ADC create failed");
+        return;
+    }
+
+    pattern.atten = ADC_ATTEN_DB_11;
+    pattern.channel = Expression.Channel;
+    pattern.unit = ADC_UNIT_1;
+    pattern.bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+
+    adc_config.sample_freq_hz = EXPRESSION_SAMPLE_RATE;
+    adc_config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+    adc_config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE2;
+    adc_config.pattern_num = 1;
+    adc_config.adc_pattern = &pattern;
+
+    if ((adc_continuous_config(Expression.Handle, &adc_config) != ESP_OK) || (adc_continuous_start(Expression.Handle) != ESP_OK))
+    {
+        ESP_LOGE(TAG, "Expression ADC start failed");
+        adc_continuous_deinit(Expression.Handle);
+        return;
+    }
+
+    // param, curve and calibration changes apply live
+    control_register_config_handler(CONFIG_ITEM_RANGE_MASK(CONFIG_ITEM_EXP_PARAM, CONFIG_ITEM_EXP_TOE), expression_config_changed);
+
+    // create task
+    xTaskCreatePinnedToCore(expression_task, "EXP", EXPRESSION_TASK_STACK_SIZE, NULL, EXPRESSION_TASK_PRIORITY, NULL, 1);
+}
@@ -0,0 +1,139 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include "expression_filter.h"
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Restart the filter, the next block is taken as is
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+void expression_filter_reset(tExpressionFilter* filter)
+{
+    memset((void*)filter, 0, sizeof(tExpressionFilter));
+    filter->Step = -1;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Shape a pedal position
+* PARAMETERS:  position: 0 - 1
+* RETURN:      0 - 1
+* NOTES:
+*****************************************************************************/
+float expression_filter_curve(uint8_t curve, float position)
+{
+    switch (curve)
+    {
+        case EXPRESSION_CURVE_LINEAR:
+        default:
+        {
+            return position;
+        }
+
+        case EXPRESSION_CURVE_LOG:
+        {
+            return position * position;
+        }
+
+        case EXPRESSION_CURVE_ANTILOG:
+        {
+            return 1.0f - ((1.0f - position) * (1.0f - position));
+        }
+
+        case EXPRESSION_CURVE_S:
+        {
+            // smoothstep
+            return position * position * (3.0f - (2.0f * position));
+        }
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Run one oversampled block through the filter
+* PARAMETERS:  input: block average, ADC counts
+* RETURN:      1 if the quantised position changed
+* NOTES:       IIR smoothing takes out the noise, then the hysteresis
+*              stops what's left from flicking between two steps while
+*              the pedal is still
+*****************************************************************************/
+uint8_t expression_filter_run(tExpressionFilter* filter, const tExpressionFilterConfig* config, float input)
+{
+    float position;
+    float range;
+    int32_t step;
+    uint16_t steps = (config->Steps > 1) ? config->Steps : 2;
+
+    if (!filter->Primed)
+    {
+        filter->Smoothed = input;
+        filter->Held = input;
+        filter->Primed = 1;
+    }
+    else
+    {
+        filter->Smoothed += (input - filter->Smoothed) * config->Smoothing;
+
+        if (filter->Smoothed > (filter->Held + config->Hysteresis))
+        {
+            filter->Held = filter->Smoothed - config->Hysteresis;
+        }
+        else if (filter->Smoothed < (filter->Held - config->Hysteresis))
+        {
+            filter->Held = filter->Smoothed + config->Hysteresis;
+        }
+    }
+
+    // calibrate, works for either direction
+    range = config->Toe - config->Heel;
+    if (range == 0.0f)
+    {
+        position = 0.0f;
+    }
+    else
+    {
+        position = (filter->Held - config->Heel) / range;
+        position = (position - config->DeadZone) / (1.0f - (2.0f * config->DeadZone));
+    }
+
+    if (position < 0.0f)
+    {
+        position = 0.0f;
+    }
+    else if (position > 1.0f)
+    {
+        position = 1.0f;
+    }
+
+    position = expression_filter_curve(config->Curve, position);
+
+    step = (int32_t)((position * (float)(steps - 1)) + 0.5f);
+    if (step == filter->Step)
+    {
+        return 0;
+    }
+
+    filter->Step = step;
+    filter->Position = (float)step / (float)(steps - 1);
+
+    return 1;
+}
@@ -0,0 +1,58 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#define EXPRESSION_ADC_MAX              4095        // 12 bit readings
+
+// Expression pedal filtering, from oversampled ADC blocks to a quantised
+// pedal position. No hardware access
+
+enum ExpressionCurves
+{
+    EXPRESSION_CURVE_LINEAR,
+    EXPRESSION_CURVE_LOG,               // slow start, like an audio taper pot
+    EXPRESSION_CURVE_ANTILOG,           // fast start
+    EXPRESSION_CURVE_S,                 // fine control at both ends
+    EXPRESSION_CURVE_LAST
+};
+
+typedef struct
+{
+    float Heel;                         // ADC counts with the pedal at the heel
+    float Toe;                          // ADC counts at the toe, may be below Heel
+    float DeadZone;                     // fraction at each end that reads as fully heel/toe
+    float Smoothing;                    // IIR weight of each new block, 0 - 1
+    float Hysteresis;                   // ADC counts the input must move to be followed
+    uint8_t Curve;                      // EXPRESSION_CURVE_
+    uint16_t Steps;                     // output quantisation
+} tExpressionFilterConfig;
+
+typedef struct
+{
+    float Smoothed;                     // IIR output, ADC counts
+    float Held;                         // after hysteresis, ADC counts
+    float Position;                     // 0 - 1, after the curve and quantisation
+    int32_t Step;                       // quantised position, -1 before the first block
+    uint8_t Primed;
+} tExpressionFilter;
+
+void expression_filter_reset(tExpressionFilter* filter);
+float expression_filter_curve(uint8_t curve, float position);
+uint8_t expression_filter_run(tExpressionFilter* filter, const tExpressionFilterConfig* config, float input);
@@ -0,0 +1,366 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include "footswitch_actions.h"
+
+#define FOOTSWITCH_ACTION_HASH_BITS     6           // log2 of FOOTSWITCH_ACTION_SLOTS
+#define FOOTSWITCH_ACTION_MAX_SWITCH    16
+#define FOOTSWITCH_ACTION_MAX_DIGITS    3
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: First slot to try for a switch mask
+* PARAMETERS:
+* RETURN:
+* NOTES:       Fibonacci hashing, the top bits of the product
+*****************************************************************************/
+static uint8_t footswitch_actions_hash(uint16_t mask)
+{
+    return (uint8_t)((uint16_t)(mask * 40503U) >> (16 - FOOTSWITCH_ACTION_HASH_BITS));
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Empty a table
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+void footswitch_actions_clear(tFootswitchActionTable* table)
+{
+    memset((void*)table, 0, sizeof(tFootswitchActionTable));
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Add an action, or replace the one for the same switches
+* PARAMETERS:  mask: switches, bit per switch
+* RETURN:      1 if added
+* NOTES:
+*****************************************************************************/
+uint8_t footswitch_actions_add(tFootswitchActionTable* table, uint16_t mask, uint8_t action, uint8_t value, uint8_t value_1, uint8_t value_2)
+{
+    tFootswitchAction* entry = NULL;
+    uint8_t slot;
+    uint8_t probe;
+
+    if ((mask == 0) || (action == FOOTSWITCH_ACTION_NONE) || (action >= FOOTSWITCH_ACTION_LAST))
+    {
+        return 0;
+    }
+
+    slot = footswitch_actions_hash(mask);
+
+    // the table is never more than half full, so this always finds a slot
+    for (probe = 0; probe < FOOTSWITCH_ACTION_SLOTS; probe++)
+    {
+        entry = &table->Slots[slot];
+
+        if (entry->Mask == mask)
+        {
+            break;
+        }
+
+        if (entry->Mask == 0)
+        {
+            if (table->Count >= FOOTSWITCH_ACTION_MAX)
+            {
+                return 0;
+            }
+
+            table->Count++;
+            break;
+        }
+
+        slot = (slot + 1) & (FOOTSWITCH_ACTION_SLOTS - 1);
+    }
+
+    entry->Mask = mask;
+    entry->Action = action;
+    entry->Value = value;
+    entry->Value_1 = value_1;
+    entry->Value_2 = value_2;
+    entry->Toggle = 0;
+
+    if (probe > table->MaxProbe)
+    {
+        table->MaxProbe = probe;
+    }
+
+    // more than one bit set?
+    if ((mask & (mask - 1)) != 0)
+    {
+        table->ComboSwitches |= mask;
+    }
+
+    if ((action == FOOTSWITCH_ACTION_PRESET) && (value >= table->PresetsPerBank))
+    {
+        table->PresetsPerBank = value + 1;
+    }
+
+    return 1;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Find the action for a set of switches
+* PARAMETERS:  mask: switches, bit per switch
+* RETURN:      action, or NULL if there isn't one
+* NOTES:       Never more than MaxProbe + 1 slots are looked at
+*****************************************************************************/
+tFootswitchAction* footswitch_actions_lookup(tFootswitchActionTable* table, uint16_t mask)
+{
+    uint8_t slot;
+
+    if (mask == 0)
+    {
+        return NULL;
+    }
+
+    slot = footswitch_actions_hash(mask);
+
+    for (uint8_t probe = 0; probe <= table->MaxProbe; probe++)
+    {
+        if (table->Slots[slot].Mask == mask)
+        {
+            return &table->Slots[slot];
+        }
+
+        if (table->Slots[slot].Mask == 0)
+        {
+            break;
+        }
+
+        slot = (slot + 1) & (FOOTSWITCH_ACTION_SLOTS - 1);
+    }
+
+    return NULL;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Read a decimal number
+* PARAMETERS:
+* RETURN:      1 if there was one
+* NOTES:       Moves the text on past it
+*****************************************************************************/
+static uint8_t footswitch_actions_number(const char** text, uint32_t* number)
+{
+    uint8_t digits = 0;
+
+    *number = 0;
+
+    while ((**text >= '0') && (**text <= '9'))
+    {
+        if (++digits > FOOTSWITCH_ACTION_MAX_DIGITS)
+        {
+            return 0;
+        }
+
+        *number = (*number * 10) + (uint32_t)(**text - '0');
+        (*text)++;
+    }
+
+    return (digits != 0);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Parse and add one <switches>:<action> entry
+* PARAMETERS:
+* RETURN:      1 if added
+* NOTES:       Moves the text on past the entry if it was valid
+*****************************************************************************/
+static uint8_t footswitch_actions_parse_entry(tFootswitchActionTable* table, const char** text_ptr)
+{
+    const char* text = *text_ptr;
+    uint16_t mask = 0;
+    uint32_t number;
+    uint8_t action;
+    uint8_t value = 0;
+    uint8_t value_1 = 0;
+    uint8_t value_2 = 127;
+
+    // switches
+    while (1)
+    {
+        if (!footswitch_actions_number(&text, &number) || (number < 1) || (number > FOOTSWITCH_ACTION_MAX_SWITCH))
+        {
+            return 0;
+        }
+
+        mask |= (1 << (number - 1));
+
+        if (*text != '+')
+        {
+            break;
+        }
+
+        text++;
+    }
+
+    if (*text++ != ':')
+    {
+        return 0;
+    }
+
+    // action
+    switch (toupper((unsigned char)*text++))
+    {
+        case 'P':
+        {
+            if (toupper((unsigned char)*text) == 'U')
+            {
+                action = FOOTSWITCH_ACTION_PRESET_UP;
+                text++;
+            }
+            else if (toupper((unsigned char)*text) == 'D')
+            {
+                action = FOOTSWITCH_ACTION_PRESET_DOWN;
+                text++;
+            }
+            else if (footswitch_actions_number(&text, &number) && (number >= 1) && (number <= 256))
+            {
+                action = FOOTSWITCH_ACTION_PRESET;
+                value = (uint8_t)(number - 1);
+            }
+            else
+            {
+                return 0;
+            }
+        } break;
+
+        case 'B':
+        {
+            if (toupper((unsigned char)*text) == 'U')
+            {
+                action = FOOTSWITCH_ACTION_BANK_UP;
+            }
+            else if (toupper((unsigned char)*text) == 'D')
+            {
+                action = FOOTSWITCH_ACTION_BANK_DOWN;
+            }
+            else
+            {
+                return 0;
+            }
+
+            text++;
+        } break;
+
+        case 'S':
+        {
+            if (!footswitch_actions_number(&text, &number) || (number < 1) || (number > 256))
+            {
+                return 0;
+            }
+
+            action = FOOTSWITCH_ACTION_SCENE;
+            value = (uint8_t)(number - 1);
+        } break;
+
+        case 'E':
+        {
+            if (!footswitch_actions_number(&text, &number) || (number > 127))
+            {
+                return 0;
+            }
+
+            action = FOOTSWITCH_ACTION_EFFECT;
+            value = (uint8_t)number;
+
+            // optional values for parameters that aren't on/off
+            if (*text == '/')
+            {
+                text++;
+                if (!footswitch_actions_number(&text, &number) || (number > 127))
+                {
+                    return 0;
+                }
+                value_1 = (uint8_t)number;
+
+                if (*text == '/')
+                {
+                    text++;
+                    if (!footswitch_actions_number(&text, &number) || (number > 127))
+                    {
+                        return 0;
+                    }
+                    value_2 = (uint8_t)number;
+                }
+            }
+        } break;
+
+        case 'T':
+        {
+            action = FOOTSWITCH_ACTION_TAP_TEMPO;
+        } break;
+
+        default:
+        {
+            return 0;
+        } break;
+    }
+
+    // must be followed by a separator
+    if ((*text != 0) && (*text != ' ') && (*text != ','))
+    {
+        return 0;
+    }
+
+    *text_ptr = text;
+
+    return footswitch_actions_add(table, mask, action, value, value_1, value_2);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Add the entries from an action table in text form
+* PARAMETERS:
+* RETURN:      number of entries that were rejected
+* NOTES:       Bad entries are skipped, the rest still get added. Later
+*              entries replace earlier ones for the same switches
+*****************************************************************************/
+uint8_t footswitch_actions_parse(tFootswitchActionTable* table, const char* text)
+{
+    uint8_t rejected = 0;
+
+    while (*text != 0)
+    {
+        if ((*text == ' ') || (*text == ','))
+        {
+            text++;
+            continue;
+        }
+
+        if (!footswitch_actions_parse_entry(table, &text))
+        {
+            rejected++;
+
+            // skip to the next entry
+            while ((*text != 0) && (*text != ' ') && (*text != ','))
+            {
+                text++;
+            }
+        }
+    }
+
+    return rejected;
+}
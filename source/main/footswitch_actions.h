@@ -0,0 +1,77 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// Footswitch action tables. A table maps a switch, or a combination of
+// switches, to an action. It's built once when the config changes and
+// looked up by switch bitmask on every press. No hardware access
+//
+// Text form, entries separated by spaces:
+//   <switches>:<action>
+//   switches: 1 based switch numbers joined with +, eg. 3 or 1+2
+//   action:   P<n>            preset n of the current bank, 1 based
+//             PU / PD         next / previous preset
+//             BU / BD         bank up / down
+//             S<n>            scene, fixed preset n whatever the bank, 1 based
+//             E<cc>[/v1[/v2]] effect toggle via midi CC, v1/v2 used if the
+//                             parameter isn't on/off
+//             T               tap tempo
+// eg. "1:P1 2:P2 3:P3 4:P4 1+2:BD 3+4:BU"
+
+enum FootswitchActions
+{
+    FOOTSWITCH_ACTION_NONE,
+    FOOTSWITCH_ACTION_PRESET,           // Value: preset in bank, 0 based
+    FOOTSWITCH_ACTION_PRESET_UP,
+    FOOTSWITCH_ACTION_PRESET_DOWN,
+    FOOTSWITCH_ACTION_BANK_UP,
+    FOOTSWITCH_ACTION_BANK_DOWN,
+    FOOTSWITCH_ACTION_SCENE,            // Value: preset, 0 based
+    FOOTSWITCH_ACTION_EFFECT,           // Value: CC, Value_1/Value_2 toggled between
+    FOOTSWITCH_ACTION_TAP_TEMPO,
+    FOOTSWITCH_ACTION_LAST
+};
+
+#define FOOTSWITCH_ACTION_SLOTS         64      // power of 2, twice the entries so probes stay short
+#define FOOTSWITCH_ACTION_MAX           (FOOTSWITCH_ACTION_SLOTS / 2)
+
+typedef struct
+{
+    uint16_t Mask;                      // switches, 0 if the slot is empty
+    uint8_t Action;                     // FOOTSWITCH_ACTION_
+    uint8_t Value;
+    uint8_t Value_1;
+    uint8_t Value_2;
+    uint8_t Toggle;                     // effect state, cleared on rebuild
+} tFootswitchAction;
+
+typedef struct
+{
+    tFootswitchAction Slots[FOOTSWITCH_ACTION_SLOTS];
+    uint16_t ComboSwitches;             // switches used in a combination, their single actions wait for release
+    uint8_t Count;
+    uint8_t MaxProbe;                   // longest probe needed by any entry
+    uint8_t PresetsPerBank;             // highest preset entry + 1
+} tFootswitchActionTable;
+
+void footswitch_actions_clear(tFootswitchActionTable* table);
+uint8_t footswitch_actions_add(tFootswitchActionTable* table, uint16_t mask, uint8_t action, uint8_t value, uint8_t value_1, uint8_t value_2);
+uint8_t footswitch_actions_parse(tFootswitchActionTable* table, const char* text);
+tFootswitchAction* footswitch_actions_lookup(tFootswitchActionTable* table, uint16_t mask);
@@ -0,0 +1,271 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include "footswitch_gesture.h"
+
+#define GESTURE_NO_EVENT            0xFF
+#define GESTURE_MAX_TIMEOUTS        4           // per sample, a zero length timer can chain into another
+
+enum GestureStates
+{
+    GESTURE_IDLE,
+    GESTURE_PRESSED,                // down, long press timer running
+    GESTURE_HELD,                   // down past the long press time
+    GESTURE_WAIT_SECOND,            // released after a short press, double tap timer running
+    GESTURE_SECOND_PRESSED,         // down for the second tap
+    GESTURE_STATE_LAST
+};
+
+enum GestureInputs
+{
+    GESTURE_INPUT_DOWN,
+    GESTURE_INPUT_UP,
+    GESTURE_INPUT_TIMEOUT,
+    GESTURE_INPUT_LAST
+};
+
+enum GestureTimers
+{
+    GESTURE_TIMER_NONE,
+    GESTURE_TIMER_KEEP,
+    GESTURE_TIMER_LONG_PRESS,
+    GESTURE_TIMER_REPEAT,
+    GESTURE_TIMER_DOUBLE_TAP
+};
+
+typedef struct
+{
+    uint8_t Next;
+    uint8_t Timer;
+    uint8_t Event1;
+    uint8_t Event2;
+} tGestureTransition;
+
+static const tGestureTransition GestureTable[GESTURE_STATE_LAST][GESTURE_INPUT_LAST] =
+{
+    // GESTURE_IDLE
+    {
+        {GESTURE_PRESSED,           GESTURE_TIMER_LONG_PRESS,   FOOTSWITCH_GESTURE_PRESS,       GESTURE_NO_EVENT},                  // down
+        {GESTURE_IDLE,              GESTURE_TIMER_NONE,         GESTURE_NO_EVENT,               GESTURE_NO_EVENT},                  // up
+        {GESTURE_IDLE,              GESTURE_TIMER_NONE,         GESTURE_NO_EVENT,               GESTURE_NO_EVENT},                  // timeout
+    },
+    // GESTURE_PRESSED
+    {
+        {GESTURE_PRESSED,           GESTURE_TIMER_KEEP,         GESTURE_NO_EVENT,               GESTURE_NO_EVENT},
+        {GESTURE_WAIT_SECOND,       GESTURE_TIMER_DOUBLE_TAP,   FOOTSWITCH_GESTURE_RELEASE,     GESTURE_NO_EVENT},
+        {GESTURE_HELD,              GESTURE_TIMER_REPEAT,       FOOTSWITCH_GESTURE_LONG_PRESS,  GESTURE_NO_EVENT},
+    },
+    // GESTURE_HELD
+    {
+        {GESTURE_HELD,              GESTURE_TIMER_KEEP,         GESTURE_NO_EVENT,               GESTURE_NO_EVENT},
+        {GESTURE_IDLE,              GESTURE_TIMER_NONE,         FOOTSWITCH_GESTURE_RELEASE,     GESTURE_NO_EVENT},
+        {GESTURE_HELD,              GESTURE_TIMER_REPEAT,       FOOTSWITCH_GESTURE_HOLD_REPEAT, GESTURE_NO_EVENT},
+    },
+    // GESTURE_WAIT_SECOND
+    {
+        {GESTURE_SECOND_PRESSED,    GESTURE_TIMER_NONE,         FOOTSWITCH_GESTURE_PRESS,       FOOTSWITCH_GESTURE_DOUBLE_TAP},
+        {GESTURE_WAIT_SECOND,       GESTURE_TIMER_KEEP,         GESTURE_NO_EVENT,               GESTURE_NO_EVENT},
+        {GESTURE_IDLE,              GESTURE_TIMER_NONE,         FOOTSWITCH_GESTURE_TAP,         GESTURE_NO_EVENT},
+    },
+    // GESTURE_SECOND_PRESSED
+    {
+        {GESTURE_SECOND_PRESSED,    GESTURE_TIMER_KEEP,         GESTURE_NO_EVENT,               GESTURE_NO_EVENT},
+        {GESTURE_IDLE,              GESTURE_TIMER_NONE,         FOOTSWITCH_GESTURE_RELEASE,     GESTURE_NO_EVENT},
+        {GESTURE_SECOND_PRESSED,    GESTURE_TIMER_NONE,         GESTURE_NO_EVENT,               GESTURE_NO_EVENT},
+    },
+};
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Send a gesture event
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void footswitch_gesture_emit(tFootswitchGestureSwitch* sw, uint8_t number, uint8_t gesture, int64_t now,
+                                    tFootswitchGestureHandler handler, void* context)
+{
+    tFootswitchGestureEvent event;
+
+    if (gesture == FOOTSWITCH_GESTURE_PRESS)
+    {
+        sw->PressTime = now;
+        sw->Repeats = 0;
+    }
+    else if (gesture == FOOTSWITCH_GESTURE_HOLD_REPEAT)
+    {
+        if (sw->Repeats < 0xFF)
+        {
+            sw->Repeats++;
+        }
+    }
+
+    event.Time = now;
+    event.Duration = (gesture == FOOTSWITCH_GESTURE_PRESS) ? 0 : (uint32_t)(now - sw->PressTime);
+    event.Switch = number;
+    event.Gesture = gesture;
+    event.Count = sw->Repeats;
+
+    handler(&event, context);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Run one input through the gesture table
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void footswitch_gesture_input(tFootswitchGestureSwitch* sw, const tFootswitchGestureConfig* config, uint8_t number, uint8_t input,
+                                     int64_t now, tFootswitchGestureHandler handler, void* context)
+{
+    const tGestureTransition* transition = &GestureTable[sw->State][input];
+
+    sw->State = transition->Next;
+
+    switch (transition->Timer)
+    {
+        case GESTURE_TIMER_NONE:
+        default:
+        {
+            sw->Deadline = 0;
+        } break;
+
+        case GESTURE_TIMER_KEEP:
+        {
+            // nothing to do
+        } break;
+
+        case GESTURE_TIMER_LONG_PRESS:
+        {
+            sw->Deadline = (config->LongPressTime != 0) ? (now + config->LongPressTime) : 0;
+        } break;
+
+        case GESTURE_TIMER_REPEAT:
+        {
+            sw->Deadline = (config->RepeatInterval != 0) ? (now + config->RepeatInterval) : 0;
+        } break;
+
+        case GESTURE_TIMER_DOUBLE_TAP:
+        {
+            // with no window this expires straight away, so the tap isn't delayed
+            sw->Deadline = now + config->DoubleTapWindow;
+        } break;
+    }
+
+    if (transition->Event1 != GESTURE_NO_EVENT)
+    {
+        footswitch_gesture_emit(sw, number, transition->Event1, now, handler, context);
+    }
+
+    if (transition->Event2 != GESTURE_NO_EVENT)
+    {
+        footswitch_gesture_emit(sw, number, transition->Event2, now, handler, context);
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Reset a switch to released and idle
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+void footswitch_gesture_reset(tFootswitchGestureSwitch* sw)
+{
+    memset((void*)sw, 0, sizeof(tFootswitchGestureSwitch));
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Feed a raw sample for one switch
+* PARAMETERS:  number: switch number, passed back in events
+*              raw: 1 if the contact reads closed
+*              now: usec sample time
+* RETURN:      1 if the switch needs sampling again soon, 0 if it's settled
+*              and can wait for an edge
+* NOTES:       Integrating debounce with hysteresis: the count rises with
+*              pressed samples and falls with released ones, so a bounce
+*              only delays the change instead of restarting it
+*****************************************************************************/
+uint8_t footswitch_gesture_sample(tFootswitchGestureSwitch* sw, const tFootswitchGestureConfig* config, uint8_t number, uint8_t raw, int64_t now,
+                                  tFootswitchGestureHandler handler, void* context)
+{
+    uint8_t press_samples = (config->PressSamples != 0) ? config->PressSamples : 1;
+    uint8_t release_samples = (config->ReleaseSamples != 0) ? config->ReleaseSamples : 1;
+    uint8_t timeouts = 0;
+
+    if (!sw->Pressed)
+    {
+        if (raw)
+        {
+            sw->Integrator++;
+        }
+        else if (sw->Integrator > 0)
+        {
+            sw->Integrator--;
+        }
+
+        if (sw->Integrator >= press_samples)
+        {
+            sw->Pressed = 1;
+            sw->Integrator = release_samples;
+            footswitch_gesture_input(sw, config, number, GESTURE_INPUT_DOWN, now, handler, context);
+        }
+    }
+    else
+    {
+        if (!raw)
+        {
+            sw->Integrator--;
+        }
+        else if (sw->Integrator < release_samples)
+        {
+            sw->Integrator++;
+        }
+
+        if (sw->Integrator == 0)
+        {
+            sw->Pressed = 0;
+            footswitch_gesture_input(sw, config, number, GESTURE_INPUT_UP, now, handler, context);
+        }
+    }
+
+    // timers
+    while ((sw->Deadline != 0) && (now >= sw->Deadline) && (timeouts < GESTURE_MAX_TIMEOUTS))
+    {
+        footswitch_gesture_input(sw, config, number, GESTURE_INPUT_TIMEOUT, now, handler, context);
+        timeouts++;
+    }
+
+    if (sw->Deadline != 0)
+    {
+        return 1;
+    }
+
+    // still debouncing?
+    if (sw->Pressed)
+    {
+        return (sw->Integrator < release_samples);
+    }
+    else
+    {
+        return (sw->Integrator != 0);
+    }
+}
@@ -0,0 +1,70 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// Per switch debounce and gesture detection. No hardware access, the caller
+// supplies the raw samples and their times
+
+enum FootswitchGestures
+{
+    FOOTSWITCH_GESTURE_PRESS,           // debounced press
+    FOOTSWITCH_GESTURE_RELEASE,         // debounced release
+    FOOTSWITCH_GESTURE_TAP,             // short press and release, after the double tap window
+    FOOTSWITCH_GESTURE_DOUBLE_TAP,      // second press inside the double tap window
+    FOOTSWITCH_GESTURE_LONG_PRESS,      // held for the long press time
+    FOOTSWITCH_GESTURE_HOLD_REPEAT,     // every repeat interval after a long press
+    FOOTSWITCH_GESTURE_LAST
+};
+
+#define FOOTSWITCH_GESTURE_MASK(g)      (1UL << (g))
+
+typedef struct
+{
+    uint8_t PressSamples;               // net pressed samples to register a press
+    uint8_t ReleaseSamples;             // net released samples to register a release
+    uint32_t LongPressTime;             // usec, 0 to disable long press and hold repeat
+    uint32_t RepeatInterval;            // usec, 0 to disable hold repeat
+    uint32_t DoubleTapWindow;           // usec, 0 to disable. Taps are delayed by this much
+} tFootswitchGestureConfig;
+
+typedef struct
+{
+    uint8_t Integrator;
+    uint8_t Pressed;                    // debounced state
+    uint8_t State;
+    uint8_t Repeats;
+    int64_t PressTime;
+    int64_t Deadline;                   // 0 if no timer running
+} tFootswitchGestureSwitch;
+
+typedef struct
+{
+    int64_t Time;                       // usec, sample time that produced it
+    uint32_t Duration;                  // usec since the press, or 0
+    uint8_t Switch;
+    uint8_t Gesture;                    // FOOTSWITCH_GESTURE_
+    uint8_t Count;                      // hold repeat count
+} tFootswitchGestureEvent;
+
+typedef void (*tFootswitchGestureHandler)(const tFootswitchGestureEvent* event, void* context);
+
+void footswitch_gesture_reset(tFootswitchGestureSwitch* sw);
+uint8_t footswitch_gesture_sample(tFootswitchGestureSwitch* sw, const tFootswitchGestureConfig* config, uint8_t number, uint8_t raw, int64_t now,
+                                  tFootswitchGestureHandler handler, void* context);
@@ -42,26 +42,42 @@ limitations under the License.
 #include "leds.h"
 #include "driver/i2c.h"
 #include "SX1509.h"
+#include "footswitch_gesture.h"
+#include "footswitch_actions.h"
+#include "tap_tempo.h"
+#include "midi_clock.h"
+#include "i2c_scheduler.h"
 #include "midi_helper.h"
 #include "tonex_params.h"
 
 #define FOOTSWITCH_TASK_STACK_SIZE          (3 * 1024)
-#define FOOTSWITCH_SAMPLE_COUNT             5       // 20 msec per sample
-#define BUTTON_FACTORY_RESET_TIME           500    // * 20 msec = 10 secs
+#define FOOTSWITCH_FACTORY_RESET_TIME       10000000    // usec switch 1 is held for
+#define FOOTSWITCH_BINARY_SAMPLES           9       // * 20 msec, binary inputs must be stable this long
+#define FOOTSWITCH_ONBOARD_MAX              4
+#define FOOTSWITCH_EXTERNAL_MAX             16
+#define FOOTSWITCH_POLL_INTERVAL            20      // msec, while a switch is active
+#define FOOTSWITCH_IDLE_POLL_INTERVAL       100     // msec, fallback when waiting for edges
+#define FOOTSWITCH_EVENT_QUEUE_LENGTH       16
+#define FOOTSWITCH_LATENCY_BUCKETS          8
+#define FOOTSWITCH_STATS_INTERVAL           30000   // msec
 
 enum FootswitchStates
 {
     FOOTSWITCH_IDLE,
-    FOOTSWITCH_WAIT_RELEASE_1,
-    FOOTSWITCH_WAIT_RELEASE_2
+    FOOTSWITCH_WAIT_RELEASE
 };
 
-enum FootswitchHandlers
+enum FootswitchEventSources
 {
-    FOOTSWITCH_HANDLER_ONBOARD,
-    FOOTSWITCH_HANDLER_EXTERNAL_PRESETS,
-    FOOTSWITCH_HANDLER_EXTERNAL_EFFECTS,
-    FOOTSWITCH_HANDLER_MAX
+    FOOTSWITCH_EVENT_ONBOARD,
+    FOOTSWITCH_EVENT_EXPANDER
+};
+
+enum FootswitchGroups
+{
+    FOOTSWITCH_GROUP_ONBOARD,
+    FOOTSWITCH_GROUP_EXTERNAL,
+    FOOTSWITCH_GROUP_MAX
 };
 
 static const char *TAG = "app_footswitches";
@@ -69,27 +85,50 @@ static const char *TAG = "app_footswitches";
 typedef struct
 {
     uint8_t state;
-    uint32_t sample_counter;
     uint16_t last_binary_val;
     uint16_t current_bank;
     uint16_t index_pending;    
-    esp_err_t (*footswitch_single_reader)(uint8_t, uint8_t*);    
-    esp_err_t (*footswitch_multiple_reader)(uint16_t*);    
 } tFootswitchHandler;
 
 typedef struct
 {
-    uint8_t toggle;
-    tExternalFootswitchEffectConfig config;
-} tExternalFootswitchEffectHandler;
+    uint8_t count;
+    uint8_t busy;
+    uint16_t pressed;           // debounced, bit per switch
+    tFootswitchHandler handler;
+    tFootswitchActionTable actions;
+    tFootswitchGestureSwitch switches[FOOTSWITCH_EXTERNAL_MAX];
+    tFootswitchGestureConfig config[FOOTSWITCH_EXTERNAL_MAX];
+} tFootswitchGroup;
+
+typedef struct
+{
+    int64_t time;               // esp_timer usec
+    uint8_t source;             // FOOTSWITCH_EVENT_
+} tFootswitchEvent;
+
+typedef struct
+{
+    uint32_t edges;
+    uint32_t edges_dropped;
+    uint32_t dispatched_polled;     // found by a poll, no edge to time from
+    uint32_t latency_max;           // usec
+    uint32_t histogram[FOOTSWITCH_LATENCY_BUCKETS];
+} tFootswitchStats;
 
 typedef struct
 {
-    tFootswitchHandler Handlers[FOOTSWITCH_HANDLER_MAX];
+    tFootswitchGroup Groups[FOOTSWITCH_GROUP_MAX];
     uint8_t io_expander_ok;
+    uint8_t io_expander_interrupt;
+    uint8_t edge_pending;
+    int64_t edge_time;
+    TickType_t idle_wait;
+    tFootswitchStats stats;
     uint8_t onboard_switch_mode;   
     uint8_t external_switch_mode;
-    tExternalFootswitchEffectHandler ExternalFootswitchEffectHandler[MAX_EXTERNAL_EFFECT_FOOTSWITCHES];
+    volatile uint8_t config_changed;
+    tTapTempo tap_tempo;            // shared by every tap switch, onboard or external
 } tFootswitchControl;
 
 typedef struct
@@ -101,10 +140,14 @@ typedef struct
 } tFootswitchLayoutEntry;
 
 static tFootswitchControl FootswitchControl;
-static SemaphoreHandle_t I2CMutexHandle;
+static QueueHandle_t footswitch_event_queue;
+
+// upper limit of each latency bucket in usec, the last bucket takes the rest
+static const uint32_t FootswitchLatencyLimits[FOOTSWITCH_LATENCY_BUCKETS - 1] = {250, 500, 1000, 2000, 5000, 10000, 20000};
 static i2c_port_t i2cnum;
 
-static const __attribute__((unused)) tFootswitchLayoutEntry FootswitchLayouts[FOOTSWITCH_LAYOUT_LAST] = 
+// built in layouts, compiled into action tables. FOOTSWITCH_LAYOUT_CUSTOM has its own table
+static const tFootswitchLayoutEntry FootswitchLayouts[FOOTSWITCH_LAYOUT_CUSTOM] = 
 {
     //tot  ppb  bdm     bum
     {3,    3,   0x0003,   0x0006},            // FOOTSWITCH_LAYOUT_1X3
@@ -120,118 +163,232 @@ static const __attribute__((unused)) tFootswitchLayoutEntry FootswitchLayouts[FO
 
 /****************************************************************************
 * NAME:        
-* DESCRIPTION: 
-* PARAMETERS:  
+* DESCRIPTION: Footswitch edge interrupt
+* PARAMETERS:  arg: FOOTSWITCH_EVENT_ source
 * RETURN:      
-* NOTES:       
+* NOTES:       Direct GPIO switches, or the SX1509 NINT output
 *****************************************************************************/
-static esp_err_t footswitch_read_single_onboard(uint8_t number, uint8_t* switch_state)
+static void IRAM_ATTR footswitch_edge_isr(void* arg)
 {
-    esp_err_t result = ESP_FAIL;
+    tFootswitchEvent event;
+    BaseType_t woken = pdFALSE;
 
-#if CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_WAVESHARE_43B || CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_WAVESHARE_43DEVONLY
-    // display board uses onboard I2C IO expander
-    uint8_t value;
+    event.time = esp_timer_get_time();
+    event.source = (uint8_t)(uintptr_t)arg;
 
-    if (CH422G_read_input(number, &value) == ESP_OK)
+    if (xQueueSendFromISR(footswitch_event_queue, (void*)&event, &woken) != pdPASS)
     {
-        result = ESP_OK;
-        *switch_state = (value == 0);
+        FootswitchControl.stats.edges_dropped++;
     }
-#else
-    // other boards can use direct IO pin
-    *switch_state = (gpio_get_level(number) == 0);
-
-    result = ESP_OK;
-#endif
 
-    return result;
+    // switch to the footswitch task now if it was waiting
+    portYIELD_FROM_ISR(woken);
 }
 
 /****************************************************************************
 * NAME:        
-* DESCRIPTION: 
+* DESCRIPTION: A switch action has been sent
 * PARAMETERS:  
 * RETURN:      
-* NOTES:       
+* NOTES:       Adds the time since the edge that woke us to the histogram
 *****************************************************************************/
-static esp_err_t footswitch_read_multiple_onboard(uint16_t* switch_state)
+static void footswitch_record_dispatch(void)
 {
-    esp_err_t result = ESP_FAIL;
-    *switch_state = 0;
+    uint32_t latency;
+    uint8_t bucket;
 
-#if CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_WAVESHARE_43B || CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_WAVESHARE_43DEVONLY
-    // display board uses onboard I2C IO expander
-    uint16_t values;
-
-    if (CH422G_read_all_input(&values) == ESP_OK)
+    if (FootswitchControl.edge_pending == 0)
     {
-        result = ESP_OK;
-        *switch_state = values;
+        FootswitchControl.stats.dispatched_polled++;
+        return;
     }
-#else
-    // direct gpio
-    if (FOOTSWITCH_1 != -1)
+
+    FootswitchControl.edge_pending = 0;
+    latency = (uint32_t)(esp_timer_get_time() - FootswitchControl.edge_time);
+
+    for (bucket = 0; bucket < (FOOTSWITCH_LATENCY_BUCKETS - 1); bucket++)
     {
-        *switch_state |= (gpio_get_level(FOOTSWITCH_1) == 0);
+        if (latency <= FootswitchLatencyLimits[bucket])
+        {
+            break;
+        }
     }
 
-    if (FOOTSWITCH_2 != -1)
+    FootswitchControl.stats.histogram[bucket]++;
+
+    if (latency > FootswitchControl.stats.latency_max)
     {
-        *switch_state |= ((gpio_get_level(FOOTSWITCH_2) == 0) << 1);
+        FootswitchControl.stats.latency_max = latency;
     }
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Log the edge to dispatch latency histogram
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       
+*****************************************************************************/
+static void footswitch_log_stats(void)
+{
+    tFootswitchStats* stats = &FootswitchControl.stats;
+
+    ESP_LOGI(TAG, "Edges %d dropped %d, dispatched from poll %d, latency max %d usec", (int)stats->edges, (int)stats->edges_dropped, 
+             (int)stats->dispatched_polled, (int)stats->latency_max);
+    ESP_LOGI(TAG, "Latency <=250us %d <=500us %d <=1ms %d <=2ms %d <=5ms %d <=10ms %d <=20ms %d >20ms %d", 
+             (int)stats->histogram[0], (int)stats->histogram[1], (int)stats->histogram[2], (int)stats->histogram[3], 
+             (int)stats->histogram[4], (int)stats->histogram[5], (int)stats->histogram[6], (int)stats->histogram[7]);
+}
 
-    if (FOOTSWITCH_3 != -1)
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Clear the IO expander interrupt
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       NINT stays low until this is done, and won't edge again
+*****************************************************************************/
+static void footswitch_clear_expander_interrupt(void)
+{
+    uint16_t sources;
+
+    if (FootswitchControl.io_expander_interrupt)
     {
-        *switch_state |= ((gpio_get_level(FOOTSWITCH_3) == 0) << 2);
+        SX1509_clearInterrupts(&sources);
     }
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Wait until the switches need looking at again
+* PARAMETERS:  busy: a switch is being debounced or timed
+* RETURN:      
+* NOTES:       Busy switches are sampled at a fixed rate so the debounce
+*              counts keep their timing. Otherwise sleep until an edge,
+*              with a fallback poll in case one is missed
+*****************************************************************************/
+static void footswitch_wait(uint8_t busy)
+{
+    tFootswitchEvent event;
+    uint8_t expander = 0;
+
+    // an edge only counts for the pass straight after it
+    FootswitchControl.edge_pending = 0;
 
-    if (FOOTSWITCH_4 != -1)
+    if (busy)
     {
-        *switch_state |= ((gpio_get_level(FOOTSWITCH_4) == 0) << 3);
+        vTaskDelay(pdMS_TO_TICKS(FOOTSWITCH_POLL_INTERVAL));
+
+        // edges while busy are just bounce
+        while (xQueueReceive(footswitch_event_queue, (void*)&event, 0) == pdPASS)
+        {
+            FootswitchControl.stats.edges++;
+            expander |= (event.source == FOOTSWITCH_EVENT_EXPANDER);
+        }
     }
+    else
+    {
+        if (xQueueReceive(footswitch_event_queue, (void*)&event, FootswitchControl.idle_wait) == pdPASS)
+        {
+            FootswitchControl.edge_pending = 1;
+            FootswitchControl.edge_time = event.time;
+
+            // keep the earliest of a burst
+            do
+            {
+                FootswitchControl.stats.edges++;
+                expander |= (event.source == FOOTSWITCH_EVENT_EXPANDER);
 
-    result = ESP_OK;
+                if (event.time < FootswitchControl.edge_time)
+                {
+                    FootswitchControl.edge_time = event.time;
+                }
+            } while (xQueueReceive(footswitch_event_queue, (void*)&event, 0) == pdPASS);
+        }
+#if CONFIG_TONEX_CONTROLLER_IO_EXPANDER_INT_GPIO >= 0
+        else if (FootswitchControl.io_expander_interrupt && (gpio_get_level(CONFIG_TONEX_CONTROLLER_IO_EXPANDER_INT_GPIO) == 0))
+        {
+            // NINT stuck low, an edge was missed
+            expander = 1;
+        }
 #endif
+    }
 
-    return result;
+    if (expander)
+    {
+        footswitch_clear_expander_interrupt();
+    }
 }
 
 /****************************************************************************
 * NAME:        
-* DESCRIPTION: 
+* DESCRIPTION: Check if any switch needs sampling again soon
 * PARAMETERS:  
+* RETURN:      1 if busy
+* NOTES:       Debouncing, or a gesture timer running
+*****************************************************************************/
+static uint8_t footswitch_busy(void)
+{
+    for (uint8_t loop = 0; loop < FOOTSWITCH_GROUP_MAX; loop++)
+    {
+        if (FootswitchControl.Groups[loop].busy)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Read the onboard switches
+* PARAMETERS:  switch_states: bit per switch, 1 = pressed
 * RETURN:      
 * NOTES:       
 *****************************************************************************/
-static esp_err_t footswitch_read_single_offboard(uint8_t pin, uint8_t* switch_state)
+static esp_err_t footswitch_read_onboard(uint16_t* switch_states)
 {
-    esp_err_t result = ESP_FAIL;
-    uint8_t level;
+    const int footswitch_pins[FOOTSWITCH_ONBOARD_MAX] = {FOOTSWITCH_1, FOOTSWITCH_2, FOOTSWITCH_3, FOOTSWITCH_4};
+    *switch_states = 0;
 
-    if (FootswitchControl.io_expander_ok)
-    {       
-        if (SX1509_digitalRead(pin, &level) == ESP_OK)
-        {            
-            // debug
-            //ESP_LOGI(TAG, "Footswitch read %d", (int)level_mask);
+#if CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_WAVESHARE_43B || CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_WAVESHARE_43DEVONLY
+    // display board uses onboard I2C IO expander
+    uint16_t values;
 
-            result = ESP_OK;
-            *switch_state = (level == 0);
+    if (CH422G_read_all_input(&values) != ESP_OK)
+    {
+        return ESP_FAIL;
+    }
+
+    for (uint8_t loop = 0; loop < FOOTSWITCH_ONBOARD_MAX; loop++)
+    {
+        if ((footswitch_pins[loop] != -1) && (((values >> footswitch_pins[loop]) & 0x01) == 0))
+        {
+            *switch_states |= (1 << loop);
+        }
+    }
+#else
+    // direct gpio
+    for (uint8_t loop = 0; loop < FOOTSWITCH_ONBOARD_MAX; loop++)
+    {
+        if ((footswitch_pins[loop] != -1) && (gpio_get_level(footswitch_pins[loop]) == 0))
+        {
+            *switch_states |= (1 << loop);
         }
     }
+#endif
 
-    return result;
+    return ESP_OK;
 }
 
 /****************************************************************************
 * NAME:        
-* DESCRIPTION: 
-* PARAMETERS:  
+* DESCRIPTION: Read the external switches
+* PARAMETERS:  switch_states: bit per switch, 1 = pressed
 * RETURN:      
 * NOTES:       
 *****************************************************************************/
-static esp_err_t footswitch_read_multiple_offboard(uint16_t* switch_states)
+static esp_err_t footswitch_read_offboard(uint16_t* switch_states)
 {
     esp_err_t result = ESP_FAIL;
 
@@ -271,376 +428,663 @@ static esp_err_t footswitch_read_multiple_offboard(uint16_t* switch_states)
 
 /****************************************************************************
 * NAME:        
-* DESCRIPTION: 
+* DESCRIPTION: Toggle an effect parameter from its midi CC
 * PARAMETERS:  
 * RETURN:      
-* NOTES:       
+* NOTES:       On/off parameters are flipped, others alternate between the
+*              two values of the action
 *****************************************************************************/
-static void footswitch_handle_dual_mode(tFootswitchHandler* handler)
+static void footswitch_toggle_effect(tFootswitchAction* action)
 {
-    uint8_t value;   
+    uint16_t param;
+    float new_value;
+    tTonexParameter* param_ptr;
+
+    // get the parameter that corresponds to this Midi control change value
+    param = midi_helper_get_param_for_change_num(action->Value);
 
-    switch (handler->state)
+    if (param == 0xFFFF)
     {
-        case FOOTSWITCH_IDLE:
-        default:
+        return;
+    }
+
+    // get the current value of the parameter
+    if (tonex_params_get_locked_access(&param_ptr) != ESP_OK)
+    {
+        return;
+    }
+
+    // is the parameter a boolean type?
+    if ((param_ptr[param].Min == 0) && (param_ptr[param].Max == 1))
+    {
+        // toggle the current value
+        if (param_ptr[param].Value == 0)
         {
-            // read footswitches
-            if (handler->footswitch_single_reader(FOOTSWITCH_1, &value) == ESP_OK) 
-            {
-                if (value == 1)
-                {
-                    ESP_LOGI(TAG, "Footswitch 1 pressed");
+            new_value = 1;
+        }
+        else
+        {
+            new_value = 0;
+        }
 
-                    // foot switch 1 pressed
-                    control_request_preset_down();
+        tonex_params_release_locked_access();
 
-                    // wait release	
-                    handler->sample_counter = 0;
-                    handler->state = FOOTSWITCH_WAIT_RELEASE_1;
-                }
-            }
+        ESP_LOGI(TAG, "Footswitch Param change to %d", (int)new_value);
 
-            if (handler->state == FOOTSWITCH_IDLE)
-            {
-                if (handler->footswitch_single_reader(FOOTSWITCH_2, &value) == ESP_OK)
-                {
-                    if (value == 1)
-                    {
-                        ESP_LOGI(TAG, "Footswitch 2 pressed");
+        // change the parameter
+        usb_modify_parameter(param, new_value);                                        
+    }
+    else
+    {
+        tonex_params_release_locked_access();
 
-                        // foot switch 2 pressed, send event
-                        control_request_preset_up();
+        // not a boolean, use local toggle variable
+        if (action->Toggle == 0)
+        {
+            // send first value
+            midi_helper_adjust_param_via_midi(action->Value, action->Value_1);
 
-                        // wait release	
-                        handler->sample_counter = 0;
-                        handler->state = FOOTSWITCH_WAIT_RELEASE_2;
-                    }
-                }
-            }
-        } break;
+            ESP_LOGI(TAG, "Footswitch Param change (1). CC:%d. Value:%d", (int)action->Value, (int)action->Value_1);
+        }
+        else
+        {
+            // send second value
+            midi_helper_adjust_param_via_midi(action->Value, action->Value_2);
 
-        case FOOTSWITCH_WAIT_RELEASE_1:
+            ESP_LOGI(TAG, "Footswitch Param change (2). CC:%d. Value:%d", (int)action->Value, (int)action->Value_2);
+        }
+
+        // flip toggle state
+        action->Toggle = !action->Toggle;
+    }
+
+    footswitch_record_dispatch();
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Tell the leds what each switch does
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       The external switches if the IO expander is fitted, otherwise
+*              the onboard ones. Called when the actions or the bank change.
+*              The table is only posted, the led task draws it
+*****************************************************************************/
+static void footswitch_sync_leds(void)
+{
+    tLedSwitchRole roles[LED_SWITCH_ROLES_MAX];
+    tFootswitchGroup* group_ptr;
+    tFootswitchAction* action;
+    uint16_t param;
+
+    if (FootswitchControl.io_expander_ok)
+    {
+        group_ptr = &FootswitchControl.Groups[FOOTSWITCH_GROUP_EXTERNAL];
+    }
+    else
+    {
+        group_ptr = &FootswitchControl.Groups[FOOTSWITCH_GROUP_ONBOARD];
+    }
+
+    memset((void*)roles, 0, sizeof(roles));
+
+    for (uint8_t loop = 0; (loop < group_ptr->count) && (loop < LED_SWITCH_ROLES_MAX); loop++)
+    {
+        action = footswitch_actions_lookup(&group_ptr->actions, (1 << loop));
+        if (action == NULL)
         {
-            // read footswitch 1
-            if (handler->footswitch_single_reader(FOOTSWITCH_1, &value) == ESP_OK)
-            {
-                if (value == 0)
-                {
-                    handler->sample_counter++;
-                    if (handler->sample_counter == FOOTSWITCH_SAMPLE_COUNT)
-                    {
-                        // foot switch released
-                        handler->state = FOOTSWITCH_IDLE;		
-                    }
-                }
-                else
-                {
-                    // reset counter
-                    handler->sample_counter = 0;
-                }
-            }
-        } break;
+            continue;
+        }
 
-        case FOOTSWITCH_WAIT_RELEASE_2:
+        switch (action->Action)
         {
-            // read footswitch 2
-            if (handler->footswitch_single_reader(FOOTSWITCH_2, &value) == ESP_OK)
+            case FOOTSWITCH_ACTION_PRESET:
             {
-                if (value == 0)
+                roles[loop].Role = LED_SWITCH_ROLE_PRESET;
+                roles[loop].Value = (group_ptr->handler.current_bank * group_ptr->actions.PresetsPerBank) + action->Value;
+            } break;
+
+            case FOOTSWITCH_ACTION_SCENE:
+            {
+                roles[loop].Role = LED_SWITCH_ROLE_PRESET;
+                roles[loop].Value = action->Value;
+            } break;
+
+            case FOOTSWITCH_ACTION_BANK_UP:
+            case FOOTSWITCH_ACTION_BANK_DOWN:
+            {
+                roles[loop].Role = LED_SWITCH_ROLE_BANK;
+                roles[loop].Value = group_ptr->handler.current_bank;
+            } break;
+
+            case FOOTSWITCH_ACTION_EFFECT:
+            {
+                param = midi_helper_get_param_for_change_num(action->Value);
+
+                if (param != 0xFFFF)
                 {
-                    handler->sample_counter++;
-                    if (handler->sample_counter == FOOTSWITCH_SAMPLE_COUNT)
-                    {
-                        // foot switch released
-                        handler->state = FOOTSWITCH_IDLE;
-                    }                 
+                    roles[loop].Role = LED_SWITCH_ROLE_EFFECT;
+                    roles[loop].Value = param;
                 }
                 else
                 {
-                    // reset counter
-                    handler->sample_counter = 0;
+                    roles[loop].Role = LED_SWITCH_ROLE_ACTION;
                 }
-            }
-        } break;
+            } break;
+
+            case FOOTSWITCH_ACTION_TAP_TEMPO:
+            {
+                roles[loop].Role = LED_SWITCH_ROLE_TEMPO;
+            } break;
+
+            case FOOTSWITCH_ACTION_NONE:
+            {
+                // not used
+            } break;
+
+            default:
+            {
+                roles[loop].Role = LED_SWITCH_ROLE_ACTION;
+            } break;
+        }
     }
+
+    leds_set_switch_roles(roles, LED_SWITCH_ROLES_MAX);
 }
 
 /****************************************************************************
 * NAME:        
-* DESCRIPTION: 
+* DESCRIPTION: Carry out a switch action
 * PARAMETERS:  
 * RETURN:      
 * NOTES:       
 *****************************************************************************/
-static void footswitch_handle_banked(tFootswitchHandler* handler, tFootswitchLayoutEntry* layout)
+static void footswitch_run_action(tFootswitchGroup* group_ptr, tFootswitchAction* action, const tFootswitchGestureEvent* event)
 {
-    uint16_t binary_val = 0;    
-    uint16_t loop;
-    uint16_t mask = 0;
+    tFootswitchHandler* handler = &group_ptr->handler;
+    uint8_t presets_per_bank = group_ptr->actions.PresetsPerBank;
 
-    // read all footswitches
-    if (handler->footswitch_multiple_reader(&binary_val) != ESP_OK)
+    switch (action->Action)
     {
-        // failed
-        return;
-    }
-    
-    // check if switch is outside of the used range
-    for (loop = 0; loop < layout->total_switches; loop++)
-    {
-        mask |= (1 << loop);
+        case FOOTSWITCH_ACTION_PRESET:
+        {
+            // set the preset
+            control_request_preset_index((handler->current_bank * presets_per_bank) + action->Value);
+            footswitch_record_dispatch();
+        } break;
+
+        case FOOTSWITCH_ACTION_PRESET_UP:
+        {
+            ESP_LOGI(TAG, "Footswitch %d pressed", (int)event->Switch + 1);
+            control_request_preset_up();
+            footswitch_record_dispatch();
+        } break;
+
+        case FOOTSWITCH_ACTION_PRESET_DOWN:
+        {
+            ESP_LOGI(TAG, "Footswitch %d pressed", (int)event->Switch + 1);
+            control_request_preset_down();
+            footswitch_record_dispatch();
+        } break;
+
+        case FOOTSWITCH_ACTION_BANK_UP:
+        {
+            if ((presets_per_bank != 0) && (handler->current_bank < (MAX_PRESETS / presets_per_bank)))
+            {
+                // bank up
+                handler->current_bank++;
+                ESP_LOGI(TAG, "Footswitch banked up %d", handler->current_bank);
+                footswitch_sync_leds();
+            }
+        } break;
+
+        case FOOTSWITCH_ACTION_BANK_DOWN:
+        {
+            if (handler->current_bank > 0)
+            {
+                // bank down
+                handler->current_bank--;   
+                ESP_LOGI(TAG, "Footswitch banked down %d", handler->current_bank);
+                footswitch_sync_leds();
+            }
+        } break;
+
+        case FOOTSWITCH_ACTION_SCENE:
+        {
+            ESP_LOGI(TAG, "Footswitch scene preset %d", (int)action->Value + 1);
+            control_request_preset_index(action->Value);
+            footswitch_record_dispatch();
+        } break;
+
+        case FOOTSWITCH_ACTION_EFFECT:
+        {
+            footswitch_toggle_effect(action);
+        } break;
+
+        case FOOTSWITCH_ACTION_TAP_TEMPO:
+        {
+            // timed from the edge that saw the press if this pass had one, else from the poll
+            if (tap_tempo_tap(&FootswitchControl.tap_tempo, FootswitchControl.edge_pending ? FootswitchControl.edge_time : event->Time))
+            {
+                ESP_LOGI(TAG, "Footswitch tap tempo %d.%d BPM", (int)FootswitchControl.tap_tempo.BPM, (int)(FootswitchControl.tap_tempo.BPM * 10) % 10);
+                midi_clock_push_tempo(FootswitchControl.tap_tempo.BPM);
+                leds_set_tempo(FootswitchControl.tap_tempo.BPM);
+                footswitch_record_dispatch();
+            }
+        } break;
+
+        default:
+        {
+            // not used
+        } break;
     }
+}
 
-    // mask off unused switches
-    binary_val &= mask;
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Run a group's switches from its action table
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       Switches that aren't part of a combination act as soon as
+*              they are pressed. The rest wait for release, so that a
+*              combination can be pressed without selecting a preset first
+*****************************************************************************/
+static void footswitch_handle_actions(tFootswitchGroup* group_ptr, const tFootswitchGestureEvent* event)
+{
+    tFootswitchHandler* handler = &group_ptr->handler;
+    tFootswitchActionTable* table = &group_ptr->actions;
+    uint16_t switch_mask = (1 << event->Switch);
+    uint16_t combo_pressed = group_ptr->pressed & table->ComboSwitches;
+    tFootswitchAction* action;
 
-    // handle state
-    switch (handler->state)
+    switch (event->Gesture)
     {
-        case FOOTSWITCH_IDLE:
+        case FOOTSWITCH_GESTURE_PRESS:
         {
-            // any buttons pressed?
-            if (binary_val != 0) 
+            if ((table->ComboSwitches & switch_mask) == 0)
             {
-                // check if bank down is pressed
-                if (binary_val == layout->bank_down_switch_mask)
-                {
-                    if (handler->current_bank > 0)
-                    {
-                        // bank down
-                        handler->current_bank--;   
-                        ESP_LOGI(TAG, "Footswitch banked down %d", handler->current_bank);
-                    }
-
-                    handler->state = FOOTSWITCH_WAIT_RELEASE_1;
-                }
-                // check if bank up is pressed
-                else if (binary_val == layout->bank_up_switch_mask)
-                {
-                    if (handler->current_bank < (MAX_PRESETS / layout->presets_per_bank))
-                    {
-                        // bank up
-                        handler->current_bank++;
-                        ESP_LOGI(TAG, "Footswitch banked up %d", handler->current_bank);
-                    }
-
-                    handler->state = FOOTSWITCH_WAIT_RELEASE_1;
-                }
-                else
+                action = footswitch_actions_lookup(table, switch_mask);
+                if (action != NULL)
                 {
-                    // single button pressed, just store it. Preset select only happens on button release
-                    handler->index_pending = binary_val;
+                    footswitch_run_action(group_ptr, action, event);
                 }
+                break;
+            }
+
+            if (handler->state == FOOTSWITCH_WAIT_RELEASE)
+            {
+                // combination already done, wait for everything to be let go
+                break;
+            }
+
+            // is it a combination?
+            action = footswitch_actions_lookup(table, combo_pressed);
+            if ((action != NULL) && ((combo_pressed & (combo_pressed - 1)) != 0))
+            {
+                footswitch_run_action(group_ptr, action, event);
+
+                handler->state = FOOTSWITCH_WAIT_RELEASE;
+                handler->index_pending = 0;
             }
             else
             {
-                if (handler->index_pending != 0)
-                {
-                    uint8_t new_preset = handler->current_bank * layout->presets_per_bank;
-
-                    // get the index from the bit set
-                    for (uint8_t loop = 1; loop < layout->presets_per_bank; loop++)    
-                    {
-                        if ((handler->index_pending & (1 << loop)) != 0)    
-                        {
-                            new_preset += loop;
-                            break;
-                        }
-                    }
-
-                    // set the preset
-                    control_request_preset_index(new_preset);
-                    handler->index_pending = 0;
-
-                    // give a little debounce time
-                    vTaskDelay(pdMS_TO_TICKS(100));
-                }
+                // just store it. Action only happens on button release
+                handler->index_pending = combo_pressed;
             }
         } break;
 
-        case FOOTSWITCH_WAIT_RELEASE_1:
+        case FOOTSWITCH_GESTURE_RELEASE:
         {
-            // check if all buttons released
-            if (binary_val == 0)
+            if ((table->ComboSwitches & switch_mask) == 0)
+            {
+                break;
+            }
+
+            if (combo_pressed != 0)
             {
+                if (handler->state == FOOTSWITCH_IDLE)
+                {
+                    handler->index_pending = combo_pressed;
+                }
+            }
+            else if (handler->state == FOOTSWITCH_WAIT_RELEASE)
+            {
+                // all buttons released
                 handler->state = FOOTSWITCH_IDLE;
                 handler->index_pending = 0;
+            }
+            else if (handler->index_pending != 0)
+            {
+                action = footswitch_actions_lookup(table, handler->index_pending);
+                if (action == NULL)
+                {
+                    // not a combination, use the lowest switch
+                    action = footswitch_actions_lookup(table, handler->index_pending & -handler->index_pending);
+                }
 
-                // give a little debounce time
-                vTaskDelay(pdMS_TO_TICKS(100));
+                if (action != NULL)
+                {
+                    footswitch_run_action(group_ptr, action, event);
+                }
+
+                handler->index_pending = 0;
             }
         } break;
+
+        default:
+        {
+            // not used
+        } break;
     }
 }
 
 /****************************************************************************
 * NAME:        
-* DESCRIPTION: 
-* PARAMETERS:  
+* DESCRIPTION: Binary mode, the 4 switches select the preset directly
+* PARAMETERS:  pressed: debounced state of the group
 * RETURN:      
-* NOTES:       
+* NOTES:       These are latching switches. Their debounce is long, so we
+*              don't jump around presets while inputs are being set
 *****************************************************************************/
-static void footswitch_handle_quad_binary(tFootswitchHandler* handler)
+static void footswitch_handle_quad_binary(tFootswitchHandler* handler, uint16_t pressed, const tFootswitchGestureEvent* event)
 {
-    uint8_t value;
-    uint8_t binary_val = 0;    
+    uint8_t binary_val = (uint8_t)(pressed & 0x0F);
 
-    // read all 4 switches (and swap so 1 is pressed)
-    handler->footswitch_single_reader(FOOTSWITCH_1, &value);
-    if (value == 1)
+    if ((event->Gesture != FOOTSWITCH_GESTURE_PRESS) && (event->Gesture != FOOTSWITCH_GESTURE_RELEASE))
+    {
+        return;
+    }
+
+    // has it changed?
+    if (binary_val != handler->last_binary_val)
     {
-        binary_val |= 1;
+        handler->last_binary_val = binary_val;
+
+        // set preset
+        control_request_preset_index(binary_val);
+        footswitch_record_dispatch();
+
+        ESP_LOGI(TAG, "Footswitch binary set preset %d", binary_val);
     }
+}
 
-    handler->footswitch_single_reader(FOOTSWITCH_2, &value);
-    if (value == 1)
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Factory reset when switch 1 is held
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       
+*****************************************************************************/
+static void footswitch_handle_reset(const tFootswitchGestureEvent* event)
+{
+    if ((event->Switch == 0) && (event->Gesture == FOOTSWITCH_GESTURE_HOLD_REPEAT) && (event->Duration >= FOOTSWITCH_FACTORY_RESET_TIME))
     {
-        binary_val |= 2;
+        ESP_LOGI(TAG, "Config Reset to default");  
+        control_set_default_config(); 
+
+        // save and reboot
+        control_save_user_data(1);
     }
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Pass a gesture event to the handlers for its group
+* PARAMETERS:  context: FOOTSWITCH_GROUP_
+* RETURN:      
+* NOTES:       
+*****************************************************************************/
+static void footswitch_handle_event(const tFootswitchGestureEvent* event, void* context)
+{
+    uint8_t group = (uint8_t)(uintptr_t)context;
+    tFootswitchGroup* group_ptr = &FootswitchControl.Groups[group];
 
-    handler->footswitch_single_reader(FOOTSWITCH_3, &value);
-    if (value == 1)
+    // keep the debounced state, for the handlers that use switch combinations
+    if (event->Gesture == FOOTSWITCH_GESTURE_PRESS)
+    {
+        group_ptr->pressed |= (1 << event->Switch);
+    }
+    else if (event->Gesture == FOOTSWITCH_GESTURE_RELEASE)
     {
-        binary_val |= 4;
+        group_ptr->pressed &= ~(1 << event->Switch);
     }
 
-    handler->footswitch_single_reader(FOOTSWITCH_4, &value);
-    if (value == 1)
+    if (group == FOOTSWITCH_GROUP_ONBOARD)
     {
-        binary_val |= 8;
+        // onboard IO foot switches (direct GPIO and IO expander on main PCB)
+        if (FootswitchControl.onboard_switch_mode == FOOTSWITCH_MODE_QUAD_BINARY)
+        {
+            // run 4 switch binary mode
+            footswitch_handle_quad_binary(&group_ptr->handler, group_ptr->pressed, event);
+        }
+        else
+        {
+            // dual, banked or custom, all from the action table
+            footswitch_handle_actions(group_ptr, event);
+        }
+
+        // check for button held for data reset
+        footswitch_handle_reset(event);
+    }
+    else
+    {
+        // presets and effects, from the action table
+        footswitch_handle_actions(group_ptr, event);
     }
+}
 
-    // has it changed?
-    if (binary_val != handler->last_binary_val)
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Sample a group of switches
+* PARAMETERS:  raw: bit per switch, 1 = contact closed
+*              now: usec sample time
+* RETURN:      
+* NOTES:       
+*****************************************************************************/
+static void footswitch_sample_group(uint8_t group, uint16_t raw, int64_t now)
+{
+    tFootswitchGroup* group_ptr = &FootswitchControl.Groups[group];
+    uint8_t busy = 0;
+
+    for (uint8_t loop = 0; loop < group_ptr->count; loop++)
     {
-        handler->last_binary_val = binary_val;
+        busy |= footswitch_gesture_sample(&group_ptr->switches[loop], &group_ptr->config[loop], loop, (raw >> loop) & 0x01, now,
+                                          footswitch_handle_event, (void*)(uintptr_t)group);
+    }
 
-        // set preset
-        control_request_preset_index(binary_val);
+    group_ptr->busy = busy;
+}
 
-        ESP_LOGI(TAG, "Footswitch binary set preset %d", binary_val);
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Add a built in layout to an action table
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       Nothing is mapped past the layout's switches
+*****************************************************************************/
+static void footswitch_add_layout(tFootswitchActionTable* table, const tFootswitchLayoutEntry* layout)
+{
+    uint16_t switch_mask = (1 << layout->total_switches) - 1;
+
+    for (uint8_t loop = 0; (loop < layout->presets_per_bank) && (loop < layout->total_switches); loop++)
+    {
+        footswitch_actions_add(table, (1 << loop), FOOTSWITCH_ACTION_PRESET, loop, 0, 0);
     }
 
-    // wait a little longer, so we don't jump around presets while inputs are being set
-    vTaskDelay(pdMS_TO_TICKS(180));
+    footswitch_actions_add(table, layout->bank_down_switch_mask & switch_mask, FOOTSWITCH_ACTION_BANK_DOWN, 0, 0, 0);
+    footswitch_actions_add(table, layout->bank_up_switch_mask & switch_mask, FOOTSWITCH_ACTION_BANK_UP, 0, 0, 0);
 }
 
 /****************************************************************************
 * NAME:        
-* DESCRIPTION: 
+* DESCRIPTION: Add a custom action table from its config item
 * PARAMETERS:  
 * RETURN:      
 * NOTES:       
 *****************************************************************************/
-static void footswitch_handle_efects(tFootswitchHandler* handler)
+static void footswitch_add_custom(tFootswitchActionTable* table, uint32_t item)
 {
-    uint8_t loop; 
-    uint8_t value;
-    uint16_t param;
-    float new_value;
-    tTonexParameter* param_ptr;
+    char text[MAX_FOOTSWITCH_ACTION_TEXT];
+    uint8_t rejected;
 
-    // handle state
-    switch (handler->state)
+    control_get_config_item_string(item, text);
+
+    rejected = footswitch_actions_parse(table, text);
+    if (rejected != 0)
     {
-         case FOOTSWITCH_IDLE:
-         default:
-         {
-            for (loop = 0; loop < MAX_EXTERNAL_EFFECT_FOOTSWITCHES; loop++)    
-            {
-                // is this switch configured?
-                if (FootswitchControl.ExternalFootswitchEffectHandler[loop].config.Switch != SWITCH_NOT_USED)
-                {
-                    // check if switch is pressed
-                    if (handler->footswitch_single_reader(FootswitchControl.ExternalFootswitchEffectHandler[loop].config.Switch, &value) == ESP_OK)
-                    {
-                        if (value == 1)
-                        {
-                            // get the parameter that corresponds to this Midi control change value
-                            param = midi_helper_get_param_for_change_num(FootswitchControl.ExternalFootswitchEffectHandler[loop].config.CC);
-
-                            if (param != 0xFFFF)
-                            {
-                                // get the current value of the parameter
-                                if (tonex_params_get_locked_access(&param_ptr) == ESP_OK)
-                                {
-                                    // is the parameter a boolean type?
-                                    if ((param_ptr[param].Min == 0) && (param_ptr[param].Max == 1))
-                                    {
-                                        // toggle the current value
-                                        if (param_ptr[param].Value == 0)
-                                        {
-                                            new_value = 1;
-                                        }
-                                        else
-                                        {
-                                            new_value = 0;
-                                        }
-
-                                        tonex_params_release_locked_access();
-
-                                        ESP_LOGI(TAG, "Footswitch Param change to %d", (int)new_value);
-
-                                        // change the parameter
-                                        usb_modify_parameter(param, new_value);                                        
-                                    }
-                                    else
-                                    {
-                                        tonex_params_release_locked_access();
-
-                                        // not a boolean, use local toggle variable
-                                        if (FootswitchControl.ExternalFootswitchEffectHandler[loop].toggle == 0)
-                                        {
-                                            // send first value
-                                            midi_helper_adjust_param_via_midi(FootswitchControl.ExternalFootswitchEffectHandler[loop].config.CC, FootswitchControl.ExternalFootswitchEffectHandler[loop].config.Value_1);
-        
-                                            ESP_LOGI(TAG, "Footswitch Param change (1). Switch: %d. CC:%d. Value:%d", (int)FootswitchControl.ExternalFootswitchEffectHandler[loop].config.Switch, 
-                                                                                                                    (int)FootswitchControl.ExternalFootswitchEffectHandler[loop].config.CC, 
-                                                                                                                    (int)FootswitchControl.ExternalFootswitchEffectHandler[loop].config.Value_1);
-                                        }
-                                        else
-                                        {
-                                            // send second value
-                                            midi_helper_adjust_param_via_midi(FootswitchControl.ExternalFootswitchEffectHandler[loop].config.CC, FootswitchControl.ExternalFootswitchEffectHandler[loop].config.Value_2);
-        
-                                            ESP_LOGI(TAG, "Footswitch Param change (2). Switch: %d. CC:%d. Value:%d", (int)FootswitchControl.ExternalFootswitchEffectHandler[loop].config.Switch, 
-                                                                                                                    (int)FootswitchControl.ExternalFootswitchEffectHandler[loop].config.CC, 
-                                                                                                                    (int)FootswitchControl.ExternalFootswitchEffectHandler[loop].config.Value_2);
-                                        }
-        
-                                        // flip toggle state
-                                        FootswitchControl.ExternalFootswitchEffectHandler[loop].toggle = !FootswitchControl.ExternalFootswitchEffectHandler[loop].toggle;
-                                    }                                                                        
-                                }                                
-                            }
-
-                            // save the switch index
-                            handler->index_pending = FootswitchControl.ExternalFootswitchEffectHandler[loop].config.Switch;
-                            handler->state = FOOTSWITCH_WAIT_RELEASE_1;
-                            break;
-                        }
-                    }
-                }
-            }
+        ESP_LOGW(TAG, "Footswitch actions '%s': %d entries ignored", text, (int)rejected);
+    }
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Build the action tables for the current config
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       Only done when the config changes, each press is then just
+*              a lookup
+*****************************************************************************/
+static void footswitch_build_actions(void)
+{
+    tFootswitchActionTable* table;
+    uint32_t item;
+    uint8_t effect_switch;
+
+    // onboard
+    table = &FootswitchControl.Groups[FOOTSWITCH_GROUP_ONBOARD].actions;
+    footswitch_actions_clear(table);
+
+    switch (FootswitchControl.onboard_switch_mode)
+    {
+        case FOOTSWITCH_MODE_DUAL_UP_DOWN:
+        default:
+        {
+            // switch 1 is previous and 2 is next
+            footswitch_actions_add(table, 0x0001, FOOTSWITCH_ACTION_PRESET_DOWN, 0, 0, 0);
+            footswitch_actions_add(table, 0x0002, FOOTSWITCH_ACTION_PRESET_UP, 0, 0, 0);
+        } break;
+
+        case FOOTSWITCH_MODE_QUAD_BANKED:
+        {
+            // 4 switch with bank up/down
+            footswitch_add_layout(table, &FootswitchLayouts[FOOTSWITCH_LAYOUT_1X4]);
+        } break;
+
+        case FOOTSWITCH_MODE_QUAD_BINARY:
+        {
+            // not used, switches select presets directly
         } break;
 
-        case FOOTSWITCH_WAIT_RELEASE_1:
+        case FOOTSWITCH_MODE_CUSTOM:
         {
-            // check if switch is released
-            if (handler->footswitch_single_reader(handler->index_pending, &value) == ESP_OK)
+            footswitch_add_custom(table, CONFIG_ITEM_FOOTSW_ACTIONS);
+        } break;
+    }
+
+    // external
+    table = &FootswitchControl.Groups[FOOTSWITCH_GROUP_EXTERNAL].actions;
+    footswitch_actions_clear(table);
+
+    if (FootswitchControl.external_switch_mode < FOOTSWITCH_LAYOUT_CUSTOM)
+    {
+        footswitch_add_layout(table, &FootswitchLayouts[FootswitchControl.external_switch_mode]);
+    }
+
+    // effect switches, these replace a preset on the same switch
+    for (uint8_t loop = 0; loop < MAX_EXTERNAL_EFFECT_FOOTSWITCHES; loop++)
+    {
+        item = CONFIG_ITEM_EXT_FOOTSW_EFFECT1_SW + (loop * (CONFIG_ITEM_EXT_FOOTSW_EFFECT2_SW - CONFIG_ITEM_EXT_FOOTSW_EFFECT1_SW));
+        effect_switch = control_get_config_item_int(item);
+
+        if (effect_switch < FOOTSWITCH_EXTERNAL_MAX)
+        {
+            footswitch_actions_add(table, (1 << effect_switch), FOOTSWITCH_ACTION_EFFECT, 
+                                   control_get_config_item_int(item + (CONFIG_ITEM_EXT_FOOTSW_EFFECT1_CC - CONFIG_ITEM_EXT_FOOTSW_EFFECT1_SW)),
+                                   control_get_config_item_int(item + (CONFIG_ITEM_EXT_FOOTSW_EFFECT1_VAL1 - CONFIG_ITEM_EXT_FOOTSW_EFFECT1_SW)),
+                                   control_get_config_item_int(item + (CONFIG_ITEM_EXT_FOOTSW_EFFECT1_VAL2 - CONFIG_ITEM_EXT_FOOTSW_EFFECT1_SW)));
+        }
+    }
+
+    if (FootswitchControl.external_switch_mode == FOOTSWITCH_LAYOUT_CUSTOM)
+    {
+        footswitch_add_custom(table, CONFIG_ITEM_EXT_FOOTSW_ACTIONS);
+    }
+
+    ESP_LOGI(TAG, "Footswitch actions onboard %d, external %d", (int)FootswitchControl.Groups[FOOTSWITCH_GROUP_ONBOARD].actions.Count, 
+             (int)FootswitchControl.Groups[FOOTSWITCH_GROUP_EXTERNAL].actions.Count);
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Load footswitch config
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       Called from the footswitch task, on start and after a change
+*****************************************************************************/
+static void footswitch_load_config(void)
+{
+    // get the currently configured mode from web config
+    FootswitchControl.onboard_switch_mode = control_get_config_item_int(CONFIG_ITEM_FOOTSWITCH_MODE);
+
+#if CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_WAVESHARE_43B || CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_WAVESHARE_43DEVONLY
+    // 4.3B doesn't have enough IO for the quad modes
+    if ((FootswitchControl.onboard_switch_mode == FOOTSWITCH_MODE_QUAD_BANKED) || (FootswitchControl.onboard_switch_mode == FOOTSWITCH_MODE_QUAD_BINARY))
+    {
+        FootswitchControl.onboard_switch_mode = FOOTSWITCH_MODE_DUAL_UP_DOWN;
+    }
+#endif
+
+    // get preset switching layout for external footswitches
+    FootswitchControl.external_switch_mode = control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_PRESET_LAYOUT);
+
+    // debounce and gesture timing
+    for (uint8_t group = 0; group < FOOTSWITCH_GROUP_MAX; group++)
+    {
+        for (uint8_t loop = 0; loop < FOOTSWITCH_EXTERNAL_MAX; loop++)
+        {
+            tFootswitchGestureConfig* config = &FootswitchControl.Groups[group].config[loop];
+
+            config->PressSamples = CONFIG_TONEX_CONTROLLER_FOOTSWITCH_PRESS_SAMPLES;
+            config->ReleaseSamples = CONFIG_TONEX_CONTROLLER_FOOTSWITCH_RELEASE_SAMPLES;
+            config->LongPressTime = CONFIG_TONEX_CONTROLLER_FOOTSWITCH_LONG_PRESS_MS * 1000;
+            config->RepeatInterval = CONFIG_TONEX_CONTROLLER_FOOTSWITCH_HOLD_REPEAT_MS * 1000;
+            config->DoubleTapWindow = 0;
+
+            if ((group == FOOTSWITCH_GROUP_ONBOARD) && (FootswitchControl.onboard_switch_mode == FOOTSWITCH_MODE_QUAD_BINARY))
             {
-                if (value == 0)
-                {
-                    handler->state = FOOTSWITCH_IDLE;
-                    handler->index_pending = 0;
+                // latching switches, only the settled state matters
+                config->PressSamples = FOOTSWITCH_BINARY_SAMPLES;
+                config->ReleaseSamples = FOOTSWITCH_BINARY_SAMPLES;
 
-                    // give a little debounce time
-                    vTaskDelay(pdMS_TO_TICKS(100));
+                if (loop != 0)
+                {
+                    // switch 1 keeps its hold repeat for the factory reset
+                    config->LongPressTime = 0;
                 }
             }
-        } break;
+        }
     }
+
+    FootswitchControl.Groups[FOOTSWITCH_GROUP_ONBOARD].count = FOOTSWITCH_ONBOARD_MAX;
+    FootswitchControl.Groups[FOOTSWITCH_GROUP_EXTERNAL].count = FOOTSWITCH_EXTERNAL_MAX;
+
+    // switch actions for the new modes
+    footswitch_build_actions();
+
+    // and show them on the strip
+    footswitch_sync_leds();
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Footswitch config items changed
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       Called from the control task, the footswitch task reloads
+*****************************************************************************/
+static void footswitch_config_changed(uint64_t changed)
+{
+    FootswitchControl.config_changed = 1;
 }
 
 /****************************************************************************
@@ -652,124 +1096,79 @@ static void footswitch_handle_efects(tFootswitchHandler* handler)
 *****************************************************************************/
 void footswitch_task(void *arg)
 {       
-    uint8_t value;
-    uint32_t reset_timer = 0;
+    uint16_t switch_states;
+    int64_t now;
+    TickType_t stats_tick;
+    uint32_t stats_count = 0;
 
     ESP_LOGI(TAG, "Footswitch task start");
 
     // let things settle
     vTaskDelay(pdMS_TO_TICKS(1000));
 
-#if CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_WAVESHARE_43B || CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_WAVESHARE_43DEVONLY
-    // 4.3B doesn't have enough IO, only supports dual mode
-    FootswitchControl.onboard_switch_mode = FOOTSWITCH_MODE_DUAL_UP_DOWN;
-#else
-    // others, get the currently configured mode from web config
-    FootswitchControl.onboard_switch_mode = control_get_config_item_int(CONFIG_ITEM_FOOTSWITCH_MODE);
-#endif
-
-    // get preset switching layout for external footswitches
-    FootswitchControl.external_switch_mode = control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_PRESET_LAYOUT);
-
-    // load config for external effect buttons
-    FootswitchControl.ExternalFootswitchEffectHandler[0].config.Switch = control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT1_SW);
-    FootswitchControl.ExternalFootswitchEffectHandler[0].config.CC = control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT1_CC);
-    FootswitchControl.ExternalFootswitchEffectHandler[0].config.Value_1 = control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT1_VAL1);
-    FootswitchControl.ExternalFootswitchEffectHandler[0].config.Value_2 = control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT1_VAL2);
-    FootswitchControl.ExternalFootswitchEffectHandler[1].config.Switch = control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT2_SW);
-    FootswitchControl.ExternalFootswitchEffectHandler[1].config.CC = control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT2_CC);
-    FootswitchControl.ExternalFootswitchEffectHandler[1].config.Value_1 = control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT2_VAL1);
-    FootswitchControl.ExternalFootswitchEffectHandler[1].config.Value_2 =control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT2_VAL2);
-    FootswitchControl.ExternalFootswitchEffectHandler[2].config.Switch = control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT3_SW);
-    FootswitchControl.ExternalFootswitchEffectHandler[2].config.CC = control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT3_CC);
-    FootswitchControl.ExternalFootswitchEffectHandler[2].config.Value_1 =control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT3_VAL1);
-    FootswitchControl.ExternalFootswitchEffectHandler[2].config.Value_2 =control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT3_VAL2);
-    FootswitchControl.ExternalFootswitchEffectHandler[3].config.Switch = control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT4_SW);
-    FootswitchControl.ExternalFootswitchEffectHandler[3].config.CC = control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT4_CC);
-    FootswitchControl.ExternalFootswitchEffectHandler[3].config.Value_1 =control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT4_VAL1);
-    FootswitchControl.ExternalFootswitchEffectHandler[3].config.Value_2 =control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT4_VAL2);
-    FootswitchControl.ExternalFootswitchEffectHandler[4].config.Switch = control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT5_SW);
-    FootswitchControl.ExternalFootswitchEffectHandler[4].config.CC = control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT5_CC);
-    FootswitchControl.ExternalFootswitchEffectHandler[4].config.Value_1 = control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT5_VAL1);
-    FootswitchControl.ExternalFootswitchEffectHandler[4].config.Value_2 =control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT5_VAL2);
-
-
-    // setup handler for onboard IO footswitches
-    FootswitchControl.Handlers[FOOTSWITCH_HANDLER_ONBOARD].footswitch_single_reader = &footswitch_read_single_onboard;
-    FootswitchControl.Handlers[FOOTSWITCH_HANDLER_ONBOARD].footswitch_multiple_reader = &footswitch_read_multiple_onboard;
-
-    // setup handler for external IO Expander footswitches
-    FootswitchControl.Handlers[FOOTSWITCH_HANDLER_EXTERNAL_PRESETS].footswitch_single_reader = &footswitch_read_single_offboard;
-    FootswitchControl.Handlers[FOOTSWITCH_HANDLER_EXTERNAL_PRESETS].footswitch_multiple_reader = &footswitch_read_multiple_offboard;
-
-    FootswitchControl.Handlers[FOOTSWITCH_HANDLER_EXTERNAL_EFFECTS].footswitch_single_reader = &footswitch_read_single_offboard;
-    FootswitchControl.Handlers[FOOTSWITCH_HANDLER_EXTERNAL_EFFECTS].footswitch_multiple_reader = &footswitch_read_multiple_offboard;
+    footswitch_load_config();
 
+    // anything that changed while settling
+    footswitch_clear_expander_interrupt();
+    stats_tick = xTaskGetTickCount();
 
     while (1)
     {
-        // handle onboard IO foot switches (direct GPIO and IO expander on main PCB)
-        switch (FootswitchControl.onboard_switch_mode) 
+        // config changed from web?
+        if (FootswitchControl.config_changed)
         {
-            case FOOTSWITCH_MODE_DUAL_UP_DOWN:
-            default:
-            {
-                // run dual mode next/previous
-                footswitch_handle_dual_mode(&FootswitchControl.Handlers[FOOTSWITCH_HANDLER_ONBOARD]);
-            } break;
+            FootswitchControl.config_changed = 0;
+            footswitch_load_config();
 
-            case FOOTSWITCH_MODE_QUAD_BANKED:
+            // start the switches afresh in the new mode
+            for (uint8_t group = 0; group < FOOTSWITCH_GROUP_MAX; group++)
             {
-                // run 4 switch with bank up/down
-                footswitch_handle_banked(&FootswitchControl.Handlers[FOOTSWITCH_HANDLER_ONBOARD], (tFootswitchLayoutEntry*)&FootswitchLayouts[FOOTSWITCH_LAYOUT_1X4]);
-            } break;
+                FootswitchControl.Groups[group].handler.state = FOOTSWITCH_IDLE;
+                FootswitchControl.Groups[group].handler.index_pending = 0;
 
-            case FOOTSWITCH_MODE_QUAD_BINARY:
-            {
-                // run 4 switch binary mode
-                footswitch_handle_quad_binary(&FootswitchControl.Handlers[FOOTSWITCH_HANDLER_ONBOARD]);
-            } break;
+                for (uint8_t loop = 0; loop < FOOTSWITCH_EXTERNAL_MAX; loop++)
+                {
+                    footswitch_gesture_reset(&FootswitchControl.Groups[group].switches[loop]);
+                }
+
+                FootswitchControl.Groups[group].pressed = 0;
+            }
+        }
+
+        now = esp_timer_get_time();
+
+        // onboard IO foot switches (direct GPIO and IO expander on main PCB)
+        if (footswitch_read_onboard(&switch_states) == ESP_OK)
+        {
+            footswitch_sample_group(FOOTSWITCH_GROUP_ONBOARD, switch_states, now);
         }
 
         // did we find an IO expander on boot?
         if (FootswitchControl.io_expander_ok)
         {
-            // handle external footswitches as banked
-            footswitch_handle_banked(&FootswitchControl.Handlers[FOOTSWITCH_HANDLER_EXTERNAL_PRESETS], (tFootswitchLayoutEntry*)&FootswitchLayouts[FootswitchControl.external_switch_mode]);
-
-            // handle effects switching
-            footswitch_handle_efects(&FootswitchControl.Handlers[FOOTSWITCH_HANDLER_EXTERNAL_EFFECTS]);
+            if (footswitch_read_offboard(&switch_states) == ESP_OK)
+            {
+                footswitch_sample_group(FOOTSWITCH_GROUP_EXTERNAL, switch_states, now);
+            }
         }
 
-        // check for button held for data reset
-        if (FOOTSWITCH_1 != -1)
+        if ((xTaskGetTickCount() - stats_tick) >= pdMS_TO_TICKS(FOOTSWITCH_STATS_INTERVAL))
         {
-            if (footswitch_read_single_onboard(FOOTSWITCH_1, &value) == ESP_OK)
+            stats_tick = xTaskGetTickCount();
+
+            // expander reads are the regular I2C load, so report the bus from here
+            i2c_scheduler_log_stats();
+
+            // only when something happened
+            if ((FootswitchControl.stats.edges + FootswitchControl.stats.dispatched_polled) != stats_count)
             {
-                if (value == 1)
-                {        
-                    reset_timer++;
-
-                    if (reset_timer > BUTTON_FACTORY_RESET_TIME)
-                    {
-                        ESP_LOGI(TAG, "Config Reset to default");  
-                        control_set_default_config(); 
-
-                        // save and reboot
-                        control_save_user_data(1);
-                    }
-                }
-                else
-                {
-                    reset_timer = 0;
-                }
+                stats_count = FootswitchControl.stats.edges + FootswitchControl.stats.dispatched_polled;
+                footswitch_log_stats();
             }
         }
 
-        // handle leds from this task, to save wasting ram on another task for it
-        leds_handle();
-
-        vTaskDelay(pdMS_TO_TICKS(20));
+        // sleep until an edge, or poll while a switch is active
+        footswitch_wait(footswitch_busy());
     }
 }
 
@@ -780,28 +1179,55 @@ void footswitch_task(void *arg)
 * RETURN:      
 * NOTES:       
 *****************************************************************************/
-void footswitches_init(i2c_port_t i2c_num, SemaphoreHandle_t I2CMutex)
+void footswitches_init(i2c_port_t i2c_num)
 {	
     memset((void*)&FootswitchControl, 0, sizeof(FootswitchControl));
 
     // save handles
-    I2CMutexHandle = I2CMutex;
 	i2cnum = i2c_num;
 
+    // switch edges wake the footswitch task
+    footswitch_event_queue = xQueueCreate(FOOTSWITCH_EVENT_QUEUE_LENGTH, sizeof(tFootswitchEvent));
+    if (footswitch_event_queue == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create footswitch event queue!");
+    }
+
+    // with edge interrupts, polling while idle is just a fallback
+    FootswitchControl.idle_wait = pdMS_TO_TICKS(FOOTSWITCH_IDLE_POLL_INTERVAL);
+
+    esp_err_t isr_result = gpio_install_isr_service(0);
+    if ((isr_result != ESP_OK) && (isr_result != ESP_ERR_INVALID_STATE))
+    {
+        ESP_LOGE(TAG, "Failed to install GPIO ISR service");
+    }
+
 #if CONFIG_TONEX_CONTROLLER_GPIO_FOOTSWITCHES
     // init GPIO
     gpio_config_t gpio_config_struct;
+    const int footswitch_pins[] = {FOOTSWITCH_1, FOOTSWITCH_2, FOOTSWITCH_3, FOOTSWITCH_4};
 
     gpio_config_struct.pin_bit_mask = (((uint64_t)1 << FOOTSWITCH_1) | ((uint64_t)1 << FOOTSWITCH_2) | ((uint64_t)1 << FOOTSWITCH_3) | ((uint64_t)1 << FOOTSWITCH_4));
     gpio_config_struct.mode = GPIO_MODE_INPUT;
     gpio_config_struct.pull_up_en = GPIO_PULLUP_ENABLE;
     gpio_config_struct.pull_down_en = GPIO_PULLDOWN_DISABLE;
-    gpio_config_struct.intr_type = GPIO_INTR_DISABLE;
+    gpio_config_struct.intr_type = GPIO_INTR_ANYEDGE;
     gpio_config(&gpio_config_struct);
+
+    for (uint8_t loop = 0; loop < (sizeof(footswitch_pins) / sizeof(footswitch_pins[0])); loop++)
+    {
+        if (footswitch_pins[loop] != -1)
+        {
+            gpio_isr_handler_add(footswitch_pins[loop], footswitch_edge_isr, (void*)FOOTSWITCH_EVENT_ONBOARD);
+        }
+    }
+#else
+    // onboard switches are on the display board IO expander, no interrupt
+    FootswitchControl.idle_wait = pdMS_TO_TICKS(FOOTSWITCH_POLL_INTERVAL);
 #endif
 
     // try to init I2C IO expander
-    if (SX1509_Init(i2c_num, I2CMutex) == ESP_OK)
+    if (SX1509_Init(i2c_num) == ESP_OK)
     {
         ESP_LOGI(TAG, "Found External IO Expander");
 
@@ -811,6 +1237,31 @@ void footswitches_init(i2c_port_t i2c_num, SemaphoreHandle_t I2CMutex)
             SX1509_gpioMode(pin, EXPANDER_INPUT_PULLUP);
         }
         FootswitchControl.io_expander_ok = 1;
+
+#if CONFIG_TONEX_CONTROLLER_IO_EXPANDER_INT_GPIO >= 0
+        // NINT is open drain, active low
+        gpio_config_t int_config_struct;
+
+        int_config_struct.pin_bit_mask = ((uint64_t)1 << CONFIG_TONEX_CONTROLLER_IO_EXPANDER_INT_GPIO);
+        int_config_struct.mode = GPIO_MODE_INPUT;
+        int_config_struct.pull_up_en = GPIO_PULLUP_ENABLE;
+        int_config_struct.pull_down_en = GPIO_PULLDOWN_DISABLE;
+        int_config_struct.intr_type = GPIO_INTR_NEGEDGE;
+        gpio_config(&int_config_struct);
+
+        if ((SX1509_enableInterrupts(0xFFFF) == ESP_OK) && 
+            (gpio_isr_handler_add(CONFIG_TONEX_CONTROLLER_IO_EXPANDER_INT_GPIO, footswitch_edge_isr, (void*)FOOTSWITCH_EVENT_EXPANDER) == ESP_OK))
+        {
+            ESP_LOGI(TAG, "External IO Expander interrupt on GPIO %d", CONFIG_TONEX_CONTROLLER_IO_EXPANDER_INT_GPIO);
+            FootswitchControl.io_expander_interrupt = 1;
+        }
+#endif
+
+        if (!FootswitchControl.io_expander_interrupt)
+        {
+            // no interrupt, has to be polled
+            FootswitchControl.idle_wait = pdMS_TO_TICKS(FOOTSWITCH_POLL_INTERVAL);
+        }
     }
     else
     {
@@ -820,6 +1271,11 @@ void footswitches_init(i2c_port_t i2c_num, SemaphoreHandle_t I2CMutex)
     // init leds
     leds_init();
 
+    // mode and layout changes apply live
+    control_register_config_handler(CONFIG_ITEM_MASK(CONFIG_ITEM_FOOTSWITCH_MODE) | 
+                                    CONFIG_ITEM_RANGE_MASK(CONFIG_ITEM_EXT_FOOTSW_PRESET_LAYOUT, CONFIG_ITEM_EXT_FOOTSW_ACTIONS),
+                                    footswitch_config_changed);
+
     // create task
     xTaskCreatePinnedToCore(footswitch_task, "FOOT", FOOTSWITCH_TASK_STACK_SIZE, NULL, FOOTSWITCH_TASK_PRIORITY, NULL, 1);
 }
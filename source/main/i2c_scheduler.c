@@ -0,0 +1,673 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "driver/i2c.h"
+#include "task_priorities.h"
+#include "i2c_scheduler.h"
+
+#define I2C_SCHEDULER_TASK_STACK_SIZE       (3 * 1024)
+#define I2C_TIMEOUT_MS                      10
+#define I2C_RETRY_MAX                       2           // extra attempts after a failed transfer
+#define I2C_MERGE_MAX                       32          // bytes in one merged register read
+
+static const char *TAG = "app_i2c_sched";
+
+typedef struct
+{
+    i2c_port_t Port;
+    TaskHandle_t Task;
+    portMUX_TYPE Lock;
+    tI2CTransaction* Head[I2C_PRIORITY_LAST];
+    tI2CTransaction* Tail[I2C_PRIORITY_LAST];
+    uint16_t Pending;
+    uint16_t PendingMax;
+    uint64_t BusTime;                               // usec, all devices
+    uint64_t LastBusTime;                           // at the last stats log
+} tI2CBus;
+
+static tI2CBus I2CBuses[I2C_NUM_MAX];
+static tI2CDeviceStats I2CStats[I2C_DEVICE_LAST];
+static int64_t I2CStatsLastLog;
+static const char* I2CDeviceNames[I2C_DEVICE_LAST] = {"CH422G", "SX1509", "LP5562", "Touch"};
+
+// footswitch expanders first, so a busy touch screen or led can't delay a switch press
+static const uint8_t I2CDevicePriority[I2C_DEVICE_LAST] =
+{
+    I2C_PRIORITY_FOOTSWITCH,        // CH422G
+    I2C_PRIORITY_FOOTSWITCH,        // SX1509
+    I2C_PRIORITY_LED,               // LP5562
+    I2C_PRIORITY_TOUCH              // Touch
+};
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Take the next transaction off a bus, highest priority first
+* PARAMETERS:
+* RETURN:      transaction or NULL if none pending
+* NOTES:
+*****************************************************************************/
+static tI2CTransaction* i2c_scheduler_next(tI2CBus* bus)
+{
+    tI2CTransaction* transaction = NULL;
+
+    taskENTER_CRITICAL(&bus->Lock);
+
+    for (uint8_t priority = 0; priority < I2C_PRIORITY_LAST; priority++)
+    {
+        if (bus->Head[priority] != NULL)
+        {
+            transaction = bus->Head[priority];
+            bus->Head[priority] = transaction->Next;
+
+            if (bus->Head[priority] == NULL)
+            {
+                bus->Tail[priority] = NULL;
+            }
+
+            transaction->Next = NULL;
+            bus->Pending--;
+            break;
+        }
+    }
+
+    taskEXIT_CRITICAL(&bus->Lock);
+
+    return transaction;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Check if a transaction is a register read that can be merged
+* PARAMETERS:
+* RETURN:      1 if mergeable
+* NOTES:
+*****************************************************************************/
+static uint8_t i2c_scheduler_is_merge_read(tI2CTransaction* transaction)
+{
+    return (transaction->Function == NULL) && (transaction->Flags & I2C_FLAG_MERGE_READ) &&
+           (transaction->WriteLength == 1) && (transaction->ReadLength > 0) && (transaction->ReadLength <= I2C_MERGE_MAX);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Pull queued reads that touch or overlap a register span
+* PARAMETERS:  first: read already taken off the queue
+*              start, end: span of registers to read, end exclusive. Widened
+*              as reads are merged in
+* RETURN:
+* NOTES:       Merged reads are chained onto first->Next. A list is only
+*              searched up to the first other transfer to the same device,
+*              so a read never moves ahead of a queued write
+*****************************************************************************/
+static void i2c_scheduler_gather_reads(tI2CBus* bus, tI2CTransaction* first, uint16_t* start, uint16_t* end)
+{
+    tI2CTransaction* last = first;
+    tI2CTransaction* prev;
+    tI2CTransaction* item;
+    tI2CTransaction* next;
+    uint16_t reg;
+    uint16_t reg_end;
+    uint16_t new_start;
+    uint16_t new_end;
+    uint8_t found;
+
+    *start = first->WriteData[0];
+    *end = *start + first->ReadLength;
+
+    taskENTER_CRITICAL(&bus->Lock);
+
+    // repeat as each merge can bring another read into range
+    do
+    {
+        found = 0;
+
+        for (uint8_t priority = 0; priority < I2C_PRIORITY_LAST; priority++)
+        {
+            prev = NULL;
+            item = bus->Head[priority];
+
+            while (item != NULL)
+            {
+                next = item->Next;
+
+                if (item->Address == first->Address)
+                {
+                    if (!i2c_scheduler_is_merge_read(item))
+                    {
+                        // don't reorder around it
+                        break;
+                    }
+
+                    reg = item->WriteData[0];
+                    reg_end = reg + item->ReadLength;
+                    new_start = (reg < *start) ? reg : *start;
+                    new_end = (reg_end > *end) ? reg_end : *end;
+
+                    if ((reg <= *end) && (reg_end >= *start) && ((new_end - new_start) <= I2C_MERGE_MAX))
+                    {
+                        // unlink
+                        if (prev == NULL)
+                        {
+                            bus->Head[priority] = next;
+                        }
+                        else
+                        {
+                            prev->Next = next;
+                        }
+
+                        if (bus->Tail[priority] == item)
+                        {
+                            bus->Tail[priority] = prev;
+                        }
+
+                        bus->Pending--;
+
+                        // add to the batch
+                        item->Next = NULL;
+                        last->Next = item;
+                        last = item;
+
+                        *start = new_start;
+                        *end = new_end;
+                        found = 1;
+
+                        item = next;
+                        continue;
+                    }
+                }
+
+                prev = item;
+                item = next;
+            }
+        }
+    } while (found);
+
+    taskEXIT_CRITICAL(&bus->Lock);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Do a bus transfer, retrying on failure
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static esp_err_t i2c_scheduler_execute(tI2CBus* bus, uint8_t address, const uint8_t* write_data, uint16_t write_length, uint8_t* read_data, uint16_t read_length, uint8_t* retries)
+{
+    esp_err_t res = ESP_FAIL;
+
+    for (uint8_t attempt = 0; attempt <= I2C_RETRY_MAX; attempt++)
+    {
+        if (attempt > 0)
+        {
+            (*retries)++;
+        }
+
+        if (read_length == 0)
+        {
+            res = i2c_master_write_to_device(bus->Port, address, write_data, write_length, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
+        }
+        else if (write_length == 0)
+        {
+            res = i2c_master_read_from_device(bus->Port, address, read_data, read_length, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
+        }
+        else
+        {
+            res = i2c_master_write_read_device(bus->Port, address, write_data, write_length, read_data, read_length, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
+        }
+
+        if (res == ESP_OK)
+        {
+            break;
+        }
+    }
+
+    return res;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Record stats for a transaction and hand back the result
+* PARAMETERS:  start: usec the bus transfer began
+*              bus_time: usec on the bus, 0 if it shared another transfer
+* RETURN:
+* NOTES:       The transaction may be gone once the callback has run
+*****************************************************************************/
+static void i2c_scheduler_complete(tI2CBus* bus, tI2CTransaction* transaction, int64_t start, uint32_t bus_time, uint8_t retries, esp_err_t result)
+{
+    tI2CDeviceStats* stats = &I2CStats[transaction->Device];
+    uint32_t wait_time = (uint32_t)(start - transaction->QueuedTime);
+
+    stats->Transactions++;
+    stats->Retries += retries;
+    stats->BusTime += bus_time;
+    stats->WaitTime += wait_time;
+    bus->BusTime += bus_time;
+
+    if (result != ESP_OK)
+    {
+        stats->Errors++;
+    }
+
+    if (bus_time > stats->BusTimeMax)
+    {
+        stats->BusTimeMax = bus_time;
+    }
+
+    if (wait_time > stats->WaitTimeMax)
+    {
+        stats->WaitTimeMax = wait_time;
+    }
+
+    transaction->Result = result;
+
+    if (transaction->Callback != NULL)
+    {
+        transaction->Callback(transaction);
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Do a register read along with any queued reads it can cover
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void i2c_scheduler_merged_read(tI2CBus* bus, tI2CTransaction* first)
+{
+    uint8_t buffer[I2C_MERGE_MAX];
+    tI2CTransaction* item;
+    tI2CTransaction* next;
+    uint16_t start;
+    uint16_t end;
+    uint8_t reg;
+    uint8_t retries = 0;
+    uint32_t bus_time;
+    esp_err_t res;
+
+    i2c_scheduler_gather_reads(bus, first, &start, &end);
+    reg = (uint8_t)start;
+
+    int64_t bus_start = esp_timer_get_time();
+    res = i2c_scheduler_execute(bus, first->Address, &reg, 1, buffer, end - start, &retries);
+    bus_time = (uint32_t)(esp_timer_get_time() - bus_start);
+
+    for (item = first; item != NULL; item = next)
+    {
+        next = item->Next;
+
+        if (res == ESP_OK)
+        {
+            memcpy((void*)item->ReadData, (void*)&buffer[item->WriteData[0] - start], item->ReadLength);
+        }
+
+        if (item == first)
+        {
+            i2c_scheduler_complete(bus, item, bus_start, bus_time, retries, res);
+        }
+        else
+        {
+            I2CStats[item->Device].Merged++;
+            i2c_scheduler_complete(bus, item, bus_start, 0, 0, res);
+        }
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Bus task, runs queued transactions one at a time
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void i2c_scheduler_task(void *arg)
+{
+    tI2CBus* bus = (tI2CBus*)arg;
+    tI2CTransaction* transaction;
+    uint8_t retries;
+    esp_err_t res;
+
+    ESP_LOGI(TAG, "I2C scheduler task start, port %d", (int)bus->Port);
+
+    for (;;)
+    {
+        // sleep until something is queued
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        while ((transaction = i2c_scheduler_next(bus)) != NULL)
+        {
+            if (i2c_scheduler_is_merge_read(transaction))
+            {
+                i2c_scheduler_merged_read(bus, transaction);
+                continue;
+            }
+
+            retries = 0;
+            int64_t bus_start = esp_timer_get_time();
+
+            if (transaction->Function != NULL)
+            {
+                res = transaction->Function(bus->Port, transaction->Arg);
+            }
+            else
+            {
+                res = i2c_scheduler_execute(bus, transaction->Address, transaction->WriteData, transaction->WriteLength,
+                                            transaction->ReadData, transaction->ReadLength, &retries);
+            }
+
+            i2c_scheduler_complete(bus, transaction, bus_start, (uint32_t)(esp_timer_get_time() - bus_start), retries, res);
+        }
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Queue a transaction
+* PARAMETERS:
+* RETURN:
+* NOTES:       Returns straight away. The transaction must stay valid until
+*              its callback has run
+*****************************************************************************/
+esp_err_t i2c_scheduler_submit(i2c_port_t port, tI2CTransaction* transaction)
+{
+    tI2CBus* bus;
+    uint8_t priority;
+
+    if ((port >= I2C_NUM_MAX) || (transaction == NULL) || (transaction->Device >= I2C_DEVICE_LAST))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    bus = &I2CBuses[port];
+    if (bus->Task == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    priority = I2CDevicePriority[transaction->Device];
+    transaction->Result = ESP_FAIL;
+    transaction->QueuedTime = esp_timer_get_time();
+    transaction->Next = NULL;
+
+    taskENTER_CRITICAL(&bus->Lock);
+
+    if (bus->Tail[priority] == NULL)
+    {
+        bus->Head[priority] = transaction;
+    }
+    else
+    {
+        bus->Tail[priority]->Next = transaction;
+    }
+    bus->Tail[priority] = transaction;
+
+    bus->Pending++;
+    if (bus->Pending > bus->PendingMax)
+    {
+        bus->PendingMax = bus->Pending;
+    }
+
+    taskEXIT_CRITICAL(&bus->Lock);
+
+    xTaskNotifyGive(bus->Task);
+
+    return ESP_OK;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Completion callback for the blocking calls
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void i2c_scheduler_wake_caller(tI2CTransaction* transaction)
+{
+    xSemaphoreGive((SemaphoreHandle_t)transaction->Context);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Queue a transaction and wait for it to finish
+* PARAMETERS:
+* RETURN:      result of the transfer
+* NOTES:       Can't be called from a bus job
+*****************************************************************************/
+esp_err_t i2c_scheduler_transfer(i2c_port_t port, tI2CTransaction* transaction)
+{
+    StaticSemaphore_t done_buffer;
+    SemaphoreHandle_t done;
+    esp_err_t res;
+
+    if ((port < I2C_NUM_MAX) && (I2CBuses[port].Task == xTaskGetCurrentTaskHandle()))
+    {
+        ESP_LOGE(TAG, "Blocking transfer from bus task");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    done = xSemaphoreCreateBinaryStatic(&done_buffer);
+    transaction->Callback = i2c_scheduler_wake_caller;
+    transaction->Context = (void*)done;
+
+    res = i2c_scheduler_submit(port, transaction);
+    if (res != ESP_OK)
+    {
+        return res;
+    }
+
+    // each transfer is bounded by the driver timeout, so this always returns
+    xSemaphoreTake(done, portMAX_DELAY);
+
+    return transaction->Result;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Write to a device and wait
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+esp_err_t i2c_scheduler_write(i2c_port_t port, uint8_t device, uint8_t address, const uint8_t* data, uint16_t length)
+{
+    tI2CTransaction transaction = {0};
+
+    transaction.Device = device;
+    transaction.Address = address;
+    transaction.WriteData = data;
+    transaction.WriteLength = length;
+
+    return i2c_scheduler_transfer(port, &transaction);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Read from a device and wait
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+esp_err_t i2c_scheduler_read(i2c_port_t port, uint8_t device, uint8_t address, uint8_t* data, uint16_t length)
+{
+    tI2CTransaction transaction = {0};
+
+    transaction.Device = device;
+    transaction.Address = address;
+    transaction.ReadData = data;
+    transaction.ReadLength = length;
+
+    return i2c_scheduler_transfer(port, &transaction);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Read registers from a device and wait
+* PARAMETERS:  flags: I2C_FLAG_MERGE_READ if the device auto-increments
+* RETURN:
+* NOTES:
+*****************************************************************************/
+esp_err_t i2c_scheduler_read_register(i2c_port_t port, uint8_t device, uint8_t address, uint8_t reg, uint8_t* data, uint16_t length, uint8_t flags)
+{
+    tI2CTransaction transaction = {0};
+
+    transaction.Device = device;
+    transaction.Address = address;
+    transaction.Flags = flags;
+    transaction.WriteData = &reg;
+    transaction.WriteLength = 1;
+    transaction.ReadData = data;
+    transaction.ReadLength = length;
+
+    return i2c_scheduler_transfer(port, &transaction);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Run a function with the bus to itself and wait
+* PARAMETERS:
+* RETURN:      result of the function
+* NOTES:       For sequences that must not be split, or bus users that go
+*              through another driver
+*****************************************************************************/
+esp_err_t i2c_scheduler_run(i2c_port_t port, uint8_t device, tI2CFunction function, void* arg)
+{
+    tI2CTransaction transaction = {0};
+
+    transaction.Device = device;
+    transaction.Function = function;
+    transaction.Arg = arg;
+
+    return i2c_scheduler_transfer(port, &transaction);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Get I2C stats for a device
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+void i2c_scheduler_get_stats(uint8_t device, tI2CDeviceStats* stats)
+{
+    if (device < I2C_DEVICE_LAST)
+    {
+        memcpy((void*)stats, (void*)&I2CStats[device], sizeof(tI2CDeviceStats));
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Log I2C stats
+* PARAMETERS:
+* RETURN:
+* NOTES:       Bus utilisation is since the last log, the rest since boot
+*****************************************************************************/
+void i2c_scheduler_log_stats(void)
+{
+    int64_t now = esp_timer_get_time();
+    int64_t elapsed = now - I2CStatsLastLog;
+    uint64_t busy;
+    uint32_t per_mille;
+    tI2CDeviceStats* stats;
+
+    if (elapsed <= 0)
+    {
+        return;
+    }
+
+    for (uint8_t port = 0; port < I2C_NUM_MAX; port++)
+    {
+        if (I2CBuses[port].Task == NULL)
+        {
+            continue;
+        }
+
+        busy = I2CBuses[port].BusTime - I2CBuses[port].LastBusTime;
+        I2CBuses[port].LastBusTime = I2CBuses[port].BusTime;
+        per_mille = (uint32_t)((busy * 1000) / elapsed);
+
+        ESP_LOGI(TAG, "I2C bus %d: %d.%d%% busy, queue depth max %d", (int)port, (int)(per_mille / 10), (int)(per_mille % 10), (int)I2CBuses[port].PendingMax);
+    }
+
+    for (uint8_t loop = 0; loop < I2C_DEVICE_LAST; loop++)
+    {
+        stats = &I2CStats[loop];
+
+        if (stats->Transactions == 0)
+        {
+            continue;
+        }
+
+        ESP_LOGI(TAG, "I2C %s: %d transfers, %d merged, %d retries, %d errors, bus avg %d max %d usec, wait avg %d max %d usec", I2CDeviceNames[loop],
+                 (int)stats->Transactions, (int)stats->Merged, (int)stats->Retries, (int)stats->Errors,
+                 (int)(stats->BusTime / stats->Transactions), (int)stats->BusTimeMax,
+                 (int)(stats->WaitTime / stats->Transactions), (int)stats->WaitTimeMax);
+    }
+
+    I2CStatsLastLog = now;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Start the scheduler for a bus
+* PARAMETERS:  port: initialised I2C master port
+* RETURN:
+* NOTES:       After this all traffic on the bus must go through the scheduler
+*****************************************************************************/
+esp_err_t i2c_scheduler_init(i2c_port_t port)
+{
+    tI2CBus* bus;
+
+    if (port >= I2C_NUM_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    bus = &I2CBuses[port];
+    if (bus->Task != NULL)
+    {
+        return ESP_OK;
+    }
+
+    memset((void*)bus, 0, sizeof(tI2CBus));
+    bus->Port = port;
+    portMUX_INITIALIZE(&bus->Lock);
+
+    if (I2CStatsLastLog == 0)
+    {
+        I2CStatsLastLog = esp_timer_get_time();
+    }
+
+    if (xTaskCreatePinnedToCore(i2c_scheduler_task, "I2C", I2C_SCHEDULER_TASK_STACK_SIZE, (void*)bus, I2C_SCHEDULER_TASK_PRIORITY, &bus->Task, 1) != pdPASS)
+    {
+        ESP_LOGE(TAG, "I2C scheduler task create failed, port %d", (int)port);
+        bus->Task = NULL;
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
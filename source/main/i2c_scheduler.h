@@ -0,0 +1,95 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "driver/i2c.h"
+#include "esp_err.h"
+
+// I2C bus users. Each has a fixed priority in the scheduler
+enum I2CDevices
+{
+    I2C_DEVICE_CH422G,
+    I2C_DEVICE_SX1509,
+    I2C_DEVICE_LP5562,
+    I2C_DEVICE_TOUCH,
+    I2C_DEVICE_LAST
+};
+
+// scheduling priorities, highest first
+enum I2CPriorities
+{
+    I2C_PRIORITY_FOOTSWITCH,
+    I2C_PRIORITY_TOUCH,
+    I2C_PRIORITY_LED,
+    I2C_PRIORITY_LAST
+};
+
+// transaction flags
+#define I2C_FLAG_MERGE_READ         0x01        // register read on an auto-incrementing device, may be combined with its neighbours
+
+typedef struct tI2CTransaction tI2CTransaction;
+
+// exclusive bus job, runs in the bus task and may use the i2c_master_* calls directly
+typedef esp_err_t (*tI2CFunction)(i2c_port_t port, void* arg);
+
+// completion callback, runs in the bus task
+typedef void (*tI2CCallback)(tI2CTransaction* transaction);
+
+struct tI2CTransaction
+{
+    uint8_t Device;                 // I2C_DEVICE_x
+    uint8_t Address;                // 7 bit device address
+    uint8_t Flags;
+    const uint8_t* WriteData;       // written first, eg. register address
+    uint16_t WriteLength;
+    uint8_t* ReadData;              // then read with a repeated start
+    uint16_t ReadLength;
+    tI2CFunction Function;          // if set, run instead of the transfer
+    void* Arg;
+    tI2CCallback Callback;          // optional
+    void* Context;
+
+    // set by the scheduler
+    esp_err_t Result;
+    int64_t QueuedTime;
+    tI2CTransaction* Next;
+};
+
+typedef struct
+{
+    uint32_t Transactions;
+    uint32_t Errors;                // failed after all retries
+    uint32_t Retries;
+    uint32_t Merged;                // reads that shared another read's transfer
+    uint64_t BusTime;               // usec on the bus
+    uint32_t BusTimeMax;            // usec, longest single transfer
+    uint64_t WaitTime;              // usec queued before starting
+    uint32_t WaitTimeMax;
+} tI2CDeviceStats;
+
+esp_err_t i2c_scheduler_init(i2c_port_t port);
+esp_err_t i2c_scheduler_submit(i2c_port_t port, tI2CTransaction* transaction);
+esp_err_t i2c_scheduler_transfer(i2c_port_t port, tI2CTransaction* transaction);
+esp_err_t i2c_scheduler_write(i2c_port_t port, uint8_t device, uint8_t address, const uint8_t* data, uint16_t length);
+esp_err_t i2c_scheduler_read(i2c_port_t port, uint8_t device, uint8_t address, uint8_t* data, uint16_t length);
+esp_err_t i2c_scheduler_read_register(i2c_port_t port, uint8_t device, uint8_t address, uint8_t reg, uint8_t* data, uint16_t length, uint8_t flags);
+esp_err_t i2c_scheduler_run(i2c_port_t port, uint8_t device, tI2CFunction function, void* arg);
+void i2c_scheduler_get_stats(uint8_t device, tI2CDeviceStats* stats);
+void i2c_scheduler_log_stats(void);
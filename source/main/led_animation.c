@@ -0,0 +1,260 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "led_animation.h"
+
+#define LED_ANIMATION_PRESET_HUE_STEP   137         // degrees, golden angle keeps neighbouring presets apart
+#define LED_ANIMATION_PI                3.14159265f
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Convert a HSV colour
+* PARAMETERS:  h: 0 - 359, s: 0 - 100, v: 0 - 100
+* RETURN:
+* NOTES:       Wiki: https://en.wikipedia.org/wiki/HSL_and_HSV
+*****************************************************************************/
+void led_animation_hsv2rgb(uint32_t h, uint32_t s, uint32_t v, tLedColour* colour)
+{
+    h %= 360; // h -> [0,360]
+    uint32_t rgb_max = v * 2.55f;
+    uint32_t rgb_min = rgb_max * (100 - s) / 100.0f;
+
+    uint32_t i = h / 60;
+    uint32_t diff = h % 60;
+
+    // RGB adjustment amount by hue
+    uint32_t rgb_adj = (rgb_max - rgb_min) * diff / 60;
+
+    switch (i)
+    {
+        case 0:
+            colour->Red = rgb_max;
+            colour->Green = rgb_min + rgb_adj;
+            colour->Blue = rgb_min;
+            break;
+
+        case 1:
+            colour->Red = rgb_max - rgb_adj;
+            colour->Green = rgb_max;
+            colour->Blue = rgb_min;
+            break;
+
+        case 2:
+            colour->Red = rgb_min;
+            colour->Green = rgb_max;
+            colour->Blue = rgb_min + rgb_adj;
+            break;
+
+        case 3:
+            colour->Red = rgb_min;
+            colour->Green = rgb_max - rgb_adj;
+            colour->Blue = rgb_max;
+            break;
+
+        case 4:
+            colour->Red = rgb_min + rgb_adj;
+            colour->Green = rgb_min;
+            colour->Blue = rgb_max;
+            break;
+
+        default:
+            colour->Red = rgb_max;
+            colour->Green = rgb_min;
+            colour->Blue = rgb_max - rgb_adj;
+            break;
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Colour for a preset
+* PARAMETERS:  brightness: 0 - 255
+* RETURN:
+* NOTES:       Always the same colour for the same preset
+*****************************************************************************/
+void led_animation_preset_colour(uint16_t preset, uint8_t brightness, tLedColour* colour)
+{
+    led_animation_hsv2rgb(((uint32_t)preset * LED_ANIMATION_PRESET_HUE_STEP) % 360, 100, ((uint32_t)brightness * 100) / 255, colour);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Scale a colour
+* PARAMETERS:  level: 0 - 1
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void led_animation_scale(const tLedColour* colour, float level, tLedColour* result)
+{
+    result->Red = (uint8_t)((colour->Red * level) + 0.5f);
+    result->Green = (uint8_t)((colour->Green * level) + 0.5f);
+    result->Blue = (uint8_t)((colour->Blue * level) + 0.5f);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Render an animation into a frame table
+* PARAMETERS:
+* RETURN:
+* NOTES:       All the maths is done here, once, so playing it back is
+*              just a table lookup
+*****************************************************************************/
+void led_animation_render(const tLedAnimation* animation, tLedFrameTable* table)
+{
+    uint32_t on_time = animation->OnTime;
+    float level;
+
+    memset((void*)table, 0, sizeof(tLedFrameTable));
+    table->FrameCount = 1;
+
+    switch (animation->Type)
+    {
+        case LED_ANIMATION_OFF:
+        default:
+        {
+            // single black frame
+        } break;
+
+        case LED_ANIMATION_SOLID:
+        {
+            table->Frames[0] = animation->Colour;
+        } break;
+
+        case LED_ANIMATION_PRESET:
+        {
+            led_animation_preset_colour(animation->Preset, animation->Brightness, &table->Frames[0]);
+        } break;
+
+        case LED_ANIMATION_TEMPO:
+        {
+            // a flash, never more than half the beat
+            if (on_time > (animation->Period / 2))
+            {
+                on_time = animation->Period / 2;
+            }
+        } // fall through
+
+        case LED_ANIMATION_BLINK:
+        {
+            if (animation->Period < LED_ANIMATION_MAX_FRAMES)
+            {
+                // too fast to show, just on
+                table->Frames[0] = animation->Colour;
+                break;
+            }
+
+            table->FrameCount = LED_ANIMATION_MAX_FRAMES;
+            table->FrameTime = animation->Period / LED_ANIMATION_MAX_FRAMES;
+            table->Repeats = animation->Repeats;
+
+            for (uint8_t loop = 0; loop < LED_ANIMATION_MAX_FRAMES; loop++)
+            {
+                if (((uint64_t)loop * animation->Period) < ((uint64_t)on_time * LED_ANIMATION_MAX_FRAMES))
+                {
+                    table->Frames[loop] = animation->Colour;
+                }
+                else
+                {
+                    table->Frames[loop] = animation->Background;
+                }
+            }
+        } break;
+
+        case LED_ANIMATION_PULSE:
+        {
+            if (animation->Period < LED_ANIMATION_MAX_FRAMES)
+            {
+                table->Frames[0] = animation->Colour;
+                break;
+            }
+
+            table->FrameCount = LED_ANIMATION_MAX_FRAMES;
+            table->FrameTime = animation->Period / LED_ANIMATION_MAX_FRAMES;
+            table->Repeats = animation->Repeats;
+
+            for (uint8_t loop = 0; loop < LED_ANIMATION_MAX_FRAMES; loop++)
+            {
+                // raised cosine, squared so the fade looks even to the eye
+                level = (1.0f - cosf((2.0f * LED_ANIMATION_PI * loop) / LED_ANIMATION_MAX_FRAMES)) * 0.5f;
+                led_animation_scale(&animation->Colour, level * level, &table->Frames[loop]);
+            }
+        } break;
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Find the frame to show
+* PARAMETERS:  elapsed: usec since the animation started
+*              next_change: set to the elapsed time the output next
+*              changes, or -1 if it never will
+* RETURN:      frame index, or -1 if the animation has finished
+* NOTES:       Skips over frames that look the same, so the caller only
+*              needs to wake when something changes
+*****************************************************************************/
+int16_t led_animation_frame(const tLedFrameTable* table, int64_t elapsed, int64_t* next_change)
+{
+    int64_t cycle_time;
+    int64_t cycle;
+    uint8_t index;
+    uint8_t next;
+
+    *next_change = -1;
+
+    if ((table->FrameTime == 0) || (table->FrameCount <= 1))
+    {
+        return 0;
+    }
+
+    if (elapsed < 0)
+    {
+        elapsed = 0;
+    }
+
+    cycle_time = (int64_t)table->FrameTime * table->FrameCount;
+    cycle = elapsed / cycle_time;
+
+    if ((table->Repeats != 0) && (cycle >= table->Repeats))
+    {
+        return -1;
+    }
+
+    index = (uint8_t)((elapsed % cycle_time) / table->FrameTime);
+
+    for (uint8_t steps = 1; steps <= table->FrameCount; steps++)
+    {
+        next = (index + steps) % table->FrameCount;
+
+        // the end of the last cycle counts as a change
+        if ((next == 0) && (table->Repeats != 0) && ((cycle + 1) >= table->Repeats))
+        {
+            *next_change = (cycle * cycle_time) + ((int64_t)(index + steps) * table->FrameTime);
+            break;
+        }
+
+        if (memcmp((const void*)&table->Frames[next], (const void*)&table->Frames[index], sizeof(tLedColour)) != 0)
+        {
+            *next_change = (cycle * cycle_time) + ((int64_t)(index + steps) * table->FrameTime);
+            break;
+        }
+    }
+
+    return index;
+}
@@ -0,0 +1,68 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// LED animations, rendered ahead of time into frame tables. No hardware
+// access, the caller picks the frame for the time and sends it
+
+#define LED_ANIMATION_MAX_FRAMES        32          // per cycle
+
+enum LedAnimationTypes
+{
+    LED_ANIMATION_OFF,
+    LED_ANIMATION_SOLID,
+    LED_ANIMATION_BLINK,                // on for OnTime of each Period
+    LED_ANIMATION_PULSE,                // smooth fade up and down over Period
+    LED_ANIMATION_TEMPO,                // short flash at the start of each beat
+    LED_ANIMATION_PRESET,               // solid, colour picked from the preset index
+    LED_ANIMATION_LAST
+};
+
+typedef struct
+{
+    uint8_t Red;
+    uint8_t Green;
+    uint8_t Blue;
+} tLedColour;
+
+typedef struct
+{
+    uint8_t Type;                       // LED_ANIMATION_
+    tLedColour Colour;                  // full brightness colour, not used for preset
+    tLedColour Background;              // blink and tempo, shown while not lit
+    uint32_t Period;                    // usec per cycle, or per beat for tempo
+    uint32_t OnTime;                    // usec lit per cycle, blink and tempo
+    uint16_t Preset;                    // preset index, for LED_ANIMATION_PRESET
+    uint8_t Brightness;                 // 0 - 255, preset colours only
+    uint8_t Repeats;                    // cycles before it ends, 0 = forever
+} tLedAnimation;
+
+typedef struct
+{
+    tLedColour Frames[LED_ANIMATION_MAX_FRAMES];
+    uint8_t FrameCount;
+    uint32_t FrameTime;                 // usec each frame shows for, 0 if it never changes
+    uint8_t Repeats;                    // cycles before it ends, 0 = forever
+} tLedFrameTable;
+
+void led_animation_hsv2rgb(uint32_t h, uint32_t s, uint32_t v, tLedColour* colour);
+void led_animation_preset_colour(uint16_t preset, uint8_t brightness, tLedColour* colour);
+void led_animation_render(const tLedAnimation* animation, tLedFrameTable* table);
+int16_t led_animation_frame(const tLedFrameTable* table, int64_t elapsed, int64_t* next_change);
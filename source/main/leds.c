@@ -20,7 +20,7 @@ limitations under the License.
 #include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/semphr.h"
+#include "freertos/queue.h"
 #include "esp_timer.h"
 #include "driver/gpio.h"
 #include "esp_err.h"
@@ -40,17 +40,46 @@ limitations under the License.
 #include "usb/usb_host.h"
 #include "usb_comms.h"
 #include "usb_tonex_one.h"
+#include "tonex_params.h"
+#include "led_animation.h"
 #include "leds.h"
 
 #define RMT_LED_STRIP_RESOLUTION_HZ     10000000 // 10MHz resolution, 1 tick = 0.1us (led strip needs a high resolution)
-#define LED_NUMBER                      1
+#define LED_TEMPO_FLASH_TIME            50000    // usec the led is lit on each beat
+#define LED_PRESET_BRIGHTNESS           10       // 0 - 255, always on so kept dim
+#define LED_TEMPO_BRIGHTNESS            40       // 0 - 255, beat flash
+#define LED_TASK_STACK_SIZE             (3 * 1024)
+#define LED_STRIP_ACTIVE_BRIGHTNESS     60       // 0 - 255, selected preset or effect on
+#define LED_STRIP_IDLE_BRIGHTNESS       6        // 0 - 255, switch does something but isn't active
+
+// onboard status led
+#if CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_WAVESHARE_ZERO || CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_DEVKITC
+#define LED_STATUS_PIXELS               1
+#else
+#define LED_STATUS_PIXELS               0
+#endif
+
+// footswitch status strip, a pixel per switch
+#if CONFIG_TONEX_CONTROLLER_LED_STRIP_GPIO >= 0
+#define LED_STRIP_PIXELS                CONFIG_TONEX_CONTROLLER_LED_STRIP_PIXELS
+#else
+#define LED_STRIP_PIXELS                0
+#endif
+
+#define LED_NUMBER                      (LED_STATUS_PIXELS + LED_STRIP_PIXELS)
+
+enum LedOutputs
+{
+    LED_OUTPUT_STATUS,
+    LED_OUTPUT_STRIP,
+    LED_OUTPUT_MAX
+};
 
-enum LedStates
+enum LedColourOrders
 {
-    LED_STATE_BOOT_FLASH_ON,
-    LED_STATE_BOOT_FLASH_OFF,
-    LED_STATE_BOOT_WAIT,
-    LED_STATE_IDLE
+    LED_ORDER_RGB,
+    LED_ORDER_GRB,
+    LED_ORDER_GBR
 };
 
 typedef struct 
@@ -67,83 +96,78 @@ typedef struct
     rmt_symbol_word_t reset_code;
 } rmt_led_strip_encoder_t;
 
-typedef struct 
+typedef struct
 {
-    uint8_t state; 
-    uint8_t queued_state; 
-    uint32_t timer;
-    uint32_t counter;
-
-    uint8_t led_strip_pixels[LED_NUMBER * 3];
+    tLedFrameTable base;                        // what the led normally shows
+    int64_t base_start;
+    tLedFrameTable overlay;                     // plays over the base until it ends
+    int64_t overlay_start;
+    uint8_t overlay_active;
+} tLedChannel;
+
+typedef struct
+{
+    uint8_t first;                              // channel of the first pixel
+    uint8_t pixels;                             // 0 if not fitted
+    uint8_t colour_order;                       // LED_ORDER_
+    uint8_t tx_buffer;                          // which buffer was sent last
+    uint8_t tx_valid;
+    volatile uint8_t tx_busy;                   // cleared by the RMT when the frame is out
     rmt_channel_handle_t led_chan;
     rmt_encoder_handle_t led_encoder;
-    rmt_transmit_config_t tx_config;
-} tLedControl;
+} tLedOutput;
 
-static const char *TAG = "app_leds";
+typedef struct
+{
+    uint16_t preset;
+    uint8_t preset_valid;
+    float bpm;
+    int64_t beat_start;
 
-#if CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_WAVESHARE_ZERO || CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_DEVKITC    
-static tLedControl LedControl;
-#endif
+    // what each footswitch does, and whether its effect is on
+    tLedSwitchRole roles[LED_SWITCH_ROLES_MAX];
+    uint16_t effects_on;                        // bit per pixel
+} tLedState;
 
-/****************************************************************************
-* NAME:        
-* DESCRIPTION: 
-* PARAMETERS:  
-* RETURN:      
-* NOTES:       Wiki: https://en.wikipedia.org/wiki/HSL_and_HSV
-*****************************************************************************/
-static void __attribute__((unused)) led_strip_hsv2rgb(uint32_t h, uint32_t s, uint32_t v, uint32_t *r, uint32_t *g, uint32_t *b)
+typedef struct
 {
-    h %= 360; // h -> [0,360]
-    uint32_t rgb_max = v * 2.55f;
-    uint32_t rgb_min = rgb_max * (100 - s) / 100.0f;
+    float bpm;
+    int64_t beat_start;
+} tLedTempo;
 
-    uint32_t i = h / 60;
-    uint32_t diff = h % 60;
+typedef struct
+{
+    tLedAnimation animation;
+    int64_t start;
+} tLedOverlay;
 
-    // RGB adjustment amount by hue
-    uint32_t rgb_adj = (rgb_max - rgb_min) * diff / 60;
+typedef struct 
+{
+    TaskHandle_t task;
 
-    switch (i) 
-    {
-        case 0:
-            *r = rgb_max;
-            *g = rgb_min + rgb_adj;
-            *b = rgb_min;
-            break;
-
-        case 1:
-            *r = rgb_max - rgb_adj;
-            *g = rgb_max;
-            *b = rgb_min;
-            break;
-
-        case 2:
-            *r = rgb_min;
-            *g = rgb_max;
-            *b = rgb_min + rgb_adj;
-            break;
-
-        case 3:
-            *r = rgb_min;
-            *g = rgb_max - rgb_adj;
-            *b = rgb_max;
-            break;
-
-        case 4:
-            *r = rgb_min + rgb_adj;
-            *g = rgb_min;
-            *b = rgb_max;
-            break;
+    // setters overwrite these, the led task takes the latest
+    QueueHandle_t preset_mailbox;
+    QueueHandle_t tempo_mailbox;
+    QueueHandle_t overlay_mailbox;
+    QueueHandle_t roles_mailbox;
+    uint8_t params_changed;
 
-        default:
-            *r = rgb_max;
-            *g = rgb_min;
-            *b = rgb_max - rgb_adj;
-            break;
-    }
-}
+    // led task only from here
+    tLedState state;
+    tLedChannel channels[LED_NUMBER];
+    tLedOutput outputs[LED_OUTPUT_MAX];
+
+    // double buffered, the last frame sent is kept to compare against
+    uint8_t led_strip_pixels[2][LED_NUMBER * 3];
+
+    rmt_transmit_config_t tx_config;
+} tLedControl;
+
+static const char *TAG = "app_leds";
+
+#if LED_NUMBER > 0
+static tLedControl LedControl;
+#endif
 
 /****************************************************************************
 * NAME:        
@@ -317,127 +341,667 @@ err:
     return ret;
 }
 
+#if LED_NUMBER > 0
 /****************************************************************************
-* NAME:        
-* DESCRIPTION: 
-* PARAMETERS:  
-* RETURN:      
-* NOTES:       
+* NAME:
+* DESCRIPTION: Put a colour into the led strip data
+* PARAMETERS:  colour_order: LED_ORDER_
+* RETURN:
+* NOTES:
 *****************************************************************************/
-void leds_handle(void)
-{    
-#if CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_WAVESHARE_ZERO || CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_DEVKITC    
-    uint32_t red = 0;
-    uint32_t green = 0;
-    uint32_t blue = 10;
-   
-    switch (LedControl.state)
+static void leds_pack_pixel(const tLedColour* colour, uint8_t colour_order, uint8_t* pixel)
+{
+    switch (colour_order)
     {
-        case LED_STATE_BOOT_FLASH_ON:
+        case LED_ORDER_GBR:
         {
-#if CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_DEVKITC
-            // led is GBR colour order
-            LedControl.led_strip_pixels[0] = green;
-            LedControl.led_strip_pixels[1] = blue;
-            LedControl.led_strip_pixels[2] = red;
-#endif        
-#if CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_WAVESHARE_ZERO 
-            // led is RGB colour order
-            LedControl.led_strip_pixels[0] = red;
-            LedControl.led_strip_pixels[1] = green;
-            LedControl.led_strip_pixels[2] = blue;
-#endif
+            pixel[0] = colour->Green;
+            pixel[1] = colour->Blue;
+            pixel[2] = colour->Red;
+        } break;
 
-            ESP_ERROR_CHECK(rmt_transmit(LedControl.led_chan, LedControl.led_encoder, LedControl.led_strip_pixels, sizeof(LedControl.led_strip_pixels), &LedControl.tx_config));
+        case LED_ORDER_GRB:
+        {
+            pixel[0] = colour->Green;
+            pixel[1] = colour->Red;
+            pixel[2] = colour->Blue;
+        } break;
 
-            LedControl.queued_state = LED_STATE_BOOT_FLASH_OFF;
-            LedControl.state = LED_STATE_BOOT_WAIT;
-            LedControl.timer = xTaskGetTickCount();
+        case LED_ORDER_RGB:
+        default:
+        {
+            pixel[0] = colour->Red;
+            pixel[1] = colour->Green;
+            pixel[2] = colour->Blue;
         } break;
+    }
+}
 
-        case LED_STATE_BOOT_FLASH_OFF:
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Show the current frame of each led
+* PARAMETERS:
+* RETURN:      ticks until the next change
+* NOTES:       Led task only. An output is only encoded and sent if one of
+*              its pixels changed. One still sending is skipped, its done
+*              callback wakes the task to try again
+*****************************************************************************/
+static TickType_t leds_update(void)
+{
+    int64_t now = esp_timer_get_time();
+    int64_t next_time = -1;
+    int64_t next_change;
+    int16_t frame;
+    tLedChannel* channel;
+    tLedOutput* output;
+    const tLedColour* colour;
+    uint8_t* pixels;
+    uint8_t* sent;
+    uint16_t length;
+
+    for (uint8_t out = 0; out < LED_OUTPUT_MAX; out++)
+    {
+        output = &LedControl.outputs[out];
+
+        if (output->pixels == 0)
         {
-            memset(LedControl.led_strip_pixels, 0, sizeof(LedControl.led_strip_pixels));
-            ESP_ERROR_CHECK(rmt_transmit(LedControl.led_chan, LedControl.led_encoder, LedControl.led_strip_pixels, sizeof(LedControl.led_strip_pixels), &LedControl.tx_config));
+            continue;
+        }
+
+        // the RMT reads the buffer as it sends, so don't pack into one it still has
+        if (output->tx_busy)
+        {
+            continue;
+        }
 
-            // check hoiw many times we have flashed the led
-            if (LedControl.counter > 0)
+        pixels = &LedControl.led_strip_pixels[output->tx_buffer ^ 1][output->first * 3];
+        sent = &LedControl.led_strip_pixels[output->tx_buffer][output->first * 3];
+        length = output->pixels * 3;
+
+        for (uint8_t loop = 0; loop < output->pixels; loop++)
+        {
+            channel = &LedControl.channels[output->first + loop];
+            frame = -1;
+
+            if (channel->overlay_active)
             {
-                LedControl.counter--;
+                frame = led_animation_frame(&channel->overlay, now - channel->overlay_start, &next_change);
+                if (frame < 0)
+                {
+                    // finished, back to the base
+                    channel->overlay_active = 0;
+                }
+                else
+                {
+                    colour = &channel->overlay.Frames[frame];
+                    next_change = (next_change < 0) ? -1 : (next_change + channel->overlay_start);
+                }
             }
 
-            if (LedControl.counter == 0)
+            if (frame < 0)
             {
-                // all done
-                LedControl.queued_state = LED_STATE_IDLE;
+                frame = led_animation_frame(&channel->base, now - channel->base_start, &next_change);
+                colour = &channel->base.Frames[(frame < 0) ? 0 : frame];
+                next_change = (next_change < 0) ? -1 : (next_change + channel->base_start);
             }
-            else
-            {            
-                // flash again
-                LedControl.queued_state = LED_STATE_BOOT_FLASH_ON;
+
+            if ((next_change >= 0) && ((next_time < 0) || (next_change < next_time)))
+            {
+                next_time = next_change;
             }
-            
-            LedControl.state = LED_STATE_BOOT_WAIT;
-            LedControl.timer = xTaskGetTickCount();
+
+            leds_pack_pixel(colour, output->colour_order, &pixels[loop * 3]);
+        }
+
+        // only send what changed
+        if (!output->tx_valid || (memcmp(pixels, sent, length) != 0))
+        {
+            output->tx_buffer ^= 1;
+            output->tx_valid = 1;
+            output->tx_busy = 1;
+
+            // queued, the RMT sends it in the background
+            rmt_transmit(output->led_chan, output->led_encoder, pixels, length, &LedControl.tx_config);
+        }
+    }
+
+    if (next_time < 0)
+    {
+        // nothing moving, sleep until asked
+        return portMAX_DELAY;
+    }
+
+    // rounded up, so the change is due when the task wakes
+    return (TickType_t)MAX(pdMS_TO_TICKS((next_time - now + 999) / 1000), 1);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: RMT has finished sending a frame
+* PARAMETERS:  user_ctx: the output
+* RETURN:      true if a higher priority task was woken
+* NOTES:       Runs from the RMT interrupt
+*****************************************************************************/
+static bool leds_tx_done_callback(rmt_channel_handle_t channel, const rmt_tx_done_event_data_t* edata, void* user_ctx)
+{
+    BaseType_t woken = pdFALSE;
+
+    ((tLedOutput*)user_ctx)->tx_busy = 0;
+
+    // a frame may have been held back while this one was sending
+    vTaskNotifyGiveFromISR(LedControl.task, &woken);
+
+    return (woken == pdTRUE);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Get the status led animation
+* PARAMETERS:
+* RETURN:
+* NOTES:       Led task only. The preset colour, flashing brighter on
+*              the beat when there is a tempo
+*****************************************************************************/
+static void leds_get_status_animation(tLedAnimation* animation)
+{
+    memset((void*)animation, 0, sizeof(tLedAnimation));
+
+    if (LedControl.state.bpm > 0.0f)
+    {
+        animation->Type = LED_ANIMATION_TEMPO;
+        animation->Period = (uint32_t)(60000000.0f / LedControl.state.bpm);
+        animation->OnTime = LED_TEMPO_FLASH_TIME;
+
+        if (LedControl.state.preset_valid)
+        {
+            led_animation_preset_colour(LedControl.state.preset, LED_TEMPO_BRIGHTNESS, &animation->Colour);
+            led_animation_preset_colour(LedControl.state.preset, LED_PRESET_BRIGHTNESS, &animation->Background);
+        }
+        else
+        {
+            animation->Colour.Green = LED_TEMPO_BRIGHTNESS;
+        }
+    }
+    else if (LedControl.state.preset_valid)
+    {
+        animation->Type = LED_ANIMATION_PRESET;
+        animation->Preset = LedControl.state.preset;
+        animation->Brightness = LED_PRESET_BRIGHTNESS;
+    }
+    else
+    {
+        animation->Type = LED_ANIMATION_OFF;
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Get the animation for a footswitch pixel
+* PARAMETERS:  pixel: strip pixel, same as the switch
+* RETURN:
+* NOTES:       Led task only. Bright when the switch's preset is
+*              selected or its effect is on, dim when it isn't
+*****************************************************************************/
+static void leds_get_switch_animation(uint8_t pixel, const tLedAnimation* status, tLedAnimation* animation)
+{
+    const tLedSwitchRole* role = &LedControl.state.roles[pixel];
+    uint8_t active = 0;
+
+    memset((void*)animation, 0, sizeof(tLedAnimation));
+    animation->Type = LED_ANIMATION_SOLID;
+
+    switch (role->Role)
+    {
+        case LED_SWITCH_ROLE_PRESET:
+        {
+            active = LedControl.state.preset_valid && (LedControl.state.preset == role->Value);
+            led_animation_preset_colour(role->Value, active ? LED_STRIP_ACTIVE_BRIGHTNESS : LED_STRIP_IDLE_BRIGHTNESS, &animation->Colour);
         } break;
 
-        case LED_STATE_BOOT_WAIT:
+        case LED_SWITCH_ROLE_BANK:
         {
-            // timed expired?
-            if ((xTaskGetTickCount() - LedControl.timer) > 150)
-            {
-                // to next state
-                LedControl.state = LedControl.queued_state;
-            }
+            // colour changes with the bank
+            led_animation_preset_colour(role->Value, LED_STRIP_IDLE_BRIGHTNESS, &animation->Colour);
+        } break;
+
+        case LED_SWITCH_ROLE_EFFECT:
+        {
+            // each effect has its own colour
+            active = (LedControl.state.effects_on & (1 << pixel)) != 0;
+            led_animation_preset_colour(role->Value, active ? LED_STRIP_ACTIVE_BRIGHTNESS : LED_STRIP_IDLE_BRIGHTNESS, &animation->Colour);
         } break;
 
-        case LED_STATE_IDLE:
+        case LED_SWITCH_ROLE_TEMPO:
         {
-            // nothing to do
+            // same as the status led
+            memcpy((void*)animation, (void*)status, sizeof(tLedAnimation));
+        } break;
+
+        case LED_SWITCH_ROLE_ACTION:
+        {
+            animation->Colour.Red = LED_STRIP_IDLE_BRIGHTNESS;
+            animation->Colour.Green = LED_STRIP_IDLE_BRIGHTNESS;
+            animation->Colour.Blue = LED_STRIP_IDLE_BRIGHTNESS;
+        } break;
+
+        case LED_SWITCH_ROLE_NONE:
+        default:
+        {
+            animation->Type = LED_ANIMATION_OFF;
         } break;
     }
-#endif    
 }
 
 /****************************************************************************
-* NAME:        
-* DESCRIPTION: 
-* PARAMETERS:  
-* RETURN:      
-* NOTES:       
+* NAME:
+* DESCRIPTION: Set what the leds normally show
+* PARAMETERS:
+* RETURN:
+* NOTES:       Led task only
 *****************************************************************************/
-void leds_init(void)
+static void leds_set_base(void)
 {
-#if CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_WAVESHARE_ZERO || CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_DEVKITC    
-    ESP_LOGI(TAG, "Leds Init start");
+    tLedAnimation status;
+    tLedAnimation animation;
+    tLedChannel* channel;
+    int64_t start;
 
-    // init memory
-    memset((void*)&LedControl, 0, sizeof(LedControl));
-    LedControl.tx_config.loop_count = 0; // no transfer loop
+    leds_get_status_animation(&status);
+
+    // tempo keeps the phase of the tap that set it
+    start = (LedControl.state.bpm > 0.0f) ? LedControl.state.beat_start : esp_timer_get_time();
+
+    for (uint8_t loop = 0; loop < LED_NUMBER; loop++)
+    {
+        channel = &LedControl.channels[loop];
+
+        if (loop < LED_STATUS_PIXELS)
+        {
+            led_animation_render(&status, &channel->base);
+        }
+        else
+        {
+            leds_get_switch_animation(loop - LED_STATUS_PIXELS, &status, &animation);
+            led_animation_render(&animation, &channel->base);
+        }
 
-    LedControl.state = LED_STATE_BOOT_FLASH_ON;
+        channel->base_start = start;
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Set up an output
+* PARAMETERS:  with_dma: only one channel can have it
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void leds_init_output(uint8_t index, int gpio_num, uint8_t first, uint8_t pixels, uint8_t colour_order, uint8_t with_dma)
+{
+    tLedOutput* output = &LedControl.outputs[index];
 
-    // set for 3 flashes at boot
-    LedControl.counter = 3;
+    output->first = first;
+    output->pixels = pixels;
+    output->colour_order = colour_order;
 
-    ESP_LOGI(TAG, "Create RMT TX channel");
+    ESP_LOGI(TAG, "Create RMT TX channel on GPIO %d, %d pixels", gpio_num, (int)pixels);
     rmt_tx_channel_config_t tx_chan_config = {
         .clk_src = RMT_CLK_SRC_DEFAULT, // select source clock
-        .gpio_num = LED_OUTPUT_GPIO_NUM,
-        .mem_block_symbols = 64, // increase the block size can make the LED less flickering
+        .gpio_num = gpio_num,
+        .mem_block_symbols = with_dma ? 64 : 48, // with DMA, this is the DMA buffer size
         .resolution_hz = RMT_LED_STRIP_RESOLUTION_HZ,
-        .trans_queue_depth = 4, // set the number of transactions that can be pending in the background
+        .trans_queue_depth = 1, // a frame is only sent once the last one is done
+        .flags.with_dma = with_dma, // frames go out without the CPU
     };
-    ESP_ERROR_CHECK(rmt_new_tx_channel(&tx_chan_config, &LedControl.led_chan));
+    ESP_ERROR_CHECK(rmt_new_tx_channel(&tx_chan_config, &output->led_chan));
 
-    ESP_LOGI(TAG, "Install led strip encoder");    
+    ESP_LOGI(TAG, "Install led strip encoder");
 
     led_strip_encoder_config_t encoder_config = {
         .resolution = RMT_LED_STRIP_RESOLUTION_HZ,
     };
-    ESP_ERROR_CHECK(rmt_new_led_strip_encoder(&encoder_config, &LedControl.led_encoder));
+    ESP_ERROR_CHECK(rmt_new_led_strip_encoder(&encoder_config, &output->led_encoder));
+
+    // only the led task sends, the callback tells it when it can again
+    rmt_tx_event_callbacks_t callbacks = {
+        .on_trans_done = leds_tx_done_callback,
+    };
+    ESP_ERROR_CHECK(rmt_tx_register_event_callbacks(output->led_chan, &callbacks, (void*)output));
 
     ESP_LOGI(TAG, "Enable RMT TX channel");
-    ESP_ERROR_CHECK(rmt_enable(LedControl.led_chan));    
-#endif     
+    ESP_ERROR_CHECK(rmt_enable(output->led_chan));
+}
+
+#if LED_STRIP_PIXELS > 0
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Read which of the switches' effects are on
+* PARAMETERS:
+* RETURN:      1 if any changed
+* NOTES:       Led task only, so nobody setting the leds waits on the
+*              parameter lock
+*****************************************************************************/
+static uint8_t leds_read_effects(void)
+{
+    uint16_t effects_on = 0;
+    uint16_t param;
+    tTonexParameter* param_ptr;
+
+    if (tonex_params_get_locked_access(&param_ptr) != ESP_OK)
+    {
+        return 0;
+    }
+
+    for (uint8_t loop = 0; loop < LED_STRIP_PIXELS; loop++)
+    {
+        if (LedControl.state.roles[loop].Role != LED_SWITCH_ROLE_EFFECT)
+        {
+            continue;
+        }
+
+        // on/off params are on at 1, anything else is on off its minimum
+        param = LedControl.state.roles[loop].Value;
+        if ((param < TONEX_PARAM_LAST) && (param_ptr[param].Value > param_ptr[param].Min))
+        {
+            effects_on |= (1 << loop);
+        }
+    }
+
+    tonex_params_release_locked_access();
+
+    if (effects_on == LedControl.state.effects_on)
+    {
+        return 0;
+    }
+
+    LedControl.state.effects_on = effects_on;
+    return 1;
+}
+#endif
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Take whatever the setters have posted
+* PARAMETERS:
+* RETURN:      1 if what the leds normally show changed
+* NOTES:       Led task only
+*****************************************************************************/
+static uint8_t leds_take_requests(void)
+{
+    uint16_t preset;
+    tLedTempo tempo;
+    tLedOverlay overlay;
+    tLedFrameTable table;
+    uint8_t changed = 0;
+
+    if (xQueueReceive(LedControl.preset_mailbox, (void*)&preset, 0) == pdTRUE)
+    {
+        LedControl.state.preset = preset;
+        LedControl.state.preset_valid = 1;
+        changed = 1;
+    }
+
+    if (xQueueReceive(LedControl.tempo_mailbox, (void*)&tempo, 0) == pdTRUE)
+    {
+        LedControl.state.bpm = tempo.bpm;
+        LedControl.state.beat_start = tempo.beat_start;
+        changed = 1;
+    }
+
+    if (xQueueReceive(LedControl.overlay_mailbox, (void*)&overlay, 0) == pdTRUE)
+    {
+        led_animation_render(&overlay.animation, &table);
+
+        for (uint8_t loop = 0; loop < LED_NUMBER; loop++)
+        {
+            memcpy((void*)&LedControl.channels[loop].overlay, (void*)&table, sizeof(table));
+            LedControl.channels[loop].overlay_start = overlay.start;
+            LedControl.channels[loop].overlay_active = 1;
+        }
+    }
+
+#if LED_STRIP_PIXELS > 0
+    tLedSwitchRole roles[LED_STRIP_PIXELS];
+    uint8_t read_effects = __atomic_exchange_n(&LedControl.params_changed, 0, __ATOMIC_ACQ_REL);
+
+    if (xQueueReceive(LedControl.roles_mailbox, (void*)roles, 0) == pdTRUE)
+    {
+        if (memcmp((void*)roles, (void*)LedControl.state.roles, sizeof(roles)) != 0)
+        {
+            memcpy((void*)LedControl.state.roles, (void*)roles, sizeof(roles));
+            changed = 1;
+
+            // effects may be on different switches now
+            read_effects = 1;
+        }
+    }
+
+    if (read_effects && leds_read_effects())
+    {
+        changed = 1;
+    }
+#endif
+
+    return changed;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Led task, renders and sends the frames
+* PARAMETERS:
+* RETURN:
+* NOTES:       The only place the leds are drawn. Setters just post to a
+*              mailbox and wake it, and it sleeps until the next frame
+*              change, the next request, or a frame finishing sending
+*****************************************************************************/
+static void leds_task(void *arg)
+{
+    TickType_t wait = 0;
+
+    ESP_LOGI(TAG, "Led task start");
+
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, wait);
+
+        if (leds_take_requests())
+        {
+            leds_set_base();
+        }
+
+        wait = leds_update();
+    }
+}
+#endif
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Play an animation over the normal led display
+* PARAMETERS:
+* RETURN:
+* NOTES:       Until its repeats are done, or the next one if it repeats
+*              forever
+*****************************************************************************/
+void leds_play(const tLedAnimation* animation)
+{
+#if LED_NUMBER > 0
+    tLedOverlay overlay;
+
+    if (LedControl.task == NULL)
+    {
+        return;
+    }
+
+    memcpy((void*)&overlay.animation, (void*)animation, sizeof(tLedAnimation));
+    overlay.start = esp_timer_get_time();
+
+    xQueueOverwrite(LedControl.overlay_mailbox, (void*)&overlay);
+    xTaskNotifyGive(LedControl.task);
+#endif
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Show the colour of the current preset
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+void leds_set_preset(uint16_t preset)
+{
+#if LED_NUMBER > 0
+    if (LedControl.task == NULL)
+    {
+        return;
+    }
+
+    xQueueOverwrite(LedControl.preset_mailbox, (void*)&preset);
+    xTaskNotifyGive(LedControl.task);
+#endif
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Flash the led at a tempo
+* PARAMETERS:  bpm: beats per minute, 0 to stop
+* RETURN:
+* NOTES:       The first flash is now, so the beat lines up with the tap
+*              that set it
+*****************************************************************************/
+void leds_set_tempo(float bpm)
+{
+#if LED_NUMBER > 0
+    tLedTempo tempo;
+
+    if (LedControl.task == NULL)
+    {
+        return;
+    }
+
+    tempo.bpm = bpm;
+    tempo.beat_start = esp_timer_get_time();
+
+    xQueueOverwrite(LedControl.tempo_mailbox, (void*)&tempo);
+    xTaskNotifyGive(LedControl.task);
+#endif
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Refresh the effect states shown on the footswitch strip
+* PARAMETERS:
+* RETURN:
+* NOTES:       Called when the pedal's parameters change. The led task
+*              reads them, and only redraws the strip if one of the
+*              switches' effects changed
+*****************************************************************************/
+void leds_sync_params(void)
+{
+#if LED_STRIP_PIXELS > 0
+    if (LedControl.task == NULL)
+    {
+        return;
+    }
+
+    __atomic_store_n(&LedControl.params_changed, 1, __ATOMIC_RELEASE);
+    xTaskNotifyGive(LedControl.task);
+#endif
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Set what each footswitch on the strip does
+* PARAMETERS:  roles: one per switch, from the first
+*              count: switches in roles
+* RETURN:
+* NOTES:       Called when the switch actions or the bank change. Pixels
+*              past the last switch are off. Only posts the table, so it
+*              never blocks the footswitch scan
+*****************************************************************************/
+void leds_set_switch_roles(const tLedSwitchRole* roles, uint8_t count)
+{
+#if LED_STRIP_PIXELS > 0
+    tLedSwitchRole new_roles[LED_STRIP_PIXELS];
+
+    if (LedControl.task == NULL)
+    {
+        return;
+    }
+
+    memset((void*)new_roles, 0, sizeof(new_roles));
+    memcpy((void*)new_roles, (void*)roles, MIN(count, LED_STRIP_PIXELS) * sizeof(tLedSwitchRole));
+
+    xQueueOverwrite(LedControl.roles_mailbox, (void*)new_roles);
+    xTaskNotifyGive(LedControl.task);
+#endif
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION:
+* PARAMETERS:
+* RETURN:
+* NOTES:       Frames are drawn and sent by the led task
+*****************************************************************************/
+void leds_init(void)
+{
+#if LED_NUMBER > 0
+    ESP_LOGI(TAG, "Leds Init start");
+
+    // init memory
+    memset((void*)&LedControl, 0, sizeof(LedControl));
+    LedControl.tx_config.loop_count = 0; // no transfer loop
+
+    // one deep, a new request replaces one not yet taken
+    LedControl.preset_mailbox = xQueueCreate(1, sizeof(uint16_t));
+    LedControl.tempo_mailbox = xQueueCreate(1, sizeof(tLedTempo));
+    LedControl.overlay_mailbox = xQueueCreate(1, sizeof(tLedOverlay));
+    if ((LedControl.preset_mailbox == NULL) || (LedControl.tempo_mailbox == NULL) || (LedControl.overlay_mailbox == NULL))
+    {
+        ESP_LOGE(TAG, "Led mailbox create failed!");
+        return;
+    }
+
+#if LED_STRIP_PIXELS > 0
+    LedControl.roles_mailbox = xQueueCreate(1, sizeof(tLedSwitchRole) * LED_STRIP_PIXELS);
+    if (LedControl.roles_mailbox == NULL)
+    {
+        ESP_LOGE(TAG, "Led mailbox create failed!");
+        return;
+    }
+#endif
+
+#if LED_STATUS_PIXELS > 0
+    // the strip gets the DMA channel if there is one
+#if CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_DEVKITC
+    leds_init_output(LED_OUTPUT_STATUS, LED_OUTPUT_GPIO_NUM, 0, LED_STATUS_PIXELS, LED_ORDER_GBR, LED_STRIP_PIXELS == 0);
+#else
+    leds_init_output(LED_OUTPUT_STATUS, LED_OUTPUT_GPIO_NUM, 0, LED_STATUS_PIXELS, LED_ORDER_RGB, LED_STRIP_PIXELS == 0);
+#endif
+#endif
+
+#if LED_STRIP_PIXELS > 0
+    // WS2812B strips are GRB
+    leds_init_output(LED_OUTPUT_STRIP, CONFIG_TONEX_CONTROLLER_LED_STRIP_GPIO, LED_STATUS_PIXELS, LED_STRIP_PIXELS, LED_ORDER_GRB, 1);
+#endif
+
+    // what the leds normally show, so the first frame isn't blank
+    leds_set_base();
+
+    if (xTaskCreatePinnedToCore(leds_task, "LEDS", LED_TASK_STACK_SIZE, NULL, LED_TASK_PRIORITY, &LedControl.task, 1) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Led task create failed!");
+        LedControl.task = NULL;
+        return;
+    }
+
+    // 3 flashes at boot
+    tLedAnimation boot_flash = {0};
+    boot_flash.Type = LED_ANIMATION_BLINK;
+    boot_flash.Colour.Blue = 10;
+    boot_flash.Period = 300000;
+    boot_flash.OnTime = 150000;
+    boot_flash.Repeats = 3;
+    leds_play(&boot_flash);
+#endif
 }
@@ -18,12 +18,37 @@ limitations under the License.
 #ifndef _LEDS_H
 #define _LEDS_H
 
+#include "led_animation.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define LED_SWITCH_ROLES_MAX            16          // footswitches the status strip can show
+
+enum LedSwitchRoles
+{
+    LED_SWITCH_ROLE_NONE,
+    LED_SWITCH_ROLE_PRESET,             // Value: preset index it selects
+    LED_SWITCH_ROLE_BANK,               // Value: current bank
+    LED_SWITCH_ROLE_EFFECT,             // Value: parameter it toggles
+    LED_SWITCH_ROLE_TEMPO,
+    LED_SWITCH_ROLE_ACTION,             // anything else, no state to show
+    LED_SWITCH_ROLE_LAST
+};
+
+typedef struct
+{
+    uint8_t Role;                       // LED_SWITCH_ROLE_
+    uint16_t Value;
+} tLedSwitchRole;
+
 void leds_init(void);
-void leds_handle(void);
+void leds_play(const tLedAnimation* animation);
+void leds_set_preset(uint16_t preset);
+void leds_set_tempo(float bpm);
+void leds_set_switch_roles(const tLedSwitchRole* roles, uint8_t count);
+void leds_sync_params(void);
 
 #ifdef __cplusplus
 } /*extern "C"*/
@@ -64,9 +64,15 @@ limitations under the License.
 #include "CH422G.h"
 #include "LP5562.h"
 #include "midi_serial.h"
+#include "midi_out.h"
+#include "midi_clock.h"
+#include "midi_helper.h"
+#include "midi_router.h"
 #include "wifi_config.h"
 #include "leds.h"
 #include "tonex_params.h"
+#include "i2c_scheduler.h"
+#include "expression.h"
 
 #define I2C_MASTER_FREQ_HZ              400000      /*!< I2C master clock frequency */
 #define I2C_MASTER_TX_BUF_DISABLE       0           /*!< I2C master doesn't need buffer */
@@ -77,9 +83,6 @@ limitations under the License.
 
 static const char *TAG = "app_main";
 
-__attribute__((unused)) SemaphoreHandle_t I2CMutex_1;
-__attribute__((unused)) SemaphoreHandle_t I2CMutex_2;
-
 static esp_err_t i2c_master_init(uint32_t port, uint32_t scl_pin, uint32_t sda_pin);
 
 /****************************************************************************
@@ -87,7 +90,7 @@ static esp_err_t i2c_master_init(uint32_t port, uint32_t scl_pin, uint32_t sda_p
 * DESCRIPTION: 
 * PARAMETERS:  
 * RETURN:      
-* NOTES:       
+* NOTES:       Only call from an I2C scheduler job on bus 1
 *****************************************************************************/
 esp_err_t i2c_master_reset(void)
 {
@@ -174,10 +177,10 @@ static esp_err_t i2c_master_init(uint32_t port, uint32_t scl_pin, uint32_t sda_p
 * RETURN:      
 * NOTES:       
 *****************************************************************************/
-static void InitIOExpander(i2c_port_t I2CNum, SemaphoreHandle_t I2CMutex)
+static void InitIOExpander(i2c_port_t I2CNum)
 {
     // init IO expander
-    if (CH422G_init(I2CNum, I2CMutex) == ESP_OK)
+    if (CH422G_init(I2CNum) == ESP_OK)
     {
         // set IO expander to output mode. Can't do mixed pins
         // For inputs, we will temporarily flip the mode
@@ -206,39 +209,28 @@ void app_main(void)
     // load the config first
     control_load_config();
 
-    // create mutexes for shared I2C buses
-    I2CMutex_1 = xSemaphoreCreateMutex();
-    if (I2CMutex_1 == NULL)
-    {
-        ESP_LOGE(TAG, "I2C Mutex 1 create failed!");
-    }
-    
-    I2CMutex_2 = xSemaphoreCreateMutex();
-    if (I2CMutex_2 == NULL)
-    {
-        ESP_LOGE(TAG, "I2C Mutex 2 create failed!");
-    }
-
-    // init I2C master 1
+    // init I2C master 1, and its scheduler which owns the bus from here on
     ESP_ERROR_CHECK(i2c_master_init(I2C_MASTER_NUM_1, I2C_MASTER_1_SCL_IO, I2C_MASTER_1_SDA_IO));
+    ESP_ERROR_CHECK(i2c_scheduler_init(I2C_MASTER_NUM_1));
     ESP_LOGI(TAG, "I2C 1 initialized successfully");
 
     if (I2C_MASTER_2_SCL_IO != -1)
     {
         ESP_ERROR_CHECK(i2c_master_init(I2C_MASTER_NUM_2, I2C_MASTER_2_SCL_IO, I2C_MASTER_2_SDA_IO));
+        ESP_ERROR_CHECK(i2c_scheduler_init(I2C_MASTER_NUM_2));
         ESP_LOGI(TAG, "I2C 2 initialized successfully");    
     }
 
 #if CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_WAVESHARE_43B || CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_WAVESHARE_43DEVONLY
     // init onboard IO expander
     ESP_LOGI(TAG, "Init Onboard IO Expander");
-    InitIOExpander(I2C_MASTER_NUM_1, I2CMutex_1);
+    InitIOExpander(I2C_MASTER_NUM_1);
 #endif
 
 #if CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_M5ATOMS3R
     // init LP5562 led driver
     ESP_LOGI(TAG, "Init LP5562 Led Driver");
-    LP5562_init(I2C_MASTER_NUM_1, I2CMutex_1);
+    LP5562_init(I2C_MASTER_NUM_1);
 #endif
 
     // init parameters
@@ -252,24 +244,46 @@ void app_main(void)
 #if CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_WAVESHARE_43B || CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_WAVESHARE_43DEVONLY
     // init GUI
     ESP_LOGI(TAG, "Init 43.B display");
-    display_init(I2C_MASTER_NUM_1, I2CMutex_1);
+    display_init(I2C_MASTER_NUM_1);
 #endif
 
 #if CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_WAVESHARE_169 || CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_WAVESHARE_169TOUCH 
     // init GUI
     ESP_LOGI(TAG, "Init 1.69 display");
-    display_init(I2C_MASTER_NUM_1, I2CMutex_1);
+    display_init(I2C_MASTER_NUM_1);
 #endif
 
 #if CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_M5ATOMS3R
     // init GUI
     ESP_LOGI(TAG, "Init 0.85 display");
-    display_init(I2C_MASTER_NUM_1, I2CMutex_1);
+    display_init(I2C_MASTER_NUM_1);
 #endif
 
     // init Footswitches
     ESP_LOGI(TAG, "Init footswitches");
-    footswitches_init(EXTERNAL_IO_EXPANDER_BUS, EXTERNAL_IO_EXPANDER_MUTEX);
+    footswitches_init(EXTERNAL_IO_EXPANDER_BUS);
+
+#if CONFIG_TONEX_CONTROLLER_EXPRESSION_GPIO >= 0
+    // init expression pedal
+    ESP_LOGI(TAG, "Init expression pedal");
+    expression_init();
+#endif
+
+    if ((control_get_config_item_int(CONFIG_ITEM_BT_MODE) != BT_MODE_DISABLED) || control_get_config_item_int(CONFIG_ITEM_MIDI_ENABLE))
+    {
+        // init Midi output feedback
+        ESP_LOGI(TAG, "Init MIDI Out");
+        midi_out_init();
+
+#if CONFIG_TONEX_CONTROLLER_MIDI_CLOCK_SYNC
+        // init Midi clock tempo tracking
+        midi_clock_init();
+#endif
+
+        // init Midi router, before any Midi inputs start
+        ESP_LOGI(TAG, "Init MIDI Router");
+        midi_router_init();
+    }
 
     if (control_get_config_item_int(CONFIG_ITEM_BT_MODE) != BT_MODE_DISABLED)
     {
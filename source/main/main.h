@@ -28,9 +28,6 @@ extern "C" {
 #define I2C_MASTER_NUM_1                0          
 #define I2C_MASTER_NUM_2                1          
 
-extern SemaphoreHandle_t I2CMutex_1;
-extern SemaphoreHandle_t I2CMutex_2;
-
 #if CONFIG_TONEX_CONTROLLER_HARDWARE_PLATFORM_WAVESHARE_43B
     // I2C bus 1
     #define I2C_MASTER_1_SCL_IO  GPIO_NUM_9       
@@ -41,7 +38,6 @@ extern SemaphoreHandle_t I2CMutex_2;
     #define I2C_MASTER_2_SDA_IO  -1
 
     #define EXTERNAL_IO_EXPANDER_BUS       I2C_MASTER_NUM_1
-    #define EXTERNAL_IO_EXPANDER_MUTEX     I2CMutex_1 
 
     // IO expander
     #define FOOTSWITCH_1		IO_EXPANDER_PIN_1
@@ -115,7 +111,6 @@ extern SemaphoreHandle_t I2CMutex_2;
     #define I2C_MASTER_2_SDA_IO  -1
     
     #define EXTERNAL_IO_EXPANDER_BUS       I2C_MASTER_NUM_1
-    #define EXTERNAL_IO_EXPANDER_MUTEX     I2CMutex_1 
 
     // IO expander
     #define FOOTSWITCH_1		-1
@@ -179,7 +174,6 @@ extern SemaphoreHandle_t I2CMutex_2;
     #define I2C_MASTER_2_SDA_IO  -1
 
     #define EXTERNAL_IO_EXPANDER_BUS       I2C_MASTER_NUM_1
-    #define EXTERNAL_IO_EXPANDER_MUTEX     I2CMutex_1 
 
     // direct IO pins
     #define FOOTSWITCH_1		GPIO_NUM_3
@@ -214,7 +208,6 @@ extern SemaphoreHandle_t I2CMutex_2;
     #define I2C_MASTER_2_SDA_IO  -1
 
     #define EXTERNAL_IO_EXPANDER_BUS       I2C_MASTER_NUM_1
-    #define EXTERNAL_IO_EXPANDER_MUTEX     I2CMutex_1 
 
     // direct IO pins
     #define FOOTSWITCH_1		GPIO_NUM_16
@@ -251,7 +244,6 @@ extern SemaphoreHandle_t I2CMutex_2;
     #define I2C_MASTER_2_SDA_IO  -1
     
     #define EXTERNAL_IO_EXPANDER_BUS       I2C_MASTER_NUM_1
-    #define EXTERNAL_IO_EXPANDER_MUTEX     I2CMutex_1 
 
     // direct IO pins
     #define FOOTSWITCH_1		GPIO_NUM_4
@@ -276,7 +268,6 @@ extern SemaphoreHandle_t I2CMutex_2;
     #define I2C_MASTER_2_SDA_IO  -1
     
     #define EXTERNAL_IO_EXPANDER_BUS       I2C_MASTER_NUM_1
-    #define EXTERNAL_IO_EXPANDER_MUTEX     I2CMutex_1 
 
     // direct IO pins
     #define FOOTSWITCH_1		GPIO_NUM_4
@@ -301,7 +292,6 @@ extern SemaphoreHandle_t I2CMutex_2;
     #define I2C_MASTER_2_SDA_IO  GPIO_NUM_2       
     
     #define EXTERNAL_IO_EXPANDER_BUS       I2C_MASTER_NUM_2
-    #define EXTERNAL_IO_EXPANDER_MUTEX     I2CMutex_2 
 
     // direct IO pins
     #define FOOTSWITCH_1		GPIO_NUM_5
@@ -0,0 +1,242 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "usb/usb_host.h"
+#include "usb_comms.h"
+#include "tonex_params.h"
+#include "midi_clock_fit.h"
+#include "midi_clock.h"
+
+#define MIDI_CLOCK_BPM_THRESHOLD            1.0f        // BPM change needed to update the pedal
+#define MIDI_CLOCK_MIN_UPDATE_TIME          500000      // usec between pedal updates
+#define MIDI_CLOCK_MIN_BPM                  20.0f
+#define MIDI_CLOCK_MAX_BPM                  300.0f
+
+static const char *TAG = "app_midi_clock";
+
+typedef struct
+{
+    SemaphoreHandle_t Mutex;
+    tMidiClockFit Fit;
+    uint8_t Running;
+    float BPM;                                  // current filtered tempo
+    float PushedBPM;                            // tempo last sent to the pedal
+    int64_t LastPushTime;
+} tMidiClock;
+
+static tMidiClock MidiClock;
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Send tempo based values to the pedal
+* PARAMETERS:
+* RETURN:
+* NOTES:       Only touches the active delay and modulation models, and
+*              only when the pedal's own tempo sync is off for them. Also
+*              used for tap tempo
+*****************************************************************************/
+void midi_clock_push_tempo(float bpm)
+{
+    tTonexParameter* param_ptr;
+    uint8_t delay_model;
+    uint8_t delay_sync;
+    uint16_t delay_time_param;
+    uint8_t mod_model;
+    uint8_t mod_sync = 1;
+    uint16_t mod_rate_param = TONEX_PARAM_LAST;
+    float delay_ms;
+    float rate_hz;
+
+    if (tonex_params_get_locked_access(&param_ptr) != ESP_OK)
+    {
+        return;
+    }
+
+    delay_model = (uint8_t)param_ptr[TONEX_PARAM_DELAY_MODEL].Value;
+    if (delay_model == TONEX_DELAY_DIGITAL)
+    {
+        delay_sync = (param_ptr[TONEX_PARAM_DELAY_DIGITAL_SYNC].Value != 0.0f);
+        delay_time_param = TONEX_PARAM_DELAY_DIGITAL_TIME;
+    }
+    else
+    {
+        delay_sync = (param_ptr[TONEX_PARAM_DELAY_TAPE_SYNC].Value != 0.0f);
+        delay_time_param = TONEX_PARAM_DELAY_TAPE_TIME;
+    }
+
+    mod_model = (uint8_t)param_ptr[TONEX_PARAM_MODULATION_MODEL].Value;
+    switch (mod_model)
+    {
+        case TONEX_MODULATION_CHORUS:
+        {
+            mod_sync = (param_ptr[TONEX_PARAM_MODULATION_CHORUS_SYNC].Value != 0.0f);
+            mod_rate_param = TONEX_PARAM_MODULATION_CHORUS_RATE;
+        } break;
+
+        case TONEX_MODULATION_TREMOLO:
+        {
+            mod_sync = (param_ptr[TONEX_PARAM_MODULATION_TREMOLO_SYNC].Value != 0.0f);
+            mod_rate_param = TONEX_PARAM_MODULATION_TREMOLO_RATE;
+        } break;
+
+        case TONEX_MODULATION_PHASER:
+        {
+            mod_sync = (param_ptr[TONEX_PARAM_MODULATION_PHASER_SYNC].Value != 0.0f);
+            mod_rate_param = TONEX_PARAM_MODULATION_PHASER_RATE;
+        } break;
+
+        case TONEX_MODULATION_FLANGER:
+        {
+            mod_sync = (param_ptr[TONEX_PARAM_MODULATION_FLANGER_SYNC].Value != 0.0f);
+            mod_rate_param = TONEX_PARAM_MODULATION_FLANGER_RATE;
+        } break;
+
+        case TONEX_MODULATION_ROTARY:
+        default:
+        {
+            // rotary speed isn't a rate in Hz, leave it alone
+        } break;
+    }
+
+    tonex_params_release_locked_access();
+
+    if (!delay_sync)
+    {
+        // quarter note delay
+        delay_ms = tonex_params_clamp_value(delay_time_param, 60000.0f / bpm);
+        usb_modify_parameter(delay_time_param, delay_ms);
+    }
+
+    if (!mod_sync && (mod_rate_param != TONEX_PARAM_LAST))
+    {
+        // one cycle per beat
+        rate_hz = tonex_params_clamp_value(mod_rate_param, bpm / 60.0f);
+        usb_modify_parameter(mod_rate_param, rate_hz);
+    }
+
+    ESP_LOGI(TAG, "Tempo %d.%d BPM", (int)bpm, (int)(bpm * 10) % 10);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Handle a Midi real time message
+* PARAMETERS:  status: 0xF8 clock, 0xFA start, 0xFB continue, 0xFC stop
+*              time_us: esp_timer time the byte arrived
+* RETURN:
+* NOTES:       Called from both the serial and BLE receive paths
+*****************************************************************************/
+void midi_clock_handle_realtime(uint8_t status, int64_t time_us)
+{
+    uint8_t push = 0;
+    float bpm = 0.0f;
+
+    if (MidiClock.Mutex == NULL)
+    {
+        return;
+    }
+
+    if (xSemaphoreTake(MidiClock.Mutex, pdMS_TO_TICKS(5)) != pdTRUE)
+    {
+        return;
+    }
+
+    switch (status)
+    {
+        case 0xF8:
+        {
+            if (midi_clock_fit_tick(&MidiClock.Fit, time_us))
+            {
+                MidiClock.BPM = midi_clock_fit_get_bpm(&MidiClock.Fit);
+
+                if ((MidiClock.BPM >= MIDI_CLOCK_MIN_BPM) && (MidiClock.BPM <= MIDI_CLOCK_MAX_BPM) &&
+                    (fabsf(MidiClock.BPM - MidiClock.PushedBPM) >= MIDI_CLOCK_BPM_THRESHOLD) &&
+                    ((time_us - MidiClock.LastPushTime) >= MIDI_CLOCK_MIN_UPDATE_TIME))
+                {
+                    MidiClock.PushedBPM = MidiClock.BPM;
+                    MidiClock.LastPushTime = time_us;
+                    bpm = MidiClock.BPM;
+                    push = 1;
+                }
+            }
+        } break;
+
+        case 0xFA:      // start
+        case 0xFB:      // continue
+        {
+            MidiClock.Running = 1;
+            midi_clock_fit_reset(&MidiClock.Fit);
+        } break;
+
+        case 0xFC:      // stop
+        {
+            MidiClock.Running = 0;
+        } break;
+
+        default:
+        {
+            // nothing to do
+        } break;
+    }
+
+    xSemaphoreGive(MidiClock.Mutex);
+
+    // send to pedal outside the lock
+    if (push)
+    {
+        midi_clock_push_tempo(bpm);
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Get the current tempo
+* PARAMETERS:
+* RETURN:      BPM, or 0 if not known
+* NOTES:
+*****************************************************************************/
+float midi_clock_get_bpm(void)
+{
+    return midi_clock_fit_get_bpm(&MidiClock.Fit);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION:
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+void midi_clock_init(void)
+{
+    memset((void*)&MidiClock, 0, sizeof(MidiClock));
+
+    MidiClock.Mutex = xSemaphoreCreateMutex();
+    if (MidiClock.Mutex == NULL)
+    {
+        ESP_LOGE(TAG, "Midi clock mutex create failed!");
+    }
+}
@@ -0,0 +1,129 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ 
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include "midi_clock_fit.h"
+
+#define MIDI_CLOCK_FIT_MIN_TICKS        12          // ticks needed before a tempo is reported
+#define MIDI_CLOCK_FIT_MAX_TICK_GAP     250000      // usec, longer gap means the clock stopped (10 BPM)
+#define MIDI_CLOCK_FIT_OUTLIER_FACTOR   3.0f        // tick gap vs period that restarts the fit
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Restart the tempo fit
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+void midi_clock_fit_reset(tMidiClockFit* fit)
+{
+    fit->TickHead = 0;
+    fit->TickCount = 0;
+    fit->Period = 0.0f;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Least squares fit of tick time against tick number
+* PARAMETERS:
+* RETURN:      usec per tick
+* NOTES:       Jitter on individual ticks averages out across the window,
+*              unlike a simple last-interval measure
+*****************************************************************************/
+static float midi_clock_fit_period(const tMidiClockFit* fit)
+{
+    uint8_t oldest = (fit->TickHead + MIDI_CLOCK_FIT_WINDOW - fit->TickCount) % MIDI_CLOCK_FIT_WINDOW;
+    int64_t base_time = fit->TickTime[oldest];
+    float mean_x = (fit->TickCount - 1) * 0.5f;
+    float mean_y = 0.0f;
+    float sum_xy = 0.0f;
+    float sum_xx = 0.0f;
+    float y;
+
+    // times relative to the oldest tick, keeps float precision
+    for (uint8_t loop = 0; loop < fit->TickCount; loop++)
+    {
+        mean_y += (float)(fit->TickTime[(oldest + loop) % MIDI_CLOCK_FIT_WINDOW] - base_time);
+    }
+    mean_y /= fit->TickCount;
+
+    for (uint8_t loop = 0; loop < fit->TickCount; loop++)
+    {
+        y = (float)(fit->TickTime[(oldest + loop) % MIDI_CLOCK_FIT_WINDOW] - base_time);
+        sum_xy += (loop - mean_x) * (y - mean_y);
+        sum_xx += (loop - mean_x) * (loop - mean_x);
+    }
+
+    return sum_xy / sum_xx;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Add a clock tick
+* PARAMETERS:  time_us: time the tick arrived
+* RETURN:      1 if Period was updated
+* NOTES:       A long gap means the clock was stopped or a tick was badly
+*              late, the fit starts over from this tick
+*****************************************************************************/
+uint8_t midi_clock_fit_tick(tMidiClockFit* fit, int64_t time_us)
+{
+    int64_t gap;
+
+    if (fit->TickCount > 0)
+    {
+        gap = time_us - fit->TickTime[(fit->TickHead + MIDI_CLOCK_FIT_WINDOW - 1) % MIDI_CLOCK_FIT_WINDOW];
+
+        if ((gap <= 0) || (gap > MIDI_CLOCK_FIT_MAX_TICK_GAP) || ((fit->Period > 0.0f) && (gap > (fit->Period * MIDI_CLOCK_FIT_OUTLIER_FACTOR))))
+        {
+            midi_clock_fit_reset(fit);
+        }
+    }
+
+    fit->TickTime[fit->TickHead] = time_us;
+    fit->TickHead = (fit->TickHead + 1) % MIDI_CLOCK_FIT_WINDOW;
+    if (fit->TickCount < MIDI_CLOCK_FIT_WINDOW)
+    {
+        fit->TickCount++;
+    }
+
+    if (fit->TickCount < MIDI_CLOCK_FIT_MIN_TICKS)
+    {
+        return 0;
+    }
+
+    fit->Period = midi_clock_fit_period(fit);
+
+    return 1;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Get the fitted tempo
+* PARAMETERS:
+* RETURN:      BPM, or 0 if not known
+* NOTES:
+*****************************************************************************/
+float midi_clock_fit_get_bpm(const tMidiClockFit* fit)
+{
+    if (fit->Period <= 0.0f)
+    {
+        return 0.0f;
+    }
+
+    return 60000000.0f / (fit->Period * MIDI_CLOCK_FIT_TICKS_PER_BEAT);
+}
@@ -0,0 +1,38 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ 
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// Midi clock tempo from tick arrival times, by a least squares fit over a
+// window of ticks. No hardware access, the caller supplies the tick times
+
+#define MIDI_CLOCK_FIT_WINDOW           48          // ticks used for the fit (2 beats)
+#define MIDI_CLOCK_FIT_TICKS_PER_BEAT   24
+
+typedef struct
+{
+    int64_t TickTime[MIDI_CLOCK_FIT_WINDOW];    // circular buffer of tick times, usec
+    uint8_t TickHead;
+    uint8_t TickCount;
+    float Period;                               // fitted usec per tick, 0 if unknown
+} tMidiClockFit;
+
+void midi_clock_fit_reset(tMidiClockFit* fit);
+uint8_t midi_clock_fit_tick(tMidiClockFit* fit, int64_t time_us);
+float midi_clock_fit_get_bpm(const tMidiClockFit* fit);
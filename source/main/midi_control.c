@@ -47,6 +47,7 @@ limitations under the License.
 #include "task_priorities.h"
 #include "midi_control.h"
 #include "midi_helper.h"
+#include "midi_router.h"
 
 static const char *TAG = "MidiBT";
 #define GATTC_TAG        "GATTC_CLIENT"
@@ -70,9 +71,107 @@ static uint8_t MidiCharacteristicUUIDByteReversed[] = {0xF3, 0x6B, 0x10, 0x9D, 0
 #define PROFILE_A_APP_ID            0
 #define INVALID_HANDLE              0
 #define BT_SCAN_DURATION            1800    // seconds
+#define BT_SCAN_KNOWN_DURATION      60      // seconds of passive scan for known devices, before an active scan
+#define MAX_KNOWN_DEVICES           8
 #define MAX_DEVICE_NAME_LENGTH      25
 #define MAX_DEVICE_NAMES            10
 
+#define BLE_DEFAULT_MTU             23
+#define BLE_MIDI_TIMESTAMP_MAX_SKEW 50000   // usec, re-anchor BLE timestamps if they drift further than this
+#define BLE_MIDI_TX_MIN_INTERVAL    15000   // usec between outgoing packets on a connection
+#define BLE_MAX_CLIENT_CONNECTIONS  CONFIG_TONEX_CONTROLLER_BT_MAX_CONNECTIONS
+#define BLE_NO_CONNECTION           0xFF
+#define BLE_RSSI_POLL_INTERVAL      5000000 // usec between RSSI reads of connected devices
+#define BLE_CONN_MIN_INTERVAL       6       // x 1.25 msec, lowest allowed by the spec
+#define BLE_CONN_MAX_INTERVAL       8       // x 1.25 msec
+#define BLE_CONN_WIFI_MIN_INTERVAL  12      // x 1.25 msec, used while WiFi is active so it gets air time
+#define BLE_CONN_WIFI_MAX_INTERVAL  24      // x 1.25 msec
+#define BLE_CONN_LATENCY            0       // peripheral can't skip connection events
+#define BLE_CONN_TIMEOUT            400     // x 10 msec supervision timeout
+#define BLE_PACKET_INTERVAL_MAX     500000  // usec, longer gaps between packets are idle time, not link timing
+#define BLE_HANDLE_CACHE_NAMESPACE  "blemidi"
+#define BLE_HANDLE_CACHE_VERSION    2
+#define BLE_HANDLE_CACHE_KEY_LENGTH 14      // 'h' + 12 hex address chars + null
+
+// how the handles of a connection were found
+enum BLEDiscovery
+{
+    BLE_DISCOVERY_NONE,
+    BLE_DISCOVERY_CACHED,                   // handles loaded from NVS, discovery skipped
+    BLE_DISCOVERY_SEARCHING                 // full service discovery
+};
+
+// discovered handles, saved in NVS per remote address
+typedef struct __attribute__ ((packed))
+{
+    uint8_t Version;
+    uint16_t ServiceStartHandle;
+    uint16_t ServiceEndHandle;
+    uint16_t CharHandle;
+    uint16_t CCCDHandle;
+    uint32_t NameHash;                      // device name it matched, 0 if not known
+} tBLEHandleCache;
+
+typedef struct
+{
+    uint8_t Ready;
+    uint16_t ConnId;
+    uint16_t MTU;
+    int64_t LastTxTime;
+} tBLEMidiOutConnection;
+
+// running stats of a usec value
+typedef struct
+{
+    uint32_t Count;
+    uint32_t Min;
+    uint32_t Max;
+    uint64_t Sum;
+} tBLEMidiStat;
+
+// per sender receive state, as each device has its own timestamp clock
+typedef struct
+{
+    uint8_t Source;                 // router source
+    int64_t AnchorTime;             // esp_timer time of the anchor timestamp, 0 if not set
+    uint16_t Anchor;
+    int64_t LastPacketTime;
+    tBLEMidiStat PacketInterval;    // time between received packets
+    tBLEMidiStat Latency;           // arrival delay beyond the fastest packet seen
+} tBLEMidiRxContext;
+
+// a connection to a remote controller when we are central, or to the host when peripheral
+typedef struct
+{
+    uint8_t InUse;                  // slot is connecting or connected
+    uint8_t Connected;              // link is open
+    uint8_t ServiceFound;
+    esp_bd_addr_t RemoteBda;
+    uint16_t ServiceStartHandle;
+    uint16_t ServiceEndHandle;
+    uint16_t CharHandle;
+    uint16_t CCCDHandle;
+    uint8_t Discovery;              // BLE_DISCOVERY_
+    uint32_t NameHash;              // device name it matched, 0 if not known
+    int64_t SetupStartTime;         // esp_timer time of the connect request
+    uint32_t SetupTime;             // msec from connect request to notify enabled
+    tBLEMidiOutConnection Out;
+    tBLEMidiRxContext Rx;
+    int8_t RSSI;
+    uint16_t ConnInterval;          // x 1.25 msec, 0 if not known
+    uint32_t RxPackets;
+    uint32_t RxMessages;
+    uint32_t TxPackets;
+    uint32_t TxErrors;
+} tBLEMidiConnection;
+
+static tBLEMidiConnection server_connection;
+static bool wifi_active = false;
+
+static tBLEMidiConnection client_connections[BLE_MAX_CLIENT_CONNECTIONS];
+static uint8_t client_setup_index = BLE_NO_CONNECTION;      // connection being set up, one at a time
+static esp_timer_handle_t client_rssi_timer;
+
 // Declare static functions
 static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param);
 static void esp_gattc_cb(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param);
@@ -87,19 +186,33 @@ static esp_bt_uuid_t notify_descr_uuid =
     .uuid = {.uuid16 = ESP_GATT_UUID_CHAR_CLIENT_CONFIG,},
 };
 
-static bool conn_device_a   = false;
-static bool get_service_a   = false;
-static bool Isconnecting    = false;
-static bool stop_scan_done  = false;
+static bool scan_active     = false;
+
+static bool scan_passive    = false;
 
-static uint8_t midi_serial_channel = 0;
-static uint16_t search_start_handle = 0xFFFF;
-static uint16_t search_end_handle = 0;
-static esp_gattc_descr_elem_t *descr_elem_result_a  = NULL;
+// device name to look for, hashed so adverts can be checked without string compares
+typedef struct
+{
+    char Name[MAX_DEVICE_NAME_LENGTH];
+    uint8_t Length;
+    uint32_t Hash;
+} tBLEDeviceName;
 
-static char remote_device_names[MAX_DEVICE_NAMES][MAX_DEVICE_NAME_LENGTH];
+static tBLEDeviceName remote_device_names[MAX_DEVICE_NAMES];
 static uint8_t remote_device_names_length = 0;
 
+// controllers seen before, from bonds and the handle cache
+typedef struct
+{
+    esp_bd_addr_t Bda;
+    uint32_t NameHash;              // device name it matched, 0 if not known
+} tBLEKnownDevice;
+
+static tBLEKnownDevice known_devices[MAX_KNOWN_DEVICES];
+static uint8_t known_devices_length = 0;
+
+static tMidiBLEScanStats scan_stats;
+
 static esp_ble_scan_params_t ble_scan_params = 
 {
     .scan_type              = BLE_SCAN_TYPE_ACTIVE,
@@ -110,16 +223,22 @@ static esp_ble_scan_params_t ble_scan_params =
     .scan_duplicate         = BLE_SCAN_DUPLICATE_DISABLE
 };
 
+// known devices can be found by address, so no scan response is needed and a lower duty cycle will do
+static esp_ble_scan_params_t ble_passive_scan_params = 
+{
+    .scan_type              = BLE_SCAN_TYPE_PASSIVE,
+    .own_addr_type          = BLE_ADDR_TYPE_PUBLIC,
+    .scan_filter_policy     = BLE_SCAN_FILTER_ALLOW_ALL,
+    .scan_interval          = 0x50,
+    .scan_window            = 0x10,
+    .scan_duplicate         = BLE_SCAN_DUPLICATE_DISABLE
+};
+
 struct gattc_profile_inst 
 {
     esp_gattc_cb_t gattc_cb;
     uint16_t gattc_if;
     uint16_t app_id;
-    uint16_t conn_id;
-    uint16_t service_start_handle;
-    uint16_t service_end_handle;
-    uint16_t char_handle;
-    esp_bd_addr_t remote_bda;
 };
 
 // One gatt-based profile one app_id and one gattc_if, this array will store the gattc_if returned by ESP_GATTS_REG_EVT
@@ -424,6 +543,145 @@ static void __attribute__((unused)) remove_all_bonded_devices(void)
     free(dev_list);
 }
 
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Convert a BLE Midi timestamp to esp_timer time
+* PARAMETERS:  rx: sender receive state
+*              timestamp: 13 bit millisecond timestamp from the sender
+* RETURN:      usec
+* NOTES:       Sender timestamps are spaced more accurately than our receive
+*              times, as packets are batched per connection interval. Time is
+*              measured from an anchor, which moves to any packet that arrives
+*              quicker than it, so the anchor tracks the fastest delivery. It 
+*              is also reset if the clocks drift apart or the timestamp wraps
+*****************************************************************************/
+static int64_t midi_ble_timestamp_to_time(tBLEMidiRxContext* rx, uint16_t timestamp)
+{
+    int64_t now = esp_timer_get_time();
+    int64_t time = rx->AnchorTime + ((int64_t)((timestamp - rx->Anchor) & 0x1FFF) * 1000);
+
+    if ((rx->AnchorTime == 0) || (time > now) || (time < (now - BLE_MIDI_TIMESTAMP_MAX_SKEW)))
+    {
+        rx->AnchorTime = now;
+        rx->Anchor = timestamp;
+        time = now;
+    }
+
+    return time;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Add a value to running stats
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       
+*****************************************************************************/
+static void midi_ble_stat_add(tBLEMidiStat* stat, uint32_t value)
+{
+    if ((stat->Count == 0) || (value < stat->Min))
+    {
+        stat->Min = value;
+    }
+
+    if (value > stat->Max)
+    {
+        stat->Max = value;
+    }
+
+    stat->Sum += value;
+    stat->Count++;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Get the average of running stats
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       
+*****************************************************************************/
+static uint32_t midi_ble_stat_average(const tBLEMidiStat* stat)
+{
+    if (stat->Count == 0)
+    {
+        return 0;
+    }
+
+    return (uint32_t)(stat->Sum / stat->Count);
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Track the time between received BLE Midi packets
+* PARAMETERS:  rx: sender receive state
+* RETURN:      
+* NOTES:       
+*****************************************************************************/
+static void midi_ble_packet_received(tBLEMidiRxContext* rx)
+{
+    int64_t now = esp_timer_get_time();
+
+    if ((rx->LastPacketTime != 0) && ((now - rx->LastPacketTime) < BLE_PACKET_INTERVAL_MAX))
+    {
+        midi_ble_stat_add(&rx->PacketInterval, (uint32_t)(now - rx->LastPacketTime));
+    }
+
+    rx->LastPacketTime = now;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Ask for low latency connection parameters
+* PARAMETERS:  bda: remote device
+* RETURN:      
+* NOTES:       WiFi and Bluetooth share the radio. While WiFi is active a 
+*              longer interval can be used so the web config stays usable
+*****************************************************************************/
+static void midi_request_conn_params(const esp_bd_addr_t bda)
+{
+    esp_ble_conn_update_params_t conn_params = {0};
+    memcpy(conn_params.bda, bda, sizeof(esp_bd_addr_t));
+
+    // For the IOS system, please reference the apple official documents about the ble connection parameters restrictions
+    conn_params.latency = BLE_CONN_LATENCY;
+    conn_params.min_int = BLE_CONN_MIN_INTERVAL;
+    conn_params.max_int = BLE_CONN_MAX_INTERVAL;
+    conn_params.timeout = BLE_CONN_TIMEOUT;
+
+#if CONFIG_TONEX_CONTROLLER_BT_WIFI_RELAX_INTERVAL
+    if (wifi_active)
+    {
+        conn_params.min_int = BLE_CONN_WIFI_MIN_INTERVAL;
+        conn_params.max_int = BLE_CONN_WIFI_MAX_INTERVAL;
+    }
+#endif
+
+    // start sent the update connection parameters to the peer device.
+    esp_ble_gap_update_conn_params(&conn_params);
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Handle a single Midi message decoded from a BLE packet
+* PARAMETERS:  message: decoded message
+*              context: tBLEMidiRxContext of the sender
+* RETURN:      
+* NOTES:       Shared by the GATT server write and GATT client notify paths
+*****************************************************************************/
+static void midi_process_ble_message(const tMidiMessage* message, void* context)
+{
+    tBLEMidiRxContext* rx = (tBLEMidiRxContext*)context;
+    int64_t time;
+
+    ESP_LOGD(TAG, "BT Midi ts %d status 0x%02X", (int)message->timestamp, (int)message->status);
+
+    time = midi_ble_timestamp_to_time(rx, message->timestamp);
+    midi_ble_stat_add(&rx->Latency, (uint32_t)(esp_timer_get_time() - time));
+
+    // pass to router, filtering and dispatch happens there
+    midi_router_receive(rx->Source, message, time);
+}
+
 /****************************************************************************
 * NAME:        
 * DESCRIPTION: 
@@ -567,11 +825,9 @@ static void gatts_profile_a_event_handler(esp_gatts_cb_event_t event, esp_gatt_i
         esp_gatt_rsp_t rsp;
         memset(&rsp, 0, sizeof(esp_gatt_rsp_t));
         rsp.attr_value.handle = param->read.handle;
-        rsp.attr_value.len = 4;
-        rsp.attr_value.value[0] = 0xde;
-        rsp.attr_value.value[1] = 0xed;
-        rsp.attr_value.value[2] = 0xbe;
-        rsp.attr_value.value[3] = 0xef;
+
+        // BLE Midi spec, reads return no payload
+        rsp.attr_value.len = 0;
         esp_ble_gatts_send_response(gatts_if, param->read.conn_id, param->read.trans_id,
                                     ESP_GATT_OK, &rsp);
         break;
@@ -585,52 +841,25 @@ static void gatts_profile_a_event_handler(esp_gatts_cb_event_t event, esp_gatt_i
             ESP_LOGI(GATTS_TAG, "value len %d, value ", param->write.len);
             ESP_LOG_BUFFER_HEX(GATTS_TAG, param->write.value, param->write.len);
 
-            // check Midi data. Program change Should be ?? ?? 0xC0 XX (XX = preset index, 0-based)
-            // first 2 bytes are header/timestamp bytes, values depend on host. Ignoring them here
-            if (param->write.len >= 4)
+            if (gls_profile_tab[PROFILE_A_APP_ID].char_handle == param->write.handle)
             {
-                // check channel
-                if ((param->write.value[2] & 0x0F) != midi_serial_channel)
-                {
-                    ESP_LOGI(GATTS_TAG, "BT Midi non-matching channel %d", param->write.value[2] & 0x0F);
-                }
-                else
-                {
-                    // check the command
-                    switch (param->write.value[2] & 0xF0)
-                    {
-                        case 0xC0:
-                        {
-                            // set preset
-                            control_request_preset_index(param->write.value[3]);
-                        } break;
-
-                        case 0xB0:
-                        {
-                            // control change
-                            uint8_t change_num = param->write.value[3];
-                            uint8_t value = param->write.value[4];
-                            midi_helper_adjust_param_via_midi(change_num, value);
-                        } break;
-                    }
-                }
+                // decode all Midi messages in the packet
+                midi_ble_packet_received(&server_connection.Rx);
+                server_connection.RxPackets++;
+                server_connection.RxMessages += midi_parser_decode_ble_packet(param->write.value, param->write.len, midi_process_ble_message, (void*)&server_connection.Rx);
             }
-
-            if (gls_profile_tab[PROFILE_A_APP_ID].descr_handle == param->write.handle && param->write.len == 2)
+            else if (gls_profile_tab[PROFILE_A_APP_ID].descr_handle == param->write.handle && param->write.len == 2)
             {
                 uint16_t descr_value = param->write.value[1]<<8 | param->write.value[0];
                 if (descr_value == 0x0001)
                 {
-                    if (a_property & ESP_GATT_CHAR_PROP_BIT_NOTIFY){
+                    if (a_property & ESP_GATT_CHAR_PROP_BIT_NOTIFY)
+                    {
                         ESP_LOGI(GATTS_TAG, "Notification enable");
-                        uint8_t notify_data[15];
-                        for (int i = 0; i < sizeof(notify_data); ++i)
-                        {
-                            notify_data[i] = i%0xff;
-                        }
-                        //the size of notify_data[] need less than MTU size
-                        esp_ble_gatts_send_indicate(gatts_if, param->write.conn_id, gls_profile_tab[PROFILE_A_APP_ID].char_handle,
-                                                sizeof(notify_data), notify_data, false);
+
+                        // Midi out can now notify this client
+                        server_connection.Out.ConnId = param->write.conn_id;
+                        server_connection.Out.Ready = 1;
                     }
                 }
                 else if (descr_value == 0x0002)
@@ -652,6 +881,7 @@ static void gatts_profile_a_event_handler(esp_gatts_cb_event_t event, esp_gatt_i
                 else if (descr_value == 0x0000)
                 {
                     ESP_LOGI(GATTS_TAG, "Notification/Indication disable");
+                    server_connection.Out.Ready = 0;
                 }
                 else
                 {
@@ -673,6 +903,7 @@ static void gatts_profile_a_event_handler(esp_gatts_cb_event_t event, esp_gatt_i
 
     case ESP_GATTS_MTU_EVT:
         ESP_LOGI(GATTS_TAG, "MTU exchange, MTU %d", param->mtu.mtu);
+        server_connection.Out.MTU = param->mtu.mtu;
         break;
 
     case ESP_GATTS_UNREG_EVT:
@@ -749,19 +980,18 @@ static void gatts_profile_a_event_handler(esp_gatts_cb_event_t event, esp_gatt_i
 
     case ESP_GATTS_CONNECT_EVT: 
     {
-        esp_ble_conn_update_params_t conn_params = {0};
-        memcpy(conn_params.bda, param->connect.remote_bda, sizeof(esp_bd_addr_t));
+        ESP_LOGI(GATTS_TAG, "Connected, conn_id %u, remote "ESP_BD_ADDR_STR"", param->connect.conn_id, ESP_BD_ADDR_HEX(param->connect.remote_bda));
 
-        // For the IOS system, please reference the apple official documents about the ble connection parameters restrictions
-        conn_params.latency = 0;
-        conn_params.max_int = 8;       // max_int (x 1.25ms)
-        conn_params.min_int = 6;       // min_int (x 1.25ms)
-        conn_params.timeout = 400;    // timeout = 400*10ms = 4000ms
+        memset((void*)&server_connection, 0, sizeof(server_connection));
+        server_connection.Connected = 1;
+        server_connection.Rx.Source = MIDI_ROUTER_SOURCE_BLE_PERIPHERAL;
+        memcpy(server_connection.RemoteBda, param->connect.remote_bda, sizeof(esp_bd_addr_t));
 
-        // start sent the update connection parameters to the peer device.
-        esp_ble_gap_update_conn_params(&conn_params);
+        midi_request_conn_params(param->connect.remote_bda);
 
-        ESP_LOGI(GATTS_TAG, "Connected, conn_id %u, remote "ESP_BD_ADDR_STR"", param->connect.conn_id, ESP_BD_ADDR_HEX(param->connect.remote_bda));
+        server_connection.Out.Ready = 0;
+        server_connection.Out.ConnId = param->connect.conn_id;
+        server_connection.Out.MTU = BLE_DEFAULT_MTU;
         
         // start security connect with peer device when receive the connect event sent by the master
         esp_ble_set_encryption(param->connect.remote_bda, ESP_BLE_SEC_ENCRYPT_MITM);
@@ -772,6 +1002,8 @@ static void gatts_profile_a_event_handler(esp_gatts_cb_event_t event, esp_gatt_i
     case ESP_GATTS_DISCONNECT_EVT:
         ESP_LOGI(GATTS_TAG, "Disconnected, remote "ESP_BD_ADDR_STR", reason 0x%02x", ESP_BD_ADDR_HEX(param->disconnect.remote_bda), param->disconnect.reason);
         esp_ble_gap_start_advertising(&adv_params);
+        server_connection.Out.Ready = 0;
+        server_connection.Connected = 0;
         control_set_bt_status(0);
         break;
 
@@ -836,155 +1068,777 @@ static void __attribute__((unused)) gatts_event_handler(esp_gatts_cb_event_t eve
     } while (0);
 }
 
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Find a client connection
+* PARAMETERS:  
+* RETURN:      index, or BLE_NO_CONNECTION
+* NOTES:       
+*****************************************************************************/
+static uint8_t client_find_by_conn_id(uint16_t conn_id)
+{
+    for (uint8_t loop = 0; loop < BLE_MAX_CLIENT_CONNECTIONS; loop++)
+    {
+        if (client_connections[loop].Connected && (client_connections[loop].Out.ConnId == conn_id))
+        {
+            return loop;
+        }
+    }
+
+    return BLE_NO_CONNECTION;
+}
 
 /****************************************************************************
 * NAME:        
-* DESCRIPTION: 
+* DESCRIPTION: Find a client connection
 * PARAMETERS:  
-* RETURN:      
+* RETURN:      index, or BLE_NO_CONNECTION
 * NOTES:       
 *****************************************************************************/
-static void __attribute__((unused)) start_scan(void)
+static uint8_t client_find_by_bda(const esp_bd_addr_t bda)
 {
-    stop_scan_done = false;
-    Isconnecting = false;
-    esp_ble_gap_start_scanning(BT_SCAN_DURATION);
+    for (uint8_t loop = 0; loop < BLE_MAX_CLIENT_CONNECTIONS; loop++)
+    {
+        if (client_connections[loop].InUse && (memcmp(client_connections[loop].RemoteBda, bda, sizeof(esp_bd_addr_t)) == 0))
+        {
+            return loop;
+        }
+    }
+
+    return BLE_NO_CONNECTION;
 }
 
 /****************************************************************************
 * NAME:        
-* DESCRIPTION: 
+* DESCRIPTION: Count client connections that are open or being opened
 * PARAMETERS:  
 * RETURN:      
 * NOTES:       
 *****************************************************************************/
-static void __attribute__((unused)) gattc_profile_a_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param)
+static uint8_t client_get_in_use_count(void)
 {
-    esp_ble_gattc_cb_param_t *p_data = (esp_ble_gattc_cb_param_t *)param;
+    uint8_t count = 0;
 
-    switch (event) 
+    for (uint8_t loop = 0; loop < BLE_MAX_CLIENT_CONNECTIONS; loop++)
     {
-        case ESP_GATTC_REG_EVT:
-            ESP_LOGI(GATTC_TAG, "REG_EVT");
-            esp_err_t scan_ret = esp_ble_gap_set_scan_params(&ble_scan_params);
-            if (scan_ret)
-            {
-                ESP_LOGE(GATTC_TAG, "set scan params error, error code = %x", scan_ret);
-            }
-            break;
-        
-        /* one device connect successfully, all profiles callback function will get the ESP_GATTC_CONNECT_EVT,
-        so must compare the mac address to check which device is connected, so it is a good choice to use ESP_GATTC_OPEN_EVT. */
-        case ESP_GATTC_CONNECT_EVT:
-            break;
+        if (client_connections[loop].InUse)
+        {
+            count++;
+        }
+    }
 
-        case ESP_GATTC_OPEN_EVT:
-            if (p_data->open.status != ESP_GATT_OK)
-            {
-                //open failed, ignore the first device, connect the second device
-                ESP_LOGE(GATTC_TAG, "connect device failed, status %d", p_data->open.status);
-                conn_device_a = false;
-                break;
-            }
+    return count;
+}
 
-            memcpy(gl_profile_tab.remote_bda, p_data->open.remote_bda, 6);
-            gl_profile_tab.conn_id = p_data->open.conn_id;
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Hash a device name
+* PARAMETERS:  
+* RETURN:      32 bit FNV-1a hash
+* NOTES:       
+*****************************************************************************/
+static uint32_t device_name_hash(const uint8_t* name, uint8_t length)
+{
+    uint32_t hash = 2166136261UL;
 
-            ESP_LOGI(GATTC_TAG, "ESP_GATTC_OPEN_EVT conn_id %d, if %d, status %d, mtu %d", p_data->open.conn_id, gattc_if, p_data->open.status, p_data->open.mtu);
-            ESP_LOGI(GATTC_TAG, "REMOTE BDA:");
-            esp_log_buffer_hex(GATTC_TAG, p_data->open.remote_bda, sizeof(esp_bd_addr_t));
-            
-            esp_err_t mtu_ret = esp_ble_gattc_send_mtu_req(gattc_if, p_data->open.conn_id);
-            if (mtu_ret)
-            {
-                ESP_LOGE(GATTC_TAG, "config MTU error, error code = %x", mtu_ret);
-            }
-            break;
+    for (uint8_t loop = 0; loop < length; loop++)
+    {
+        hash ^= name[loop];
+        hash *= 16777619UL;
+    }
 
-        case ESP_GATTC_CFG_MTU_EVT:
-            if (param->cfg_mtu.status != ESP_GATT_OK)
-            {
-                ESP_LOGE(GATTC_TAG,"Config mtu failed");
-            }
-            
-            //ESP_LOGI(GATTC_TAG, "Status %d, MTU %d, conn_id %d", param->cfg_mtu.status, param->cfg_mtu.mtu, param->cfg_mtu.conn_id);
-            search_start_handle = 0xFFFF;
-            search_end_handle = 0;
+    return hash;
+}
 
-            if (esp_ble_gattc_search_service(gattc_if, param->cfg_mtu.conn_id, NULL) != ESP_OK)
-            {
-                ESP_LOGE(GATTC_TAG, "Failed to start search for UUID");
-            }
-            else
-            {
-                ESP_LOGI(GATTC_TAG, "Searching for Midi Service UUID match");
-            }
-            break;
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Find an advertised name in the device name list
+* PARAMETERS:  
+* RETURN:      index in remote_device_names, or BLE_NO_CONNECTION
+* NOTES:       Hash and length rule out nearly all names, the compare just
+*              guards against a collision
+*****************************************************************************/
+static uint8_t device_name_find(const uint8_t* name, uint8_t length)
+{
+    uint32_t hash = device_name_hash(name, length);
 
-        case ESP_GATTC_SEARCH_RES_EVT: 
+    for (uint8_t loop = 0; loop < remote_device_names_length; loop++)
+    {
+        if ((remote_device_names[loop].Hash == hash) && (remote_device_names[loop].Length == length) && 
+            (memcmp(remote_device_names[loop].Name, name, length) == 0))
         {
-            //ESP_LOGI(GATTC_TAG, "SEARCH RES: conn_id = %x is primary service %d", p_data->search_res.conn_id, p_data->search_res.is_primary);
-            //ESP_LOGI(GATTC_TAG, "start handle %d end handle %d current handle value %d", p_data->search_res.start_handle, p_data->search_res.end_handle, p_data->search_res.srvc_id.inst_id);
-            
-            if (p_data->search_res.start_handle < search_start_handle)
-            {
-                search_start_handle = p_data->search_res.start_handle;
-            }
+            return loop;
+        }
+    }
 
-            if (p_data->search_res.end_handle > search_end_handle)
-            {
-                search_end_handle = p_data->search_res.end_handle;
-            }
+    return BLE_NO_CONNECTION;
+}
 
-            get_service_a = true;
-            gl_profile_tab.service_start_handle = search_start_handle;
-            gl_profile_tab.service_end_handle = search_end_handle;
-            break;
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Find a device name hash in the device name list
+* PARAMETERS:  
+* RETURN:      index in remote_device_names, or BLE_NO_CONNECTION
+* NOTES:       For known controllers, whose name may not be in the advert
+*****************************************************************************/
+static uint8_t device_name_find_hash(uint32_t hash)
+{
+    for (uint8_t loop = 0; loop < remote_device_names_length; loop++)
+    {
+        if (remote_device_names[loop].Hash == hash)
+        {
+            return loop;
         }
-        
-        case ESP_GATTC_SEARCH_CMPL_EVT:
-            uint16_t count = 1;
-            esp_gatt_status_t res;
-            ESP_LOGI(GATTC_TAG, "Search complete for Services");
+    }
 
-            if (p_data->search_cmpl.status != ESP_GATT_OK)
-            {
-                ESP_LOGE(GATTC_TAG, "Search service failed, error status = %x", p_data->search_cmpl.status);
-                break;
-            }
-            
-            if (get_service_a)
-            {                
-                // get descriptors for Midi
-                esp_gattc_char_elem_t* char_elem_result = (esp_gattc_char_elem_t *)malloc(sizeof(esp_gattc_char_elem_t) * 4);
-                if (!char_elem_result)
-                {
-                    ESP_LOGE(GATTC_TAG, "gattc no mem");
-                }
-                else 
-                {
-                    ESP_LOGI(GATTC_TAG, "Finding Characteristics");
+    return BLE_NO_CONNECTION;
+}
 
-                    // init search table
-                    uint8_t filter_index = 0;
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Check if an advert lists its services and Midi isn't one
+* PARAMETERS:  
+* RETURN:      1 if the device can't be a Midi controller
+* NOTES:       Only a complete 128 bit list can rule a device out
+*****************************************************************************/
+static uint8_t adv_lacks_midi_service(uint8_t* adv_data)
+{
+    uint8_t* uuids;
+    uint8_t uuids_len = 0;
 
-                    remote_filter_char_uuid_reuse[filter_index].len = ESP_UUID_LEN_128;
-                    memcpy((void*)remote_filter_char_uuid_reuse[filter_index].uuid.uuid128, (void*)MidiCharacteristicUUIDByteReversed, ESP_UUID_LEN_128);
-                    filter_index++;
-                    
-                    //remote_filter_char_uuid_reuse[filter_index].len = ESP_UUID_LEN_128;
-                    //memcpy((void*)remote_filter_char_uuid_reuse[filter_index].uuid.uuid128, (void*)BatteryLevelCharacteristicUUIDByteReversed, ESP_UUID_LEN_128);
-                    //filter_index++;
+    uuids = esp_ble_resolve_adv_data(adv_data, ESP_BLE_AD_TYPE_128SRV_CMPL, &uuids_len);
+    if (uuids == NULL)
+    {
+        return 0;
+    }
 
-                    // loop and find all characteristics, and register notification
-                    for (int loop = 0; loop < filter_index; loop++)
-                    {
-                        // find the characteristic
+    for (uint8_t loop = 0; (loop + ESP_UUID_LEN_128) <= uuids_len; loop += ESP_UUID_LEN_128)
+    {
+        if (memcmp(&uuids[loop], adv_service_uuid128, ESP_UUID_LEN_128) == 0)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Check if an address is a known controller
+* PARAMETERS:  
+* RETURN:      the known device, or NULL
+* NOTES:       
+*****************************************************************************/
+static tBLEKnownDevice* client_known_device_find(const esp_bd_addr_t bda)
+{
+    for (uint8_t loop = 0; loop < known_devices_length; loop++)
+    {
+        if (memcmp(known_devices[loop].Bda, bda, sizeof(esp_bd_addr_t)) == 0)
+        {
+            return &known_devices[loop];
+        }
+    }
+
+    return NULL;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Add a known controller
+* PARAMETERS:  name_hash: device name it matched, 0 if not known
+* RETURN:      
+* NOTES:       A known name is kept if it's added again without one
+*****************************************************************************/
+static void client_known_device_add(const esp_bd_addr_t bda, uint32_t name_hash)
+{
+    tBLEKnownDevice* known = client_known_device_find(bda);
+
+    if (known != NULL)
+    {
+        if (name_hash != 0)
+        {
+            known->NameHash = name_hash;
+        }
+        return;
+    }
+
+    if (known_devices_length >= MAX_KNOWN_DEVICES)
+    {
+        return;
+    }
+
+    memcpy(known_devices[known_devices_length].Bda, bda, sizeof(esp_bd_addr_t));
+    known_devices[known_devices_length].NameHash = name_hash;
+    known_devices_length++;
+    scan_stats.KnownDevices = known_devices_length;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Remove a known controller
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       
+*****************************************************************************/
+static void client_known_device_remove(const esp_bd_addr_t bda)
+{
+    for (uint8_t loop = 0; loop < known_devices_length; loop++)
+    {
+        if (memcmp(known_devices[loop].Bda, bda, sizeof(esp_bd_addr_t)) == 0)
+        {
+            // move the last one into the gap
+            known_devices_length--;
+            memcpy((void*)&known_devices[loop], (void*)&known_devices[known_devices_length], sizeof(tBLEKnownDevice));
+            scan_stats.KnownDevices = known_devices_length;
+            return;
+        }
+    }
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Build the known controller list
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       From bonded devices and the addresses in the handle cache.
+*              Only the cache knows which device name each one matched
+*****************************************************************************/
+static void client_known_devices_init(void)
+{
+    nvs_iterator_t it = NULL;
+    nvs_entry_info_t info;
+    nvs_handle_t nvs_handle;
+    tBLEHandleCache cache;
+    size_t size;
+    esp_bd_addr_t bda;
+    unsigned int addr[6];
+    uint32_t name_hash;
+    esp_err_t err;
+    int dev_num;
+
+    known_devices_length = 0;
+
+    dev_num = esp_ble_get_bond_device_num();
+    if (dev_num > 0)
+    {
+        esp_ble_bond_dev_t *dev_list = (esp_ble_bond_dev_t *)malloc(sizeof(esp_ble_bond_dev_t) * dev_num);
+        if (dev_list != NULL)
+        {
+            esp_ble_get_bond_device_list(&dev_num, dev_list);
+            for (int i = 0; i < dev_num; i++) 
+            {
+                client_known_device_add(dev_list[i].bd_addr, 0);
+            }
+
+            free(dev_list);
+        }
+    }
+
+    // cache keys are 'h' and the address in hex
+    err = nvs_entry_find(NVS_DEFAULT_PART_NAME, BLE_HANDLE_CACHE_NAMESPACE, NVS_TYPE_BLOB, &it);
+    while (err == ESP_OK)
+    {
+        nvs_entry_info(it, &info);
+
+        if (sscanf(info.key, "h%02x%02x%02x%02x%02x%02x", &addr[0], &addr[1], &addr[2], &addr[3], &addr[4], &addr[5]) == 6)
+        {
+            for (uint8_t loop = 0; loop < sizeof(esp_bd_addr_t); loop++)
+            {
+                bda[loop] = (uint8_t)addr[loop];
+            }
+
+            name_hash = 0;
+            size = sizeof(cache);
+
+            if (nvs_open(BLE_HANDLE_CACHE_NAMESPACE, NVS_READONLY, &nvs_handle) == ESP_OK)
+            {
+                if ((nvs_get_blob(nvs_handle, info.key, (void*)&cache, &size) == ESP_OK) && (size == sizeof(cache)) && (cache.Version == BLE_HANDLE_CACHE_VERSION))
+                {
+                    name_hash = cache.NameHash;
+                }
+
+                nvs_close(nvs_handle);
+            }
+
+            client_known_device_add(bda, name_hash);
+        }
+
+        err = nvs_entry_next(&it);
+    }
+    nvs_release_iterator(it);
+
+    scan_stats.KnownDevices = known_devices_length;
+    ESP_LOGI(GATTC_TAG, "Known devices: %d", (int)known_devices_length);
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: 
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       
+*****************************************************************************/
+static void start_scan(void)
+{
+    if (scan_active)
+    {
+        return;
+    }
+
+    scan_active = true;
+
+    if (scan_passive)
+    {
+        esp_ble_gap_start_scanning(BT_SCAN_KNOWN_DURATION);
+    }
+    else
+    {
+        esp_ble_gap_start_scanning(BT_SCAN_DURATION);
+    }
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Set the scan parameters, scan starts when they are applied
+* PARAMETERS:  passive: 1 for a passive scan for known devices
+* RETURN:      
+* NOTES:       
+*****************************************************************************/
+static void configure_scan(uint8_t passive)
+{
+    esp_err_t ret;
+
+    if (scan_active)
+    {
+        return;
+    }
+
+    scan_passive = (passive != 0);
+    scan_stats.Passive = scan_passive;
+
+    if (scan_passive)
+    {
+        ret = esp_ble_gap_set_scan_params(&ble_passive_scan_params);
+    }
+    else
+    {
+        ret = esp_ble_gap_set_scan_params(&ble_scan_params);
+    }
+
+    if (ret)
+    {
+        ESP_LOGE(GATTC_TAG, "set scan params error, error code = %x", ret);
+    }
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Scan for more devices if there is a free connection slot
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       Connection setup is done one device at a time, as the notify
+*              registration event doesn't say which connection it is for
+*****************************************************************************/
+static void client_resume_scan(void)
+{
+    if ((client_setup_index == BLE_NO_CONNECTION) && (client_get_in_use_count() < BLE_MAX_CLIENT_CONNECTIONS))
+    {
+        // known devices first with a passive scan, then look for new ones
+        configure_scan(known_devices_length > 0);
+    }
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Finish setting up a connection
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       
+*****************************************************************************/
+static void client_setup_done(void)
+{
+    client_setup_index = BLE_NO_CONNECTION;
+    client_resume_scan();
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Drop a connection that couldn't be set up
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       Disconnect event frees the slot and resumes scanning
+*****************************************************************************/
+static void client_setup_failed(tBLEMidiConnection* conn)
+{
+    ESP_LOGW(GATTC_TAG, "Midi setup failed, disconnecting "ESP_BD_ADDR_STR"", ESP_BD_ADDR_HEX(conn->RemoteBda));
+
+    // don't keep reconnecting to it by address
+    client_known_device_remove(conn->RemoteBda);
+    esp_ble_gap_disconnect(conn->RemoteBda);
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Build the NVS key for a remote address
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       
+*****************************************************************************/
+static void client_handle_cache_key(const esp_bd_addr_t bda, char* key)
+{
+    snprintf(key, BLE_HANDLE_CACHE_KEY_LENGTH, "h%02x%02x%02x%02x%02x%02x", bda[0], bda[1], bda[2], bda[3], bda[4], bda[5]);
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Load cached handles for a connection
+* PARAMETERS:  
+* RETURN:      1 if found
+* NOTES:       
+*****************************************************************************/
+static uint8_t client_handle_cache_load(tBLEMidiConnection* conn)
+{
+    nvs_handle_t nvs_handle;
+    tBLEHandleCache cache;
+    size_t size = sizeof(cache);
+    char key[BLE_HANDLE_CACHE_KEY_LENGTH];
+    esp_err_t err;
+
+    if (nvs_open(BLE_HANDLE_CACHE_NAMESPACE, NVS_READONLY, &nvs_handle) != ESP_OK)
+    {
+        // nothing saved yet
+        return 0;
+    }
+
+    client_handle_cache_key(conn->RemoteBda, key);
+    err = nvs_get_blob(nvs_handle, key, (void*)&cache, &size);
+    nvs_close(nvs_handle);
+
+    if ((err != ESP_OK) || (size != sizeof(cache)) || (cache.Version != BLE_HANDLE_CACHE_VERSION))
+    {
+        return 0;
+    }
+
+    conn->ServiceStartHandle = cache.ServiceStartHandle;
+    conn->ServiceEndHandle = cache.ServiceEndHandle;
+    conn->CharHandle = cache.CharHandle;
+    conn->CCCDHandle = cache.CCCDHandle;
+
+    return 1;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Save discovered handles for a connection
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       
+*****************************************************************************/
+static void client_handle_cache_save(tBLEMidiConnection* conn)
+{
+    nvs_handle_t nvs_handle;
+    tBLEHandleCache cache;
+    char key[BLE_HANDLE_CACHE_KEY_LENGTH];
+
+    if (nvs_open(BLE_HANDLE_CACHE_NAMESPACE, NVS_READWRITE, &nvs_handle) != ESP_OK)
+    {
+        ESP_LOGE(GATTC_TAG, "Handle cache open failed");
+        return;
+    }
+
+    cache.Version = BLE_HANDLE_CACHE_VERSION;
+    cache.ServiceStartHandle = conn->ServiceStartHandle;
+    cache.ServiceEndHandle = conn->ServiceEndHandle;
+    cache.CharHandle = conn->CharHandle;
+    cache.CCCDHandle = conn->CCCDHandle;
+    cache.NameHash = conn->NameHash;
+
+    client_handle_cache_key(conn->RemoteBda, key);
+    if (nvs_set_blob(nvs_handle, key, (void*)&cache, sizeof(cache)) == ESP_OK)
+    {
+        nvs_commit(nvs_handle);
+        ESP_LOGI(GATTC_TAG, "Saved handle cache %s", key);
+    }
+    else
+    {
+        ESP_LOGE(GATTC_TAG, "Handle cache write failed");
+    }
+
+    nvs_close(nvs_handle);
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Remove cached handles for a remote address
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       
+*****************************************************************************/
+static void client_handle_cache_erase(const esp_bd_addr_t bda)
+{
+    nvs_handle_t nvs_handle;
+    char key[BLE_HANDLE_CACHE_KEY_LENGTH];
+
+    if (nvs_open(BLE_HANDLE_CACHE_NAMESPACE, NVS_READWRITE, &nvs_handle) != ESP_OK)
+    {
+        return;
+    }
+
+    client_handle_cache_key(bda, key);
+    if (nvs_erase_key(nvs_handle, key) == ESP_OK)
+    {
+        nvs_commit(nvs_handle);
+        ESP_LOGI(GATTC_TAG, "Erased handle cache %s", key);
+    }
+
+    nvs_close(nvs_handle);
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Start full service discovery on a connection
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       
+*****************************************************************************/
+static void client_start_discovery(esp_gatt_if_t gattc_if, tBLEMidiConnection* conn)
+{
+    conn->Discovery = BLE_DISCOVERY_SEARCHING;
+    conn->ServiceStartHandle = 0xFFFF;
+    conn->ServiceEndHandle = 0;
+    conn->ServiceFound = 0;
+
+    if (esp_ble_gattc_search_service(gattc_if, conn->Out.ConnId, NULL) != ESP_OK)
+    {
+        ESP_LOGE(GATTC_TAG, "Failed to start search for UUID");
+        client_setup_failed(conn);
+    }
+    else
+    {
+        ESP_LOGI(GATTC_TAG, "Searching for Midi Service UUID match");
+    }
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Cached handles didn't work, do a full discovery instead
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       
+*****************************************************************************/
+static void client_cache_fallback(esp_gatt_if_t gattc_if, tBLEMidiConnection* conn)
+{
+    ESP_LOGW(GATTC_TAG, "Cached handles failed, doing full discovery");
+    client_handle_cache_erase(conn->RemoteBda);
+    client_start_discovery(gattc_if, conn);
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Read the signal strength of connected devices
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       esp_timer callback. Result comes in the GAP read RSSI event
+*****************************************************************************/
+static void client_rssi_timer_callback(void* arg)
+{
+    for (uint8_t loop = 0; loop < BLE_MAX_CLIENT_CONNECTIONS; loop++)
+    {
+        if (client_connections[loop].Connected)
+        {
+            esp_ble_gap_read_rssi(client_connections[loop].RemoteBda);
+
+            ESP_LOGD(GATTC_TAG, "Conn %d RSSI %d rx packets %d rx msgs %d tx packets %d tx errors %d", (int)loop, (int)client_connections[loop].RSSI,
+                     (int)client_connections[loop].RxPackets, (int)client_connections[loop].RxMessages, 
+                     (int)client_connections[loop].TxPackets, (int)client_connections[loop].TxErrors);
+        }
+    }
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: 
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       
+*****************************************************************************/
+static void __attribute__((unused)) gattc_profile_a_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param)
+{
+    esp_ble_gattc_cb_param_t *p_data = (esp_ble_gattc_cb_param_t *)param;
+    tBLEMidiConnection* conn = NULL;
+    uint8_t index;
+
+    switch (event) 
+    {
+        case ESP_GATTC_REG_EVT:
+            ESP_LOGI(GATTC_TAG, "REG_EVT");
+            client_known_devices_init();
+            client_resume_scan();
+            break;
+        
+        /* one device connect successfully, all profiles callback function will get the ESP_GATTC_CONNECT_EVT,
+        so must compare the mac address to check which device is connected, so it is a good choice to use ESP_GATTC_OPEN_EVT. */
+        case ESP_GATTC_CONNECT_EVT:
+            break;
+
+        case ESP_GATTC_OPEN_EVT:
+            index = client_find_by_bda(p_data->open.remote_bda);
+
+            if (p_data->open.status != ESP_GATT_OK)
+            {
+                //open failed, free the slot and look for another device
+                ESP_LOGE(GATTC_TAG, "connect device failed, status %d", p_data->open.status);
+
+                if (index != BLE_NO_CONNECTION)
+                {
+                    memset((void*)&client_connections[index], 0, sizeof(tBLEMidiConnection));
+                }
+                client_setup_done();
+                break;
+            }
+
+            if (index == BLE_NO_CONNECTION)
+            {
+                ESP_LOGW(GATTC_TAG, "Open for unknown device, closing");
+                esp_ble_gattc_close(gattc_if, p_data->open.conn_id);
+                break;
+            }
+
+            conn = &client_connections[index];
+            conn->Connected = 1;
+            conn->Out.Ready = 0;
+            conn->Out.ConnId = p_data->open.conn_id;
+            conn->Out.MTU = p_data->open.mtu;
+            conn->Out.LastTxTime = 0;
+            conn->Rx.Source = MIDI_ROUTER_SOURCE_BLE_CENTRAL;
+            conn->Rx.AnchorTime = 0;
+
+            ESP_LOGI(GATTC_TAG, "ESP_GATTC_OPEN_EVT conn_id %d, if %d, status %d, mtu %d, slot %d", p_data->open.conn_id, gattc_if, p_data->open.status, p_data->open.mtu, (int)index);
+            ESP_LOGI(GATTC_TAG, "REMOTE BDA:");
+            esp_log_buffer_hex(GATTC_TAG, p_data->open.remote_bda, sizeof(esp_bd_addr_t));
+            
+            midi_request_conn_params(conn->RemoteBda);
+
+            esp_err_t mtu_ret = esp_ble_gattc_send_mtu_req(gattc_if, p_data->open.conn_id);
+            if (mtu_ret)
+            {
+                ESP_LOGE(GATTC_TAG, "config MTU error, error code = %x", mtu_ret);
+            }
+
+            // known device, go straight to notify enable
+            if (client_handle_cache_load(conn))
+            {
+                ESP_LOGI(GATTC_TAG, "Using cached handles, char %d cccd %d", (int)conn->CharHandle, (int)conn->CCCDHandle);
+                conn->Discovery = BLE_DISCOVERY_CACHED;
+
+                if (esp_ble_gattc_register_for_notify(gattc_if, conn->RemoteBda, conn->CharHandle) != ESP_OK)
+                {
+                    client_cache_fallback(gattc_if, conn);
+                }
+            }
+            break;
+
+        case ESP_GATTC_CFG_MTU_EVT:
+            index = client_find_by_conn_id(param->cfg_mtu.conn_id);
+            if (index == BLE_NO_CONNECTION)
+            {
+                break;
+            }
+            conn = &client_connections[index];
+
+            if (param->cfg_mtu.status != ESP_GATT_OK)
+            {
+                ESP_LOGE(GATTC_TAG,"Config mtu failed");
+            }
+            else
+            {
+                conn->Out.MTU = param->cfg_mtu.mtu;
+            }
+            
+            //ESP_LOGI(GATTC_TAG, "Status %d, MTU %d, conn_id %d", param->cfg_mtu.status, param->cfg_mtu.mtu, param->cfg_mtu.conn_id);
+            if (conn->Discovery == BLE_DISCOVERY_NONE)
+            {
+                client_start_discovery(gattc_if, conn);
+            }
+            break;
+
+        case ESP_GATTC_SEARCH_RES_EVT: 
+        {
+            //ESP_LOGI(GATTC_TAG, "SEARCH RES: conn_id = %x is primary service %d", p_data->search_res.conn_id, p_data->search_res.is_primary);
+            //ESP_LOGI(GATTC_TAG, "start handle %d end handle %d current handle value %d", p_data->search_res.start_handle, p_data->search_res.end_handle, p_data->search_res.srvc_id.inst_id);
+            index = client_find_by_conn_id(p_data->search_res.conn_id);
+            if (index == BLE_NO_CONNECTION)
+            {
+                break;
+            }
+            conn = &client_connections[index];
+
+            if (p_data->search_res.start_handle < conn->ServiceStartHandle)
+            {
+                conn->ServiceStartHandle = p_data->search_res.start_handle;
+            }
+
+            if (p_data->search_res.end_handle > conn->ServiceEndHandle)
+            {
+                conn->ServiceEndHandle = p_data->search_res.end_handle;
+            }
+
+            conn->ServiceFound = 1;
+            break;
+        }
+        
+        case ESP_GATTC_SEARCH_CMPL_EVT:
+            uint16_t count = 1;
+            esp_gatt_status_t res;
+            ESP_LOGI(GATTC_TAG, "Search complete for Services");
+
+            index = client_find_by_conn_id(p_data->search_cmpl.conn_id);
+            if (index == BLE_NO_CONNECTION)
+            {
+                break;
+            }
+            conn = &client_connections[index];
+
+            if (p_data->search_cmpl.status != ESP_GATT_OK)
+            {
+                ESP_LOGE(GATTC_TAG, "Search service failed, error status = %x", p_data->search_cmpl.status);
+                client_setup_failed(conn);
+                break;
+            }
+            
+            if (conn->ServiceFound)
+            {                
+                // get descriptors for Midi
+                esp_gattc_char_elem_t* char_elem_result = (esp_gattc_char_elem_t *)malloc(sizeof(esp_gattc_char_elem_t) * 4);
+                if (!char_elem_result)
+                {
+                    ESP_LOGE(GATTC_TAG, "gattc no mem");
+                }
+                else 
+                {
+                    ESP_LOGI(GATTC_TAG, "Finding Characteristics");
+
+                    // init search table
+                    uint8_t filter_index = 0;
+
+                    remote_filter_char_uuid_reuse[filter_index].len = ESP_UUID_LEN_128;
+                    memcpy((void*)remote_filter_char_uuid_reuse[filter_index].uuid.uuid128, (void*)MidiCharacteristicUUIDByteReversed, ESP_UUID_LEN_128);
+                    filter_index++;
+                    
+                    //remote_filter_char_uuid_reuse[filter_index].len = ESP_UUID_LEN_128;
+                    //memcpy((void*)remote_filter_char_uuid_reuse[filter_index].uuid.uuid128, (void*)BatteryLevelCharacteristicUUIDByteReversed, ESP_UUID_LEN_128);
+                    //filter_index++;
+
+                    // loop and find all characteristics, and register notification
+                    for (int loop = 0; loop < filter_index; loop++)
+                    {
+                        // find the characteristic
                         count = 1;
                         res = esp_ble_gattc_get_char_by_uuid(gattc_if, 
                                                         p_data->search_cmpl.conn_id, 
-                                                        gl_profile_tab.service_start_handle, 
-                                                        gl_profile_tab.service_end_handle, 
+                                                        conn->ServiceStartHandle, 
+                                                        conn->ServiceEndHandle, 
                                                         remote_filter_char_uuid_reuse[loop], 
                                                         char_elem_result, 
                                                         &count);
@@ -997,9 +1851,9 @@ static void __attribute__((unused)) gattc_profile_a_event_handler(esp_gattc_cb_e
                             {
                                 if (char_elem_result[character_loop].properties & ESP_GATT_CHAR_PROP_BIT_NOTIFY)
                                 {
-                                    gl_profile_tab.char_handle = char_elem_result[character_loop].char_handle;
+                                    conn->CharHandle = char_elem_result[character_loop].char_handle;
 
-                                    if (esp_ble_gattc_register_for_notify(gattc_if,  gl_profile_tab.remote_bda, char_elem_result[character_loop].char_handle) != ESP_OK)
+                                    if (esp_ble_gattc_register_for_notify(gattc_if, conn->RemoteBda, char_elem_result[character_loop].char_handle) != ESP_OK)
                                     {
                                         ESP_LOGE(GATTC_TAG, "esp_ble_gattc_register_for_notify failed %d %d", (int)loop, (int)char_elem_result[character_loop].char_handle);
                                     }
@@ -1007,6 +1861,9 @@ static void __attribute__((unused)) gattc_profile_a_event_handler(esp_gattc_cb_e
                                     {
                                         ESP_LOGI(GATTC_TAG, "esp_ble_gattc_register_for_notify OK %d on handle %d", (int)loop, (int)char_elem_result[character_loop].char_handle);                                
 
+                                        // Midi out can now write to this device
+                                        conn->Out.Ready = 1;
+
                                         // update UI to show a BT connected
                                         control_set_bt_status(1);
                                     }
@@ -1022,27 +1879,52 @@ static void __attribute__((unused)) gattc_profile_a_event_handler(esp_gattc_cb_e
                     free(char_elem_result);
                 }
             }
-        
+
+            if (!conn->Out.Ready)
+            {
+                // not a usable Midi device, free the slot for another
+                client_setup_failed(conn);
+            }
             break;
 
         case ESP_GATTC_REG_FOR_NOTIFY_EVT: 
         {
-            if (p_data->reg_for_notify.status != ESP_GATT_OK)
+            if (client_setup_index == BLE_NO_CONNECTION)
             {
-                ESP_LOGE(GATTC_TAG, "reg notify failed, error status =%x", p_data->reg_for_notify.status);
                 break;
             }
-        
+            conn = &client_connections[client_setup_index];
+
             uint16_t count = 0;
             uint16_t notify_en = 1;
+            esp_gattc_descr_elem_t* descr_elem_result;
+
+            if (conn->Discovery == BLE_DISCOVERY_CACHED)
+            {
+                // CCCD handle is known, no need to look it up
+                if ((p_data->reg_for_notify.status != ESP_GATT_OK) || 
+                    (esp_ble_gattc_write_char_descr(gattc_if, conn->Out.ConnId, conn->CCCDHandle, sizeof(notify_en), (uint8_t*)&notify_en, 
+                                                    ESP_GATT_WRITE_TYPE_RSP, ESP_GATT_AUTH_REQ_NONE) != ESP_OK))
+                {
+                    client_cache_fallback(gattc_if, conn);
+                }
+                break;
+            }
+
+            if (p_data->reg_for_notify.status != ESP_GATT_OK)
+            {
+                ESP_LOGE(GATTC_TAG, "reg notify failed, error status =%x", p_data->reg_for_notify.status);
+                client_setup_done();
+                break;
+            }
+
 
             esp_gatt_status_t ret_status = esp_ble_gattc_get_attr_count( gattc_if,
-                                                                        gl_profile_tab.conn_id,
+                                                                        conn->Out.ConnId,
                                                                         ESP_GATT_DB_DESCRIPTOR,
-                                                                        gl_profile_tab.service_start_handle,
-                                                                        gl_profile_tab.service_end_handle,
-                                                                        //????? to do
-                                                                        gl_profile_tab.char_handle,
+                                                                        conn->ServiceStartHandle,
+                                                                        conn->ServiceEndHandle,
+                                                                        conn->CharHandle,
                                                                         &count);
             if (ret_status != ESP_GATT_OK)
             {
@@ -1051,19 +1933,19 @@ static void __attribute__((unused)) gattc_profile_a_event_handler(esp_gattc_cb_e
             
             if (count > 0)
             {
-                descr_elem_result_a = (esp_gattc_descr_elem_t *)malloc(sizeof(esp_gattc_descr_elem_t) * count);
+                descr_elem_result = (esp_gattc_descr_elem_t *)malloc(sizeof(esp_gattc_descr_elem_t) * count);
 
-                if (!descr_elem_result_a)
+                if (!descr_elem_result)
                 {
                     ESP_LOGE(GATTC_TAG, "malloc error, gattc no mem");
                 }
                 else
                 {
                     ret_status = esp_ble_gattc_get_descr_by_char_handle(gattc_if,
-                                                                        gl_profile_tab.conn_id,
+                                                                        conn->Out.ConnId,
                                                                         p_data->reg_for_notify.handle,
                                                                         notify_descr_uuid,
-                                                                        descr_elem_result_a,
+                                                                        descr_elem_result,
                                                                         &count);
 
                     if (ret_status != ESP_GATT_OK)
@@ -1071,11 +1953,12 @@ static void __attribute__((unused)) gattc_profile_a_event_handler(esp_gattc_cb_e
                         ESP_LOGE(GATTC_TAG, "esp_ble_gattc_get_descr_by_char_handle error %d", (int)ret_status);
                     }
 
-                    if (count > 0 && descr_elem_result_a[0].uuid.len == ESP_UUID_LEN_16 && descr_elem_result_a[0].uuid.uuid.uuid16 == ESP_GATT_UUID_CHAR_CLIENT_CONFIG)
+                    if (count > 0 && descr_elem_result[0].uuid.len == ESP_UUID_LEN_16 && descr_elem_result[0].uuid.uuid.uuid16 == ESP_GATT_UUID_CHAR_CLIENT_CONFIG)
                     {
+                        conn->CCCDHandle = descr_elem_result[0].handle;
                         ret_status = esp_ble_gattc_write_char_descr(gattc_if,
-                                                                    gl_profile_tab.conn_id,
-                                                                    descr_elem_result_a[0].handle,
+                                                                    conn->Out.ConnId,
+                                                                    descr_elem_result[0].handle,
                                                                     sizeof(notify_en),
                                                                     (uint8_t*)&notify_en,
                                                                     ESP_GATT_WRITE_TYPE_RSP,
@@ -1085,80 +1968,83 @@ static void __attribute__((unused)) gattc_profile_a_event_handler(esp_gattc_cb_e
                     if (ret_status != ESP_GATT_OK)
                     {
                         ESP_LOGE(GATTC_TAG, "esp_ble_gattc_write_char_descr error %d", (int)ret_status);
+                        client_setup_done();
                     }
 
                     // free descr_elem_result
-                    free(descr_elem_result_a);
+                    free(descr_elem_result);
                 }
             }
             else
             {
                 ESP_LOGE(GATTC_TAG, "decsr not found");
+                client_setup_done();
             }
             break;
         }
 
         case ESP_GATTC_NOTIFY_EVT:
-            ESP_LOGI(GATTC_TAG, "ESP_GATTC_NOTIFY_EVT, Receive notify value:");
-            esp_log_buffer_hex(GATTC_TAG, p_data->notify.value, p_data->notify.value_len);
+            ESP_LOGD(GATTC_TAG, "ESP_GATTC_NOTIFY_EVT, Receive notify value:");
+            ESP_LOG_BUFFER_HEX_LEVEL(GATTC_TAG, p_data->notify.value, p_data->notify.value_len, ESP_LOG_DEBUG);
 
-            // check Midi data. Program change Should be ?? ?? 0xC0 XX (XX = preset index, 0-based)
-            // first 2 bytes are header/timestamp bytes, values depend on host. Ignoring them here
-            if (p_data->notify.value_len >= 4)
+            index = client_find_by_conn_id(p_data->notify.conn_id);
+            if (index == BLE_NO_CONNECTION)
             {
-                // check channel
-                if ((p_data->notify.value[2] & 0x0F) != midi_serial_channel)
-                {
-                    ESP_LOGI(GATTC_TAG, "BT Midi non-matching channel %d", p_data->notify.value[2] & 0x0F);
-                }
-                else
-                {
-                    // check the command
-                    switch (p_data->notify.value[2] & 0xF0)
-                    {
-                        case 0xC0:
-                        {
-                            // set preset
-                            control_request_preset_index(p_data->notify.value[3]);
-                        } break;
-
-                        case 0xB0:
-                        {
-                            // note issue here with MVave chocolate pedal. Bank up/down sends 
-                            // a control change message, which would modify a different parameter
-                            if (control_get_config_item_int(CONFIG_ITEM_ENABLE_BT_MIDI_CC))
-                            {                        
-                                // control change
-                                uint8_t change_num = p_data->notify.value[3];
-                                uint8_t value = p_data->notify.value[4];
-                                midi_helper_adjust_param_via_midi(change_num, value);
-                            }
-                        } break;
-                    }
-                }
+                break;
             }
+            conn = &client_connections[index];
+            conn->RxPackets++;
+            midi_ble_packet_received(&conn->Rx);
+
+            // decode all Midi messages in the packet
+            conn->RxMessages += midi_parser_decode_ble_packet(p_data->notify.value, p_data->notify.value_len, midi_process_ble_message, (void*)&conn->Rx);
             break;
 
         case ESP_GATTC_WRITE_DESCR_EVT:
+            index = client_find_by_conn_id(p_data->write.conn_id);
+            if (index != BLE_NO_CONNECTION)
+            {
+                conn = &client_connections[index];
+            }
+
             if (p_data->write.status != ESP_GATT_OK)
             {
                 ESP_LOGE(GATTC_TAG, "write descr failed, error status = %x", p_data->write.status);
-                break;
+
+                if ((conn != NULL) && (conn->Discovery == BLE_DISCOVERY_CACHED))
+                {
+                    client_cache_fallback(gattc_if, conn);
+                    break;
+                }
             }
-            ESP_LOGI(GATTC_TAG, "write descr success");
-            
-            uint8_t write_char_data[35];
-            for (int i = 0; i < sizeof(write_char_data); ++i)
+            else
             {
-                write_char_data[i] = i % 256;
+                ESP_LOGI(GATTC_TAG, "write descr success");
+
+                if (conn != NULL)
+                {
+                    conn->SetupTime = (uint32_t)((esp_timer_get_time() - conn->SetupStartTime) / 1000);
+                    client_known_device_add(conn->RemoteBda, conn->NameHash);
+                    ESP_LOGI(GATTC_TAG, "Device %d ready in %d ms, %s", (int)index, (int)conn->SetupTime, (conn->Discovery == BLE_DISCOVERY_CACHED) ? "cached handles" : "full discovery");
+
+                    if (conn->Discovery == BLE_DISCOVERY_CACHED)
+                    {
+                        // Midi out can now write to this device
+                        conn->Out.Ready = 1;
+
+                        // update UI to show a BT connected
+                        control_set_bt_status(1);
+                    }
+                    else
+                    {
+                        // next connect can skip discovery
+                        client_handle_cache_save(conn);
+                    }
+                }
             }
-            esp_ble_gattc_write_char( gattc_if,
-                                    gl_profile_tab.conn_id,
-                                    gl_profile_tab.char_handle,
-                                    sizeof(write_char_data),
-                                    write_char_data,
-                                    ESP_GATT_WRITE_TYPE_RSP,
-                                    ESP_GATT_AUTH_REQ_NONE);
+            
+            // notify enabled, look for the next device
+            client_setup_done();
             break;
 
         case ESP_GATTC_WRITE_CHAR_EVT:
@@ -1166,11 +2052,6 @@ static void __attribute__((unused)) gattc_profile_a_event_handler(esp_gattc_cb_e
             {
                 ESP_LOGE(GATTC_TAG, "write char failed, error status = %x", p_data->write.status);
             }
-            else
-            {
-                ESP_LOGI(GATTC_TAG, "write char success");
-            }
-            start_scan();
             break;
 
         case ESP_GATTC_SRVC_CHG_EVT: 
@@ -1178,21 +2059,33 @@ static void __attribute__((unused)) gattc_profile_a_event_handler(esp_gattc_cb_e
             esp_bd_addr_t bda;
             memcpy(bda, p_data->srvc_chg.remote_bda, sizeof(esp_bd_addr_t));
             ESP_LOGI(GATTC_TAG, "ESP_GATTC_SRVC_CHG_EVT, bd_addr:%08x%04x",(bda[0] << 24) + (bda[1] << 16) + (bda[2] << 8) + bda[3], (bda[4] << 8) + bda[5]);
+
+            // device services changed, cached handles may be wrong
+            client_handle_cache_erase(bda);
             break;
         }
+
         case ESP_GATTC_DISCONNECT_EVT:
-            //Start scanning again
-            start_scan();
+            index = client_find_by_bda(p_data->disconnect.remote_bda);
+            if (index != BLE_NO_CONNECTION)
+            {
+                ESP_LOGI(GATTC_TAG, "Device %d disconnected, reason 0x%02x", (int)index, p_data->disconnect.reason);
+                memset((void*)&client_connections[index], 0, sizeof(tBLEMidiConnection));
 
-            // update UI to show a BT disconnected
-            control_set_bt_status(0);
+                if (client_setup_index == index)
+                {
+                    client_setup_index = BLE_NO_CONNECTION;
+                }
+            }
 
-            if (memcmp(p_data->disconnect.remote_bda, gl_profile_tab.remote_bda, 6) == 0)
+            if (client_get_in_use_count() == 0)
             {
-                ESP_LOGI(GATTC_TAG, "Device A disconnected");
-                conn_device_a = false;
-                get_service_a = false;
+                // update UI to show a BT disconnected
+                control_set_bt_status(0);
             }
+
+            //Start scanning again
+            client_resume_scan();
             break;
             
         default:
@@ -1332,12 +2225,30 @@ static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *par
             break;
 
         case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT:
+        {
+            uint8_t index;
+
             ESP_LOGI(GATTS_TAG, "Connection params update, status %d, conn_int %d, latency %d, timeout %d",
                     param->update_conn_params.status,
                     param->update_conn_params.conn_int,
                     param->update_conn_params.latency,
                     param->update_conn_params.timeout);
+
+            if (param->update_conn_params.status == ESP_BT_STATUS_SUCCESS)
+            {
+                // keep the interval the peer agreed to
+                index = client_find_by_bda(param->update_conn_params.bda);
+                if (index != BLE_NO_CONNECTION)
+                {
+                    client_connections[index].ConnInterval = param->update_conn_params.conn_int;
+                }
+                else if (server_connection.Connected && (memcmp(server_connection.RemoteBda, param->update_conn_params.bda, sizeof(esp_bd_addr_t)) == 0))
+                {
+                    server_connection.ConnInterval = param->update_conn_params.conn_int;
+                }
+            }
             break;
+        }
 
         case ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT:
             ESP_LOGI(GATTS_TAG, "Packet length update, status %d, rx %d, tx %d",
@@ -1350,8 +2261,22 @@ static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *par
         // Client stuff
         case ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT: 
         {
-            //the unit of the duration is second
-            esp_ble_gap_start_scanning(BT_SCAN_DURATION);
+            start_scan();
+            break;
+        }
+
+        case ESP_GAP_BLE_READ_RSSI_COMPLETE_EVT:
+        {
+            uint8_t index;
+
+            if (param->read_rssi_cmpl.status == ESP_BT_STATUS_SUCCESS)
+            {
+                index = client_find_by_bda(param->read_rssi_cmpl.remote_addr);
+                if (index != BLE_NO_CONNECTION)
+                {
+                    client_connections[index].RSSI = param->read_rssi_cmpl.rssi;
+                }
+            }
             break;
         }
         
@@ -1364,6 +2289,7 @@ static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *par
             else
             {
                 ESP_LOGE(GATTC_TAG, "Scan start failed");
+                scan_active = false;
             }
             break;
 
@@ -1374,52 +2300,112 @@ static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *par
             switch (scan_result->scan_rst.search_evt) 
             {
             case ESP_GAP_SEARCH_INQ_RES_EVT:
-                //esp_log_buffer_hex(GATTC_TAG, scan_result->scan_rst.bda, 6);
-                //ESP_LOGI(GATTC_TAG, "Searched Adv Data Len %d, Scan Response Len %d", scan_result->scan_rst.adv_data_len, scan_result->scan_rst.scan_rsp_len);
-                adv_name = esp_ble_resolve_adv_data(scan_result->scan_rst.ble_adv, ESP_BLE_AD_TYPE_NAME_CMPL, &adv_name_len);
-                //ESP_LOGI(GATTC_TAG, "Searched Device Name Len %d", adv_name_len);
-                //esp_log_buffer_char(GATTC_TAG, adv_name, adv_name_len);
-                //ESP_LOGI(GATTC_TAG, "\n");
-                
-                if (Isconnecting)
+            {
+                uint8_t name_index = BLE_NO_CONNECTION;
+                tBLEKnownDevice* known;
+
+                scan_stats.AdvProcessed++;
+
+                if (client_setup_index != BLE_NO_CONNECTION)
                 {
+                    // busy setting up a connection
+                    scan_stats.AdvSkipped++;
                     break;
                 }
                 
-                if (conn_device_a && !stop_scan_done)
+                if (client_get_in_use_count() >= BLE_MAX_CLIENT_CONNECTIONS)
                 {
-                    stop_scan_done = true;
+                    scan_active = false;
                     esp_ble_gap_stop_scanning();
-                    ESP_LOGI(GATTC_TAG, "Device is connected, stopping scan");
+                    ESP_LOGI(GATTC_TAG, "All devices connected, stopping scan");
+                    scan_stats.AdvSkipped++;
                     break;
                 }
-                
-                if (adv_name != NULL) 
+
+                if (client_find_by_bda(scan_result->scan_rst.bda) != BLE_NO_CONNECTION)
+                {
+                    // already connected to this one
+                    scan_stats.AdvSkipped++;
+                    break;
+                }
+
+                if (remote_device_names_length == 0)
+                {
+                    // no device types enabled
+                    scan_stats.AdvDropped++;
+                    break;
+                }
+
+                // known controllers match on address alone, which a passive scan needs as the name may be in the scan response
+                known = client_known_device_find(scan_result->scan_rst.bda);
+
+                if ((known != NULL) && (known->NameHash != 0))
                 {
-                    if (remote_device_names_length > 0)
+                    // its device type may have been disabled since
+                    name_index = device_name_find_hash(known->NameHash);
+
+                    if (name_index == BLE_NO_CONNECTION)
                     {
-                        // loop over list of enabled devices to connect to
-                        for (uint8_t loop = 0; loop < remote_device_names_length; loop++)
-                        {       
-                            //ESP_LOGI(GATTC_TAG, "Checking for device %s. len: %d %d", remote_device_names[loop], strlen(remote_device_names[loop]), adv_name_len);
-                            if ((strlen(remote_device_names[loop]) == adv_name_len) && (strncmp((char*)adv_name, remote_device_names[loop], adv_name_len)) == 0) 
-                            {
-                                if (conn_device_a == false) 
-                                {
-                                    conn_device_a = true;
-                                    ESP_LOGI(GATTC_TAG, "Searched device %s", remote_device_names[loop]);
-                                    esp_ble_gap_stop_scanning();
-                                    esp_ble_gattc_open(gl_profile_tab.gattc_if, scan_result->scan_rst.bda, scan_result->scan_rst.ble_addr_type, true);
-                                    Isconnecting = true;
-                                }
-                                break;
-                            }
-                        }
+                        scan_stats.AdvDropped++;
+                        break;
                     }
                 }
-                break;
+                else
+                {
+                    // new, or bonded before its name was recorded
+                    if (adv_lacks_midi_service(scan_result->scan_rst.ble_adv))
+                    {
+                        scan_stats.AdvDropped++;
+                        break;
+                    }
+
+                    adv_name = esp_ble_resolve_adv_data(scan_result->scan_rst.ble_adv, ESP_BLE_AD_TYPE_NAME_CMPL, &adv_name_len);
+                    if (adv_name != NULL)
+                    {
+                        name_index = device_name_find(adv_name, adv_name_len);
+                    }
+
+                    if (name_index == BLE_NO_CONNECTION)
+                    {
+                        scan_stats.AdvDropped++;
+                        break;
+                    }
+                }
+
+                // claim a free slot
+                for (uint8_t slot = 0; slot < BLE_MAX_CLIENT_CONNECTIONS; slot++)
+                {
+                    if (!client_connections[slot].InUse)
+                    {
+                        memset((void*)&client_connections[slot], 0, sizeof(tBLEMidiConnection));
+                        client_connections[slot].InUse = 1;
+                        client_connections[slot].RSSI = scan_result->scan_rst.rssi;
+                        client_connections[slot].SetupStartTime = esp_timer_get_time();
+                        memcpy(client_connections[slot].RemoteBda, scan_result->scan_rst.bda, sizeof(esp_bd_addr_t));
+                        client_connections[slot].NameHash = (name_index != BLE_NO_CONNECTION) ? remote_device_names[name_index].Hash : 0;
+                        client_setup_index = slot;
+
+                        ESP_LOGI(GATTC_TAG, "Searched device %s, RSSI %d, slot %d", (name_index != BLE_NO_CONNECTION) ? remote_device_names[name_index].Name : "(known)", 
+                                 scan_result->scan_rst.rssi, (int)slot);
+                        scan_stats.AdvMatched++;
+                        scan_active = false;
+                        esp_ble_gap_stop_scanning();
+                        esp_ble_gattc_open(gl_profile_tab.gattc_if, scan_result->scan_rst.bda, scan_result->scan_rst.ble_addr_type, true);
+                        break;
+                    }
+                }
+            } break;
             
             case ESP_GAP_SEARCH_INQ_CMPL_EVT:
+                // scan duration ended
+                scan_active = false;
+
+                if (scan_passive)
+                {
+                    // known devices not around, look for new ones
+                    ESP_LOGI(GATTC_TAG, "Known device scan done, starting full scan");
+                    configure_scan(0);
+                }
                 break;
 
             default:
@@ -1494,33 +2480,41 @@ static void InitDeviceList(void)
 {
     memset((void*)remote_device_names, 0, sizeof(remote_device_names));
     remote_device_names_length = 0;
+    memset((void*)&scan_stats, 0, sizeof(scan_stats));
 
     // build list of devices to scan for and connect to if found
     if (control_get_config_item_int(CONFIG_ITEM_MV_CHOC_ENABLE))
     {
         // M-vave Chocolate device name is 'FootCtrl'
-        strncpy(remote_device_names[remote_device_names_length], "FootCtrl", MAX_DEVICE_NAME_LENGTH);
+        strncpy(remote_device_names[remote_device_names_length].Name, "FootCtrl", MAX_DEVICE_NAME_LENGTH);
         remote_device_names_length++;
 
         // M-vave Chocolate Plus device name is 'FootCtrlPlus'
-        strncpy(remote_device_names[remote_device_names_length], "FootCtrlPlus", MAX_DEVICE_NAME_LENGTH);
+        strncpy(remote_device_names[remote_device_names_length].Name, "FootCtrlPlus", MAX_DEVICE_NAME_LENGTH);
         remote_device_names_length++;
     }
 
     if (control_get_config_item_int(CONFIG_ITEM_XV_MD1_ENABLE))
     {
         // Xvive Bluetooth Midi adaptor is 'Xvive MD1'
-        strncpy(remote_device_names[remote_device_names_length], "Xvive MD1", MAX_DEVICE_NAME_LENGTH);
+        strncpy(remote_device_names[remote_device_names_length].Name, "Xvive MD1", MAX_DEVICE_NAME_LENGTH);
         remote_device_names_length++;
     }
 
     if (control_get_config_item_int(CONFIG_ITEM_CUSTOM_BT_ENABLE))
     {
         // Custom Bluetooth device name
-        control_get_config_item_string(CONFIG_ITEM_BT_CUSTOM_NAME, remote_device_names[remote_device_names_length]);
+        control_get_config_item_string(CONFIG_ITEM_BT_CUSTOM_NAME, remote_device_names[remote_device_names_length].Name);
         remote_device_names_length++;
     }
 
+    for (uint8_t loop = 0; loop < remote_device_names_length; loop++)
+    {
+        remote_device_names[loop].Name[MAX_DEVICE_NAME_LENGTH - 1] = 0;
+        remote_device_names[loop].Length = strlen(remote_device_names[loop].Name);
+        remote_device_names[loop].Hash = device_name_hash((uint8_t*)remote_device_names[loop].Name, remote_device_names[loop].Length);
+    }
+
     ESP_LOGI(GATTC_TAG, "Device List length: %d", remote_device_names_length);
 }
 
@@ -1537,15 +2531,6 @@ static void init_BLE(void)
 
     ESP_LOGI(TAG, "Midi BLE init start");
 
-    // get the channel to use
-    midi_serial_channel = control_get_config_item_int(CONFIG_ITEM_MIDI_CHANNEL);
-
-    // adjust to zero based indexing
-    if (midi_serial_channel > 0)
-    {
-        midi_serial_channel--;
-    }
-
         
     ESP_ERROR_CHECK(esp_bt_controller_mem_release(ESP_BT_MODE_CLASSIC_BT));
 
@@ -1593,6 +2578,22 @@ static void init_BLE(void)
 
         InitDeviceList();
 
+        // periodic signal strength read of connected devices
+        const esp_timer_create_args_t rssi_timer_args = 
+        {
+            .callback = &client_rssi_timer_callback,
+            .name = "ble_rssi"
+        };
+
+        if (esp_timer_create(&rssi_timer_args, &client_rssi_timer) == ESP_OK)
+        {
+            esp_timer_start_periodic(client_rssi_timer, BLE_RSSI_POLL_INTERVAL);
+        }
+        else
+        {
+            ESP_LOGE(GATTC_TAG, "RSSI timer create failed");
+        }
+
         // register the callback function to the gattc module
         ret = esp_ble_gattc_register_callback(esp_gattc_cb);
         if(ret)
@@ -1667,6 +2668,199 @@ static void init_BLE(void)
     //heap_caps_print_heap_info(MALLOC_CAP_SPIRAM);
 }
 
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Send a BLE Midi packet to the connected devices
+* PARAMETERS:  data: complete BLE Midi packet, including header
+*              length: packet length
+* RETURN:      ESP_ERR_TIMEOUT if throttled, ESP_ERR_INVALID_STATE if not connected
+* NOTES:       Notifies when we are the peripheral, writes to every connected
+*              controller when central
+*****************************************************************************/
+esp_err_t midi_send_ble_packet(uint8_t* data, uint16_t length)
+{
+    int64_t now = esp_timer_get_time();
+    esp_err_t res = ESP_ERR_INVALID_STATE;
+    esp_err_t write_res;
+    tBLEMidiConnection* conn;
+
+    if (server_connection.Out.Ready)
+    {
+        if ((now - server_connection.Out.LastTxTime) < BLE_MIDI_TX_MIN_INTERVAL)
+        {
+            return ESP_ERR_TIMEOUT;
+        }
+
+        res = esp_ble_gatts_send_indicate(gls_profile_tab[PROFILE_A_APP_ID].gatts_if, server_connection.Out.ConnId, 
+                                          gls_profile_tab[PROFILE_A_APP_ID].char_handle, length, data, false);
+        server_connection.Out.LastTxTime = now;
+    }
+    else
+    {
+        // packet goes to all, so if any connection is throttled hold it for all
+        for (uint8_t loop = 0; loop < BLE_MAX_CLIENT_CONNECTIONS; loop++)
+        {
+            if (client_connections[loop].Out.Ready && ((now - client_connections[loop].Out.LastTxTime) < BLE_MIDI_TX_MIN_INTERVAL))
+            {
+                return ESP_ERR_TIMEOUT;
+            }
+        }
+
+        for (uint8_t loop = 0; loop < BLE_MAX_CLIENT_CONNECTIONS; loop++)
+        {
+            conn = &client_connections[loop];
+
+            if (conn->Out.Ready)
+            {
+                write_res = esp_ble_gattc_write_char(gl_profile_tab.gattc_if, conn->Out.ConnId, conn->CharHandle, 
+                                                     length, data, ESP_GATT_WRITE_TYPE_NO_RSP, ESP_GATT_AUTH_REQ_NONE);
+                conn->Out.LastTxTime = now;
+
+                if (write_res == ESP_OK)
+                {
+                    conn->TxPackets++;
+                }
+                else
+                {
+                    conn->TxErrors++;
+                }
+
+                if ((res == ESP_ERR_INVALID_STATE) || (write_res != ESP_OK))
+                {
+                    res = write_res;
+                }
+            }
+        }
+    }
+
+    if ((res != ESP_OK) && (res != ESP_ERR_INVALID_STATE))
+    {
+        ESP_LOGW(TAG, "BLE Midi send failed %d", (int)res);
+    }
+
+    return res;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Get the largest BLE Midi packet the connections can carry
+* PARAMETERS:  
+* RETURN:      0 if nothing connected
+* NOTES:       Smallest of all connected controllers when central
+*****************************************************************************/
+uint16_t midi_get_ble_max_payload(void)
+{
+    uint16_t mtu = 0;
+
+    if (server_connection.Out.Ready)
+    {
+        return server_connection.Out.MTU - 3;
+    }
+
+    for (uint8_t loop = 0; loop < BLE_MAX_CLIENT_CONNECTIONS; loop++)
+    {
+        if (client_connections[loop].Out.Ready && ((mtu == 0) || (client_connections[loop].Out.MTU < mtu)))
+        {
+            mtu = client_connections[loop].Out.MTU;
+        }
+    }
+
+    if (mtu == 0)
+    {
+        return 0;
+    }
+
+    return mtu - 3;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Get stats for connected controllers
+* PARAMETERS:  stats: array to fill
+*              max_count: size of stats array
+* RETURN:      number of entries filled
+* NOTES:       
+*****************************************************************************/
+uint8_t midi_get_ble_connection_stats(tMidiBLEConnectionStats* stats, uint8_t max_count)
+{
+    uint8_t count = 0;
+    tBLEMidiConnection* conn;
+
+    // host connection first when peripheral, then controllers when central
+    for (uint8_t loop = 0; (loop <= BLE_MAX_CLIENT_CONNECTIONS) && (count < max_count); loop++)
+    {
+        if (loop == 0)
+        {
+            conn = &server_connection;
+        }
+        else
+        {
+            conn = &client_connections[loop - 1];
+        }
+
+        if (conn->Connected)
+        {
+            memcpy((void*)stats[count].Address, (void*)conn->RemoteBda, sizeof(stats[count].Address));
+            stats[count].RSSI = conn->RSSI;
+            stats[count].MTU = conn->Out.MTU;
+            stats[count].RxPackets = conn->RxPackets;
+            stats[count].RxMessages = conn->RxMessages;
+            stats[count].TxPackets = conn->TxPackets;
+            stats[count].TxErrors = conn->TxErrors;
+            stats[count].SetupTime = conn->SetupTime;
+            stats[count].SetupCached = (conn->Discovery == BLE_DISCOVERY_CACHED);
+            stats[count].ConnInterval = conn->ConnInterval * 1250;
+            stats[count].PacketIntervalAvg = midi_ble_stat_average(&conn->Rx.PacketInterval);
+            stats[count].PacketIntervalMin = conn->Rx.PacketInterval.Min;
+            stats[count].PacketIntervalMax = conn->Rx.PacketInterval.Max;
+            stats[count].LatencyAvg = midi_ble_stat_average(&conn->Rx.Latency);
+            stats[count].LatencyMax = conn->Rx.Latency.Max;
+            count++;
+        }
+    }
+
+    return count;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Get the scan filter counters
+* PARAMETERS:  stats: filled in
+* RETURN:      
+* NOTES:       Central mode only
+*****************************************************************************/
+void midi_get_ble_scan_stats(tMidiBLEScanStats* stats)
+{
+    memcpy((void*)stats, (void*)&scan_stats, sizeof(tMidiBLEScanStats));
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Tell Bluetooth when WiFi is running
+* PARAMETERS:  active: 1 if WiFi is on
+* RETURN:      
+* NOTES:       Renegotiates open connections if the interval should change
+*****************************************************************************/
+void midi_set_wifi_active(uint8_t active)
+{
+    wifi_active = (active != 0);
+
+#if CONFIG_TONEX_CONTROLLER_BT_WIFI_RELAX_INTERVAL
+    if (server_connection.Connected)
+    {
+        midi_request_conn_params(server_connection.RemoteBda);
+    }
+
+    for (uint8_t loop = 0; loop < BLE_MAX_CLIENT_CONNECTIONS; loop++)
+    {
+        if (client_connections[loop].Connected)
+        {
+            midi_request_conn_params(client_connections[loop].RemoteBda);
+        }
+    }
+#endif
+}
+
 /****************************************************************************
 * NAME:        
 * DESCRIPTION: 
@@ -1676,7 +2870,17 @@ static void init_BLE(void)
 *****************************************************************************/
 void midi_delete_bluetooth_bonds(void)
 {
+    nvs_handle_t nvs_handle;
+
     remove_all_bonded_devices();
+
+    // handle cache goes with the bonds
+    if (nvs_open(BLE_HANDLE_CACHE_NAMESPACE, NVS_READWRITE, &nvs_handle) == ESP_OK)
+    {
+        nvs_erase_all(nvs_handle);
+        nvs_commit(nvs_handle);
+        nvs_close(nvs_handle);
+    }
 }
 
 /****************************************************************************
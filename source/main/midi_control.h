@@ -23,8 +23,44 @@ limitations under the License.
 extern "C" {
 #endif
 
+#define MIDI_BLE_MAX_CONNECTION_STATS   4
+
+typedef struct
+{
+    uint8_t Address[6];
+    int8_t RSSI;
+    uint16_t MTU;
+    uint32_t RxPackets;
+    uint32_t RxMessages;
+    uint32_t TxPackets;
+    uint32_t TxErrors;
+    uint32_t SetupTime;         // msec from connect to notify enabled
+    uint8_t SetupCached;        // 1 if cached handles were used
+    uint32_t ConnInterval;      // usec, 0 if not known
+    uint32_t PacketIntervalAvg; // usec between received packets
+    uint32_t PacketIntervalMin;
+    uint32_t PacketIntervalMax;
+    uint32_t LatencyAvg;        // usec, arrival delay beyond the fastest packet by BLE timestamp
+    uint32_t LatencyMax;
+} tMidiBLEConnectionStats;
+
+typedef struct
+{
+    uint32_t AdvProcessed;      // adverts received
+    uint32_t AdvMatched;        // adverts that started a connection
+    uint32_t AdvDropped;        // adverts rejected by the address, service or name filters
+    uint32_t AdvSkipped;        // adverts ignored while busy or already connected
+    uint8_t KnownDevices;       // controllers that can be found by address
+    uint8_t Passive;            // 1 if scanning passively for known devices
+} tMidiBLEScanStats;
+
 void midi_init(void);
 void midi_delete_bluetooth_bonds(void);
+void midi_set_wifi_active(uint8_t active);
+esp_err_t midi_send_ble_packet(uint8_t* data, uint16_t length);
+uint16_t midi_get_ble_max_payload(void);
+uint8_t midi_get_ble_connection_stats(tMidiBLEConnectionStats* stats, uint8_t max_count);
+void midi_get_ble_scan_stats(tMidiBLEScanStats* stats);
 
 #ifdef __cplusplus
 } /*extern "C"*/
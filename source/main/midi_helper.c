@@ -19,6 +19,7 @@ limitations under the License.
 #include <inttypes.h>
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
 #include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -37,9 +38,12 @@ limitations under the License.
 #include "usb/usb_host.h"
 #include "usb_tonex_one.h"
 #include "tonex_params.h"
+#include "midi_helper.h"
 
 static const char *TAG = "app_midi_helper";
 
+#define MIDI_HELPER_MAX_STEPPED_RANGE       16          // params with integer ranges this small are treated as stepped
+
 /****************************************************************************
 * NAME:        
 * DESCRIPTION: 
@@ -854,6 +858,54 @@ esp_err_t midi_helper_adjust_param_via_midi(uint8_t change_num, uint8_t midi_val
     return ESP_OK;
 }
 
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Set a parameter from a 14 bit Midi value
+* PARAMETERS:  param: TONEX_PARAM_ index
+*              midi_value: 0..16383
+* RETURN:      
+* NOTES:       Used by NRPN and 14 bit control change. For stepped params
+*              (on/off, model selects) a value within the param range is
+*              used directly, larger values are scaled across the range
+*****************************************************************************/
+esp_err_t midi_helper_adjust_param_14bit(uint16_t param, uint16_t midi_value)
+{
+    float min;
+    float max;
+    float value;
+
+    if ((param >= TONEX_PARAM_LAST) || (midi_value > MIDI_HELPER_14BIT_MAX))
+    {
+        ESP_LOGW(TAG, "Invalid 14 bit param %d value %d", (int)param, (int)midi_value);
+        return ESP_FAIL;
+    }
+
+    tonex_params_get_min_max(param, &min, &max);
+
+    if (((max - min) <= MIDI_HELPER_MAX_STEPPED_RANGE) && (min == (int)min) && (max == (int)max))
+    {
+        if (midi_value <= (max - min))
+        {
+            value = min + midi_value;
+        }
+        else
+        {
+            value = roundf(min + (((float)midi_value / MIDI_HELPER_14BIT_MAX) * (max - min)));
+        }
+    }
+    else
+    {
+        value = min + (((float)midi_value / MIDI_HELPER_14BIT_MAX) * (max - min));
+    }
+
+    value = tonex_params_clamp_value(param, value);
+
+    // modify the parameter
+    usb_modify_parameter(param, value);
+
+    return ESP_OK;
+}
+
 /****************************************************************************
 * NAME:        
 * DESCRIPTION: 
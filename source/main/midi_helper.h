@@ -17,5 +17,10 @@ limitations under the License.
 
 #pragma once
 
+#include "midi_parser.h"
+
+#define MIDI_HELPER_14BIT_MAX               16383
+
 esp_err_t midi_helper_adjust_param_via_midi(uint8_t change_num, uint8_t midi_value);
+esp_err_t midi_helper_adjust_param_14bit(uint16_t param, uint16_t midi_value);
 uint16_t midi_helper_get_param_for_change_num(uint8_t change_num);
@@ -0,0 +1,445 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/ringbuf.h"
+#include "esp_timer.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "main.h"
+#include "control.h"
+#include "task_priorities.h"
+#include "midi_control.h"
+#include "midi_serial.h"
+#include "midi_helper.h"
+#include "midi_out.h"
+#include "tonex_params.h"
+
+#define MIDI_OUT_TASK_STACK_SIZE            (3 * 1024)
+#define MIDI_OUT_RING_BUFFER_SIZE           512
+#define MIDI_OUT_BLE_PACKET_MAX             128         // largest BLE Midi packet we will build
+#define MIDI_OUT_BLE_BATCH_TIME             10          // msec to collect messages into one BLE packet
+#define MIDI_OUT_STATE_UNKNOWN              0xFF
+
+static const char *TAG = "app_midi_out";
+
+// parameters that are reported back to controllers
+static const uint16_t MidiOutEnableParams[] =
+{
+    TONEX_PARAM_NOISE_GATE_ENABLE,
+    TONEX_PARAM_COMP_ENABLE,
+    TONEX_PARAM_MODEL_AMP_ENABLE,
+    TONEX_PARAM_MODEL_CABINET_ENABLE,
+    TONEX_PARAM_MODULATION_ENABLE,
+    TONEX_PARAM_DELAY_ENABLE,
+    TONEX_PARAM_REVERB_ENABLE
+};
+
+#define MIDI_OUT_NUM_ENABLE_PARAMS          (sizeof(MidiOutEnableParams) / sizeof(MidiOutEnableParams[0]))
+
+typedef struct
+{
+    RingbufHandle_t RingBuffer;
+    uint8_t Channel;
+    uint16_t LastPreset;
+    uint8_t EnableChangeNum[MIDI_OUT_NUM_ENABLE_PARAMS];
+    uint8_t EnableState[MIDI_OUT_NUM_ENABLE_PARAMS];
+    uint8_t BLEPacket[MIDI_OUT_BLE_PACKET_MAX];
+    uint16_t BLEPacketLength;
+    TickType_t BLEBatchStart;
+    uint8_t BLEDeferred[3];                     // message that didn't fit while throttled
+    uint8_t BLEDeferredLength;
+    uint32_t BLEPacketsSent;
+    uint32_t BLEPacketsDropped;
+} tMidiOut;
+
+static tMidiOut MidiOut;
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Send the pending BLE packet
+* PARAMETERS:
+* RETURN:      ESP_OK if sent or discarded, ESP_ERR_TIMEOUT if throttled
+* NOTES:
+*****************************************************************************/
+static esp_err_t midi_out_ble_flush(void)
+{
+    esp_err_t res;
+
+    if (MidiOut.BLEPacketLength == 0)
+    {
+        return ESP_OK;
+    }
+
+    res = midi_send_ble_packet(MidiOut.BLEPacket, MidiOut.BLEPacketLength);
+    if (res == ESP_ERR_TIMEOUT)
+    {
+        // connection throttled, try again next batch period
+        MidiOut.BLEBatchStart = xTaskGetTickCount();
+        return res;
+    }
+
+    if (res == ESP_OK)
+    {
+        MidiOut.BLEPacketsSent++;
+    }
+    else
+    {
+        MidiOut.BLEPacketsDropped++;
+    }
+
+    MidiOut.BLEPacketLength = 0;
+    return ESP_OK;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Add a message to the pending BLE packet
+* PARAMETERS:
+* RETURN:      ESP_ERR_TIMEOUT if it didn't fit and the full packet is
+*              throttled, the caller tries again later
+* NOTES:       Packing as per the BLE Midi spec. Header byte holds timestamp
+*              high bits, each message is preceeded by timestamp low bits
+*****************************************************************************/
+static esp_err_t midi_out_ble_add(const uint8_t* data, uint16_t length)
+{
+    uint16_t max_payload = midi_get_ble_max_payload();
+    uint16_t timestamp;
+
+    if (max_payload == 0)
+    {
+        // nothing connected
+        MidiOut.BLEPacketLength = 0;
+        return ESP_OK;
+    }
+
+    if (max_payload > MIDI_OUT_BLE_PACKET_MAX)
+    {
+        max_payload = MIDI_OUT_BLE_PACKET_MAX;
+    }
+
+    // flush if this message won't fit (timestamp byte + message)
+    if ((MidiOut.BLEPacketLength + 1 + length) > max_payload)
+    {
+        if (midi_out_ble_flush() == ESP_ERR_TIMEOUT)
+        {
+            // packet stays pending until the connection allows it
+            return ESP_ERR_TIMEOUT;
+        }
+    }
+
+    timestamp = (uint16_t)((esp_timer_get_time() / 1000) & 0x1FFF);
+
+    if (MidiOut.BLEPacketLength == 0)
+    {
+        // header
+        MidiOut.BLEPacket[MidiOut.BLEPacketLength++] = 0x80 | ((timestamp >> 7) & 0x3F);
+        MidiOut.BLEBatchStart = xTaskGetTickCount();
+    }
+
+    MidiOut.BLEPacket[MidiOut.BLEPacketLength++] = 0x80 | (timestamp & 0x7F);
+    memcpy((void*)&MidiOut.BLEPacket[MidiOut.BLEPacketLength], (void*)data, length);
+    MidiOut.BLEPacketLength += length;
+
+    return ESP_OK;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION:
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void midi_out_task(void *arg)
+{
+    uint8_t* item;
+    size_t item_size;
+    TickType_t wait;
+    TickType_t elapsed;
+
+    ESP_LOGI(TAG, "Midi Out task start");
+
+    while (1)
+    {
+        if (MidiOut.BLEDeferredLength != 0)
+        {
+            // throttled, nothing else is taken until the held message is in a packet
+            elapsed = xTaskGetTickCount() - MidiOut.BLEBatchStart;
+            if (elapsed < pdMS_TO_TICKS(MIDI_OUT_BLE_BATCH_TIME))
+            {
+                vTaskDelay(pdMS_TO_TICKS(MIDI_OUT_BLE_BATCH_TIME) - elapsed);
+            }
+
+            if (midi_out_ble_add(MidiOut.BLEDeferred, MidiOut.BLEDeferredLength) == ESP_OK)
+            {
+                MidiOut.BLEDeferredLength = 0;
+            }
+
+            continue;
+        }
+
+        if (MidiOut.BLEPacketLength == 0)
+        {
+            // nothing pending, wait for a message
+            wait = portMAX_DELAY;
+        }
+        else
+        {
+            // wait for the rest of the batch period
+            elapsed = xTaskGetTickCount() - MidiOut.BLEBatchStart;
+
+            if (elapsed >= pdMS_TO_TICKS(MIDI_OUT_BLE_BATCH_TIME))
+            {
+                wait = 0;
+            }
+            else
+            {
+                wait = pdMS_TO_TICKS(MIDI_OUT_BLE_BATCH_TIME) - elapsed;
+            }
+        }
+
+        item = (uint8_t*)xRingbufferReceive(MidiOut.RingBuffer, &item_size, wait);
+        if (item != NULL)
+        {
+            // first byte is the destinations, message follows
+            if (item[0] & MIDI_OUT_DEST_SERIAL)
+            {
+                // serial port sends immediately
+                midi_serial_write(&item[1], item_size - 1);
+            }
+
+            if (item[0] & MIDI_OUT_DEST_BLE)
+            {
+                // BLE gets batched
+                if (midi_out_ble_add(&item[1], item_size - 1) == ESP_ERR_TIMEOUT)
+                {
+                    // hold it, the serial copy has already gone
+                    memcpy((void*)MidiOut.BLEDeferred, (void*)&item[1], item_size - 1);
+                    MidiOut.BLEDeferredLength = item_size - 1;
+                }
+            }
+
+            vRingbufferReturnItem(MidiOut.RingBuffer, (void*)item);
+        }
+
+        if ((MidiOut.BLEPacketLength != 0) && ((xTaskGetTickCount() - MidiOut.BLEBatchStart) >= pdMS_TO_TICKS(MIDI_OUT_BLE_BATCH_TIME)))
+        {
+            midi_out_ble_flush();
+        }
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Queue a Midi message for output on selected destinations
+* PARAMETERS:  destinations: MIDI_OUT_DEST_ bit mask
+*              status: status byte
+*              data_1, data_2: data bytes, unused ones ignored
+* RETURN:
+* NOTES:       Safe to call from any task, doesn't block
+*****************************************************************************/
+esp_err_t midi_out_send_message_to(uint8_t destinations, uint8_t status, uint8_t data_1, uint8_t data_2)
+{
+    uint8_t message[4];
+    uint8_t length = 2;
+    uint8_t data_count;
+
+    if (MidiOut.RingBuffer == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    message[0] = destinations;
+    message[1] = status;
+
+    // data bytes for the status, system common ones included
+    data_count = midi_parser_get_data_length(status);
+
+    if (data_count > 0)
+    {
+        message[length++] = data_1 & 0x7F;
+    }
+
+    if (data_count > 1)
+    {
+        message[length++] = data_2 & 0x7F;
+    }
+
+    if (xRingbufferSend(MidiOut.RingBuffer, (void*)message, length, 0) != pdTRUE)
+    {
+        ESP_LOGW(TAG, "Midi out ring buffer full");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Queue a Midi message for output on all destinations
+* PARAMETERS:  status: status byte
+*              data_1, data_2: data bytes, unused ones ignored
+* RETURN:
+* NOTES:       Safe to call from any task, doesn't block
+*****************************************************************************/
+esp_err_t midi_out_send_message(uint8_t status, uint8_t data_1, uint8_t data_2)
+{
+    return midi_out_send_message_to(MIDI_OUT_DEST_ALL, status, data_1, data_2);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Send a program change if the preset has changed
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+void midi_out_sync_preset(uint16_t index)
+{
+    if ((MidiOut.RingBuffer == NULL) || (index > 127) || (index == MidiOut.LastPreset))
+    {
+        return;
+    }
+
+    if (midi_out_send_message(0xC0 | MidiOut.Channel, index, 0) == ESP_OK)
+    {
+        MidiOut.LastPreset = index;
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Send control changes for any effect enables that changed
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+void midi_out_sync_params(void)
+{
+    tTonexParameter* param_ptr;
+    uint8_t state[MIDI_OUT_NUM_ENABLE_PARAMS];
+
+    if (MidiOut.RingBuffer == NULL)
+    {
+        return;
+    }
+
+    // snapshot the states, keep lock time short
+    if (tonex_params_get_locked_access(&param_ptr) != ESP_OK)
+    {
+        return;
+    }
+
+    for (uint8_t loop = 0; loop < MIDI_OUT_NUM_ENABLE_PARAMS; loop++)
+    {
+        state[loop] = (param_ptr[MidiOutEnableParams[loop]].Value != 0.0f) ? 1 : 0;
+    }
+
+    tonex_params_release_locked_access();
+
+    for (uint8_t loop = 0; loop < MIDI_OUT_NUM_ENABLE_PARAMS; loop++)
+    {
+        if ((MidiOut.EnableChangeNum[loop] == MIDI_OUT_STATE_UNKNOWN) || (state[loop] == MidiOut.EnableState[loop]))
+        {
+            continue;
+        }
+
+        if (midi_out_send_message(0xB0 | MidiOut.Channel, MidiOut.EnableChangeNum[loop], state[loop] ? 127 : 0) == ESP_OK)
+        {
+            MidiOut.EnableState[loop] = state[loop];
+        }
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Load the Midi channel from config
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void midi_out_load_channel(void)
+{
+    uint8_t channel;
+
+    // get the channel to use, adjusted to zero based
+    channel = control_get_config_item_int(CONFIG_ITEM_MIDI_CHANNEL);
+    if (channel > 0)
+    {
+        channel--;
+    }
+
+    MidiOut.Channel = channel;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Midi channel changed
+* PARAMETERS:
+* RETURN:
+* NOTES:       Called from the control task
+*****************************************************************************/
+static void midi_out_config_changed(uint64_t changed)
+{
+    midi_out_load_channel();
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION:
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+void midi_out_init(void)
+{
+    memset((void*)&MidiOut, 0, sizeof(MidiOut));
+    MidiOut.LastPreset = 0xFFFF;
+
+    midi_out_load_channel();
+    control_register_config_handler(CONFIG_ITEM_MASK(CONFIG_ITEM_MIDI_CHANNEL), midi_out_config_changed);
+
+    // find the control change used for each enable, so we report on the same one
+    for (uint8_t loop = 0; loop < MIDI_OUT_NUM_ENABLE_PARAMS; loop++)
+    {
+        MidiOut.EnableChangeNum[loop] = MIDI_OUT_STATE_UNKNOWN;
+        MidiOut.EnableState[loop] = MIDI_OUT_STATE_UNKNOWN;
+
+        for (uint8_t change_num = 0; change_num < 128; change_num++)
+        {
+            if (midi_helper_get_param_for_change_num(change_num) == MidiOutEnableParams[loop])
+            {
+                MidiOut.EnableChangeNum[loop] = change_num;
+                break;
+            }
+        }
+    }
+
+    MidiOut.RingBuffer = xRingbufferCreate(MIDI_OUT_RING_BUFFER_SIZE, RINGBUF_TYPE_NOSPLIT);
+    if (MidiOut.RingBuffer == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create Midi out ring buffer!");
+        return;
+    }
+
+    xTaskCreatePinnedToCore(midi_out_task, "MIDIO", MIDI_OUT_TASK_STACK_SIZE, NULL, MIDI_OUT_TASK_PRIORITY, NULL, 1);
+}
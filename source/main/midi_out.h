@@ -0,0 +1,32 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// output destinations
+#define MIDI_OUT_DEST_SERIAL                (1 << 0)
+#define MIDI_OUT_DEST_BLE                   (1 << 1)
+#define MIDI_OUT_DEST_ALL                   (MIDI_OUT_DEST_SERIAL | MIDI_OUT_DEST_BLE)
+
+void midi_out_init(void);
+esp_err_t midi_out_send_message(uint8_t status, uint8_t data_1, uint8_t data_2);
+esp_err_t midi_out_send_message_to(uint8_t destinations, uint8_t status, uint8_t data_1, uint8_t data_2);
+void midi_out_sync_preset(uint16_t index);
+void midi_out_sync_params(void);
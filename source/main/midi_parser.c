@@ -0,0 +1,293 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ 
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include "midi_parser.h"
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Get number of data bytes that follow a Midi status byte
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       
+*****************************************************************************/
+uint8_t midi_parser_get_data_length(uint8_t status)
+{
+    if (status < 0xF0)
+    {
+        switch (status & 0xF0)
+        {
+            case 0xC0:      // program change
+            case 0xD0:      // channel pressure
+            {
+                return 1;
+            } break;
+
+            default:
+            {
+                return 2;
+            } break;
+        }
+    }
+    else
+    {
+        switch (status)
+        {
+            case 0xF1:      // MTC quarter frame
+            case 0xF3:      // song select
+            {
+                return 1;
+            } break;
+
+            case 0xF2:      // song position
+            {
+                return 2;
+            } break;
+
+            default:
+            {
+                // tune request, sysex end, real time
+                return 0;
+            } break;
+        }
+    }
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Decode a BLE Midi packet, which may hold multiple messages
+* PARAMETERS:  data: packet payload
+*              length: payload length
+*              callback: called for each complete message
+*              context: passed to callback
+* RETURN:      number of messages decoded
+* NOTES:       Packet is: header (10tttttt), then per message a timestamp
+*              byte (1ttttttt), status and data. Running status may omit 
+*              the status byte, and optionally the timestamp byte too.
+*              A timestamp and real time byte may split a message.
+*              Sysex payloads are skipped, including packets that only
+*              continue one. Low timestamp wrap increments the high bits,
+*              per the BLE Midi spec
+*****************************************************************************/
+uint16_t midi_parser_decode_ble_packet(const uint8_t* data, uint16_t length, midi_parser_message_callback_t callback, void* context)
+{
+    tMidiMessage message = {0};
+    tMidiMessage real_time = {0};
+    uint16_t decoded = 0;
+    uint16_t index = 1;
+    uint16_t timestamp = 0;
+    uint8_t timestamp_high;
+    uint8_t timestamp_low = 0;
+    uint8_t running_status = 0;
+    uint8_t data_needed = 0;
+    uint8_t timestamp_valid = 0;
+    uint8_t status_expected = 0;
+    uint8_t in_sysex = 0;
+    uint8_t byte;
+
+    // header byte has bit 7 set, bit 6 clear
+    if ((data == NULL) || (length < 2) || ((data[0] & 0xC0) != 0x80))
+    {
+        return 0;
+    }
+
+    timestamp_high = data[0] & 0x3F;
+
+    // no timestamp after the header, the packet continues a sysex
+    if ((data[1] & 0x80) == 0)
+    {
+        in_sysex = 1;
+    }
+
+    while (index < length)
+    {
+        byte = data[index++];
+
+        if (byte & 0x80)
+        {
+            if (!status_expected)
+            {
+                // timestamp byte. If lower 7 bits went backwards, the high bits roll over
+                if (timestamp_valid && ((byte & 0x7F) < timestamp_low))
+                {
+                    timestamp_high = (timestamp_high + 1) & 0x3F;
+                }
+
+                timestamp_low = byte & 0x7F;
+                timestamp_valid = 1;
+                timestamp = ((uint16_t)timestamp_high << 7) | timestamp_low;
+
+                // a partial message carries on after a real time byte
+                status_expected = 1;
+                continue;
+            }
+
+            // status byte
+            status_expected = 0;
+
+            if (byte >= 0xF8)
+            {
+                // real time, can appear anywhere and doesn't affect running status
+                real_time.timestamp = timestamp;
+                real_time.status = byte;
+                real_time.length = 0;
+                callback(&real_time, context);
+                decoded++;
+                continue;
+            }
+
+            if (in_sysex)
+            {
+                // F7 ends the sysex, any other status aborts it
+                in_sysex = 0;
+
+                if (byte == 0xF7)
+                {
+                    continue;
+                }
+            }
+
+            if (byte == 0xF0)
+            {
+                in_sysex = 1;
+                running_status = 0;
+                continue;
+            }
+
+            // system common clears running status
+            running_status = (byte < 0xF0) ? byte : 0;
+
+            message.timestamp = timestamp;
+            message.status = byte;
+            message.length = 0;
+            data_needed = midi_parser_get_data_length(byte);
+
+            if (data_needed == 0)
+            {
+                callback(&message, context);
+                decoded++;
+            }
+        }
+        else
+        {
+            // data byte
+            status_expected = 0;
+
+            if (in_sysex)
+            {
+                continue;
+            }
+
+            if (data_needed == 0)
+            {
+                // start of a running status message
+                if (running_status == 0)
+                {
+                    // nothing to apply it to
+                    continue;
+                }
+
+                message.timestamp = timestamp;
+                message.status = running_status;
+                message.length = 0;
+                data_needed = midi_parser_get_data_length(running_status);
+            }
+
+            message.data[message.length++] = byte;
+            data_needed--;
+
+            if (data_needed == 0)
+            {
+                callback(&message, context);
+                decoded++;
+            }
+        }
+    }
+
+    return decoded;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Feed one byte of a serial Midi stream into the parser
+* PARAMETERS:  parser: parser state, zero to init
+*              byte: received byte
+*              message: filled when a message completes
+* RETURN:      1 if message holds a complete message
+* NOTES:       Handles running status and real time bytes interleaved 
+*              within other messages. Sysex payloads are skipped
+*****************************************************************************/
+uint8_t midi_parser_parse_serial_byte(tMidiSerialParser* parser, uint8_t byte, tMidiMessage* message)
+{
+    if (byte >= 0xF8)
+    {
+        // real time, doesn't disturb a message in progress
+        message->status = byte;
+        message->length = 0;
+        return 1;
+    }
+
+    if (byte & 0x80)
+    {
+        parser->in_sysex = (byte == 0xF0);
+
+        // system common clears running status
+        parser->running_status = (byte < 0xF0) ? byte : 0;
+        parser->message.status = byte;
+        parser->message.length = 0;
+        parser->data_needed = midi_parser_get_data_length(byte);
+
+        if ((parser->data_needed == 0) && (byte != 0xF0) && (byte != 0xF7))
+        {
+            *message = parser->message;
+            return 1;
+        }
+
+        return 0;
+    }
+
+    // data byte
+    if (parser->in_sysex)
+    {
+        return 0;
+    }
+
+    if (parser->data_needed == 0)
+    {
+        if (parser->running_status == 0)
+        {
+            // no status to apply it to
+            return 0;
+        }
+
+        parser->message.status = parser->running_status;
+        parser->message.length = 0;
+        parser->data_needed = midi_parser_get_data_length(parser->running_status);
+    }
+
+    parser->message.data[parser->message.length++] = byte;
+    parser->data_needed--;
+
+    if (parser->data_needed == 0)
+    {
+        *message = parser->message;
+        return 1;
+    }
+
+    return 0;
+}
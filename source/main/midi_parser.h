@@ -0,0 +1,46 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ 
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// Midi byte stream parsing, for BLE Midi packets and serial Midi. No
+// hardware access
+
+typedef struct __attribute__ ((packed)) 
+{
+    uint16_t timestamp;     // 13 bit BLE Midi timestamp, milliseconds
+    uint8_t status;
+    uint8_t data[2];
+    uint8_t length;         // number of valid bytes in data
+} tMidiMessage;
+
+typedef void (*midi_parser_message_callback_t)(const tMidiMessage* message, void* context);
+
+uint16_t midi_parser_decode_ble_packet(const uint8_t* data, uint16_t length, midi_parser_message_callback_t callback, void* context);
+
+typedef struct
+{
+    tMidiMessage message;
+    uint8_t running_status;
+    uint8_t data_needed;
+    uint8_t in_sysex;
+} tMidiSerialParser;
+
+uint8_t midi_parser_parse_serial_byte(tMidiSerialParser* parser, uint8_t byte, tMidiMessage* message);
+uint8_t midi_parser_get_data_length(uint8_t status);
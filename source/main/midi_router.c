@@ -0,0 +1,884 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "control.h"
+#include "task_priorities.h"
+#include "midi_helper.h"
+#include "midi_clock.h"
+#include "midi_out.h"
+#include "midi_router.h"
+
+#define MIDI_ROUTER_TASK_STACK_SIZE         (3 * 1024)
+#define MIDI_ROUTER_QUEUE_SIZE              64          // per source, must be a power of 2
+#define MIDI_ROUTER_QUEUE_MASK              (MIDI_ROUTER_QUEUE_SIZE - 1)
+#define MIDI_ROUTER_PRESET_INTERVAL         200         // msec minimum between preset changes sent to the pedal
+#define MIDI_ROUTER_STATS_INTERVAL          60000       // msec between stats logging
+#define MIDI_ROUTER_NO_VALUE                0xFF
+#define MIDI_ROUTER_LSB_TIMEOUT             10          // msec to wait for a LSB before using the MSB alone
+#define MIDI_ROUTER_PENDING_WAIT            5           // msec task wait while a LSB is pending
+#define MIDI_ROUTER_PEDAL_QUEUE_SIZE        64          // pedal actions waiting, must be a power of 2
+#define MIDI_ROUTER_PEDAL_QUEUE_MASK        (MIDI_ROUTER_PEDAL_QUEUE_SIZE - 1)
+#define MIDI_ROUTER_ROUTE_ITEMS             (CONFIG_ITEM_MIDI_ROUTE2_SRC - CONFIG_ITEM_MIDI_ROUTE1_SRC)     // config items per user route
+
+_Static_assert((MIDI_ROUTER_FIRST_USER_ROUTE + MAX_MIDI_USER_ROUTES) <= MIDI_ROUTER_MAX_ROUTES, "MIDI_ROUTER_MAX_ROUTES too small");
+
+// control change numbers for NRPN/RPN
+#define MIDI_CC_DATA_ENTRY_MSB              6
+#define MIDI_CC_DATA_ENTRY_LSB              38
+#define MIDI_CC_NRPN_LSB                    98
+#define MIDI_CC_NRPN_MSB                    99
+#define MIDI_CC_RPN_LSB                     100
+#define MIDI_CC_RPN_MSB                     101
+#define MIDI_CC_14BIT_MSB_LAST              31          // 14 bit pairs are CC 0..31 with LSB on CC + 32
+#define MIDI_CC_14BIT_LSB_OFFSET            32
+
+enum MidiRouterParamSelect
+{
+    MIDI_ROUTER_SELECT_NONE,                // data entry goes to the CC table
+    MIDI_ROUTER_SELECT_NRPN,                // data entry goes to a TONEX_PARAM_ index
+    MIDI_ROUTER_SELECT_RPN                  // registered params not supported, data entry ignored
+};
+
+enum MidiRouterPedalActions
+{
+    MIDI_ROUTER_ACTION_PRESET,              // Value is the preset index
+    MIDI_ROUTER_ACTION_CC,                  // Number is the CC, Value its 7 bit value
+    MIDI_ROUTER_ACTION_PARAM_14BIT          // Number is the TONEX_PARAM_ index, Value 14 bits
+};
+
+static const char *TAG = "app_midi_router";
+
+typedef struct
+{
+    tMidiMessage Message;
+    int64_t Time;
+} tMidiRouterItem;
+
+// Single producer (the source's receive task), single consumer (router task).
+// Head is only written by the producer and Tail only by the router, so no lock is needed
+typedef struct
+{
+    tMidiRouterItem Items[MIDI_ROUTER_QUEUE_SIZE];
+    volatile uint16_t Head;
+    volatile uint16_t Tail;
+    tMidiRouterQueueStats Stats;
+} tMidiRouterQueue;
+
+// what the pedal is to be sent, in the order it arrived
+typedef struct
+{
+    uint8_t Type;                           // MIDI_ROUTER_ACTION_
+    uint16_t Number;
+    uint16_t Value;
+} tMidiRouterPedalAction;
+
+typedef struct
+{
+    TaskHandle_t Task;
+    tMidiRouterQueue Queues[MIDI_ROUTER_SOURCE_LAST];
+    tMidiRoute Routes[MIDI_ROUTER_MAX_ROUTES];
+    uint32_t RouteCount[MIDI_ROUTER_MAX_ROUTES];
+    tMidiRouterPedalAction PedalActions[MIDI_ROUTER_PEDAL_QUEUE_SIZE];
+    uint16_t PedalHead;                     // oldest action
+    uint16_t PedalCount;
+    uint32_t PedalDropped;
+    TickType_t LastPresetTick;
+} tMidiRouter;
+
+// NRPN and 14 bit control change state, per source as each is a separate Midi stream
+typedef struct
+{
+    uint8_t Select;
+    uint8_t SelectMSB;
+    uint8_t SelectLSB;
+    uint8_t DataMSB;
+    uint8_t DataMSBPending;
+    TickType_t DataMSBTick;
+    uint8_t CCMSBNum;                       // MIDI_ROUTER_NO_VALUE if none pending
+    uint8_t CCMSBValue;
+    TickType_t CCMSBTick;
+} tMidiRouterHighRes;
+
+static tMidiRouter MidiRouter;
+static tMidiRouterHighRes MidiRouterHighRes[MIDI_ROUTER_SOURCE_LAST];
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Get the type filter bit for a message
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static uint8_t midi_router_get_type(uint8_t status)
+{
+    if (status >= 0xF8)
+    {
+        return MIDI_ROUTER_TYPE_REALTIME;
+    }
+    else if (status >= 0xF0)
+    {
+        return MIDI_ROUTER_TYPE_SYSTEM;
+    }
+
+    switch (status & 0xF0)
+    {
+        case 0x80:
+        case 0x90:
+        case 0xA0:
+        {
+            return MIDI_ROUTER_TYPE_NOTE;
+        } break;
+
+        case 0xB0:
+        {
+            return MIDI_ROUTER_TYPE_CC;
+        } break;
+
+        case 0xC0:
+        {
+            return MIDI_ROUTER_TYPE_PC;
+        } break;
+
+        default:
+        {
+            return MIDI_ROUTER_TYPE_OTHER_CHANNEL;
+        } break;
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Add an action for the pedal
+* PARAMETERS:  type: MIDI_ROUTER_ACTION_
+* RETURN:
+* NOTES:       Kept in arrival order. Only a run of the same action with
+*              the same number is merged, so a burst of one CC or of
+*              preset changes sends just the latest value
+*****************************************************************************/
+static void midi_router_queue_action(uint8_t type, uint16_t number, uint16_t value)
+{
+    tMidiRouterPedalAction* action;
+
+    if (MidiRouter.PedalCount != 0)
+    {
+        action = &MidiRouter.PedalActions[(MidiRouter.PedalHead + MidiRouter.PedalCount - 1) & MIDI_ROUTER_PEDAL_QUEUE_MASK];
+
+        if ((action->Type == type) && ((type == MIDI_ROUTER_ACTION_PRESET) || (action->Number == number)))
+        {
+            action->Value = value;
+            return;
+        }
+    }
+
+    if (MidiRouter.PedalCount >= MIDI_ROUTER_PEDAL_QUEUE_SIZE)
+    {
+        MidiRouter.PedalDropped++;
+        return;
+    }
+
+    action = &MidiRouter.PedalActions[(MidiRouter.PedalHead + MidiRouter.PedalCount) & MIDI_ROUTER_PEDAL_QUEUE_MASK];
+    action->Type = type;
+    action->Number = number;
+    action->Value = value;
+    MidiRouter.PedalCount++;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Hold a 7 bit control change to send to the pedal
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void midi_router_queue_cc(uint8_t change_num, uint8_t value)
+{
+    midi_router_queue_action(MIDI_ROUTER_ACTION_CC, change_num, value);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Hold a 14 bit parameter write to send to the pedal
+* PARAMETERS:  param: TONEX_PARAM_ index
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void midi_router_queue_param_14bit(uint16_t param, uint16_t value)
+{
+    midi_router_queue_action(MIDI_ROUTER_ACTION_PARAM_14BIT, param, value);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Handle NRPN and 14 bit control change
+* PARAMETERS:  source: message source
+*              change_num: CC number
+*              value: CC value
+* RETURN:      1 if the message was used, 0 if it should go to the CC table
+* NOTES:       NRPN number is the TONEX_PARAM_ index. An MSB waits briefly
+*              for its LSB, so a pair gives one parameter write not two.
+*              Selecting another parameter sends a waiting MSB on its own.
+*              Data entry only goes to NRPN once one is selected, so the
+*              CC table use of CC 6 and 38 is unchanged otherwise
+*****************************************************************************/
+static uint8_t midi_router_handle_high_res(uint8_t source, uint8_t change_num, uint8_t value)
+{
+    tMidiRouterHighRes* high_res = &MidiRouterHighRes[source];
+
+    switch (change_num)
+    {
+        case MIDI_CC_NRPN_MSB:
+        case MIDI_CC_NRPN_LSB:
+        case MIDI_CC_RPN_MSB:
+        case MIDI_CC_RPN_LSB:
+        {
+            if (high_res->DataMSBPending)
+            {
+                // the old parameter won't get its LSB now, it gets the MSB on its own
+                high_res->DataMSBPending = 0;
+                midi_router_queue_param_14bit((high_res->SelectMSB << 7) | high_res->SelectLSB, high_res->DataMSB << 7);
+            }
+
+            if ((change_num == MIDI_CC_NRPN_MSB) || (change_num == MIDI_CC_RPN_MSB))
+            {
+                high_res->SelectMSB = value;
+            }
+            else
+            {
+                high_res->SelectLSB = value;
+            }
+
+            if ((high_res->SelectMSB == 127) && (high_res->SelectLSB == 127))
+            {
+                // null parameter, data entry goes back to the CC table
+                high_res->Select = MIDI_ROUTER_SELECT_NONE;
+            }
+            else if ((change_num == MIDI_CC_NRPN_MSB) || (change_num == MIDI_CC_NRPN_LSB))
+            {
+                high_res->Select = MIDI_ROUTER_SELECT_NRPN;
+            }
+            else
+            {
+                high_res->Select = MIDI_ROUTER_SELECT_RPN;
+            }
+            return 1;
+        } break;
+
+        case MIDI_CC_DATA_ENTRY_MSB:
+        {
+            if (high_res->Select == MIDI_ROUTER_SELECT_NONE)
+            {
+                break;
+            }
+
+            if (high_res->Select == MIDI_ROUTER_SELECT_NRPN)
+            {
+                // wait for the LSB
+                high_res->DataMSB = value;
+                high_res->DataMSBPending = 1;
+                high_res->DataMSBTick = xTaskGetTickCount();
+            }
+            return 1;
+        } break;
+
+        case MIDI_CC_DATA_ENTRY_LSB:
+        {
+            if (high_res->Select == MIDI_ROUTER_SELECT_NONE)
+            {
+                break;
+            }
+
+            if (high_res->Select == MIDI_ROUTER_SELECT_NRPN)
+            {
+                // LSB on its own is a fine adjust of the last MSB
+                high_res->DataMSBPending = 0;
+                midi_router_queue_param_14bit((high_res->SelectMSB << 7) | high_res->SelectLSB, (high_res->DataMSB << 7) | value);
+            }
+            return 1;
+        } break;
+    }
+
+#if CONFIG_TONEX_CONTROLLER_MIDI_14BIT_CC
+    if ((high_res->CCMSBNum != MIDI_ROUTER_NO_VALUE) && (change_num == (high_res->CCMSBNum + MIDI_CC_14BIT_LSB_OFFSET)))
+    {
+        // LSB completes the pending pair
+        uint16_t param = midi_helper_get_param_for_change_num(high_res->CCMSBNum);
+
+        if (param != 0xFFFF)
+        {
+            midi_router_queue_param_14bit(param, (high_res->CCMSBValue << 7) | value);
+        }
+
+        high_res->CCMSBNum = MIDI_ROUTER_NO_VALUE;
+        return 1;
+    }
+
+    if ((change_num <= MIDI_CC_14BIT_MSB_LAST) && (midi_helper_get_param_for_change_num(change_num) != 0xFFFF))
+    {
+        // a different pending MSB won't get its LSB now
+        if (high_res->CCMSBNum != MIDI_ROUTER_NO_VALUE)
+        {
+            midi_router_queue_cc(high_res->CCMSBNum, high_res->CCMSBValue);
+        }
+
+        // possible 14 bit MSB, wait for the LSB
+        high_res->CCMSBNum = change_num;
+        high_res->CCMSBValue = value;
+        high_res->CCMSBTick = xTaskGetTickCount();
+        return 1;
+    }
+#endif
+
+    return 0;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Send any MSB whose LSB didn't arrive in time
+* PARAMETERS:
+* RETURN:      1 if any are still waiting
+* NOTES:
+*****************************************************************************/
+static uint8_t midi_router_check_lsb_timeout(void)
+{
+    tMidiRouterHighRes* high_res;
+    uint8_t waiting = 0;
+
+    for (uint8_t source = 0; source < MIDI_ROUTER_SOURCE_LAST; source++)
+    {
+        high_res = &MidiRouterHighRes[source];
+
+        if (high_res->DataMSBPending)
+        {
+            if ((xTaskGetTickCount() - high_res->DataMSBTick) >= pdMS_TO_TICKS(MIDI_ROUTER_LSB_TIMEOUT))
+            {
+                high_res->DataMSBPending = 0;
+                midi_router_queue_param_14bit((high_res->SelectMSB << 7) | high_res->SelectLSB, high_res->DataMSB << 7);
+            }
+            else
+            {
+                waiting = 1;
+            }
+        }
+
+        if (high_res->CCMSBNum != MIDI_ROUTER_NO_VALUE)
+        {
+            if ((xTaskGetTickCount() - high_res->CCMSBTick) >= pdMS_TO_TICKS(MIDI_ROUTER_LSB_TIMEOUT))
+            {
+                // plain 7 bit control change
+                midi_router_queue_cc(high_res->CCMSBNum, high_res->CCMSBValue);
+                high_res->CCMSBNum = MIDI_ROUTER_NO_VALUE;
+            }
+            else
+            {
+                waiting = 1;
+            }
+        }
+    }
+
+    return waiting;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Queue any MSB from a source that is still waiting for its LSB
+* PARAMETERS:
+* RETURN:
+* NOTES:       Another message came first, so the LSB isn't coming and the
+*              MSB must go ahead of that message
+*****************************************************************************/
+static void midi_router_release_msb(uint8_t source)
+{
+    tMidiRouterHighRes* high_res = &MidiRouterHighRes[source];
+
+    if (high_res->DataMSBPending)
+    {
+        high_res->DataMSBPending = 0;
+        midi_router_queue_param_14bit((high_res->SelectMSB << 7) | high_res->SelectLSB, high_res->DataMSB << 7);
+    }
+
+    if (high_res->CCMSBNum != MIDI_ROUTER_NO_VALUE)
+    {
+        midi_router_queue_cc(high_res->CCMSBNum, high_res->CCMSBValue);
+        high_res->CCMSBNum = MIDI_ROUTER_NO_VALUE;
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Apply a message to the pedal
+* PARAMETERS:
+* RETURN:
+* NOTES:       Preset changes and control changes are queued in order, so
+*              a burst only sends the latest value
+*****************************************************************************/
+static void midi_router_dispatch_pedal(uint8_t source, const tMidiRouterItem* item)
+{
+    switch (midi_router_get_type(item->Message.status))
+    {
+        case MIDI_ROUTER_TYPE_PC:
+        {
+            midi_router_release_msb(source);
+            midi_router_queue_action(MIDI_ROUTER_ACTION_PRESET, 0, item->Message.data[0]);
+        } break;
+
+        case MIDI_ROUTER_TYPE_CC:
+        {
+            if (midi_router_handle_high_res(source, item->Message.data[0], item->Message.data[1]))
+            {
+                // used for NRPN or 14 bit
+                break;
+            }
+
+            midi_router_release_msb(source);
+            midi_router_queue_cc(item->Message.data[0], item->Message.data[1]);
+        } break;
+
+        case MIDI_ROUTER_TYPE_REALTIME:
+        {
+            // clock is time critical, handle straight away
+            midi_clock_handle_realtime(item->Message.status, item->Time);
+        } break;
+
+        default:
+        {
+            // not used by the pedal
+        } break;
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Send queued preset and control changes to the pedal
+* PARAMETERS:
+* RETURN:
+* NOTES:       In arrival order. A preset change too soon after the last
+*              one waits, and so does everything queued after it, so a
+*              change never lands on the wrong preset
+*****************************************************************************/
+static void midi_router_flush_pedal(void)
+{
+    tMidiRouterPedalAction* action;
+
+    while (MidiRouter.PedalCount != 0)
+    {
+        action = &MidiRouter.PedalActions[MidiRouter.PedalHead];
+
+        switch (action->Type)
+        {
+            case MIDI_ROUTER_ACTION_PRESET:
+            {
+                if ((xTaskGetTickCount() - MidiRouter.LastPresetTick) < pdMS_TO_TICKS(MIDI_ROUTER_PRESET_INTERVAL))
+                {
+                    // try again on the next pass
+                    return;
+                }
+
+                ESP_LOGI(TAG, "Change to preset %d", (int)action->Value);
+                control_request_preset_index(action->Value);
+                MidiRouter.LastPresetTick = xTaskGetTickCount();
+            } break;
+
+            case MIDI_ROUTER_ACTION_CC:
+            {
+                ESP_LOGI(TAG, "Midi CC change num: %d, value: %d", (int)action->Number, (int)action->Value);
+                midi_helper_adjust_param_via_midi(action->Number, action->Value);
+            } break;
+
+            case MIDI_ROUTER_ACTION_PARAM_14BIT:
+            default:
+            {
+                midi_helper_adjust_param_14bit(action->Number, action->Value);
+            } break;
+        }
+
+        MidiRouter.PedalHead = (MidiRouter.PedalHead + 1) & MIDI_ROUTER_PEDAL_QUEUE_MASK;
+        MidiRouter.PedalCount--;
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Route a message from a source to its destinations
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void midi_router_route(uint8_t source, const tMidiRouterItem* item)
+{
+    uint8_t type = midi_router_get_type(item->Message.status);
+    uint8_t destinations = 0;
+    uint8_t out_destinations = 0;
+    tMidiRoute* route;
+
+    for (uint8_t loop = 0; loop < MIDI_ROUTER_MAX_ROUTES; loop++)
+    {
+        route = &MidiRouter.Routes[loop];
+
+        if (!route->Enabled || !(route->SourceMask & MIDI_ROUTER_SOURCE_MASK(source)) || !(route->TypeMask & type))
+        {
+            continue;
+        }
+
+        // channel filter only applies to channel messages
+        if ((item->Message.status < 0xF0) && (route->Channel != MIDI_ROUTER_CHANNEL_ANY) && ((item->Message.status & 0x0F) != route->Channel))
+        {
+            continue;
+        }
+
+        MidiRouter.RouteCount[loop]++;
+
+        // merge destinations, so overlapping routes don't send twice
+        destinations |= route->Destinations;
+    }
+
+    if (destinations & MIDI_ROUTER_DEST_PEDAL)
+    {
+        midi_router_dispatch_pedal(source, item);
+    }
+
+    if (destinations & MIDI_ROUTER_DEST_SERIAL_OUT)
+    {
+        out_destinations |= MIDI_OUT_DEST_SERIAL;
+    }
+
+    if (destinations & MIDI_ROUTER_DEST_BLE_OUT)
+    {
+        out_destinations |= MIDI_OUT_DEST_BLE;
+    }
+
+    if (out_destinations != 0)
+    {
+        midi_out_send_message_to(out_destinations, item->Message.status, item->Message.data[0], item->Message.data[1]);
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION:
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void midi_router_log_stats(void)
+{
+    for (uint8_t loop = 0; loop < MIDI_ROUTER_SOURCE_LAST; loop++)
+    {
+        ESP_LOGI(TAG, "Source %d: received %d dropped %d high water %d", (int)loop, (int)MidiRouter.Queues[loop].Stats.Received,
+                 (int)MidiRouter.Queues[loop].Stats.Dropped, (int)MidiRouter.Queues[loop].Stats.HighWater);
+    }
+
+    if (MidiRouter.PedalDropped != 0)
+    {
+        ESP_LOGW(TAG, "Pedal actions dropped %d", (int)MidiRouter.PedalDropped);
+    }
+
+    for (uint8_t loop = 0; loop < MIDI_ROUTER_MAX_ROUTES; loop++)
+    {
+        if (MidiRouter.Routes[loop].Enabled)
+        {
+            ESP_LOGI(TAG, "Route %d: %d messages", (int)loop, (int)MidiRouter.RouteCount[loop]);
+        }
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION:
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void midi_router_task(void *arg)
+{
+    tMidiRouterQueue* queue;
+    tMidiRouterItem item;
+    uint16_t tail;
+    uint8_t busy;
+    uint8_t lsb_waiting = 0;
+    TickType_t stats_tick = xTaskGetTickCount();
+
+    ESP_LOGI(TAG, "Midi Router task start");
+
+    while (1)
+    {
+        // sources notify when they queue something. Timeout lets pending presets and MSBs go out
+        ulTaskNotifyTake(pdTRUE, lsb_waiting ? pdMS_TO_TICKS(MIDI_ROUTER_PENDING_WAIT) : pdMS_TO_TICKS(20));
+
+        // take one message from each source in turn, so one busy source can't starve the others
+        do
+        {
+            busy = 0;
+
+            for (uint8_t source = 0; source < MIDI_ROUTER_SOURCE_LAST; source++)
+            {
+                queue = &MidiRouter.Queues[source];
+                tail = queue->Tail;
+
+                if (tail != __atomic_load_n(&queue->Head, __ATOMIC_ACQUIRE))
+                {
+                    memcpy((void*)&item, (void*)&queue->Items[tail], sizeof(item));
+                    __atomic_store_n(&queue->Tail, (tail + 1) & MIDI_ROUTER_QUEUE_MASK, __ATOMIC_RELEASE);
+
+                    midi_router_route(source, &item);
+                    busy = 1;
+                }
+            }
+        } while (busy);
+
+        lsb_waiting = midi_router_check_lsb_timeout();
+        midi_router_flush_pedal();
+
+        if ((xTaskGetTickCount() - stats_tick) >= pdMS_TO_TICKS(MIDI_ROUTER_STATS_INTERVAL))
+        {
+            stats_tick = xTaskGetTickCount();
+            midi_router_log_stats();
+        }
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Queue a received Midi message for routing
+* PARAMETERS:  source: MIDI_ROUTER_SOURCE_
+*              message: received message
+*              time_us: esp_timer time the message arrived
+* RETURN:
+* NOTES:       Each source must only call this from one task. Doesn't block
+*****************************************************************************/
+esp_err_t midi_router_receive(uint8_t source, const tMidiMessage* message, int64_t time_us)
+{
+    tMidiRouterQueue* queue;
+    uint16_t head;
+    uint16_t next;
+    uint16_t used;
+
+    if ((MidiRouter.Task == NULL) || (source >= MIDI_ROUTER_SOURCE_LAST))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    queue = &MidiRouter.Queues[source];
+    head = queue->Head;
+    next = (head + 1) & MIDI_ROUTER_QUEUE_MASK;
+
+    if (next == __atomic_load_n(&queue->Tail, __ATOMIC_ACQUIRE))
+    {
+        queue->Stats.Dropped++;
+        return ESP_FAIL;
+    }
+
+    memcpy((void*)&queue->Items[head].Message, (void*)message, sizeof(tMidiMessage));
+    queue->Items[head].Time = time_us;
+    __atomic_store_n(&queue->Head, next, __ATOMIC_RELEASE);
+
+    queue->Stats.Received++;
+    used = (next - queue->Tail) & MIDI_ROUTER_QUEUE_MASK;
+    if (used > queue->Stats.HighWater)
+    {
+        queue->Stats.HighWater = used;
+    }
+
+    xTaskNotifyGive(MidiRouter.Task);
+
+    return ESP_OK;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Set up a route
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+esp_err_t midi_router_set_route(uint8_t index, const tMidiRoute* route)
+{
+    if (index >= MIDI_ROUTER_MAX_ROUTES)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // disable while updating, as the router may be using it
+    MidiRouter.Routes[index].Enabled = 0;
+    MidiRouter.Routes[index].SourceMask = route->SourceMask;
+    MidiRouter.Routes[index].Destinations = route->Destinations;
+    MidiRouter.Routes[index].Channel = route->Channel;
+    MidiRouter.Routes[index].TypeMask = route->TypeMask;
+    MidiRouter.RouteCount[index] = 0;
+    MidiRouter.Routes[index].Enabled = route->Enabled;
+
+    return ESP_OK;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION:
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+esp_err_t midi_router_get_queue_stats(uint8_t source, tMidiRouterQueueStats* stats)
+{
+    if (source >= MIDI_ROUTER_SOURCE_LAST)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memcpy((void*)stats, (void*)&MidiRouter.Queues[source].Stats, sizeof(tMidiRouterQueueStats));
+    return ESP_OK;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION:
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+uint32_t midi_router_get_route_count(uint8_t index)
+{
+    if (index >= MIDI_ROUTER_MAX_ROUTES)
+    {
+        return 0;
+    }
+
+    return MidiRouter.RouteCount[index];
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Set up the routes to the pedal from config
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void midi_router_set_pedal_routes(void)
+{
+    tMidiRoute route;
+    uint8_t channel;
+
+    // get the channel to use, adjusted to zero based
+    channel = control_get_config_item_int(CONFIG_ITEM_MIDI_CHANNEL);
+    if (channel > 0)
+    {
+        channel--;
+    }
+
+    // serial and BLE peripheral to pedal
+    route.Enabled = 1;
+    route.SourceMask = MIDI_ROUTER_SOURCE_MASK(MIDI_ROUTER_SOURCE_SERIAL) | MIDI_ROUTER_SOURCE_MASK(MIDI_ROUTER_SOURCE_BLE_PERIPHERAL);
+    route.Destinations = MIDI_ROUTER_DEST_PEDAL;
+    route.Channel = channel;
+    route.TypeMask = MIDI_ROUTER_TYPE_PC | MIDI_ROUTER_TYPE_CC | MIDI_ROUTER_TYPE_REALTIME;
+    midi_router_set_route(0, &route);
+
+    // BLE central to pedal. Control change is optional, as the MVave chocolate
+    // sends control change for bank up/down, which would modify a different parameter
+    route.SourceMask = MIDI_ROUTER_SOURCE_MASK(MIDI_ROUTER_SOURCE_BLE_CENTRAL);
+    route.TypeMask = MIDI_ROUTER_TYPE_PC | MIDI_ROUTER_TYPE_REALTIME;
+    if (control_get_config_item_int(CONFIG_ITEM_ENABLE_BT_MIDI_CC))
+    {
+        route.TypeMask |= MIDI_ROUTER_TYPE_CC;
+    }
+    midi_router_set_route(1, &route);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Set up the user routes from config
+* PARAMETERS:
+* RETURN:
+* NOTES:       A route is off until it has both a source and a destination
+*****************************************************************************/
+static void midi_router_set_user_routes(void)
+{
+    tMidiRoute route;
+    uint8_t channel;
+
+    for (uint8_t loop = 0; loop < MAX_MIDI_USER_ROUTES; loop++)
+    {
+        route.SourceMask = control_get_config_item_int(CONFIG_ITEM_MIDI_ROUTE1_SRC + (loop * MIDI_ROUTER_ROUTE_ITEMS));
+        route.Destinations = control_get_config_item_int(CONFIG_ITEM_MIDI_ROUTE1_DST + (loop * MIDI_ROUTER_ROUTE_ITEMS));
+        route.TypeMask = control_get_config_item_int(CONFIG_ITEM_MIDI_ROUTE1_TYPE + (loop * MIDI_ROUTER_ROUTE_ITEMS));
+        route.Enabled = (route.SourceMask != 0) && (route.Destinations != 0);
+
+        // config is 1 to 16 or 0 for any, adjust to zero based
+        channel = control_get_config_item_int(CONFIG_ITEM_MIDI_ROUTE1_CH + (loop * MIDI_ROUTER_ROUTE_ITEMS));
+        route.Channel = (channel == 0) ? MIDI_ROUTER_CHANNEL_ANY : (channel - 1);
+
+        midi_router_set_route(MIDI_ROUTER_FIRST_USER_ROUTE + loop, &route);
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Midi channel or BT CC config changed
+* PARAMETERS:
+* RETURN:
+* NOTES:       Called from the control task
+*****************************************************************************/
+static void midi_router_config_changed(uint64_t changed)
+{
+    midi_router_set_pedal_routes();
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: User route config changed
+* PARAMETERS:
+* RETURN:
+* NOTES:       Called from the control task
+*****************************************************************************/
+static void midi_router_routes_changed(uint64_t changed)
+{
+    midi_router_set_user_routes();
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION:
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+void midi_router_init(void)
+{
+    memset((void*)&MidiRouter, 0, sizeof(MidiRouter));
+    memset((void*)MidiRouterHighRes, 0, sizeof(MidiRouterHighRes));
+
+    for (uint8_t loop = 0; loop < MIDI_ROUTER_SOURCE_LAST; loop++)
+    {
+        MidiRouterHighRes[loop].CCMSBNum = MIDI_ROUTER_NO_VALUE;
+        MidiRouterHighRes[loop].SelectMSB = 127;
+        MidiRouterHighRes[loop].SelectLSB = 127;
+    }
+
+    midi_router_set_pedal_routes();
+    control_register_config_handler(CONFIG_ITEM_MASK(CONFIG_ITEM_MIDI_CHANNEL) | CONFIG_ITEM_MASK(CONFIG_ITEM_ENABLE_BT_MIDI_CC), midi_router_config_changed);
+
+    midi_router_set_user_routes();
+    control_register_config_handler(CONFIG_ITEM_RANGE_MASK(CONFIG_ITEM_MIDI_ROUTE1_SRC, CONFIG_ITEM_MIDI_ROUTE4_TYPE), midi_router_routes_changed);
+
+    xTaskCreatePinnedToCore(midi_router_task, "MIDIR", MIDI_ROUTER_TASK_STACK_SIZE, NULL, MIDI_ROUTER_TASK_PRIORITY, &MidiRouter.Task, 1);
+}
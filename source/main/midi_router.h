@@ -0,0 +1,71 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#pragma once
+
+// Midi sources
+enum MidiRouterSources
+{
+    MIDI_ROUTER_SOURCE_SERIAL,
+    MIDI_ROUTER_SOURCE_BLE_CENTRAL,         // we are central, message from a connected controller
+    MIDI_ROUTER_SOURCE_BLE_PERIPHERAL,      // we are peripheral, message written by a host
+    MIDI_ROUTER_SOURCE_LAST
+};
+
+#define MIDI_ROUTER_SOURCE_MASK(x)          (1 << (x))
+#define MIDI_ROUTER_SOURCE_MASK_ALL         ((1 << MIDI_ROUTER_SOURCE_LAST) - 1)
+
+// Midi destinations
+#define MIDI_ROUTER_DEST_PEDAL              (1 << 0)
+#define MIDI_ROUTER_DEST_SERIAL_OUT         (1 << 1)
+#define MIDI_ROUTER_DEST_BLE_OUT            (1 << 2)
+#define MIDI_ROUTER_DEST_ALL                0x07
+
+// message type filter
+#define MIDI_ROUTER_TYPE_NOTE               (1 << 0)        // note on/off, poly pressure
+#define MIDI_ROUTER_TYPE_CC                 (1 << 1)
+#define MIDI_ROUTER_TYPE_PC                 (1 << 2)
+#define MIDI_ROUTER_TYPE_OTHER_CHANNEL      (1 << 3)        // channel pressure, pitch bend
+#define MIDI_ROUTER_TYPE_SYSTEM             (1 << 4)        // system common
+#define MIDI_ROUTER_TYPE_REALTIME           (1 << 5)        // clock, start, stop etc
+#define MIDI_ROUTER_TYPE_ALL                0x3F
+
+#define MIDI_ROUTER_CHANNEL_ANY             0xFF
+#define MIDI_ROUTER_MAX_ROUTES              6
+#define MIDI_ROUTER_FIRST_USER_ROUTE        2           // 0 and 1 are the pedal routes
+
+typedef struct
+{
+    uint8_t Enabled;
+    uint8_t SourceMask;         // MIDI_ROUTER_SOURCE_MASK() bits
+    uint8_t Destinations;       // MIDI_ROUTER_DEST_ bits
+    uint8_t Channel;            // 0 based, or MIDI_ROUTER_CHANNEL_ANY. Channel messages only
+    uint8_t TypeMask;           // MIDI_ROUTER_TYPE_ bits
+} tMidiRoute;
+
+typedef struct
+{
+    uint32_t Received;
+    uint32_t Dropped;
+    uint16_t HighWater;
+} tMidiRouterQueueStats;
+
+void midi_router_init(void);
+esp_err_t midi_router_receive(uint8_t source, const tMidiMessage* message, int64_t time_us);
+esp_err_t midi_router_set_route(uint8_t index, const tMidiRoute* route);
+esp_err_t midi_router_get_queue_stats(uint8_t source, tMidiRouterQueueStats* stats);
+uint32_t midi_router_get_route_count(uint8_t index);
@@ -38,37 +38,21 @@ limitations under the License.
 #include "control.h"
 #include "task_priorities.h"
 #include "midi_helper.h"
+#include "midi_router.h"
 
 #define MIDI_SERIAL_TASK_STACK_SIZE             (3 * 1024)
 #define MIDI_SERIAL_BUFFER_SIZE                 128
 
 #define UART_PORT_NUM                           UART_NUM_1
+#define MIDI_SERIAL_BYTE_TIME                   320         // usec per byte at 31250 baud
 
 static const char *TAG = "app_midi_serial";
 
 // Note: based on https://github.com/vit3k/tonex_controller/blob/main/main/midi.cpp
 
 static uint8_t midi_serial_buffer[MIDI_SERIAL_BUFFER_SIZE];
-static uint8_t midi_serial_channel = 0;
-
-/****************************************************************************
-* NAME:        
-* DESCRIPTION: 
-* PARAMETERS:  
-* RETURN:      
-* NOTES:       
-*****************************************************************************/
-static void midi_serial_uart_rx_purge(void)
-{
-    int length = 0;
-    uart_get_buffered_data_len(UART_PORT_NUM, (size_t*)&length);
-
-    if (length != 0)
-    {
-        // read and discard remaining data
-        uart_read_bytes(UART_PORT_NUM, midi_serial_buffer, length, pdMS_TO_TICKS(1));
-    }
-}
+static tMidiSerialParser midi_serial_parser;
+static volatile uint8_t midi_serial_uart_ready = 0;    // set once by init, read from other tasks
 
 /****************************************************************************
 * NAME:        
@@ -80,6 +64,9 @@ static void midi_serial_uart_rx_purge(void)
 static void midi_serial_task(void *arg)
 {
     int rx_length;
+    size_t buffered_length;
+    int64_t rx_time;
+    tMidiMessage message;
 
     ESP_LOGI(TAG, "Midi Serial task start");
 
@@ -97,110 +84,62 @@ static void midi_serial_task(void *arg)
     ESP_ERROR_CHECK(uart_driver_install(UART_PORT_NUM, MIDI_SERIAL_BUFFER_SIZE * 2, 0, 0, NULL, intr_alloc_flags));
     ESP_ERROR_CHECK(uart_param_config(UART_PORT_NUM, &uart_config));
     ESP_ERROR_CHECK(uart_set_pin(UART_PORT_NUM, UART_TX_PIN, UART_RX_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+    midi_serial_uart_ready = 1;
 
     while (1) 
     {
-        // try to read data from UART
-        rx_length = uart_read_bytes(UART_PORT_NUM, midi_serial_buffer, (MIDI_SERIAL_BUFFER_SIZE - 1), pdMS_TO_TICKS(20));
+        // wait for the first byte, then take whatever else arrived with it.
+        // Returning as soon as data arrives keeps the receive time accurate for Midi clock
+        rx_length = uart_read_bytes(UART_PORT_NUM, midi_serial_buffer, 1, pdMS_TO_TICKS(20));
         
-        if (rx_length != 0)
+        if (rx_length > 0)
         {
-            // ESP_LOG_BUFFER_HEXDUMP(TAG, data, rx_length, ESP_LOG_INFO);
-            ESP_LOGI(TAG, "Midi Serial Got %d bytes", rx_length);
+            rx_time = esp_timer_get_time();
 
-            for (size_t i = 0; i < rx_length; i++)
+            if ((uart_get_buffered_data_len(UART_PORT_NUM, &buffered_length) == ESP_OK) && (buffered_length > 0))
             {
-                // Skip real-time messages (status bytes 0xF8 to 0xFF)
-                if (midi_serial_buffer[i] >= 0xF8)
-                {
-                    continue;
-                }
+                buffered_length = MIN(buffered_length, (MIDI_SERIAL_BUFFER_SIZE - 2));
+                rx_length += uart_read_bytes(UART_PORT_NUM, &midi_serial_buffer[1], buffered_length, 0);
+            }
 
-                // get the channel
-                uint8_t channel = midi_serial_buffer[i] & 0x0F;
+            // ESP_LOG_BUFFER_HEXDUMP(TAG, data, rx_length, ESP_LOG_INFO);
+            ESP_LOGD(TAG, "Midi Serial Got %d bytes", rx_length);
 
-                // check the command
-                switch (midi_serial_buffer[i] & 0xF0)
+            for (size_t i = 0; i < rx_length; i++)
+            {
+                if (midi_parser_parse_serial_byte(&midi_serial_parser, midi_serial_buffer[i], &message))
                 {
-                    case 0xC0:
-                    {                        
-                        // Program Change
-                        // Ensure there's a data byte following the status byte
-                        if ((i + 1) < MIDI_SERIAL_BUFFER_SIZE)
-                        {
-                            uint8_t programNumber = midi_serial_buffer[i + 1];
-
-                            if (channel == midi_serial_channel)
-                            {
-                                ESP_LOGI(TAG, "Change to preset %d", programNumber);
-
-                                // change to this preset
-                                control_request_preset_index(programNumber);
-
-                                // apply some rate limiting, so the message queue doesn't fill if we get spammed hard 
-                                vTaskDelay(pdMS_TO_TICKS(200));
-
-                                // purge uart rx so we don'tr get swamped if rapid changes arrive
-                                midi_serial_uart_rx_purge();
-                            }
-                            
-                            // Skip the data byte
-                            i++;
-                        }
-                        else
-                        { 
-                            ESP_LOGW(TAG, "Warning: Incomplete Program Change message at end of buffer");
-                            break;
-                        }   
-                    } break;
-
-                    case  0xB0:
-                    {   
-                        // control change
-                        // Ensure there's a data byte following the status byte
-                        if ((i + 1) < MIDI_SERIAL_BUFFER_SIZE)
-                        {
-                            uint8_t change_num = midi_serial_buffer[i + 1];
-                            uint8_t value = midi_serial_buffer[i + 2];
-
-                            ESP_LOGI(TAG, "Midi CC change num: %d, value: %d", change_num, value);
-
-                            if (channel == midi_serial_channel)
-                            {
-                                midi_helper_adjust_param_via_midi(change_num, value);
-
-                                // apply some rate limiting, so the message queue doesn't fill if we get spammed hard 
-                                vTaskDelay(pdMS_TO_TICKS(200));
-
-                                // purge uart rx so we don'tr get swamped if rapid changes arrive
-                                midi_serial_uart_rx_purge();
-                            }
-                        }
-                        else
-                        { 
-                            ESP_LOGW(TAG, "Warning: Incomplete Control Change message at end of buffer");
-                            break;
-                        }    
-                    } break;        
-                
-                    case 0x80:
-                    {
-                        // This is a status byte for a different type of message
-                        // Skip this message by finding the next status byte or end of buffer
-                        while ((++i < MIDI_SERIAL_BUFFER_SIZE) && !(midi_serial_buffer[i] & 0x80))
-                        {
-                        }
-                        i--; // Decrement i because the for loop will increment it again
-                    } break;
+                    // estimate when this byte arrived, from its position in the read
+                    midi_router_receive(MIDI_ROUTER_SOURCE_SERIAL, &message, rx_time - ((rx_length - 1 - i) * MIDI_SERIAL_BYTE_TIME));
                 }
             }
-
-            // don't hog the CPU
-            vTaskDelay(pdMS_TO_TICKS(5));
         }
     }
 }
 
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Write raw Midi bytes to the UART
+* PARAMETERS:  
+* RETURN:      
+* NOTES:       Blocks until the data is in the UART Tx FIFO
+*****************************************************************************/
+esp_err_t midi_serial_write(const uint8_t* data, uint16_t length)
+{
+    if (!midi_serial_uart_ready)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (uart_write_bytes(UART_PORT_NUM, (const void*)data, length) != length)
+    {
+        ESP_LOGW(TAG, "Midi Serial write failed");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
 /****************************************************************************
 * NAME:        
 * DESCRIPTION: 
@@ -211,15 +150,7 @@ static void midi_serial_task(void *arg)
 void midi_serial_init(void)
 {	
     memset((void*)midi_serial_buffer, 0, sizeof(midi_serial_buffer));
-
-    // get the channel to use
-    midi_serial_channel = control_get_config_item_int(CONFIG_ITEM_MIDI_CHANNEL);
-
-    // adjust to zero based indexing
-    if (midi_serial_channel > 0)
-    {
-        midi_serial_channel--;
-    }
+    memset((void*)&midi_serial_parser, 0, sizeof(midi_serial_parser));
 
     xTaskCreatePinnedToCore(midi_serial_task, "MIDIS", MIDI_SERIAL_TASK_STACK_SIZE, NULL, MIDI_SERIAL_TASK_PRIORITY, NULL, 1);
 }
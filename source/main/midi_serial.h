@@ -23,6 +23,7 @@ extern "C" {
 #endif
 
 void midi_serial_init(void);
+esp_err_t midi_serial_write(const uint8_t* data, uint16_t length);
 
 #ifdef __cplusplus
 } /*extern "C"*/
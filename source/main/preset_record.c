@@ -0,0 +1,101 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ 
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include "preset_record.h"
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Encode a preset as tag, length, value fields
+* PARAMETERS:  description_size: size of the description buffer, at most 256
+*              record: PRESET_RECORD_SIZE(description_size) buffer
+* RETURN:      record length
+* NOTES:
+*****************************************************************************/
+size_t preset_record_encode(uint16_t skin_index, const char* description, size_t description_size, uint8_t* record)
+{
+    size_t length = 0;
+    size_t text_length = strnlen(description, description_size - 1);
+
+    record[length++] = PRESET_TAG_SKIN;
+    record[length++] = sizeof(uint16_t);
+    record[length++] = skin_index & 0xFF;
+    record[length++] = skin_index >> 8;
+
+    record[length++] = PRESET_TAG_DESCRIPTION;
+    record[length++] = (uint8_t)text_length;
+    memcpy((void*)&record[length], (void*)description, text_length);
+    length += text_length;
+
+    return length;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Decode a preset record
+* PARAMETERS:  description_size: size of the description buffer
+* RETURN:      1 if OK, 0 if the record was truncated
+* NOTES:       Fields not in the record keep their current value
+*****************************************************************************/
+uint8_t preset_record_decode(const uint8_t* record, size_t length, uint16_t* skin_index, char* description, size_t description_size)
+{
+    size_t pos = 0;
+    uint8_t tag;
+    uint8_t field_length;
+
+    while ((pos + 2) <= length)
+    {
+        tag = record[pos];
+        field_length = record[pos + 1];
+        pos += 2;
+
+        if ((pos + field_length) > length)
+        {
+            return 0;
+        }
+
+        switch (tag)
+        {
+            case PRESET_TAG_SKIN:
+            {
+                if (field_length == sizeof(uint16_t))
+                {
+                    *skin_index = record[pos] | (record[pos + 1] << 8);
+                }
+            } break;
+
+            case PRESET_TAG_DESCRIPTION:
+            {
+                if (field_length < description_size)
+                {
+                    memcpy((void*)description, (void*)&record[pos], field_length);
+                    description[field_length] = 0;
+                }
+            } break;
+
+            default:
+            {
+                // from a newer firmware, skip it
+            } break;
+        }
+
+        pos += field_length;
+    }
+
+    return 1;
+}
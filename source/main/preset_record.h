@@ -0,0 +1,36 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ 
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Preset records as stored in flash: tag, length, value fields so newer
+// firmware can add fields and older firmware skips them. No hardware access
+
+#define PRESET_RECORD_SIZE(text_size)   (2 + sizeof(uint16_t) + 2 + (text_size))
+
+// record tags. Never reuse a number, unknown tags are skipped on load
+enum PresetTags
+{
+    PRESET_TAG_SKIN = 1,                // uint16_t
+    PRESET_TAG_DESCRIPTION = 2,         // text, no terminator
+};
+
+size_t preset_record_encode(uint16_t skin_index, const char* description, size_t description_size, uint8_t* record);
+uint8_t preset_record_decode(const uint8_t* record, size_t length, uint16_t* skin_index, char* description, size_t description_size);
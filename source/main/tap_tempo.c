@@ -0,0 +1,150 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "tap_tempo.h"
+
+#define TAP_TEMPO_MIN_INTERVAL          200000      // usec, faster is a double hit (300 BPM)
+#define TAP_TEMPO_MAX_INTERVAL          2000000     // usec, slower starts over (30 BPM)
+#define TAP_TEMPO_MIN_INTERVALS         2           // before a tempo is reported, 3 taps
+#define TAP_TEMPO_OUTLIER_FRACTION      0.2f        // interval vs average that counts as a stray tap
+#define TAP_TEMPO_BPM_THRESHOLD         1.0f        // BPM change needed to report a new tempo
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Forget all taps and the tempo
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+void tap_tempo_reset(tTapTempo* tap)
+{
+    memset((void*)tap, 0, sizeof(tTapTempo));
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Add an interval to the window
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void tap_tempo_add(tTapTempo* tap, uint32_t interval)
+{
+    tap->Intervals[tap->Head] = interval;
+    tap->Head = (tap->Head + 1) % TAP_TEMPO_WINDOW;
+
+    if (tap->Count < TAP_TEMPO_WINDOW)
+    {
+        tap->Count++;
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Average interval in the window
+* PARAMETERS:
+* RETURN:      usec
+* NOTES:
+*****************************************************************************/
+static float tap_tempo_mean(const tTapTempo* tap)
+{
+    uint32_t sum = 0;
+
+    // order doesn't matter, so the whole used part of the buffer
+    for (uint8_t loop = 0; loop < tap->Count; loop++)
+    {
+        sum += tap->Intervals[loop];
+    }
+
+    return (float)sum / (float)tap->Count;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Register a tap
+* PARAMETERS:  time_us: esp_timer time of the press
+* RETURN:      1 if there is a new stable tempo, in tap->BPM
+* NOTES:       A single stray interval, like a missed or early tap, is
+*              dropped. Two matching ones in a row are taken as a new tempo
+*****************************************************************************/
+uint8_t tap_tempo_tap(tTapTempo* tap, int64_t time_us)
+{
+    int64_t gap = time_us - tap->LastTap;
+    uint32_t interval;
+    float mean;
+
+    if ((tap->LastTap == 0) || (gap <= 0) || (gap > TAP_TEMPO_MAX_INTERVAL))
+    {
+        // first tap, or too long since the last. Start over
+        tap->LastTap = time_us;
+        tap->Count = 0;
+        tap->Head = 0;
+        tap->Outlier = 0;
+        return 0;
+    }
+
+    if (gap < TAP_TEMPO_MIN_INTERVAL)
+    {
+        // ignore it altogether
+        return 0;
+    }
+
+    tap->LastTap = time_us;
+    interval = (uint32_t)gap;
+
+    if (tap->Count >= TAP_TEMPO_MIN_INTERVALS)
+    {
+        mean = tap_tempo_mean(tap);
+
+        if (fabsf((float)interval - mean) > (mean * TAP_TEMPO_OUTLIER_FRACTION))
+        {
+            // stray unless it agrees with the previous stray
+            if ((tap->Outlier == 0) || (fabsf((float)interval - (float)tap->Outlier) > ((float)tap->Outlier * TAP_TEMPO_OUTLIER_FRACTION)))
+            {
+                tap->Outlier = interval;
+                return 0;
+            }
+
+            // changed tempo, the window restarts with both new intervals
+            tap->Count = 0;
+            tap->Head = 0;
+            tap_tempo_add(tap, tap->Outlier);
+        }
+    }
+
+    tap->Outlier = 0;
+    tap_tempo_add(tap, interval);
+
+    if (tap->Count < TAP_TEMPO_MIN_INTERVALS)
+    {
+        return 0;
+    }
+
+    tap->BPM = 60000000.0f / tap_tempo_mean(tap);
+
+    // only once per tempo, not on every tap at the same tempo
+    if (fabsf(tap->BPM - tap->PushedBPM) < TAP_TEMPO_BPM_THRESHOLD)
+    {
+        return 0;
+    }
+
+    tap->PushedBPM = tap->BPM;
+    return 1;
+}
@@ -0,0 +1,39 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// Tap tempo from footswitch press times. No hardware access, the caller
+// supplies the time of each tap
+
+#define TAP_TEMPO_WINDOW                6           // intervals averaged
+
+typedef struct
+{
+    int64_t LastTap;                    // usec, 0 before the first tap
+    uint32_t Intervals[TAP_TEMPO_WINDOW];   // circular buffer, usec
+    uint8_t Head;
+    uint8_t Count;
+    uint32_t Outlier;                   // last rejected interval, 0 if none
+    float BPM;                          // current tempo, 0 if not known
+    float PushedBPM;                    // tempo last reported as changed
+} tTapTempo;
+
+void tap_tempo_reset(tTapTempo* tap);
+uint8_t tap_tempo_tap(tTapTempo* tap, int64_t time_us);
@@ -24,11 +24,16 @@ extern "C" {
 #endif
 
 #define USB_DAEMON_TASK_PRIORITY        (tskIDLE_PRIORITY + 4)
+#define I2C_SCHEDULER_TASK_PRIORITY     (tskIDLE_PRIORITY + 3)
 #define USB_CLASS_TASK_PRIORITY         (tskIDLE_PRIORITY + 4)
 #define DISPLAY_TASK_PRIORITY           (tskIDLE_PRIORITY + 2)
 #define CTRL_TASK_PRIORITY              (tskIDLE_PRIORITY + 3)
 #define MIDI_SERIAL_TASK_PRIORITY       (tskIDLE_PRIORITY + 2)
+#define MIDI_OUT_TASK_PRIORITY          (tskIDLE_PRIORITY + 2)
+#define MIDI_ROUTER_TASK_PRIORITY       (tskIDLE_PRIORITY + 2)
 #define FOOTSWITCH_TASK_PRIORITY        (tskIDLE_PRIORITY + 1)
+#define EXPRESSION_TASK_PRIORITY        (tskIDLE_PRIORITY + 1)
+#define LED_TASK_PRIORITY               (tskIDLE_PRIORITY + 1)
 #define WIFI_TASK_PRIORITY              (tskIDLE_PRIORITY + 1)
 
 #ifdef __cplusplus
@@ -60,6 +60,8 @@ limitations under the License.
 #include "display.h"
 #include "wifi_config.h"
 #include "tonex_params.h"
+#include "midi_out.h"
+#include "leds.h"
 
 static const char *TAG = "app_TonexOne";
 
@@ -1127,6 +1129,12 @@ static esp_err_t usb_tonex_one_process_single_message(uint8_t* data, uint16_t le
                     // update web UI
                     wifi_request_sync(WIFI_SYNC_TYPE_PARAMS, NULL, NULL);
 
+                    // update Midi controllers
+                    midi_out_sync_params();
+
+                    // update footswitch leds
+                    leds_sync_params();
+
                     // debug dump parameters
                     //tonex_dump_parameters();
                 } break;
@@ -1249,6 +1257,8 @@ void usb_tonex_one_handle(class_driver_t* driver_obj)
                     {
                         usb_tonex_one_modify_parameter(message.Payload, message.PayloadFloat);
                         usb_tonex_one_send_single_parameter(message.Payload, message.PayloadFloat);
+                        midi_out_sync_params();
+                        leds_sync_params();
                     } break;
                 }
             }
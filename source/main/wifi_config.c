@@ -47,6 +47,7 @@ limitations under the License.
 #include "usb_comms.h"
 #include "task_priorities.h"
 #include "tonex_params.h"
+#include "midi_control.h"
 
 #define WIFI_CONFIG_TASK_STACK_SIZE   (3 * 1024)
 
@@ -76,12 +77,18 @@ static void wifi_kill_all(void);
 static void wifi_build_params_json(void);
 static void wifi_build_config_json(void);
 static void wifi_build_preset_json(void);
+static void wifi_build_bt_stats_json(void);
+static esp_err_t wifi_set_config_items(uint8_t flags);
+static void wifi_set_tx_power(void);
+static void wifi_config_changed(uint64_t changed);
+static void wifi_build_set_config_json(char* command, esp_err_t result);
 
 enum WiFivents
 {
     EVENT_SYNC_PARAMS,
     EVENT_SYNC_PRESET,
-    EVENT_SYNC_CONFIG
+    EVENT_SYNC_CONFIG,
+    EVENT_APPLY_CONFIG
 };
 
 typedef struct
@@ -102,6 +109,7 @@ typedef struct
     jparse_ctx_t jctx;
     json_gen_str_t jstr;
     httpd_ws_frame_t ws_rsp;
+    tConfigTransaction ConfigTransaction;
     char PresetName[MAX_TEXT_LENGTH];
     uint16_t PresetIndex;
     uint8_t ParamsChanged : 1;
@@ -178,6 +186,17 @@ static uint8_t process_wifi_command(tWiFiMessage* message)
             
             pWebConfig->ConfigChanged = 1;
         } break;    
+
+        case EVENT_APPLY_CONFIG:
+        {
+            char mdns_name[MAX_MDNS_NAME];
+
+            wifi_set_tx_power();
+
+            control_get_config_item_string(CONFIG_ITEM_MDNS_NAME, mdns_name);
+            mdns_hostname_set(mdns_name);
+            mdns_instance_name_set(mdns_name);
+        } break;
     }
 
     return 1;
@@ -322,7 +341,8 @@ static void wifi_build_params_json(void)
 ****************************************************************************/
 static void wifi_build_config_json(void)
 {
-    char str_val[64];
+    char str_val[MAX_TEXT_LENGTH];
+    const tConfigItemInfo* info;
 
     // init generation of json response
     json_gen_str_start(&pWebConfig->jstr, pWebConfig->TempBuffer, MAX_TEMP_BUFFER, NULL, NULL);
@@ -334,54 +354,20 @@ static void wifi_build_config_json(void)
     json_gen_obj_set_string(&pWebConfig->jstr, "CMD", "GETCONFIG");
 
     // add config
-    json_gen_obj_set_int(&pWebConfig->jstr, "BT_MODE", control_get_config_item_int(CONFIG_ITEM_BT_MODE));
-    json_gen_obj_set_int(&pWebConfig->jstr, "BT_CHOC_EN", control_get_config_item_int(CONFIG_ITEM_MV_CHOC_ENABLE));
-    json_gen_obj_set_int(&pWebConfig->jstr, "BT_MD1_EN", control_get_config_item_int(CONFIG_ITEM_XV_MD1_ENABLE));
-    json_gen_obj_set_int(&pWebConfig->jstr, "BT_CUST_EN", control_get_config_item_int(CONFIG_ITEM_CUSTOM_BT_ENABLE));
-
-    control_get_config_item_string(CONFIG_ITEM_BT_CUSTOM_NAME, str_val);
-    json_gen_obj_set_string(&pWebConfig->jstr, "BT_CUST_NAME", str_val);
-
-    json_gen_obj_set_int(&pWebConfig->jstr, "TOGGLE_BYPASS", control_get_config_item_int(CONFIG_ITEM_TOGGLE_BYPASS));
-    json_gen_obj_set_int(&pWebConfig->jstr, "S_MIDI_EN", control_get_config_item_int(CONFIG_ITEM_MIDI_ENABLE));
-    json_gen_obj_set_int(&pWebConfig->jstr, "S_MIDI_CH", control_get_config_item_int(CONFIG_ITEM_MIDI_CHANNEL));
-    json_gen_obj_set_int(&pWebConfig->jstr, "FOOTSW_MODE", control_get_config_item_int(CONFIG_ITEM_FOOTSWITCH_MODE));
-    json_gen_obj_set_int(&pWebConfig->jstr, "BT_MIDI_CC", control_get_config_item_int(CONFIG_ITEM_ENABLE_BT_MIDI_CC));
-    json_gen_obj_set_int(&pWebConfig->jstr, "WIFI_MODE", control_get_config_item_int(CONFIG_ITEM_WIFI_MODE));
-    json_gen_obj_set_int(&pWebConfig->jstr, "WIFI_POWER", control_get_config_item_int(CONFIG_ITEM_WIFI_TX_POWER));
-    json_gen_obj_set_int(&pWebConfig->jstr, "SCREEN_ROT", control_get_config_item_int(CONFIG_ITEM_SCREEN_ROTATION));
-
-    control_get_config_item_string(CONFIG_ITEM_WIFI_SSID, str_val);
-    json_gen_obj_set_string(&pWebConfig->jstr, "WIFI_SSID", str_val);
-
-    control_get_config_item_string(CONFIG_ITEM_WIFI_PASSWORD, str_val);
-    json_gen_obj_set_string(&pWebConfig->jstr, "WIFI_PW", str_val);
-
-    control_get_config_item_string(CONFIG_ITEM_MDNS_NAME, str_val);
-    json_gen_obj_set_string(&pWebConfig->jstr, "MDNS_NAME", str_val);
-
-    json_gen_obj_set_int(&pWebConfig->jstr, "EXTFS_PS_LAYOUT", control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_PRESET_LAYOUT));
-
-    json_gen_obj_set_int(&pWebConfig->jstr, "EXTFS_ES1_SW", control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT1_SW));
-    json_gen_obj_set_int(&pWebConfig->jstr, "EXTFS_ES1_CC", control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT1_CC));
-    json_gen_obj_set_int(&pWebConfig->jstr, "EXTFS_ES1_V1", control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT1_VAL1));
-    json_gen_obj_set_int(&pWebConfig->jstr, "EXTFS_ES1_V2", control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT1_VAL2));
-    json_gen_obj_set_int(&pWebConfig->jstr, "EXTFS_ES2_SW", control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT2_SW));
-    json_gen_obj_set_int(&pWebConfig->jstr, "EXTFS_ES2_CC", control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT2_CC));
-    json_gen_obj_set_int(&pWebConfig->jstr, "EXTFS_ES2_V1", control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT2_VAL1));
-    json_gen_obj_set_int(&pWebConfig->jstr, "EXTFS_ES2_V2", control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT2_VAL2));
-    json_gen_obj_set_int(&pWebConfig->jstr, "EXTFS_ES3_SW", control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT3_SW));
-    json_gen_obj_set_int(&pWebConfig->jstr, "EXTFS_ES3_CC", control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT3_CC));
-    json_gen_obj_set_int(&pWebConfig->jstr, "EXTFS_ES3_V1", control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT3_VAL1));
-    json_gen_obj_set_int(&pWebConfig->jstr, "EXTFS_ES3_V2", control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT3_VAL2));
-    json_gen_obj_set_int(&pWebConfig->jstr, "EXTFS_ES4_SW", control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT4_SW));
-    json_gen_obj_set_int(&pWebConfig->jstr, "EXTFS_ES4_CC", control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT4_CC));
-    json_gen_obj_set_int(&pWebConfig->jstr, "EXTFS_ES4_V1", control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT4_VAL1));
-    json_gen_obj_set_int(&pWebConfig->jstr, "EXTFS_ES4_V2", control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT4_VAL2));
-    json_gen_obj_set_int(&pWebConfig->jstr, "EXTFS_ES5_SW", control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT5_SW));
-    json_gen_obj_set_int(&pWebConfig->jstr, "EXTFS_ES5_CC", control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT5_CC));
-    json_gen_obj_set_int(&pWebConfig->jstr, "EXTFS_ES5_V1", control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT5_VAL1));
-    json_gen_obj_set_int(&pWebConfig->jstr, "EXTFS_ES5_V2", control_get_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT5_VAL2));
+    for (uint32_t item = 0; item < CONFIG_ITEM_LAST; item++)
+    {
+        info = control_get_config_item_info(item);
+
+        if (info->Type == CONFIG_TYPE_STRING)
+        {
+            control_get_config_item_string(item, str_val);
+            json_gen_obj_set_string(&pWebConfig->jstr, info->JsonKey, str_val);
+        }
+        else
+        {
+            json_gen_obj_set_int(&pWebConfig->jstr, info->JsonKey, control_get_config_item_int(item));
+        }
+    }
 
     // add the }
     json_gen_end_object(&pWebConfig->jstr);
@@ -423,6 +409,185 @@ static void wifi_build_preset_json(void)
     //debug ESP_LOGI(TAG, "Json: %s", pWebConfig->TempBuffer);
 }
 
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Set the config items found in a SETCONFIG/SETWIFI command
+* PARAMETERS:  flags: CONFIG_FLAG_ for the command
+* RETURN:      ESP_OK if saved
+* NOTES:       Items missing from the json are left unchanged. Everything
+*              is applied and saved in one go
+****************************************************************************/
+static esp_err_t wifi_set_config_items(uint8_t flags)
+{
+    esp_err_t result;
+    char str_val[MAX_TEXT_LENGTH];
+    const tConfigItemInfo* info;
+    tConfigTransaction* transaction = &pWebConfig->ConfigTransaction;
+    int int_val;
+
+    control_config_begin(transaction);
+
+    for (uint32_t item = 0; item < CONFIG_ITEM_LAST; item++)
+    {
+        info = control_get_config_item_info(item);
+
+        if ((info->Flags & flags) == 0)
+        {
+            continue;
+        }
+
+        if (info->Type == CONFIG_TYPE_STRING)
+        {
+            if (json_obj_get_string(&pWebConfig->jctx, info->JsonKey, str_val, sizeof(str_val)) == OS_SUCCESS)
+            {
+                control_config_set_string(transaction, item, str_val);
+            }
+        }
+        else if (json_obj_get_int(&pWebConfig->jctx, info->JsonKey, &int_val) == OS_SUCCESS)
+        {
+            // out of range values are dropped and logged
+            control_config_set_int(transaction, item, int_val);
+        }
+    }
+
+    result = control_config_commit(transaction);
+    if (result != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Config save failed");
+    }
+
+    return result;
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Build the reply to a SETCONFIG/SETWIFI command
+* PARAMETERS:  
+* RETURN:      none
+* NOTES:       
+****************************************************************************/
+static void wifi_build_set_config_json(char* command, esp_err_t result)
+{
+    // init generation of json response
+    json_gen_str_start(&pWebConfig->jstr, pWebConfig->TempBuffer, MAX_TEMP_BUFFER, NULL, NULL);
+
+    // start json object, adds {
+    json_gen_start_object(&pWebConfig->jstr);
+
+    json_gen_obj_set_string(&pWebConfig->jstr, "CMD", command);
+    json_gen_obj_set_int(&pWebConfig->jstr, "RESULT", (result == ESP_OK));
+    json_gen_obj_set_int(&pWebConfig->jstr, "REBOOT", pWebConfig->ConfigTransaction.RebootNeeded);
+
+    // add the }
+    json_gen_end_object(&pWebConfig->jstr);
+
+    // end generation
+    json_gen_str_end(&pWebConfig->jstr);
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Config items changed
+* PARAMETERS:  
+* RETURN:      none
+* NOTES:       Called from the control task
+****************************************************************************/
+static void wifi_config_changed(uint64_t changed)
+{
+    tWiFiMessage message;
+
+    // let the web page know
+    wifi_request_sync(WIFI_SYNC_TYPE_CONFIG, NULL, NULL);
+
+    if (changed & (CONFIG_ITEM_MASK(CONFIG_ITEM_WIFI_TX_POWER) | CONFIG_ITEM_MASK(CONFIG_ITEM_MDNS_NAME)))
+    {
+        // apply from the WiFi task
+        message.Event = EVENT_APPLY_CONFIG;
+
+        if (xQueueSend(wifi_input_queue, (void*)&message, 0) != pdPASS)
+        {
+            ESP_LOGE(TAG, "wifi_config_changed queue send failed!");            
+        }
+    }
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Build the Bluetooth connection stats
+* PARAMETERS:  
+* RETURN:      none
+* NOTES:       Times are in usec, except setup time in msec
+****************************************************************************/
+static void wifi_build_bt_stats_json(void)
+{
+    tMidiBLEConnectionStats stats[MIDI_BLE_MAX_CONNECTION_STATS];
+    tMidiBLEScanStats scan_stats;
+    uint8_t count;
+    char str_val[24];
+
+    count = midi_get_ble_connection_stats(stats, MIDI_BLE_MAX_CONNECTION_STATS);
+    midi_get_ble_scan_stats(&scan_stats);
+
+    // init generation of json response
+    json_gen_str_start(&pWebConfig->jstr, pWebConfig->TempBuffer, MAX_TEMP_BUFFER, NULL, NULL);
+
+    // start json object, adds {
+    json_gen_start_object(&pWebConfig->jstr);
+
+    // add response
+    json_gen_obj_set_string(&pWebConfig->jstr, "CMD", "GETBTSTATS");
+
+    // add the [ for connections
+    json_gen_push_array(&pWebConfig->jstr, "CONNS");
+
+    for (uint8_t loop = 0; loop < count; loop++)
+    {
+        // add the {
+        json_gen_start_object(&pWebConfig->jstr);
+
+        sprintf(str_val, "%02X:%02X:%02X:%02X:%02X:%02X", stats[loop].Address[0], stats[loop].Address[1], stats[loop].Address[2], 
+                                                          stats[loop].Address[3], stats[loop].Address[4], stats[loop].Address[5]);
+        json_gen_obj_set_string(&pWebConfig->jstr, "ADDR", str_val);
+        json_gen_obj_set_int(&pWebConfig->jstr, "RSSI", stats[loop].RSSI);
+        json_gen_obj_set_int(&pWebConfig->jstr, "INTERVAL", stats[loop].ConnInterval);
+        json_gen_obj_set_int(&pWebConfig->jstr, "RX_PKTS", stats[loop].RxPackets);
+        json_gen_obj_set_int(&pWebConfig->jstr, "RX_MSGS", stats[loop].RxMessages);
+        json_gen_obj_set_int(&pWebConfig->jstr, "TX_PKTS", stats[loop].TxPackets);
+        json_gen_obj_set_int(&pWebConfig->jstr, "TX_ERR", stats[loop].TxErrors);
+        json_gen_obj_set_int(&pWebConfig->jstr, "SETUP_MS", stats[loop].SetupTime);
+        json_gen_obj_set_int(&pWebConfig->jstr, "SETUP_CACHED", stats[loop].SetupCached);
+        json_gen_obj_set_int(&pWebConfig->jstr, "PKT_INT_AVG", stats[loop].PacketIntervalAvg);
+        json_gen_obj_set_int(&pWebConfig->jstr, "PKT_INT_MIN", stats[loop].PacketIntervalMin);
+        json_gen_obj_set_int(&pWebConfig->jstr, "PKT_INT_MAX", stats[loop].PacketIntervalMax);
+        json_gen_obj_set_int(&pWebConfig->jstr, "LAT_AVG", stats[loop].LatencyAvg);
+        json_gen_obj_set_int(&pWebConfig->jstr, "LAT_MAX", stats[loop].LatencyMax);
+
+        // add the }
+        json_gen_end_object(&pWebConfig->jstr);
+    }
+
+    // add the ]
+    json_gen_pop_array(&pWebConfig->jstr);
+
+    // add the { for scan counters
+    json_gen_push_object(&pWebConfig->jstr, "SCAN");
+    json_gen_obj_set_int(&pWebConfig->jstr, "ADV", scan_stats.AdvProcessed);
+    json_gen_obj_set_int(&pWebConfig->jstr, "MATCHED", scan_stats.AdvMatched);
+    json_gen_obj_set_int(&pWebConfig->jstr, "DROPPED", scan_stats.AdvDropped);
+    json_gen_obj_set_int(&pWebConfig->jstr, "SKIPPED", scan_stats.AdvSkipped);
+    json_gen_obj_set_int(&pWebConfig->jstr, "KNOWN", scan_stats.KnownDevices);
+    json_gen_obj_set_int(&pWebConfig->jstr, "PASSIVE", scan_stats.Passive);
+
+    // add the } for scan counters
+    json_gen_pop_object(&pWebConfig->jstr);
+
+    // add the }
+    json_gen_end_object(&pWebConfig->jstr);
+
+    // end generation
+    json_gen_str_end(&pWebConfig->jstr);
+}
+
 /****************************************************************************
 * NAME:        
 * DESCRIPTION: 
@@ -559,219 +724,49 @@ static esp_err_t ws_handler(httpd_req_t *req)
                         // build packet and send
                         build_send_ws_response_packet(req, pWebConfig->TempBuffer);
                     }
+                    else if (strcmp(str_val, "GETBTSTATS") == 0)
+                    {
+                        // send Bluetooth connection stats. Polled, so no log here
+
+                        // build json response
+                        wifi_build_bt_stats_json();
+                        
+                        // build packet and send
+                        build_send_ws_response_packet(req, pWebConfig->TempBuffer);
+                    }
                     else if (strcmp(str_val, "SETCONFIG") == 0)
                     {
                         // set config
                         ESP_LOGI(TAG, "Config Set");
 
-                        if (json_obj_get_int(&pWebConfig->jctx, "S_MIDI_EN", &int_val) == OS_SUCCESS)
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_MIDI_ENABLE, int_val);
-                        }
-
-                        if (json_obj_get_int(&pWebConfig->jctx, "S_MIDI_CH", &int_val) == OS_SUCCESS)
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_MIDI_CHANNEL, int_val);        
-                        }
-
-                        if (json_obj_get_int(&pWebConfig->jctx, "TOGGLE_BYPASS", &int_val) == OS_SUCCESS)
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_TOGGLE_BYPASS, int_val);
-                        }
-                        
-                        if (json_obj_get_int(&pWebConfig->jctx, "BT_MODE", &int_val) == OS_SUCCESS)
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_BT_MODE, int_val);
-                        }
-
-                        if (json_obj_get_int(&pWebConfig->jctx, "BT_CHOC_EN", &int_val) == OS_SUCCESS)
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_MV_CHOC_ENABLE, int_val);
-                        }
-
-                        if (json_obj_get_int(&pWebConfig->jctx, "BT_MD1_EN", &int_val) == OS_SUCCESS)
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_XV_MD1_ENABLE, int_val);
-                        }
-
-                        // pause a little to allow control task a chance to process    
-                        vTaskDelay(pdMS_TO_TICKS(250));    
-
-                        if (json_obj_get_int(&pWebConfig->jctx, "BT_CUST_EN", &int_val) == OS_SUCCESS)
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_CUSTOM_BT_ENABLE, int_val);
-                        }
-                        
-                        if (json_obj_get_string(&pWebConfig->jctx, "BT_CUST_NAME", str_val, sizeof(str_val)) == OS_SUCCESS)
-                        {
-                            control_set_config_item_string(CONFIG_ITEM_BT_CUSTOM_NAME, str_val);
-                        }
-
-                        if (json_obj_get_int(&pWebConfig->jctx, "BT_MIDI_CC", &int_val) == OS_SUCCESS)
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_ENABLE_BT_MIDI_CC, int_val);
-                        }
-                        
-                        if (json_obj_get_int(&pWebConfig->jctx, "FOOTSW_MODE", &int_val) == OS_SUCCESS)
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_FOOTSWITCH_MODE, int_val);
-                        }
-
-                        if (json_obj_get_int(&pWebConfig->jctx, "SCREEN_ROT", &int_val) == OS_SUCCESS)
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_SCREEN_ROTATION, int_val);
-                        }
-                                    
-                        if (json_obj_get_int(&pWebConfig->jctx, "EXTFS_PS_LAYOUT", &int_val) == OS_SUCCESS)
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_EXT_FOOTSW_PRESET_LAYOUT, int_val);
-                        }
-
-                        if (json_obj_get_int(&pWebConfig->jctx, "EXTFS_ES1_SW", &int_val) == OS_SUCCESS) 
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT1_SW, int_val);
-                        }
-
-                        if (json_obj_get_int(&pWebConfig->jctx, "EXTFS_ES1_CC", &int_val) == OS_SUCCESS) 
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT1_CC, int_val);
-                        }
-
-                        if (json_obj_get_int(&pWebConfig->jctx, "EXTFS_ES1_V1", &int_val) == OS_SUCCESS) 
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT1_VAL1, int_val);
-                        }
-
-                        // pause a little to allow control task a chance to process    
-                        vTaskDelay(pdMS_TO_TICKS(250));    
-
-                        if (json_obj_get_int(&pWebConfig->jctx, "EXTFS_ES1_V2", &int_val) == OS_SUCCESS) 
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT1_VAL2, int_val);
-                        }
-
-                        if (json_obj_get_int(&pWebConfig->jctx, "EXTFS_ES2_SW", &int_val) == OS_SUCCESS) 
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT2_SW, int_val);
-                        }
-
-                        if (json_obj_get_int(&pWebConfig->jctx,  "EXTFS_ES2_CC", &int_val) == OS_SUCCESS)
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT2_CC, int_val);
-                        }
-
-                        if (json_obj_get_int(&pWebConfig->jctx, "EXTFS_ES2_V1", &int_val) == OS_SUCCESS) 
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT2_VAL1, int_val);
-                        }
-
-                        if (json_obj_get_int(&pWebConfig->jctx, "EXTFS_ES2_V2", &int_val) == OS_SUCCESS) 
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT2_VAL2, int_val);
-                        }
-
-                        if (json_obj_get_int(&pWebConfig->jctx, "EXTFS_ES3_SW", &int_val) == OS_SUCCESS) 
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT3_SW, int_val);
-                        }
-
-                        if (json_obj_get_int(&pWebConfig->jctx, "EXTFS_ES3_CC", &int_val) == OS_SUCCESS) 
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT3_CC, int_val);
-                        }
-
-                        if (json_obj_get_int(&pWebConfig->jctx, "EXTFS_ES3_V1", &int_val) == OS_SUCCESS) 
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT3_VAL1, int_val);
-                        }
-
-                        if (json_obj_get_int(&pWebConfig->jctx, "EXTFS_ES3_V2", &int_val) == OS_SUCCESS) 
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT3_VAL2, int_val);
-                        }
-
-                        // pause a little to allow control task a chance to process    
-                        vTaskDelay(pdMS_TO_TICKS(250));    
-
-                        if (json_obj_get_int(&pWebConfig->jctx, "EXTFS_ES4_SW", &int_val) == OS_SUCCESS) 
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT4_SW, int_val);
-                        }
-
-                        if (json_obj_get_int(&pWebConfig->jctx, "EXTFS_ES4_CC", &int_val) == OS_SUCCESS) 
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT4_CC, int_val);
-                        }
-
-                        if (json_obj_get_int(&pWebConfig->jctx, "EXTFS_ES4_V1", &int_val) == OS_SUCCESS) 
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT4_VAL1, int_val);
-                        }
-
-                        if (json_obj_get_int(&pWebConfig->jctx, "EXTFS_ES4_V2", &int_val) == OS_SUCCESS) 
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT4_VAL2, int_val);
-                        }
-
-                        if (json_obj_get_int(&pWebConfig->jctx, "EXTFS_ES5_SW", &int_val) == OS_SUCCESS) 
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT5_SW, int_val);
-                        }
+                        // save and apply it
+                        esp_err_t result = wifi_set_config_items(CONFIG_FLAG_SETCONFIG);
 
-                        if (json_obj_get_int(&pWebConfig->jctx, "EXTFS_ES5_CC", &int_val) == OS_SUCCESS) 
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT5_CC, int_val);
-                        }
-
-                        if (json_obj_get_int(&pWebConfig->jctx, "EXTFS_ES5_V1", &int_val) == OS_SUCCESS) 
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT5_VAL1, int_val);
-                        }
+                        // tell the page if it needs to wait for a reboot
+                        wifi_build_set_config_json(str_val, result);
+                        build_send_ws_response_packet(req, pWebConfig->TempBuffer);
 
-                        if (json_obj_get_int(&pWebConfig->jctx, "EXTFS_ES5_V2", &int_val) == OS_SUCCESS) 
+                        if (pWebConfig->ConfigTransaction.RebootNeeded)
                         {
-                            control_set_config_item_int(CONFIG_ITEM_EXT_FOOTSW_EFFECT5_VAL2, int_val);
+                            control_save_user_data(1);
                         }
-
-                        vTaskDelay(pdMS_TO_TICKS(250));
-
-                        // save it and reboot after
-                        control_save_user_data(1);
                     }
                     else if (strcmp(str_val, "SETWIFI") == 0)
                     {
                         // set config
                         ESP_LOGI(TAG, "WiFi Set");
 
-                        if (json_obj_get_int(&pWebConfig->jctx, "WIFI_MODE", &int_val) == OS_SUCCESS)
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_WIFI_MODE, int_val);
-                        }
-
-                        if (json_obj_get_string(&pWebConfig->jctx, "WIFI_SSID", str_val, sizeof(str_val)) == OS_SUCCESS)
-                        {
-                            control_set_config_item_string(CONFIG_ITEM_WIFI_SSID, str_val);
-                        }
+                        // save and apply it
+                        esp_err_t result = wifi_set_config_items(CONFIG_FLAG_SETWIFI);
 
-                        if (json_obj_get_string(&pWebConfig->jctx, "WIFI_PW", str_val, sizeof(str_val)) == OS_SUCCESS)
-                        {
-                            control_set_config_item_string(CONFIG_ITEM_WIFI_PASSWORD, str_val);
-                        }
-
-                        if (json_obj_get_int(&pWebConfig->jctx, "WIFI_POWER", &int_val) == OS_SUCCESS)
-                        {
-                            control_set_config_item_int(CONFIG_ITEM_WIFI_TX_POWER, int_val);
-                        }
+                        // tell the page if it needs to wait for a reboot
+                        wifi_build_set_config_json(str_val, result);
+                        build_send_ws_response_packet(req, pWebConfig->TempBuffer);
 
-                        if (json_obj_get_string(&pWebConfig->jctx, "MDNS_NAME", str_val, sizeof(str_val)) == OS_SUCCESS)
+                        if (pWebConfig->ConfigTransaction.RebootNeeded)
                         {
-                            control_set_config_item_string(CONFIG_ITEM_MDNS_NAME, str_val);
+                            control_save_user_data(1);
                         }
-
-                        vTaskDelay(pdMS_TO_TICKS(250));
-
-                        // save it and reboot after
-                        control_save_user_data(1);
                     }                
                     else if (strcmp(str_val, "SETPARAM") == 0)
                     {
@@ -1275,6 +1270,47 @@ static void wifi_kill_all(void)
     stop_webserver();
     vTaskDelay(pdMS_TO_TICKS(5000));
     esp_wifi_stop();
+
+    // Bluetooth can have the radio to itself again
+    midi_set_wifi_active(0);
+}
+
+/****************************************************************************
+* NAME:        
+* DESCRIPTION: Set the WiFi TX power from config
+* PARAMETERS:  
+* RETURN:      none
+* NOTES:       Some platforms seem to have stability issues on max power
+****************************************************************************/
+static void wifi_set_tx_power(void)
+{
+    switch (control_get_config_item_int(CONFIG_ITEM_WIFI_TX_POWER))
+    {
+        case WIFI_TX_POWER_100:        
+        {
+            esp_wifi_set_max_tx_power(80);
+        } break;
+
+        case WIFI_TX_POWER_75:
+        {
+            esp_wifi_set_max_tx_power(66);
+        } break;
+
+        case WIFI_TX_POWER_50:
+        {
+            esp_wifi_set_max_tx_power(52);
+        } break;
+
+        case WIFI_TX_POWER_25:
+        default:
+        {
+            esp_wifi_set_max_tx_power(28);
+        } break;
+    }
+
+    int8_t power;
+    esp_wifi_get_max_tx_power(&power);
+    ESP_LOGI(TAG, "WiFi Tx power: %d dbm", (int)(power * 0.25f));
 }
 
 /****************************************************************************
@@ -1329,34 +1365,10 @@ static void wifi_config_task(void *arg)
         } break;
     }
 
-    // set the WiFi TX power. Some platforms seem to have stability issues on max power
-    switch (control_get_config_item_int(CONFIG_ITEM_WIFI_TX_POWER))
-    {
-        case WIFI_TX_POWER_100:        
-        {
-            esp_wifi_set_max_tx_power(80);
-        } break;
+    // WiFi shares the radio, let Bluetooth relax its connection interval
+    midi_set_wifi_active(1);
 
-        case WIFI_TX_POWER_75:
-        {
-            esp_wifi_set_max_tx_power(66);
-        } break;
-
-        case WIFI_TX_POWER_50:
-        {
-            esp_wifi_set_max_tx_power(52);
-        } break;
-
-        case WIFI_TX_POWER_25:
-        default:
-        {
-            esp_wifi_set_max_tx_power(28);
-        } break;
-    }
-
-    int8_t power;
-    esp_wifi_get_max_tx_power(&power);
-    ESP_LOGI(TAG, "WiFi Tx power: %d dbm", (int)(power * 0.25f));
+    wifi_set_tx_power();
 
     start_mdns_service();
 
@@ -1415,5 +1427,8 @@ void wifi_config_init(void)
         ESP_LOGE(TAG, "Failed to create WiFi input queue!");
     }
 
+    // keep the web page and radio in step with config changes
+    control_register_config_handler(CONFIG_ITEM_RANGE_MASK(0, CONFIG_ITEM_LAST - 1), wifi_config_changed);
+
     xTaskCreatePinnedToCore(wifi_config_task, "WIFI", WIFI_CONFIG_TASK_STACK_SIZE, NULL, WIFI_TASK_PRIORITY, NULL, 0);
 }
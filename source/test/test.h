@@ -0,0 +1,38 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ 
+*/
+
+#pragma once
+
+#include <stdio.h>
+
+// Minimal checks for the host tests, each test program returns the
+// number of failures
+
+static int test_failures = 0;
+
+#define TEST_CHECK(cond)                                                                    \
+    do                                                                                      \
+    {                                                                                       \
+        if (!(cond))                                                                        \
+        {                                                                                   \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);                 \
+            test_failures++;                                                                \
+        }                                                                                   \
+    } while (0)
+
+#define TEST_RESULT()                                                                       \
+    (printf("%s: %d failure(s)\n", __FILE__, test_failures), (test_failures != 0))
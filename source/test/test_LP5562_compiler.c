@@ -0,0 +1,165 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ 
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include "test.h"
+#include "LP5562_compiler.h"
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Read back an instruction
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static uint16_t test_op(const tLP5562Program* program, uint8_t step)
+{
+    return (uint16_t)((program->Code[step * 2] << 8) | program->Code[(step * 2) + 1]);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Blink with a loop count
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_blink(void)
+{
+    tLP5562Effect effect = {0};
+    tLP5562Program program;
+
+    effect.Type = LP5562_EFFECT_BLINK;
+    effect.Low = 0;
+    effect.High = 200;
+    effect.OnTime = 100;
+    effect.OffTime = 400;
+    effect.Count = 3;
+
+    TEST_CHECK(LP5562_compile(&effect, &program) == 1);
+    TEST_CHECK(program.Steps == 6);
+    TEST_CHECK(test_op(&program, 0) == 0x40C8);         // set PWM 200
+    TEST_CHECK(test_op(&program, 1) == 0x4600);         // wait 6 * 15.6 msec
+    TEST_CHECK(test_op(&program, 2) == 0x4000);         // set PWM 0
+    TEST_CHECK(test_op(&program, 3) == 0x5A00);         // wait 26 * 15.6 msec
+    TEST_CHECK(test_op(&program, 4) == 0xA100);         // branch to 0, 2 more times
+    TEST_CHECK(test_op(&program, 5) == 0xC000);         // end
+
+    // most loops the branch can hold
+    effect.Count = LP5562_EFFECT_MAX_COUNT;
+    TEST_CHECK(LP5562_compile(&effect, &program) == 1);
+    TEST_CHECK(test_op(&program, 4) == 0xBF80);
+
+    effect.Count = LP5562_EFFECT_MAX_COUNT + 1;
+    TEST_CHECK(LP5562_compile(&effect, &program) == 0);
+
+    // one pass needs no branch
+    effect.Count = 1;
+    TEST_CHECK(LP5562_compile(&effect, &program) == 1);
+    TEST_CHECK(program.Steps == 5);
+    TEST_CHECK(test_op(&program, 4) == 0xC000);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Breathe, ramps split into 127 level steps
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_breathe(void)
+{
+    tLP5562Effect effect = {0};
+    tLP5562Program program;
+
+    effect.Type = LP5562_EFFECT_BREATHE;
+    effect.Low = 0;
+    effect.High = 255;
+    effect.RiseTime = 510;
+    effect.FallTime = 255;
+    effect.Count = 0;
+
+    TEST_CHECK(LP5562_compile(&effect, &program) == 1);
+    TEST_CHECK(program.Steps == 8);
+    TEST_CHECK(test_op(&program, 0) == 0x4000);         // set PWM 0
+
+    // up, 2 msec a level is 4 short cycles
+    TEST_CHECK(test_op(&program, 1) == 0x047F);
+    TEST_CHECK(test_op(&program, 2) == 0x047F);
+    TEST_CHECK(test_op(&program, 3) == 0x0401);
+
+    // down, 1 msec a level
+    TEST_CHECK(test_op(&program, 4) == 0x02FF);
+    TEST_CHECK(test_op(&program, 5) == 0x02FF);
+    TEST_CHECK(test_op(&program, 6) == 0x0281);
+
+    // no off time, so straight back to the start forever
+    TEST_CHECK(test_op(&program, 7) == 0x0000);
+
+    // branches back past the set PWM
+    effect.Count = 2;
+    effect.OffTime = 100;
+    TEST_CHECK(LP5562_compile(&effect, &program) == 1);
+    TEST_CHECK(test_op(&program, 7) == 0x4600);
+    TEST_CHECK(test_op(&program, 8) == 0xA081);
+    TEST_CHECK(test_op(&program, 9) == 0xC000);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Ramp once and hold, and the limits
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_ramp_and_limits(void)
+{
+    tLP5562Effect effect = {0};
+    tLP5562Program program;
+
+    effect.Type = LP5562_EFFECT_RAMP;
+    effect.Low = 20;
+    effect.High = 120;
+    effect.RiseTime = 0;
+
+    // as fast as it goes
+    TEST_CHECK(LP5562_compile(&effect, &program) == 1);
+    TEST_CHECK(program.Steps == 3);
+    TEST_CHECK(test_op(&program, 0) == 0x4014);
+    TEST_CHECK(test_op(&program, 1) == 0x0164);
+    TEST_CHECK(test_op(&program, 2) == 0xC000);
+
+    // over a minute of waits doesn't fit in an engine
+    effect.Type = LP5562_EFFECT_BLINK;
+    effect.OnTime = 60000;
+    effect.OffTime = 60000;
+    TEST_CHECK(LP5562_compile(&effect, &program) == 0);
+
+    effect.Type = LP5562_EFFECT_LAST;
+    TEST_CHECK(LP5562_compile(&effect, &program) == 0);
+    TEST_CHECK(program.Steps == 0);
+}
+
+int main(void)
+{
+    test_blink();
+    test_breathe();
+    test_ramp_and_limits();
+
+    return TEST_RESULT();
+}
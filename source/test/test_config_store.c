@@ -0,0 +1,676 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ 
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "test.h"
+#include "esp_err.h"
+#include "control.h"
+#include "tonex_params.h"
+#include "preset_record.h"
+#include "config_store.h"
+
+#define FAKE_MAX_ENTRIES        100
+#define FAKE_MAX_DATA           4096
+
+// Released single blob layout, byte offsets as shipped up to V1.0.8.2 beta 4.
+// Written out by hand rather than taken from tConfigData, so a change to the
+// struct that moves a released field shows up here
+#define LEGACY_PRESET_SIZE      130             // uint16_t skin, char[128] description
+#define LEGACY_BT_MODE          2600
+#define LEGACY_BT_FLAGS         2601            // uint16_t. Bit 0 Mvave Chocolate, 1 Xvive MD1, 2 custom
+#define LEGACY_MIDI_FLAGS       2603            // bit 0 serial enable, 1 BT Midi CC
+#define LEGACY_MIDI_CHANNEL     2604
+#define LEGACY_GENERAL_FLAGS    2605            // uint16_t. Bit 0 toggle bypass, 1-2 screen rotation
+#define LEGACY_FOOTSWITCH_MODE  2607
+#define LEGACY_BT_CUSTOM_NAME   2608            // char[25]
+#define LEGACY_WIFI_FLAGS       2633            // bits 0-3 mode, 4-7 tx power
+#define LEGACY_WIFI_SSID        2634            // char[65]
+#define LEGACY_WIFI_PASSWORD    2699            // char[65]
+#define LEGACY_MDNS_NAME        2764            // char[32]
+#define LEGACY_EXT_LAYOUT       2796
+#define LEGACY_EXT_EFFECTS      2797            // 5 x switch, CC, value 1, value 2
+#define LEGACY_SIZE             2817
+
+typedef struct
+{
+    char Key[CONFIG_STORE_KEY_SIZE];
+    uint8_t Type;                       // ConfigStorageTypes
+    size_t Length;
+    uint8_t Data[FAKE_MAX_DATA];
+} tFakeEntry;
+
+// one namespace, held in RAM
+typedef struct
+{
+    tFakeEntry Entries[FAKE_MAX_ENTRIES];
+    uint32_t Count;
+    uint32_t Commits;
+    uint8_t FailWrites;
+} tFakeStorage;
+
+typedef struct
+{
+    const char* Name;
+    size_t Length;                      // blob bytes, a prefix of the released layout
+    uint8_t HasWiFi;
+    uint8_t HasExternal;
+} tLegacyFixture;
+
+// Only the full image is known to be a shipped layout, it is the struct in
+// the first tree this repo has. The Releases folder only holds readme files,
+// so the shorter images are built from the rule that fields were only ever
+// added to the end, not from flash dumps of those releases
+static const tLegacyFixture LegacyFixtures[] = 
+{
+    {"V1.0.8.2 beta 4",             LEGACY_SIZE,        1, 1},
+    {"no external footswitches",    LEGACY_EXT_LAYOUT,  1, 0},
+    {"no wifi",                     LEGACY_WIFI_FLAGS,  0, 0},
+};
+
+static tFakeStorage ConfigNVS;
+static tFakeStorage LegacyNVS;
+static tConfigStore Store;
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Find a key
+* PARAMETERS:
+* RETURN:      entry, NULL if not stored
+* NOTES:
+*****************************************************************************/
+static tFakeEntry* fake_find(tFakeStorage* fake, const char* key)
+{
+    for (uint32_t loop = 0; loop < fake->Count; loop++)
+    {
+        if (strcmp(fake->Entries[loop].Key, key) == 0)
+        {
+            return &fake->Entries[loop];
+        }
+    }
+
+    return NULL;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Store a key, replacing any old value
+* PARAMETERS:
+* RETURN:      1 if OK
+* NOTES:
+*****************************************************************************/
+static uint8_t fake_put(tFakeStorage* fake, const char* key, uint8_t type, const void* data, size_t length)
+{
+    tFakeEntry* entry = fake_find(fake, key);
+
+    if (fake->FailWrites || (length > FAKE_MAX_DATA) || (strlen(key) >= CONFIG_STORE_KEY_SIZE))
+    {
+        return 0;
+    }
+
+    if (entry == NULL)
+    {
+        if (fake->Count >= FAKE_MAX_ENTRIES)
+        {
+            return 0;
+        }
+
+        entry = &fake->Entries[fake->Count++];
+        strcpy(entry->Key, key);
+    }
+
+    entry->Type = type;
+    entry->Length = length;
+    memcpy((void*)entry->Data, data, length);
+    return 1;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Read a key of the given type
+* PARAMETERS:  data: NULL to get the length
+* RETURN:      1 if OK
+* NOTES:       Like NVS, a short buffer or a type mismatch fails
+*****************************************************************************/
+static uint8_t fake_get(tFakeStorage* fake, const char* key, uint8_t type, void* data, size_t* length)
+{
+    tFakeEntry* entry = fake_find(fake, key);
+
+    if ((entry == NULL) || (entry->Type != type))
+    {
+        return 0;
+    }
+
+    if (data != NULL)
+    {
+        if (*length < entry->Length)
+        {
+            return 0;
+        }
+
+        memcpy(data, (void*)entry->Data, entry->Length);
+    }
+
+    *length = entry->Length;
+    return 1;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: tConfigStorageOps over a tFakeStorage
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static uint8_t fake_get_u8(void* context, const char* key, uint8_t* value)
+{
+    size_t length = sizeof(uint8_t);
+
+    return fake_get((tFakeStorage*)context, key, CONFIG_STORAGE_U8, (void*)value, &length);
+}
+
+static uint8_t fake_set_u8(void* context, const char* key, uint8_t value)
+{
+    return fake_put((tFakeStorage*)context, key, CONFIG_STORAGE_U8, (void*)&value, sizeof(value));
+}
+
+static uint8_t fake_get_u32(void* context, const char* key, uint32_t* value)
+{
+    size_t length = sizeof(uint32_t);
+
+    return fake_get((tFakeStorage*)context, key, CONFIG_STORAGE_U32, (void*)value, &length);
+}
+
+static uint8_t fake_set_u32(void* context, const char* key, uint32_t value)
+{
+    return fake_put((tFakeStorage*)context, key, CONFIG_STORAGE_U32, (void*)&value, sizeof(value));
+}
+
+static uint8_t fake_get_string(void* context, const char* key, char* text, size_t* length)
+{
+    return fake_get((tFakeStorage*)context, key, CONFIG_STORAGE_STRING, (void*)text, length);
+}
+
+static uint8_t fake_set_string(void* context, const char* key, const char* text)
+{
+    return fake_put((tFakeStorage*)context, key, CONFIG_STORAGE_STRING, (void*)text, strlen(text) + 1);
+}
+
+static uint8_t fake_get_blob(void* context, const char* key, void* data, size_t* length)
+{
+    return fake_get((tFakeStorage*)context, key, CONFIG_STORAGE_BLOB, data, length);
+}
+
+static uint8_t fake_set_blob(void* context, const char* key, const void* data, size_t length)
+{
+    return fake_put((tFakeStorage*)context, key, CONFIG_STORAGE_BLOB, data, length);
+}
+
+static uint8_t fake_erase(void* context, const char* key)
+{
+    tFakeStorage* fake = (tFakeStorage*)context;
+    tFakeEntry* entry = fake_find(fake, key);
+
+    if ((entry == NULL) || fake->FailWrites)
+    {
+        return 0;
+    }
+
+    // keep the table packed
+    fake->Count--;
+    memmove((void*)entry, (void*)(entry + 1), (size_t)((uint8_t*)&fake->Entries[fake->Count] - (uint8_t*)entry));
+    return 1;
+}
+
+static uint8_t fake_commit(void* context)
+{
+    tFakeStorage* fake = (tFakeStorage*)context;
+
+    fake->Commits++;
+    return !fake->FailWrites;
+}
+
+static void fake_for_each(void* context, tConfigStorageEntry entry, void* arg)
+{
+    tFakeStorage* fake = (tFakeStorage*)context;
+
+    for (uint32_t loop = 0; loop < fake->Count; loop++)
+    {
+        entry(arg, fake->Entries[loop].Key, fake->Entries[loop].Type);
+    }
+}
+
+static const tConfigStorageOps FakeStorageOps = 
+{
+    .GetU8 = fake_get_u8,
+    .SetU8 = fake_set_u8,
+    .GetU32 = fake_get_u32,
+    .SetU32 = fake_set_u32,
+    .GetString = fake_get_string,
+    .SetString = fake_set_string,
+    .GetBlob = fake_get_blob,
+    .SetBlob = fake_set_blob,
+    .Erase = fake_erase,
+    .Commit = fake_commit,
+    .ForEach = fake_for_each
+};
+
+static const tConfigStorage ConfigStorage = {&FakeStorageOps, (void*)&ConfigNVS};
+static const tConfigStorage LegacyStorage = {&FakeStorageOps, (void*)&LegacyNVS};
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Empty flash and a store with the boot defaults
+* PARAMETERS:
+* RETURN:
+* NOTES:       Same start as control_load_config()
+*****************************************************************************/
+static void reset_all(void)
+{
+    memset((void*)&ConfigNVS, 0, sizeof(ConfigNVS));
+    memset((void*)&LegacyNVS, 0, sizeof(LegacyNVS));
+    memset((void*)&Store, 0, sizeof(Store));
+
+    for (uint32_t loop = 0; loop < MAX_PRESETS_DEFAULT; loop++)
+    {
+        strcpy(Store.ConfigData.UserData[loop].PresetDescription, "Description");
+    }
+
+    config_store_set_defaults(&Store);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Find a config item by its web UI key
+* PARAMETERS:
+* RETURN:      item, CONFIG_ITEM_LAST if not found
+* NOTES:
+*****************************************************************************/
+static uint32_t item_by_json(const char* json)
+{
+    for (uint32_t item = 0; item < CONFIG_ITEM_LAST; item++)
+    {
+        if (strcmp(config_store_get_item_info(item)->JsonKey, json) == 0)
+        {
+            return item;
+        }
+    }
+
+    return CONFIG_ITEM_LAST;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Check an int item
+* PARAMETERS:
+* RETURN:      1 if it has the value
+* NOTES:
+*****************************************************************************/
+static uint8_t item_int_is(const tConfigStore* store, const char* json, uint32_t value)
+{
+    return config_store_get_int(store, item_by_json(json)) == value;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Check a string item
+* PARAMETERS:
+* RETURN:      1 if it has the text
+* NOTES:
+*****************************************************************************/
+static uint8_t item_string_is(const tConfigStore* store, const char* json, const char* text)
+{
+    char value[MAX_TEXT_LENGTH];
+
+    return config_store_get_string(store, item_by_json(json), value) && (strcmp(value, text) == 0);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Build a legacy blob image
+* PARAMETERS:  blob: LEGACY_SIZE buffer, filled in full, callers store a
+*              prefix of it
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void build_legacy_blob(uint8_t* blob)
+{
+    memset((void*)blob, 0, LEGACY_SIZE);
+
+    // presets 0 and 7 edited, the rest as shipped
+    for (uint32_t preset = 0; preset < MAX_PRESETS_DEFAULT; preset++)
+    {
+        strcpy((char*)&blob[(preset * LEGACY_PRESET_SIZE) + 2], "Description");
+    }
+    blob[0] = 3;
+    strcpy((char*)&blob[2], "Edge of breakup");
+    blob[(7 * LEGACY_PRESET_SIZE)] = 0x12;
+    blob[(7 * LEGACY_PRESET_SIZE) + 1] = 0x01;
+    strcpy((char*)&blob[(7 * LEGACY_PRESET_SIZE) + 2], "Lead");
+
+    blob[LEGACY_BT_MODE] = BT_MODE_PERIPHERAL;
+    blob[LEGACY_BT_FLAGS] = 0x06;                   // MD1 and custom, not Chocolate
+    blob[LEGACY_MIDI_FLAGS] = 0x03;
+    blob[LEGACY_MIDI_CHANNEL] = 10;
+    blob[LEGACY_GENERAL_FLAGS] = 0x03;              // toggle bypass, rotated 180
+    blob[LEGACY_FOOTSWITCH_MODE] = FOOTSWITCH_MODE_QUAD_BINARY;
+    strcpy((char*)&blob[LEGACY_BT_CUSTOM_NAME], "MyPedal");
+
+    blob[LEGACY_WIFI_FLAGS] = (WIFI_TX_POWER_75 << 4) | WIFI_MODE_STATION;
+    strcpy((char*)&blob[LEGACY_WIFI_SSID], "HomeNet");
+    strcpy((char*)&blob[LEGACY_WIFI_PASSWORD], "secret99");
+    strcpy((char*)&blob[LEGACY_MDNS_NAME], "stage");
+
+    blob[LEGACY_EXT_LAYOUT] = FOOTSWITCH_LAYOUT_2X4;
+    for (uint32_t loop = 0; loop < 5; loop++)
+    {
+        blob[LEGACY_EXT_EFFECTS + (loop * 4)] = loop + 3;
+        blob[LEGACY_EXT_EFFECTS + (loop * 4) + 1] = 20 + loop;
+        blob[LEGACY_EXT_EFFECTS + (loop * 4) + 2] = 0;
+        blob[LEGACY_EXT_EFFECTS + (loop * 4) + 3] = 127;
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Check the items migrated from a legacy blob
+* PARAMETERS:
+* RETURN:
+* NOTES:       Fields past the end of the blob must have their defaults
+*****************************************************************************/
+static void check_legacy_items(const tConfigStore* store, const tLegacyFixture* fixture)
+{
+    TEST_CHECK(store->ConfigData.UserData[0].SkinIndex == 3);
+    TEST_CHECK(strcmp(store->ConfigData.UserData[0].PresetDescription, "Edge of breakup") == 0);
+    TEST_CHECK(store->ConfigData.UserData[7].SkinIndex == 0x0112);
+    TEST_CHECK(strcmp(store->ConfigData.UserData[7].PresetDescription, "Lead") == 0);
+    TEST_CHECK(strcmp(store->ConfigData.UserData[19].PresetDescription, "Description") == 0);
+
+    TEST_CHECK(item_int_is(store, "BT_MODE", BT_MODE_PERIPHERAL));
+    TEST_CHECK(item_int_is(store, "BT_CHOC_EN", 0));
+    TEST_CHECK(item_int_is(store, "BT_MD1_EN", 1));
+    TEST_CHECK(item_int_is(store, "BT_CUST_EN", 1));
+    TEST_CHECK(item_int_is(store, "S_MIDI_EN", 1));
+    TEST_CHECK(item_int_is(store, "BT_MIDI_CC", 1));
+    TEST_CHECK(item_int_is(store, "S_MIDI_CH", 10));
+    TEST_CHECK(item_int_is(store, "TOGGLE_BYPASS", 1));
+    TEST_CHECK(item_int_is(store, "SCREEN_ROT", SCREEN_ROTATION_180));
+    TEST_CHECK(item_int_is(store, "FOOTSW_MODE", FOOTSWITCH_MODE_QUAD_BINARY));
+    TEST_CHECK(item_string_is(store, "BT_CUST_NAME", "MyPedal"));
+
+    if (fixture->HasWiFi)
+    {
+        TEST_CHECK(item_int_is(store, "WIFI_MODE", WIFI_MODE_STATION));
+        TEST_CHECK(item_int_is(store, "WIFI_POWER", WIFI_TX_POWER_75));
+        TEST_CHECK(item_string_is(store, "WIFI_SSID", "HomeNet"));
+        TEST_CHECK(item_string_is(store, "WIFI_PW", "secret99"));
+        TEST_CHECK(item_string_is(store, "MDNS_NAME", "stage"));
+    }
+    else
+    {
+        TEST_CHECK(item_int_is(store, "WIFI_MODE", WIFI_MODE_ACCESS_POINT_TIMED));
+        TEST_CHECK(item_int_is(store, "WIFI_POWER", WIFI_TX_POWER_25));
+        TEST_CHECK(item_string_is(store, "WIFI_SSID", "TonexConfig"));
+        TEST_CHECK(item_string_is(store, "WIFI_PW", "12345678"));
+        TEST_CHECK(item_string_is(store, "MDNS_NAME", "tonex"));
+    }
+
+    if (fixture->HasExternal)
+    {
+        TEST_CHECK(item_int_is(store, "EXTFS_PS_LAYOUT", FOOTSWITCH_LAYOUT_2X4));
+        TEST_CHECK(item_int_is(store, "EXTFS_ES1_SW", 3));
+        TEST_CHECK(item_int_is(store, "EXTFS_ES3_CC", 22));
+        TEST_CHECK(item_int_is(store, "EXTFS_ES5_SW", 7));
+        TEST_CHECK(item_int_is(store, "EXTFS_ES5_V2", 127));
+    }
+    else
+    {
+        TEST_CHECK(item_int_is(store, "EXTFS_PS_LAYOUT", FOOTSWITCH_LAYOUT_1X4));
+        TEST_CHECK(item_int_is(store, "EXTFS_ES1_SW", SWITCH_NOT_USED));
+        TEST_CHECK(item_int_is(store, "EXTFS_ES5_V2", 0));
+    }
+
+    // added after the blob was retired
+    TEST_CHECK(item_string_is(store, "FOOTSW_ACTIONS", "1:P1 2:P2 3:P3 4:P4 1+2:BD 3+4:BU"));
+    TEST_CHECK(item_int_is(store, "EXP_PARAM", TONEX_PARAM_LAST));
+    TEST_CHECK(item_int_is(store, "EXP_HEEL", 200));
+    TEST_CHECK(item_int_is(store, "EXP_TOE", 3900));
+    TEST_CHECK(item_int_is(store, "MIDI_RT1_SRC", 0));
+    TEST_CHECK(item_int_is(store, "MIDI_RT4_TYPE", 0x3F));
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Each legacy blob runs the whole chain to the current version
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_legacy_blobs(void)
+{
+    static uint8_t blob[LEGACY_SIZE];
+    static tConfigStore reloaded;
+    tFakeEntry* entry;
+    uint16_t skin_index;
+    char description[MAX_TEXT_LENGTH];
+    uint8_t version;
+
+    for (uint32_t loop = 0; loop < (sizeof(LegacyFixtures) / sizeof(tLegacyFixture)); loop++)
+    {
+        const tLegacyFixture* fixture = &LegacyFixtures[loop];
+
+        printf("legacy fixture: %s, %d bytes\n", fixture->Name, (int)fixture->Length);
+
+        reset_all();
+        build_legacy_blob(blob);
+        fake_set_blob((void*)&LegacyNVS, "userdata", (void*)blob, fixture->Length);
+
+        TEST_CHECK(config_store_load(&Store, &ConfigStorage, &LegacyStorage) == CONFIG_STORE_VERSION);
+        check_legacy_items(&Store, fixture);
+        TEST_CHECK((Store.ConfigDirty == 0) && (Store.PresetDirty == 0) && (Store.LoadReset == 0));
+
+        // blob gone, version stored, one entry per item and preset
+        TEST_CHECK(fake_find(&LegacyNVS, "userdata") == NULL);
+        version = 0;
+        TEST_CHECK(fake_get_u8((void*)&ConfigNVS, "ver", &version) && (version == CONFIG_STORE_VERSION));
+        TEST_CHECK(ConfigNVS.Count == (1 + CONFIG_ITEM_LAST + MAX_PRESETS_DEFAULT));
+
+        entry = fake_find(&ConfigNVS, "midi_ch");
+        TEST_CHECK((entry != NULL) && (entry->Type == CONFIG_STORAGE_U32) && (entry->Data[0] == 10));
+        entry = fake_find(&ConfigNVS, "bt_cust_name");
+        TEST_CHECK((entry != NULL) && (entry->Type == CONFIG_STORAGE_STRING) && (strcmp((char*)entry->Data, "MyPedal") == 0));
+
+        // presets are records now
+        entry = fake_find(&ConfigNVS, "preset07");
+        TEST_CHECK((entry != NULL) && (entry->Type == CONFIG_STORAGE_BLOB));
+        if (entry != NULL)
+        {
+            skin_index = 0;
+            TEST_CHECK(preset_record_decode(entry->Data, entry->Length, &skin_index, description, MAX_TEXT_LENGTH) == 1);
+            TEST_CHECK((skin_index == 0x0112) && (strcmp(description, "Lead") == 0));
+        }
+
+        // next boot reads the same back, with nothing to write
+        memset((void*)&reloaded, 0, sizeof(reloaded));
+        config_store_set_defaults(&reloaded);
+        TEST_CHECK(config_store_load(&reloaded, &ConfigStorage, &LegacyStorage) == CONFIG_STORE_VERSION);
+        check_legacy_items(&reloaded, fixture);
+        TEST_CHECK(reloaded.SaveStats.Saves == 0);
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Out of range values in a legacy blob are reset
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_legacy_invalid(void)
+{
+    static uint8_t blob[LEGACY_SIZE];
+
+    reset_all();
+    build_legacy_blob(blob);
+    blob[LEGACY_MIDI_CHANNEL] = 0;
+    blob[LEGACY_BT_MODE] = 9;
+    fake_set_blob((void*)&LegacyNVS, "userdata", (void*)blob, LEGACY_SIZE);
+
+    TEST_CHECK(config_store_load(&Store, &ConfigStorage, &LegacyStorage) == CONFIG_STORE_VERSION);
+    TEST_CHECK(item_int_is(&Store, "S_MIDI_CH", 1));
+    TEST_CHECK(item_int_is(&Store, "BT_MODE", BT_MODE_CENTRAL));
+    TEST_CHECK(Store.LoadReset == (CONFIG_ITEM_MASK(CONFIG_ITEM_MIDI_CHANNEL) | CONFIG_ITEM_MASK(CONFIG_ITEM_BT_MODE)));
+    TEST_CHECK(item_string_is(&Store, "WIFI_SSID", "HomeNet"));
+    TEST_CHECK(Store.ConfigDirty == 0);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: A blob from newer firmware is left alone
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_legacy_too_big(void)
+{
+    static uint8_t blob[FAKE_MAX_DATA];
+
+    reset_all();
+    memset((void*)blob, 0x55, sizeof(blob));
+    fake_set_blob((void*)&LegacyNVS, "userdata", (void*)blob, sizeof(blob));
+
+    TEST_CHECK(config_store_load(&Store, &ConfigStorage, &LegacyStorage) == CONFIG_STORE_VERSION);
+    TEST_CHECK(fake_find(&LegacyNVS, "userdata") != NULL);
+    TEST_CHECK(item_int_is(&Store, "S_MIDI_CH", 1));
+    TEST_CHECK(item_string_is(&Store, "WIFI_SSID", "TonexConfig"));
+    TEST_CHECK(Store.LoadReset == 0);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: A failed write keeps the legacy blob and the version
+* PARAMETERS:
+* RETURN:
+* NOTES:       Next boot tries again
+*****************************************************************************/
+static void test_legacy_write_failed(void)
+{
+    static uint8_t blob[LEGACY_SIZE];
+    uint8_t version = 0xFF;
+
+    reset_all();
+    build_legacy_blob(blob);
+    fake_set_blob((void*)&LegacyNVS, "userdata", (void*)blob, LEGACY_SIZE);
+    ConfigNVS.FailWrites = 1;
+
+    TEST_CHECK(config_store_load(&Store, &ConfigStorage, &LegacyStorage) == 0);
+    TEST_CHECK(fake_find(&LegacyNVS, "userdata") != NULL);
+    TEST_CHECK(!fake_get_u8((void*)&ConfigNVS, "ver", &version));
+
+    // flash working again
+    ConfigNVS.FailWrites = 0;
+    reset_all();
+    fake_set_blob((void*)&LegacyNVS, "userdata", (void*)blob, LEGACY_SIZE);
+    TEST_CHECK(config_store_load(&Store, &ConfigStorage, &LegacyStorage) == CONFIG_STORE_VERSION);
+    check_legacy_items(&Store, &LegacyFixtures[0]);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Version 1 presets were packed tUserData blobs
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_version_1_presets(void)
+{
+    uint8_t packed[LEGACY_PRESET_SIZE];
+    tFakeEntry* entry;
+    uint16_t skin_index;
+    char description[MAX_TEXT_LENGTH];
+    uint8_t version = 0;
+
+    reset_all();
+    fake_set_u8((void*)&ConfigNVS, "ver", 1);
+    fake_set_u32((void*)&ConfigNVS, "midi_ch", 7);
+
+    memset((void*)packed, 0, sizeof(packed));
+    packed[0] = 5;
+    strcpy((char*)&packed[2], "Crunch");
+    fake_set_blob((void*)&ConfigNVS, "preset05", (void*)packed, sizeof(packed));
+
+    // no legacy namespace at all
+    TEST_CHECK(config_store_load(&Store, &ConfigStorage, NULL) == CONFIG_STORE_VERSION);
+    TEST_CHECK(fake_get_u8((void*)&ConfigNVS, "ver", &version) && (version == CONFIG_STORE_VERSION));
+    TEST_CHECK(item_int_is(&Store, "S_MIDI_CH", 7));
+    TEST_CHECK((Store.ConfigData.UserData[5].SkinIndex == 5) && (strcmp(Store.ConfigData.UserData[5].PresetDescription, "Crunch") == 0));
+    TEST_CHECK(strcmp(Store.ConfigData.UserData[6].PresetDescription, "Description") == 0);
+
+    entry = fake_find(&ConfigNVS, "preset05");
+    TEST_CHECK((entry != NULL) && (entry->Length != LEGACY_PRESET_SIZE));
+    if (entry != NULL)
+    {
+        TEST_CHECK(preset_record_decode(entry->Data, entry->Length, &skin_index, description, MAX_TEXT_LENGTH) == 1);
+        TEST_CHECK((skin_index == 5) && (strcmp(description, "Crunch") == 0));
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Current version, odd entries
+* PARAMETERS:
+* RETURN:
+* NOTES:       Unknown keys and wrong types are skipped, bad values reset
+*****************************************************************************/
+static void test_version_2_entries(void)
+{
+    uint8_t version = 0;
+
+    reset_all();
+    fake_set_u8((void*)&ConfigNVS, "ver", CONFIG_STORE_VERSION);
+    fake_set_u32((void*)&ConfigNVS, "from_future", 1);
+    fake_set_string((void*)&ConfigNVS, "midi_ch", "12");
+    fake_set_u32((void*)&ConfigNVS, "screen_rot", 99);
+    fake_set_u32((void*)&ConfigNVS, "exp_heel", 321);
+    fake_set_string((void*)&ConfigNVS, "mdns_name", "rig");
+
+    TEST_CHECK(config_store_load(&Store, &ConfigStorage, &LegacyStorage) == CONFIG_STORE_VERSION);
+    TEST_CHECK(fake_get_u8((void*)&ConfigNVS, "ver", &version) && (version == CONFIG_STORE_VERSION));
+    TEST_CHECK(item_int_is(&Store, "S_MIDI_CH", 1));
+    TEST_CHECK(item_int_is(&Store, "SCREEN_ROT", SCREEN_ROTATION_0));
+    TEST_CHECK(Store.LoadReset == CONFIG_ITEM_MASK(CONFIG_ITEM_SCREEN_ROTATION));
+    TEST_CHECK(item_int_is(&Store, "EXP_HEEL", 321));
+    TEST_CHECK(item_string_is(&Store, "MDNS_NAME", "rig"));
+
+    // the wrong typed one is rewritten, the unknown one is left
+    TEST_CHECK(fake_find(&ConfigNVS, "midi_ch")->Type == CONFIG_STORAGE_U32);
+    TEST_CHECK(fake_find(&ConfigNVS, "from_future") != NULL);
+    TEST_CHECK(Store.ConfigDirty == 0);
+}
+
+int main(void)
+{
+    test_legacy_blobs();
+    test_legacy_invalid();
+    test_legacy_too_big();
+    test_legacy_write_failed();
+    test_version_1_presets();
+    test_version_2_entries();
+
+    return TEST_RESULT();
+}
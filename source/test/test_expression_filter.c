@@ -0,0 +1,415 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ 
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "test.h"
+#include "expression_filter.h"
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Plain full range config, no smoothing
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_config(tExpressionFilterConfig* config)
+{
+    config->Heel = 0.0f;
+    config->Toe = EXPRESSION_ADC_MAX;
+    config->DeadZone = 0.0f;
+    config->Smoothing = 1.0f;
+    config->Hysteresis = 20.0f;
+    config->Curve = EXPRESSION_CURVE_LINEAR;
+    config->Steps = 128;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Curves keep their end points and order
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_curves(void)
+{
+    for (uint8_t curve = 0; curve < EXPRESSION_CURVE_LAST; curve++)
+    {
+        float last = -1.0f;
+
+        TEST_CHECK(fabsf(expression_filter_curve(curve, 0.0f)) < 1e-6f);
+        TEST_CHECK(fabsf(expression_filter_curve(curve, 1.0f) - 1.0f) < 1e-6f);
+
+        // always rising
+        for (uint8_t loop = 0; loop <= 100; loop++)
+        {
+            float value = expression_filter_curve(curve, loop / 100.0f);
+
+            TEST_CHECK(value > last);
+            last = value;
+        }
+    }
+
+    TEST_CHECK(fabsf(expression_filter_curve(EXPRESSION_CURVE_LINEAR, 0.3f) - 0.3f) < 1e-6f);
+    TEST_CHECK(fabsf(expression_filter_curve(EXPRESSION_CURVE_LOG, 0.5f) - 0.25f) < 1e-6f);
+    TEST_CHECK(fabsf(expression_filter_curve(EXPRESSION_CURVE_ANTILOG, 0.5f) - 0.75f) < 1e-6f);
+
+    // S curve is flat at the ends and symmetric about the middle
+    TEST_CHECK(fabsf(expression_filter_curve(EXPRESSION_CURVE_S, 0.5f) - 0.5f) < 1e-6f);
+    TEST_CHECK(expression_filter_curve(EXPRESSION_CURVE_S, 0.1f) < 0.1f);
+    TEST_CHECK(fabsf(expression_filter_curve(EXPRESSION_CURVE_S, 0.2f) + expression_filter_curve(EXPRESSION_CURVE_S, 0.8f) - 1.0f) < 1e-6f);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Noise inside the hysteresis doesn't move the output
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_hysteresis(void)
+{
+    tExpressionFilter filter;
+    tExpressionFilterConfig config;
+    const float noise[] = {15.0f, -15.0f, 19.0f, -19.0f, 8.0f, -3.0f, 0.0f};
+    int32_t step;
+
+    test_config(&config);
+    expression_filter_reset(&filter);
+
+    // first block is taken as is, and always reported
+    TEST_CHECK(filter.Step == -1);
+    TEST_CHECK(expression_filter_run(&filter, &config, 2048.0f) == 1);
+    step = filter.Step;
+    TEST_CHECK(step == 64);
+    TEST_CHECK(fabsf(filter.Position - (64.0f / 127.0f)) < 1e-6f);
+
+    // one step is about 32 counts, so this would flick without hysteresis
+    for (uint8_t loop = 0; loop < sizeof(noise) / sizeof(noise[0]); loop++)
+    {
+        TEST_CHECK(expression_filter_run(&filter, &config, 2048.0f + noise[loop]) == 0);
+        TEST_CHECK(filter.Step == step);
+    }
+
+    // a real move is followed, less the hysteresis
+    TEST_CHECK(expression_filter_run(&filter, &config, 2148.0f) == 1);
+    TEST_CHECK(fabsf(filter.Held - 2128.0f) < 0.01f);
+
+    // and turning back has to cross the whole band first
+    TEST_CHECK(expression_filter_run(&filter, &config, 2110.0f) == 0);
+    TEST_CHECK(fabsf(filter.Held - 2128.0f) < 0.01f);
+    expression_filter_run(&filter, &config, 2000.0f);
+    TEST_CHECK(fabsf(filter.Held - 2020.0f) < 0.01f);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Smoothing eases into a jump
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_smoothing(void)
+{
+    tExpressionFilter filter;
+    tExpressionFilterConfig config;
+    int32_t last;
+    uint8_t blocks = 0;
+
+    test_config(&config);
+    config.Smoothing = 0.25f;
+    config.Hysteresis = 0.0f;
+    expression_filter_reset(&filter);
+
+    expression_filter_run(&filter, &config, 0.0f);
+    TEST_CHECK(filter.Step == 0);
+
+    expression_filter_run(&filter, &config, EXPRESSION_ADC_MAX);
+    TEST_CHECK(filter.Step == 32);
+    last = filter.Step;
+
+    // gets there, without going past or back
+    while ((filter.Step < 127) && (blocks < 100))
+    {
+        expression_filter_run(&filter, &config, EXPRESSION_ADC_MAX);
+        TEST_CHECK(filter.Step >= last);
+        last = filter.Step;
+        blocks++;
+    }
+
+    TEST_CHECK(filter.Step == 127);
+    TEST_CHECK(blocks > 5);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Heel and toe calibration, reversed pedals and dead zones
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_calibration(void)
+{
+    tExpressionFilter filter;
+    tExpressionFilterConfig config;
+
+    test_config(&config);
+    config.Heel = 3900.0f;
+    config.Toe = 300.0f;
+    config.DeadZone = 0.05f;
+    config.Hysteresis = 0.0f;
+
+    expression_filter_reset(&filter);
+    expression_filter_run(&filter, &config, 4095.0f);
+    TEST_CHECK(filter.Step == 0);
+
+    // inside the heel dead zone
+    expression_filter_run(&filter, &config, 3900.0f - 150.0f);
+    TEST_CHECK(filter.Step == 0);
+
+    expression_filter_run(&filter, &config, 2100.0f);
+    TEST_CHECK(filter.Step == 64);
+
+    // inside the toe dead zone
+    expression_filter_run(&filter, &config, 300.0f + 150.0f);
+    TEST_CHECK(filter.Step == 127);
+    TEST_CHECK(fabsf(filter.Position - 1.0f) < 1e-6f);
+
+    // uncalibrated reads as heel
+    config.Toe = config.Heel;
+    expression_filter_run(&filter, &config, 1000.0f);
+    TEST_CHECK(filter.Step == 0);
+
+    // curve is applied before quantising
+    test_config(&config);
+    config.Curve = EXPRESSION_CURVE_LOG;
+    config.Steps = 101;
+    expression_filter_reset(&filter);
+    expression_filter_run(&filter, &config, EXPRESSION_ADC_MAX / 2.0f);
+    TEST_CHECK(filter.Step == 25);
+}
+
+// generated sweep. Settings as expression.c uses them
+#define SWEEP_BLOCK_SAMPLES     128         // ADC samples averaged into one filter input
+#define SWEEP_NOISE             15.0f       // ADC counts, about 3 sigma of the per sample noise
+#define SWEEP_SPIKE             250.0f      // ADC counts, single sample glitches
+#define SWEEP_SPIKE_CHANCE      64          // 1 sample in this many
+#define SWEEP_SEEDS             20
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Seeded pseudo random number, same on every host
+* PARAMETERS:
+* RETURN:      0 - 1
+* NOTES:       Numerical Recipes LCG
+*****************************************************************************/
+static float sweep_random(uint32_t* seed)
+{
+    *seed = (*seed * 1664525UL) + 1013904223UL;
+
+    return (*seed >> 8) / 16777216.0f;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: One block as expression.c would make it
+* PARAMETERS:  position: true pedal reading, ADC counts
+* RETURN:      block average, ADC counts
+* NOTES:       Roughly gaussian noise on every sample, plus the odd spike
+*****************************************************************************/
+static float sweep_block(uint32_t* seed, float position)
+{
+    float total = 0.0f;
+
+    for (uint32_t sample = 0; sample < SWEEP_BLOCK_SAMPLES; sample++)
+    {
+        float value = position + ((sweep_random(seed) + sweep_random(seed) + sweep_random(seed) - 1.5f) * SWEEP_NOISE);
+
+        if ((uint32_t)(sweep_random(seed) * SWEEP_SPIKE_CHANCE) == 0)
+        {
+            value += (sweep_random(seed) < 0.5f) ? -SWEEP_SPIKE : SWEEP_SPIKE;
+        }
+
+        // ADC clips and is whole counts
+        value = fminf(fmaxf(value, 0.0f), EXPRESSION_ADC_MAX);
+        total += floorf(value);
+    }
+
+    return total / SWEEP_BLOCK_SAMPLES;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Noisy heel to toe and back sweeps, with holds
+* PARAMETERS:
+* RETURN:
+* NOTES:       Generated, not recorded from a pedal. Each seed is a hold at
+*              the heel, an eased sweep to the toe with a pause part way,
+*              a hold at the toe, then the same back. The output must only
+*              move with the pedal and stay put while it is held
+*****************************************************************************/
+static void test_noisy_sweep(void)
+{
+    tExpressionFilter filter;
+    tExpressionFilterConfig config;
+
+    test_config(&config);
+    config.Heel = 200.0f;
+    config.Toe = 3900.0f;
+    config.DeadZone = 0.02f;
+    config.Smoothing = 0.25f;
+    config.Hysteresis = 6.0f;
+
+    for (uint32_t loop = 0; loop < SWEEP_SEEDS; loop++)
+    {
+        uint32_t seed = 0x5EED0000UL + loop;
+        uint32_t sweep_blocks = 60 + (uint32_t)(sweep_random(&seed) * 120.0f);     // about 0.8 to 2.3 seconds
+        float pause = 0.3f + (sweep_random(&seed) * 0.4f);
+        uint32_t flicker = 0;
+        uint32_t reversals = 0;
+        int32_t last;
+        int32_t held;
+
+        expression_filter_reset(&filter);
+
+        for (uint8_t direction = 0; direction < 2; direction++)
+        {
+            float from = direction ? config.Toe : config.Heel;
+            float to = direction ? config.Heel : config.Toe;
+
+            // settle at the start, then no change at all
+            for (uint32_t block = 0; block < 40; block++)
+            {
+                expression_filter_run(&filter, &config, sweep_block(&seed, from));
+            }
+            held = filter.Step;
+            TEST_CHECK(held == (direction ? 127 : 0));
+
+            for (uint32_t block = 0; block < 80; block++)
+            {
+                expression_filter_run(&filter, &config, sweep_block(&seed, from));
+                flicker += (filter.Step != held);
+            }
+
+            // sweep, eased in and out, with a pause
+            last = filter.Step;
+            for (uint32_t block = 0; block <= sweep_blocks; block++)
+            {
+                float travel = (float)block / sweep_blocks;
+                float eased = travel * travel * (3.0f - (2.0f * travel));
+                uint32_t repeat = (fabsf(travel - pause) < (0.5f / sweep_blocks)) ? 60 : 1;
+
+                for (uint32_t hold = 0; hold < repeat; hold++)
+                {
+                    expression_filter_run(&filter, &config, sweep_block(&seed, from + ((to - from) * eased)));
+                    reversals += direction ? (filter.Step > last) : (filter.Step < last);
+                    last = filter.Step;
+                }
+            }
+
+            // held at the far end
+            for (uint32_t block = 0; block < 40; block++)
+            {
+                expression_filter_run(&filter, &config, sweep_block(&seed, to));
+                reversals += direction ? (filter.Step > last) : (filter.Step < last);
+                last = filter.Step;
+            }
+            held = filter.Step;
+            TEST_CHECK(held == (direction ? 0 : 127));
+
+            for (uint32_t block = 0; block < 80; block++)
+            {
+                expression_filter_run(&filter, &config, sweep_block(&seed, to));
+                flicker += (filter.Step != held);
+            }
+        }
+
+        if ((flicker != 0) || (reversals != 0))
+        {
+            printf("sweep seed %d: %d flicker, %d reversals\n", (int)loop, (int)flicker, (int)reversals);
+        }
+        TEST_CHECK(flicker == 0);
+        TEST_CHECK(reversals == 0);
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: A pedal held part way doesn't flicker
+* PARAMETERS:
+* RETURN:
+* NOTES:       Every place along the travel, same noise as the sweep. A
+*              burst of noise may move the output one step once, but it
+*              must never step back again
+*****************************************************************************/
+static void test_noisy_hold(void)
+{
+    tExpressionFilter filter;
+    tExpressionFilterConfig config;
+    uint32_t seed = 0x5EED1000UL;
+    uint32_t flicker = 0;
+    uint32_t changes;
+    int32_t last;
+
+    test_config(&config);
+    config.Heel = 200.0f;
+    config.Toe = 3900.0f;
+    config.DeadZone = 0.02f;
+    config.Smoothing = 0.25f;
+    config.Hysteresis = 6.0f;
+
+    for (float position = config.Heel; position <= config.Toe; position += 7.3f)
+    {
+        expression_filter_reset(&filter);
+
+        for (uint32_t block = 0; block < 20; block++)
+        {
+            expression_filter_run(&filter, &config, sweep_block(&seed, position));
+        }
+
+        last = filter.Step;
+        changes = 0;
+        for (uint32_t block = 0; block < 80; block++)
+        {
+            expression_filter_run(&filter, &config, sweep_block(&seed, position));
+            if (filter.Step != last)
+            {
+                TEST_CHECK(abs(filter.Step - last) == 1);
+                changes++;
+                last = filter.Step;
+            }
+        }
+
+        flicker += (changes > 1);
+    }
+
+    TEST_CHECK(flicker == 0);
+}
+
+int main(void)
+{
+    test_curves();
+    test_hysteresis();
+    test_smoothing();
+    test_calibration();
+    test_noisy_sweep();
+    test_noisy_hold();
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,246 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ 
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include "test.h"
+#include "footswitch_gesture.h"
+
+#define TEST_MAX_EVENTS     64
+#define TEST_SAMPLE_TIME    10000       // usec between samples
+
+static tFootswitchGestureEvent Events[TEST_MAX_EVENTS];
+static uint8_t EventCount;
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Record gesture events
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_handler(const tFootswitchGestureEvent* event, void* context)
+{
+    (void)context;
+
+    if (EventCount < TEST_MAX_EVENTS)
+    {
+        Events[EventCount++] = *event;
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Start a test with a released switch
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_start(tFootswitchGestureSwitch* sw, tFootswitchGestureConfig* config)
+{
+    footswitch_gesture_reset(sw);
+    EventCount = 0;
+
+    config->PressSamples = 3;
+    config->ReleaseSamples = 3;
+    config->LongPressTime = 500000;
+    config->RepeatInterval = 100000;
+    config->DoubleTapWindow = 0;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Feed the same raw level for a number of samples
+* PARAMETERS:
+* RETURN:      time of the next sample
+* NOTES:
+*****************************************************************************/
+static int64_t test_hold(tFootswitchGestureSwitch* sw, const tFootswitchGestureConfig* config, uint8_t raw, uint32_t samples, int64_t now)
+{
+    for (uint32_t loop = 0; loop < samples; loop++)
+    {
+        footswitch_gesture_sample(sw, config, 2, raw, now, test_handler, NULL);
+        now += TEST_SAMPLE_TIME;
+    }
+
+    return now;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Bounces delay the debounced change instead of restarting it
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_debounce(void)
+{
+    tFootswitchGestureSwitch sw;
+    tFootswitchGestureConfig config;
+    const uint8_t press[] = {1, 0, 1, 1, 0, 1, 1};
+    int64_t now = 0;
+
+    test_start(&sw, &config);
+
+    // net count reaches 3 on the last sample
+    for (uint8_t loop = 0; loop < sizeof(press); loop++)
+    {
+        footswitch_gesture_sample(&sw, &config, 2, press[loop], now, test_handler, NULL);
+        TEST_CHECK(EventCount == ((loop == (sizeof(press) - 1)) ? 1 : 0));
+        now += TEST_SAMPLE_TIME;
+    }
+
+    TEST_CHECK(Events[0].Gesture == FOOTSWITCH_GESTURE_PRESS);
+    TEST_CHECK(Events[0].Switch == 2);
+    TEST_CHECK(Events[0].Time == (6 * TEST_SAMPLE_TIME));
+
+    // a single released sample isn't a release
+    now = test_hold(&sw, &config, 0, 1, now);
+    now = test_hold(&sw, &config, 1, 2, now);
+    TEST_CHECK(EventCount == 1);
+
+    // settled switch needs no more sampling
+    TEST_CHECK(footswitch_gesture_sample(&sw, &config, 2, 1, now, test_handler, NULL) == 1);
+
+    now = test_hold(&sw, &config, 0, 3, now + TEST_SAMPLE_TIME);
+    TEST_CHECK(EventCount >= 2);
+    TEST_CHECK(Events[1].Gesture == FOOTSWITCH_GESTURE_RELEASE);
+    TEST_CHECK(footswitch_gesture_sample(&sw, &config, 2, 0, now, test_handler, NULL) == 0);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Taps, with and without a double tap window
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_taps(void)
+{
+    tFootswitchGestureSwitch sw;
+    tFootswitchGestureConfig config;
+    int64_t now = 0;
+
+    // no window, the tap comes with the release
+    test_start(&sw, &config);
+    now = test_hold(&sw, &config, 1, 10, now);
+    now = test_hold(&sw, &config, 0, 3, now);
+    TEST_CHECK(EventCount == 3);
+    TEST_CHECK(Events[1].Gesture == FOOTSWITCH_GESTURE_RELEASE);
+    TEST_CHECK(Events[2].Gesture == FOOTSWITCH_GESTURE_TAP);
+    TEST_CHECK(Events[2].Time == Events[1].Time);
+    TEST_CHECK(Events[1].Duration == (10 * TEST_SAMPLE_TIME));
+
+    // with a window, the tap waits for it to close
+    test_start(&sw, &config);
+    config.DoubleTapWindow = 200000;
+    now = test_hold(&sw, &config, 1, 10, now);
+    now = test_hold(&sw, &config, 0, 3, now);
+    TEST_CHECK(EventCount == 2);
+    now = test_hold(&sw, &config, 0, 20, now);
+    TEST_CHECK(EventCount == 3);
+    TEST_CHECK(Events[2].Gesture == FOOTSWITCH_GESTURE_TAP);
+    TEST_CHECK((Events[2].Time - Events[1].Time) == config.DoubleTapWindow);
+
+    // second press inside the window
+    test_start(&sw, &config);
+    config.DoubleTapWindow = 200000;
+    now = test_hold(&sw, &config, 1, 5, now);
+    now = test_hold(&sw, &config, 0, 5, now);
+    now = test_hold(&sw, &config, 1, 5, now);
+    now = test_hold(&sw, &config, 0, 30, now);
+    TEST_CHECK(EventCount == 5);
+    TEST_CHECK(Events[2].Gesture == FOOTSWITCH_GESTURE_PRESS);
+    TEST_CHECK(Events[3].Gesture == FOOTSWITCH_GESTURE_DOUBLE_TAP);
+    TEST_CHECK(Events[4].Gesture == FOOTSWITCH_GESTURE_RELEASE);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Long press then hold repeats
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_hold_repeat(void)
+{
+    tFootswitchGestureSwitch sw;
+    tFootswitchGestureConfig config;
+    int64_t now = 0;
+
+    test_start(&sw, &config);
+
+    // pressed on the third sample, then 800 msec more
+    now = test_hold(&sw, &config, 1, 83, now);
+    TEST_CHECK(EventCount == 5);
+    TEST_CHECK(Events[1].Gesture == FOOTSWITCH_GESTURE_LONG_PRESS);
+    TEST_CHECK(Events[1].Duration == config.LongPressTime);
+
+    for (uint8_t loop = 2; loop < 5; loop++)
+    {
+        TEST_CHECK(Events[loop].Gesture == FOOTSWITCH_GESTURE_HOLD_REPEAT);
+        TEST_CHECK(Events[loop].Count == (loop - 1));
+        TEST_CHECK(Events[loop].Duration == (config.LongPressTime + ((loop - 1) * config.RepeatInterval)));
+    }
+
+    // no tap after a long press
+    now = test_hold(&sw, &config, 0, 10, now);
+    TEST_CHECK(EventCount == 6);
+    TEST_CHECK(Events[5].Gesture == FOOTSWITCH_GESTURE_RELEASE);
+
+    // disabled, as for latching switches
+    test_start(&sw, &config);
+    config.LongPressTime = 0;
+    now = test_hold(&sw, &config, 1, 200, now);
+    TEST_CHECK(EventCount == 1);
+    TEST_CHECK(Events[0].Gesture == FOOTSWITCH_GESTURE_PRESS);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: A late sample catches up on the timers it missed
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_late_sample(void)
+{
+    tFootswitchGestureSwitch sw;
+    tFootswitchGestureConfig config;
+    int64_t now = 0;
+
+    test_start(&sw, &config);
+    config.RepeatInterval = 0;
+    now = test_hold(&sw, &config, 1, 3, now);
+    TEST_CHECK(EventCount == 1);
+
+    // long press and its disabled repeat, in one sample
+    footswitch_gesture_sample(&sw, &config, 2, 1, now + 2000000, test_handler, NULL);
+    TEST_CHECK(EventCount == 2);
+    TEST_CHECK(Events[1].Gesture == FOOTSWITCH_GESTURE_LONG_PRESS);
+    TEST_CHECK(footswitch_gesture_sample(&sw, &config, 2, 1, now + 2010000, test_handler, NULL) == 0);
+}
+
+int main(void)
+{
+    test_debounce();
+    test_taps();
+    test_hold_repeat();
+    test_late_sample();
+
+    return TEST_RESULT();
+}
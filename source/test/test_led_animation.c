@@ -0,0 +1,207 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ 
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include "test.h"
+#include "led_animation.h"
+
+static const tLedColour TestRed = {255, 0, 0};
+static const tLedColour TestDim = {0, 0, 10};
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Compare two colours
+* PARAMETERS:
+* RETURN:      1 if the same
+* NOTES:
+*****************************************************************************/
+static uint8_t test_same_colour(const tLedColour* a, const tLedColour* b)
+{
+    return (a->Red == b->Red) && (a->Green == b->Green) && (a->Blue == b->Blue);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Solid colours and animations too fast to show
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_solid(void)
+{
+    tLedAnimation animation = {0};
+    tLedFrameTable table;
+    int64_t next_change;
+
+    animation.Type = LED_ANIMATION_SOLID;
+    animation.Colour = TestRed;
+    led_animation_render(&animation, &table);
+    TEST_CHECK((table.FrameCount == 1) && (table.FrameTime == 0));
+    TEST_CHECK(test_same_colour(&table.Frames[0], &TestRed));
+    TEST_CHECK(led_animation_frame(&table, 123456789, &next_change) == 0);
+    TEST_CHECK(next_change == -1);
+
+    animation.Type = LED_ANIMATION_BLINK;
+    animation.Period = LED_ANIMATION_MAX_FRAMES - 1;
+    led_animation_render(&animation, &table);
+    TEST_CHECK(table.FrameCount == 1);
+    TEST_CHECK(test_same_colour(&table.Frames[0], &TestRed));
+
+    animation.Type = LED_ANIMATION_OFF;
+    led_animation_render(&animation, &table);
+    TEST_CHECK((table.FrameCount == 1) && (table.Frames[0].Red == 0));
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Blink frames, next change times and repeats
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_blink(void)
+{
+    tLedAnimation animation = {0};
+    tLedFrameTable table;
+    int64_t next_change;
+
+    // 10 msec frames, lit for the first 8
+    animation.Type = LED_ANIMATION_BLINK;
+    animation.Colour = TestRed;
+    animation.Background = TestDim;
+    animation.Period = 320000;
+    animation.OnTime = 80000;
+    animation.Repeats = 2;
+    led_animation_render(&animation, &table);
+
+    TEST_CHECK(table.FrameCount == LED_ANIMATION_MAX_FRAMES);
+    TEST_CHECK(table.FrameTime == 10000);
+    TEST_CHECK(test_same_colour(&table.Frames[7], &TestRed));
+    TEST_CHECK(test_same_colour(&table.Frames[8], &TestDim));
+    TEST_CHECK(test_same_colour(&table.Frames[31], &TestDim));
+
+    // only wakes when the colour changes
+    TEST_CHECK(led_animation_frame(&table, 0, &next_change) == 0);
+    TEST_CHECK(next_change == 80000);
+    TEST_CHECK(led_animation_frame(&table, 85000, &next_change) == 8);
+    TEST_CHECK(next_change == 320000);
+    TEST_CHECK(led_animation_frame(&table, 330000, &next_change) == 1);
+    TEST_CHECK(next_change == 400000);
+
+    // last cycle ends at 640 msec
+    TEST_CHECK(led_animation_frame(&table, 400000, &next_change) == 8);
+    TEST_CHECK(next_change == 640000);
+    TEST_CHECK(led_animation_frame(&table, 640000, &next_change) == -1);
+    TEST_CHECK(next_change == -1);
+
+    // forever
+    table.Repeats = 0;
+    TEST_CHECK(led_animation_frame(&table, (320000 * 100) + 5000, &next_change) == 0);
+    TEST_CHECK(next_change == ((320000 * 100) + 80000));
+    TEST_CHECK(led_animation_frame(&table, -50, &next_change) == 0);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Tempo flashes are at most half the beat
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_tempo(void)
+{
+    tLedAnimation animation = {0};
+    tLedFrameTable table;
+
+    animation.Type = LED_ANIMATION_TEMPO;
+    animation.Colour = TestRed;
+    animation.Period = 500000;
+    animation.OnTime = 400000;
+    led_animation_render(&animation, &table);
+
+    TEST_CHECK(table.FrameCount == LED_ANIMATION_MAX_FRAMES);
+    TEST_CHECK(test_same_colour(&table.Frames[15], &TestRed));
+    TEST_CHECK(table.Frames[16].Red == 0);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Pulse fades up and back down
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_pulse(void)
+{
+    tLedAnimation animation = {0};
+    tLedFrameTable table;
+
+    animation.Type = LED_ANIMATION_PULSE;
+    animation.Colour = TestRed;
+    animation.Period = 1000000;
+    led_animation_render(&animation, &table);
+
+    TEST_CHECK(table.Frames[0].Red == 0);
+    TEST_CHECK(table.Frames[LED_ANIMATION_MAX_FRAMES / 2].Red == 255);
+
+    for (uint8_t loop = 1; loop < (LED_ANIMATION_MAX_FRAMES / 2); loop++)
+    {
+        TEST_CHECK(table.Frames[loop].Red >= table.Frames[loop - 1].Red);
+        TEST_CHECK(table.Frames[loop].Red == table.Frames[LED_ANIMATION_MAX_FRAMES - loop].Red);
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Preset colours
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_preset(void)
+{
+    tLedColour colour;
+    tLedColour other;
+
+    led_animation_preset_colour(0, 255, &colour);
+    TEST_CHECK(test_same_colour(&colour, &TestRed));
+
+    led_animation_preset_colour(0, 0, &colour);
+    TEST_CHECK((colour.Red == 0) && (colour.Green == 0) && (colour.Blue == 0));
+
+    // neighbours differ, and the same preset is always the same
+    for (uint16_t preset = 0; preset < 20; preset++)
+    {
+        led_animation_preset_colour(preset, 255, &colour);
+        led_animation_preset_colour(preset + 1, 255, &other);
+        TEST_CHECK(!test_same_colour(&colour, &other));
+        led_animation_preset_colour(preset, 255, &other);
+        TEST_CHECK(test_same_colour(&colour, &other));
+    }
+}
+
+int main(void)
+{
+    test_solid();
+    test_blink();
+    test_tempo();
+    test_pulse();
+    test_preset();
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,138 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ 
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "test.h"
+#include "midi_clock_fit.h"
+
+static uint32_t random_state = 12345;
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Repeatable pseudo random jitter
+* PARAMETERS:  range: usec either side of 0
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static int32_t test_jitter(int32_t range)
+{
+    random_state = (random_state * 1103515245) + 12345;
+
+    return (int32_t)((random_state >> 8) % (uint32_t)((range * 2) + 1)) - range;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Send ticks at a tempo
+* PARAMETERS:  start: time of the first tick, usec
+*              jitter: usec either side of the ideal time
+* RETURN:      time of the next tick
+* NOTES:
+*****************************************************************************/
+static int64_t test_send_ticks(tMidiClockFit* fit, int64_t start, float bpm, uint16_t ticks, int32_t jitter)
+{
+    float period = 60000000.0f / (bpm * MIDI_CLOCK_FIT_TICKS_PER_BEAT);
+
+    for (uint16_t loop = 0; loop < ticks; loop++)
+    {
+        midi_clock_fit_tick(fit, start + (int64_t)(loop * period) + test_jitter(jitter));
+    }
+
+    return start + (int64_t)(ticks * period);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Steady clocks, with and without jitter
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_steady(void)
+{
+    tMidiClockFit fit;
+
+    memset((void*)&fit, 0, sizeof(fit));
+
+    // not enough ticks yet
+    test_send_ticks(&fit, 1000000, 120.0f, 11, 0);
+    TEST_CHECK(midi_clock_fit_get_bpm(&fit) == 0.0f);
+
+    memset((void*)&fit, 0, sizeof(fit));
+    test_send_ticks(&fit, 1000000, 120.0f, 48, 0);
+    TEST_CHECK(fabsf(midi_clock_fit_get_bpm(&fit) - 120.0f) < 0.05f);
+
+    // +-2 msec on each 20.8 msec tick is nearly +-10% on one interval,
+    // the fit over the window should still be close
+    memset((void*)&fit, 0, sizeof(fit));
+    test_send_ticks(&fit, 1000000, 120.0f, 200, 2000);
+    TEST_CHECK(fabsf(midi_clock_fit_get_bpm(&fit) - 120.0f) < 0.5f);
+
+    memset((void*)&fit, 0, sizeof(fit));
+    test_send_ticks(&fit, 1000000, 174.0f, 200, 1500);
+    TEST_CHECK(fabsf(midi_clock_fit_get_bpm(&fit) - 174.0f) < 1.0f);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Tempo changes, stops and late ticks
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_changes(void)
+{
+    tMidiClockFit fit;
+    int64_t time;
+
+    memset((void*)&fit, 0, sizeof(fit));
+
+    // the window moves on to a new tempo
+    time = test_send_ticks(&fit, 1000000, 120.0f, 100, 1000);
+    test_send_ticks(&fit, time, 90.0f, MIDI_CLOCK_FIT_WINDOW, 1000);
+    TEST_CHECK(fabsf(midi_clock_fit_get_bpm(&fit) - 90.0f) < 0.5f);
+
+    // a stop starts the fit over
+    time = test_send_ticks(&fit, 1000000, 120.0f, 100, 0);
+    midi_clock_fit_tick(&fit, time + 1000000);
+    TEST_CHECK(fit.TickCount == 1);
+
+    // so does a tick more than 3 periods late, and the old tempo stays
+    // until there are enough new ticks
+    time = test_send_ticks(&fit, 3000000, 120.0f, 100, 0);
+    midi_clock_fit_tick(&fit, time + 80000);
+    TEST_CHECK(fit.TickCount == 1);
+    TEST_CHECK(midi_clock_fit_get_bpm(&fit) == 0.0f);
+
+    // and time going backwards
+    time = test_send_ticks(&fit, 5000000, 120.0f, 100, 0);
+    midi_clock_fit_tick(&fit, time - 1000000);
+    TEST_CHECK(fit.TickCount == 1);
+
+    midi_clock_fit_reset(&fit);
+    TEST_CHECK((fit.TickCount == 0) && (midi_clock_fit_get_bpm(&fit) == 0.0f));
+}
+
+int main(void)
+{
+    test_steady();
+    test_changes();
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,281 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ 
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include "test.h"
+#include "midi_parser.h"
+
+#define MAX_RECEIVED        16
+
+typedef struct
+{
+    tMidiMessage Messages[MAX_RECEIVED];
+    uint8_t Count;
+} tReceived;
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Decoder callback, keeps each message
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_collect(const tMidiMessage* message, void* context)
+{
+    tReceived* received = (tReceived*)context;
+
+    if (received->Count < MAX_RECEIVED)
+    {
+        received->Messages[received->Count++] = *message;
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Check a received message
+* PARAMETERS:
+* RETURN:      1 if it matches
+* NOTES:
+*****************************************************************************/
+static uint8_t test_message_is(const tMidiMessage* message, uint8_t status, uint8_t length, uint8_t data_0, uint8_t data_1)
+{
+    if ((message->status != status) || (message->length != length))
+    {
+        return 0;
+    }
+
+    if ((length > 0) && (message->data[0] != data_0))
+    {
+        return 0;
+    }
+
+    if ((length > 1) && (message->data[1] != data_1))
+    {
+        return 0;
+    }
+
+    return 1;
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Decode a packet
+* PARAMETERS:
+* RETURN:      messages decoded
+* NOTES:
+*****************************************************************************/
+static uint16_t test_decode(const uint8_t* data, uint16_t length, tReceived* received)
+{
+    memset((void*)received, 0, sizeof(tReceived));
+
+    return midi_parser_decode_ble_packet(data, length, test_collect, (void*)received);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: BLE Midi packets
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_ble_packets(void)
+{
+    tReceived received;
+
+    // one note on
+    const uint8_t single[] = {0x80, 0x80, 0x90, 0x40, 0x7F};
+    TEST_CHECK(test_decode(single, sizeof(single), &received) == 1);
+    TEST_CHECK(test_message_is(&received.Messages[0], 0x90, 2, 0x40, 0x7F));
+
+    // running status, with and without its own timestamp
+    const uint8_t running[] = {0x80, 0x81, 0xB0, 0x07, 0x10, 0x0B, 0x20, 0x82, 0x01, 0x30};
+    TEST_CHECK(test_decode(running, sizeof(running), &received) == 3);
+    TEST_CHECK(test_message_is(&received.Messages[0], 0xB0, 2, 0x07, 0x10));
+    TEST_CHECK(test_message_is(&received.Messages[1], 0xB0, 2, 0x0B, 0x20));
+    TEST_CHECK(test_message_is(&received.Messages[2], 0xB0, 2, 0x01, 0x30));
+    TEST_CHECK(received.Messages[2].timestamp == 2);
+
+    // a clock between the data bytes of a note on
+    const uint8_t split[] = {0x80, 0x80, 0x90, 0x40, 0x85, 0xF8, 0x7F};
+    TEST_CHECK(test_decode(split, sizeof(split), &received) == 2);
+    TEST_CHECK(test_message_is(&received.Messages[0], 0xF8, 0, 0, 0));
+    TEST_CHECK(received.Messages[0].timestamp == 5);
+    TEST_CHECK(test_message_is(&received.Messages[1], 0x90, 2, 0x40, 0x7F));
+    TEST_CHECK(received.Messages[1].timestamp == 0);
+
+    // program change then song select, running status doesn't survive system common
+    const uint8_t common[] = {0x80, 0x80, 0xC0, 0x05, 0x80, 0xF3, 0x02, 0x03};
+    TEST_CHECK(test_decode(common, sizeof(common), &received) == 2);
+    TEST_CHECK(test_message_is(&received.Messages[0], 0xC0, 1, 0x05, 0));
+    TEST_CHECK(test_message_is(&received.Messages[1], 0xF3, 1, 0x02, 0));
+
+    // sysex is skipped, the message after it isn't
+    const uint8_t sysex[] = {0x80, 0x80, 0xF0, 0x00, 0x21, 0x7E, 0x81, 0xF7, 0x82, 0xC0, 0x09};
+    TEST_CHECK(test_decode(sysex, sizeof(sysex), &received) == 1);
+    TEST_CHECK(test_message_is(&received.Messages[0], 0xC0, 1, 0x09, 0));
+
+    // packet continuing a sysex from the last one
+    const uint8_t continued[] = {0x80, 0x01, 0x02, 0x03, 0x81, 0xF7, 0x82, 0xB0, 0x07, 0x64};
+    TEST_CHECK(test_decode(continued, sizeof(continued), &received) == 1);
+    TEST_CHECK(test_message_is(&received.Messages[0], 0xB0, 2, 0x07, 0x64));
+
+    // low timestamp going backwards rolls the high bits over
+    const uint8_t wrap[] = {0x81, 0xFF, 0x90, 0x01, 0x02, 0x80, 0x90, 0x03, 0x04};
+    TEST_CHECK(test_decode(wrap, sizeof(wrap), &received) == 2);
+    TEST_CHECK(received.Messages[0].timestamp == ((1 << 7) | 127));
+    TEST_CHECK(received.Messages[1].timestamp == (2 << 7));
+
+    // not BLE Midi, eg. a notification enable
+    const uint8_t cccd[] = {0x01, 0x00};
+    TEST_CHECK(test_decode(cccd, sizeof(cccd), &received) == 0);
+    TEST_CHECK(test_decode(single, 1, &received) == 0);
+}
+
+// Packet sequences shaped like the controllers' traffic. These are not
+// captures, none are available, so they are built from the BLE Midi spec
+// and the messages each device is set up to send
+typedef struct
+{
+    const char* Name;
+    uint8_t Packet[20];
+    uint8_t Length;
+    uint8_t Count;
+    tMidiMessage Expected[4];
+} tBleFixture;
+
+static const tBleFixture BleFixtures[] =
+{
+    // M-Vave Chocolate bank change: CC then PC, each with a full status and timestamp
+    {"choc_bank", {0x8A, 0xC5, 0xB0, 0x0E, 0x01, 0xC6, 0xC0, 0x04}, 8, 2,
+        {{0x545, 0xB0, {0x0E, 0x01}, 2}, {0x546, 0xC0, {0x04, 0}, 1}}},
+
+    // M-Vave Chocolate switch press, a lone PC
+    {"choc_preset", {0x8A, 0xD0, 0xC0, 0x02}, 4, 1,
+        {{0x550, 0xC0, {0x02, 0}, 1}}},
+
+    // Xvive MD1 bridging a serial stream: one timestamp, then running status with none
+    {"md1_running", {0x93, 0xF0, 0xB0, 0x07, 0x64, 0x0B, 0x40, 0x01, 0x10}, 9, 3,
+        {{0x9F0, 0xB0, {0x07, 0x64}, 2}, {0x9F0, 0xB0, {0x0B, 0x40}, 2}, {0x9F0, 0xB0, {0x01, 0x10}, 2}}},
+
+    // Xvive MD1 bridging a clock that lands inside a CC
+    {"md1_clock", {0x93, 0xF0, 0xB0, 0x07, 0xF1, 0xF8, 0x65, 0xF2, 0xF8}, 9, 3,
+        {{0x9F1, 0xF8, {0, 0}, 0}, {0x9F0, 0xB0, {0x07, 0x65}, 2}, {0x9F2, 0xF8, {0, 0}, 0}}},
+
+    // timestamp low bits wrapping inside a packet, high bits at their top
+    {"wrap_in_packet", {0xBF, 0xFE, 0xC0, 0x01, 0x81, 0xC0, 0x02}, 7, 2,
+        {{0x1FFE, 0xC0, {0x01, 0}, 1}, {0x0001, 0xC0, {0x02, 0}, 1}}},
+
+    // next packet after the 13 bit wrap
+    {"wrap_next_packet", {0x80, 0x82, 0xB0, 0x07, 0x00}, 5, 1,
+        {{0x0002, 0xB0, {0x07, 0x00}, 2}}},
+};
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Device shaped BLE Midi packets
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_ble_fixtures(void)
+{
+    tReceived received;
+    const tBleFixture* fixture;
+    const tMidiMessage* expected;
+    uint8_t ok;
+
+    for (uint8_t loop = 0; loop < (sizeof(BleFixtures) / sizeof(BleFixtures[0])); loop++)
+    {
+        fixture = &BleFixtures[loop];
+        ok = (test_decode(fixture->Packet, fixture->Length, &received) == fixture->Count);
+
+        for (uint8_t message = 0; ok && (message < fixture->Count); message++)
+        {
+            expected = &fixture->Expected[message];
+            ok = test_message_is(&received.Messages[message], expected->status, expected->length, expected->data[0], expected->data[1]) &&
+                 (received.Messages[message].timestamp == expected->timestamp);
+        }
+
+        if (!ok)
+        {
+            printf("fixture %s\n", fixture->Name);
+        }
+        TEST_CHECK(ok);
+    }
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Serial Midi byte stream
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_serial_stream(void)
+{
+    const uint8_t stream[] = {0x90, 0x40, 0xF8, 0x7F, 0x41, 0x00, 0xF0, 0x01, 0xF7, 0xC2, 0x03};
+    tMidiSerialParser parser;
+    tMidiMessage message;
+    tReceived received;
+
+    memset((void*)&parser, 0, sizeof(parser));
+    memset((void*)&received, 0, sizeof(received));
+
+    for (uint8_t loop = 0; loop < sizeof(stream); loop++)
+    {
+        if (midi_parser_parse_serial_byte(&parser, stream[loop], &message))
+        {
+            test_collect(&message, (void*)&received);
+        }
+    }
+
+    TEST_CHECK(received.Count == 4);
+    TEST_CHECK(test_message_is(&received.Messages[0], 0xF8, 0, 0, 0));
+    TEST_CHECK(test_message_is(&received.Messages[1], 0x90, 2, 0x40, 0x7F));
+    TEST_CHECK(test_message_is(&received.Messages[2], 0x90, 2, 0x41, 0x00));
+    TEST_CHECK(test_message_is(&received.Messages[3], 0xC2, 1, 0x03, 0));
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Data bytes for each status
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_data_length(void)
+{
+    TEST_CHECK(midi_parser_get_data_length(0x90) == 2);
+    TEST_CHECK(midi_parser_get_data_length(0xC5) == 1);
+    TEST_CHECK(midi_parser_get_data_length(0xD0) == 1);
+    TEST_CHECK(midi_parser_get_data_length(0xF1) == 1);
+    TEST_CHECK(midi_parser_get_data_length(0xF2) == 2);
+    TEST_CHECK(midi_parser_get_data_length(0xF3) == 1);
+    TEST_CHECK(midi_parser_get_data_length(0xF6) == 0);
+    TEST_CHECK(midi_parser_get_data_length(0xF8) == 0);
+}
+
+int main(void)
+{
+    test_ble_packets();
+    test_ble_fixtures();
+    test_serial_stream();
+    test_data_length();
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,150 @@
+/*
+ Copyright (C) 2025  Greg Smith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ 
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include "test.h"
+#include "preset_record.h"
+
+#define TEST_TEXT_SIZE      128
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Encode then decode gives back the same preset
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_round_trip(void)
+{
+    uint8_t record[PRESET_RECORD_SIZE(TEST_TEXT_SIZE)];
+    char description[TEST_TEXT_SIZE] = "Clean with a little drive";
+    uint16_t skin_index = 0x1234;
+    size_t length;
+
+    length = preset_record_encode(skin_index, description, TEST_TEXT_SIZE, record);
+    TEST_CHECK(length == (4 + 2 + strlen(description)));
+    TEST_CHECK((record[0] == PRESET_TAG_SKIN) && (record[1] == 2));
+    TEST_CHECK((record[2] == 0x34) && (record[3] == 0x12));
+
+    skin_index = 0;
+    memset(description, 'x', sizeof(description));
+    TEST_CHECK(preset_record_decode(record, length, &skin_index, description, TEST_TEXT_SIZE) == 1);
+    TEST_CHECK(skin_index == 0x1234);
+    TEST_CHECK(strcmp(description, "Clean with a little drive") == 0);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Longest and empty descriptions
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_text_limits(void)
+{
+    uint8_t record[PRESET_RECORD_SIZE(TEST_TEXT_SIZE)];
+    char description[TEST_TEXT_SIZE];
+    char decoded[TEST_TEXT_SIZE];
+    uint16_t skin_index = 0;
+    size_t length;
+
+    // unterminated buffer, encode stops one short of the size
+    memset(description, 'a', sizeof(description));
+    length = preset_record_encode(7, description, TEST_TEXT_SIZE, record);
+    TEST_CHECK(length == (4 + 2 + TEST_TEXT_SIZE - 1));
+    TEST_CHECK(preset_record_decode(record, length, &skin_index, decoded, TEST_TEXT_SIZE) == 1);
+    TEST_CHECK(strlen(decoded) == (TEST_TEXT_SIZE - 1));
+    TEST_CHECK(skin_index == 7);
+
+    description[0] = 0;
+    length = preset_record_encode(8, description, TEST_TEXT_SIZE, record);
+    TEST_CHECK(preset_record_decode(record, length, &skin_index, decoded, TEST_TEXT_SIZE) == 1);
+    TEST_CHECK((decoded[0] == 0) && (skin_index == 8));
+
+    // too long for a smaller buffer, kept as it was
+    memset(description, 'b', 20);
+    description[20] = 0;
+    length = preset_record_encode(9, description, TEST_TEXT_SIZE, record);
+    strcpy(decoded, "old");
+    TEST_CHECK(preset_record_decode(record, length, &skin_index, decoded, 10) == 1);
+    TEST_CHECK((strcmp(decoded, "old") == 0) && (skin_index == 9));
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Tags from newer firmware are skipped
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_unknown_tag(void)
+{
+    const uint8_t record[] = { 0x7F, 3, 1, 2, 3, PRESET_TAG_SKIN, 2, 5, 0, 0x7E, 0, PRESET_TAG_DESCRIPTION, 2, 'h', 'i' };
+    char decoded[TEST_TEXT_SIZE] = "";
+    uint16_t skin_index = 0;
+
+    TEST_CHECK(preset_record_decode(record, sizeof(record), &skin_index, decoded, TEST_TEXT_SIZE) == 1);
+    TEST_CHECK(skin_index == 5);
+    TEST_CHECK(strcmp(decoded, "hi") == 0);
+}
+
+/****************************************************************************
+* NAME:
+* DESCRIPTION: Short and malformed records
+* PARAMETERS:
+* RETURN:
+* NOTES:
+*****************************************************************************/
+static void test_truncated(void)
+{
+    uint8_t record[PRESET_RECORD_SIZE(TEST_TEXT_SIZE)];
+    char decoded[TEST_TEXT_SIZE] = "old";
+    uint16_t skin_index = 3;
+    size_t length;
+
+    length = preset_record_encode(11, "description", TEST_TEXT_SIZE, record);
+
+    // description cut short, the skin before it still loads
+    TEST_CHECK(preset_record_decode(record, length - 1, &skin_index, decoded, TEST_TEXT_SIZE) == 0);
+    TEST_CHECK(skin_index == 11);
+    TEST_CHECK(strcmp(decoded, "old") == 0);
+
+    // a lone tag byte is ignored
+    skin_index = 3;
+    TEST_CHECK(preset_record_decode(record, 1, &skin_index, decoded, TEST_TEXT_SIZE) == 1);
+    TEST_CHECK(skin_index == 3);
+
+    // wrong sized skin field is skipped
+    record[1] = 1;
+    record[3] = PRESET_TAG_DESCRIPTION;
+    record[4] = 0;
+    TEST_CHECK(preset_record_decode(record, 5, &skin_index, decoded, TEST_TEXT_SIZE) == 1);
+    TEST_CHECK((skin_index == 3) && (decoded[0] == 0));
+
+    TEST_CHECK(preset_record_decode(record, 0, &skin_index, decoded, TEST_TEXT_SIZE) == 1);
+}
+
+int main(void)
+{
+    test_round_trip();
+    test_text_limits();
+    test_unknown_tag();
+    test_truncated();
+
+    return TEST_RESULT();
+}